@@ -0,0 +1,209 @@
+#include "TreeGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Small, fast and identical everywhere
+class SplitMix64 {
+public:
+    explicit SplitMix64(uint64_t seed) : m_state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // [0, 1)
+    double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+    uint32_t Below(uint32_t bound) { return (uint32_t)(((Next() >> 32) * bound) >> 32); }
+    // Box-Muller; one of the pair is thrown away to keep the stream simple
+    double NextGaussian() {
+        double u1 = NextDouble();
+        double u2 = NextDouble();
+        if (u1 < 1e-300) u1 = 1e-300;
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+const char* const kExtensions[] = {".txt", ".jpg", ".png", ".log", ".cpp", ".h", ".json", ".gz",
+                                   ".pdf", ".md", ".py", ".js", "", ".dat", ".html", ".o"};
+const char kNameChars[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+
+uint32_t DrawLength(const TreeSpec& spec, SplitMix64& rng) {
+    double length = 0.0;
+    switch (spec.name_distribution) {
+    case TreeSpec::LengthDistribution::Uniform:
+        return spec.name_min + rng.Below(spec.name_max - spec.name_min + 1);
+    case TreeSpec::LengthDistribution::Normal:
+        length = spec.name_mean + spec.name_stddev * rng.NextGaussian();
+        break;
+    case TreeSpec::LengthDistribution::LogNormal: {
+        // Parameters of the underlying normal that give the requested mean and stddev
+        double variance = spec.name_stddev * spec.name_stddev;
+        double sigma2 = std::log(1.0 + variance / (spec.name_mean * spec.name_mean));
+        double mu = std::log(spec.name_mean) - sigma2 / 2.0;
+        length = std::exp(mu + std::sqrt(sigma2) * rng.NextGaussian());
+        break;
+    }
+    }
+    long rounded = std::lround(length);
+    return (uint32_t)std::clamp<long>(rounded, (long)spec.name_min, (long)spec.name_max);
+}
+
+std::string DrawName(const TreeSpec& spec, SplitMix64& rng, bool with_extension) {
+    std::string name;
+    uint32_t length = DrawLength(spec, rng);
+    for (uint32_t i = 0; i < length; i++) name += kNameChars[rng.Below(sizeof(kNameChars) - 1)];
+    if (with_extension) name += kExtensions[rng.Below(sizeof(kExtensions) / sizeof(kExtensions[0]))];
+    return name;
+}
+
+bool MakeFile(const fs::path& path, const std::string& content) {
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = content.empty() || write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    close(fd);
+    return ok;
+#else
+    std::ofstream out(path, std::ios::binary);
+    if (!content.empty()) out.write(content.data(), (std::streamsize)content.size());
+    return (bool)out;
+#endif
+}
+
+struct PlannedDir {
+    fs::path path;
+    uint32_t files;
+    uint64_t seed; // per-directory stream, so parallel filling doesn't change the names
+    std::vector<std::string> subdirs;
+};
+
+} // namespace
+
+std::string TreeGenerator::MakeTempRoot(uint64_t seed) {
+    std::error_code ec;
+    fs::path root = fs::temp_directory_path(ec) /
+                    ("fnm_bench_" + std::to_string(seed) + "_" + std::to_string((long long)getpid()));
+    return root.string();
+}
+
+bool TreeGenerator::Generate(const TreeSpec& spec, const std::string& root, TreeStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    stats = TreeStats();
+    SplitMix64 rng(spec.seed);
+
+    // Lay out the directories breadth-first, naming them on the way
+    std::vector<PlannedDir> dirs;
+    dirs.push_back({fs::path(root), 0, rng.Next(), {}});
+    size_t level_begin = 0;
+    for (uint32_t level = 0; level < spec.depth; level++) {
+        size_t level_end = dirs.size();
+        for (size_t parent = level_begin; parent < level_end; parent++) {
+            std::unordered_set<std::string> used;
+            for (uint32_t i = 0; i < spec.fanout; i++) {
+                std::string name = DrawName(spec, rng, false);
+                while (!used.insert(name).second) name += kNameChars[rng.Below(sizeof(kNameChars) - 1)];
+                stats.name_bytes += name.size();
+                dirs[parent].subdirs.push_back(name);
+                dirs.push_back({dirs[parent].path / name, 0, rng.Next(), {}});
+            }
+        }
+        level_begin = level_end;
+    }
+    for (size_t i = 0; i < dirs.size(); i++) {
+        dirs[i].files = spec.files / (uint32_t)dirs.size() + (i < spec.files % dirs.size() ? 1 : 0);
+    }
+    stats.dirs = dirs.size() - 1;
+
+    std::error_code ec;
+    for (const PlannedDir& dir : dirs) {
+        fs::create_directories(dir.path, ec);
+        if (ec) return false;
+    }
+
+    // Files go in parallel, one directory at a time per worker
+    std::string content(spec.file_bytes, 'x');
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> files{0}, name_bytes{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]() {
+        while (true) {
+            size_t index = next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= dirs.size() || failed.load(std::memory_order_relaxed)) break;
+            const PlannedDir& dir = dirs[index];
+            SplitMix64 dir_rng(dir.seed);
+            // Extensionless files mustn't land on a subdirectory's name either
+            std::unordered_set<std::string> used(dir.subdirs.begin(), dir.subdirs.end());
+            uint64_t bytes = 0;
+            for (uint32_t i = 0; i < dir.files; i++) {
+                std::string name = DrawName(spec, dir_rng, true);
+                // Collisions get a character spliced in before the extension
+                while (!used.insert(name).second) {
+                    size_t dot = name.rfind('.');
+                    name.insert(dot == std::string::npos || dot == 0 ? name.size() : dot, 1,
+                                kNameChars[dir_rng.Below(sizeof(kNameChars) - 1)]);
+                }
+                if (!MakeFile(dir.path / name, content)) {
+                    failed = true;
+                    return;
+                }
+                bytes += name.size();
+            }
+            files.fetch_add(dir.files, std::memory_order_relaxed);
+            name_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    };
+    unsigned thread_count = (std::min)((std::max)(4u, std::thread::hardware_concurrency()), 16u);
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < thread_count; i++) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+
+    stats.files = files;
+    stats.name_bytes += name_bytes;
+    stats.bytes = stats.files * spec.file_bytes;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return !failed;
+}
+
+const char* TreeGenerator::DistributionName(TreeSpec::LengthDistribution distribution) {
+    switch (distribution) {
+    case TreeSpec::LengthDistribution::Uniform: return "uniform";
+    case TreeSpec::LengthDistribution::Normal: return "normal";
+    case TreeSpec::LengthDistribution::LogNormal: return "lognormal";
+    }
+    return "";
+}
+
+bool TreeGenerator::ParseDistribution(const std::string& name, TreeSpec::LengthDistribution& distribution) {
+    if (name == "uniform") distribution = TreeSpec::LengthDistribution::Uniform;
+    else if (name == "normal") distribution = TreeSpec::LengthDistribution::Normal;
+    else if (name == "lognormal") distribution = TreeSpec::LengthDistribution::LogNormal;
+    else return false;
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Shape of a synthetic directory tree. The same spec always produces the same tree, on
+// any platform: randomness comes from a seeded SplitMix64 stream and the distributions
+// are implemented here rather than taken from <random>, whose output varies by library.
+struct TreeSpec {
+    enum class LengthDistribution { Uniform, Normal, LogNormal };
+
+    uint64_t seed = 1;
+    uint32_t files = 100000;   // spread evenly over all directories, root included
+    uint32_t fanout = 8;       // subdirectories per directory
+    uint32_t depth = 3;        // directory levels below the root
+    uint32_t file_bytes = 0;   // written into every file
+
+    // Length of the name stem, extension not included. Uniform draws from [min, max];
+    // Normal and LogNormal use mean/stddev (of the length itself) and are clamped to it.
+    LengthDistribution name_distribution = LengthDistribution::LogNormal;
+    double name_mean = 12.0;
+    double name_stddev = 6.0;
+    uint32_t name_min = 1;
+    uint32_t name_max = 64;
+};
+
+struct TreeStats {
+    uint64_t dirs = 0;  // root not counted
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t name_bytes = 0;
+    double seconds = 0.0;
+};
+
+class TreeGenerator {
+public:
+    // Fresh directory under the system temp directory, unique to this process
+    static std::string MakeTempRoot(uint64_t seed);
+
+    // Builds the tree under `root` (created if needed, expected to be empty). Directories
+    // are filled in parallel. Returns false if anything could not be created.
+    static bool Generate(const TreeSpec& spec, const std::string& root, TreeStats& stats);
+
+    static const char* DistributionName(TreeSpec::LengthDistribution distribution);
+    static bool ParseDistribution(const std::string& name, TreeSpec::LengthDistribution& distribution);
+};
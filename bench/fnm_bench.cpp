@@ -0,0 +1,466 @@
+// fnm_bench: times the core operations on a generated tree and writes the results as JSON,
+// so runs on the same machine can be compared across versions.
+//
+// Every operation is repeated --runs times and reported with throughput (entries or
+// renames/deletes per second), latency percentiles over the runs, and the peak resident
+// memory while it ran. The tree is regenerated from the same seed before each delete run.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileScanner.h"
+#include "TreeGenerator.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int kFormatVersion = 1;
+
+const char* kUsage =
+    "usage: fnm_bench [options]\n"
+    "\n"
+    "tree:\n"
+    "  --files N          files in the tree (default 100000)\n"
+    "  --fanout N         subfolders per folder (default 8)\n"
+    "  --depth N          folder levels below the root (default 3)\n"
+    "  --file-bytes N     bytes written into every file (default 0)\n"
+    "  --name-dist D      uniform, normal or lognormal name lengths (default lognormal)\n"
+    "  --name-mean X      mean name length (default 12)\n"
+    "  --name-stddev X    standard deviation of the name length (default 6)\n"
+    "  --name-min N       shortest name (default 1)\n"
+    "  --name-max N       longest name, extension not included (default 64)\n"
+    "  --seed N           generator seed (default 1)\n"
+    "  --root DIR         generate here instead of a fresh temp folder (must be empty)\n"
+    "  --keep             leave the tree on disk afterwards\n"
+    "\n"
+    "run:\n"
+    "  --runs N           repetitions per operation (default 5)\n"
+    "  --ops LIST         comma-separated subset of scan,filter,rename,delete (default all)\n"
+    "  --output FILE      write the JSON report here instead of stdout\n";
+
+struct BenchOptions {
+    TreeSpec spec;
+    std::string root;
+    bool keep = false;
+    int runs = 5;
+    std::vector<std::string> ops = {"scan", "filter", "rename", "delete"};
+    std::string output;
+};
+
+struct OpResult {
+    std::string op{};
+    uint64_t items = 0;            // per sample
+    std::vector<double> seconds{}; // one per sample
+    uint64_t peak_rss_bytes = 0;
+    std::string note{};
+};
+
+// --- Memory ---
+
+// Linux lets a process reset its high-water mark, so every operation gets its own peak.
+// Elsewhere the peak is process-wide, which still catches growth between versions.
+void ResetPeakRss() {
+#if defined(__linux__)
+    if (FILE* file = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+#endif
+}
+
+uint64_t PeakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+    return 0;
+#elif defined(__linux__)
+    if (FILE* file = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        unsigned long long kb = 0;
+        while (std::fgets(line, sizeof(line), file)) {
+            if (std::sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+        }
+        std::fclose(file);
+        if (kb) return kb * 1024;
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)usage.ru_maxrss * 1024;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)usage.ru_maxrss; // bytes on macOS
+#endif
+}
+
+// --- Measuring ---
+
+double Time(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Nearest-rank percentile of sorted samples
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[(std::min)((std::max)(rank, (size_t)1), sorted.size()) - 1];
+}
+
+void SelectFiles(FileScanner& scanner) {
+    EntryStore& files = scanner.GetFilesModifiable();
+    for (uint32_t i = 0; i < files.Size(); i++) files.SetSelected(i, !files.IsDirectory(i));
+}
+
+bool Regenerate(const BenchOptions& options, TreeStats& stats) {
+    std::error_code ec;
+    fs::remove_all(options.root, ec);
+    return TreeGenerator::Generate(options.spec, options.root, stats);
+}
+
+OpResult BenchScan(const BenchOptions& options) {
+    OpResult result{"scan"};
+    ResetPeakRss();
+    for (int run = 0; run < options.runs; run++) {
+        FileScanner scanner;
+        scanner.SetSnapshotsEnabled(false);
+        result.seconds.push_back(Time([&] { scanner.ScanDirectory(options.root, true); }));
+        result.items = scanner.GetFiles().Size();
+    }
+    result.peak_rss_bytes = PeakRssBytes();
+    result.note = "full recursive ScanDirectory, warm cache";
+    return result;
+}
+
+OpResult BenchFilter(const BenchOptions& options) {
+    // Short patterns can't use the trigram index; longer ones mostly skip the arena
+    static const char* const patterns[] = {"a", "x7", ".txt", "ab_", "q-z9", "zzzzzz"};
+
+    OpResult result{"filter"};
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(false);
+    scanner.ScanDirectory(options.root, true);
+    result.items = scanner.GetFiles().Size();
+
+    ResetPeakRss();
+    for (int run = 0; run < options.runs; run++) {
+        for (const char* pattern : patterns) {
+            scanner.ApplyFilter("");
+            result.seconds.push_back(Time([&] { scanner.ApplyFilter(pattern); }));
+        }
+    }
+    result.peak_rss_bytes = PeakRssBytes();
+    result.note = "one sample per pattern and run, each from an unfiltered list";
+    return result;
+}
+
+OpResult BenchRename(const BenchOptions& options) {
+    OpResult result{"rename"};
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(false);
+    scanner.ScanDirectory(options.root, true);
+
+    // Every file there and back again, so the tree ends up as it started
+    RenameOptions forward;
+    forward.name_template = "{name}_r{ext}";
+    RenameOptions back;
+    back.match = "^(.*)_r(\\.[a-z]+)?$";
+    back.name_template = "{1}{2}";
+
+    ResetPeakRss();
+    for (int run = 0; run < options.runs; run++) {
+        for (const RenameOptions* rename : {&forward, &back}) {
+            SelectFiles(scanner);
+            RenameResult renamed;
+            result.seconds.push_back(Time([&] { renamed = scanner.ExecuteRename(*rename); }));
+            result.items = renamed.renamed;
+            if (renamed.failed > 0) result.note = "some renames failed";
+        }
+    }
+    result.peak_rss_bytes = PeakRssBytes();
+    if (result.note.empty()) result.note = "all files, planning included; one sample per direction and run";
+    return result;
+}
+
+OpResult BenchDelete(const BenchOptions& options) {
+    OpResult result{"delete"};
+    uint64_t peak = 0;
+    for (int run = 0; run < options.runs; run++) {
+        TreeStats stats;
+        if (run > 0 && !Regenerate(options, stats)) {
+            result.note = "could not regenerate the tree";
+            break;
+        }
+        FileScanner scanner;
+        scanner.SetSnapshotsEnabled(false);
+        scanner.ScanDirectory(options.root, true);
+        SelectFiles(scanner);
+
+        ResetPeakRss();
+        FileScanner::DeleteStatus status;
+        result.seconds.push_back(Time([&] { status = scanner.ExecuteDelete(); }));
+        result.items = status.completed - status.failed;
+        if (status.failed > 0) result.note = "some deletes failed";
+        peak = (std::max)(peak, PeakRssBytes());
+    }
+    result.peak_rss_bytes = peak;
+    if (result.note.empty()) result.note = "all files; tree regenerated before each run";
+    return result;
+}
+
+// --- Report ---
+
+void AppendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+            out += escaped;
+            continue;
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+std::string Number(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6g", value);
+    return text;
+}
+
+std::string BuildReport(const BenchOptions& options, const TreeStats& tree, const std::vector<OpResult>& results) {
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    const TreeSpec& spec = options.spec;
+    std::string out = "{\n";
+    out += "  \"format_version\": " + std::to_string(kFormatVersion) + ",\n";
+    out += "  \"timestamp\": \"" + std::string(timestamp) + "\",\n";
+#if defined(_WIN32)
+    const char* os = "windows";
+#elif defined(__APPLE__)
+    const char* os = "macos";
+#elif defined(__linux__)
+    const char* os = "linux";
+#else
+    const char* os = "other";
+#endif
+#if defined(NDEBUG)
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+    out += "  \"host\": {\"os\": \"" + std::string(os) + "\", \"hardware_threads\": " +
+           std::to_string(std::thread::hardware_concurrency()) + ", \"build\": \"" + build + "\"},\n";
+    out += "  \"tree\": {\"seed\": " + std::to_string(spec.seed) + ", \"files\": " + std::to_string(tree.files) +
+           ", \"dirs\": " + std::to_string(tree.dirs) + ", \"fanout\": " + std::to_string(spec.fanout) +
+           ", \"depth\": " + std::to_string(spec.depth) + ", \"file_bytes\": " + std::to_string(spec.file_bytes) +
+           ", \"name_distribution\": \"" + TreeGenerator::DistributionName(spec.name_distribution) +
+           "\", \"name_mean\": " + Number(spec.name_mean) + ", \"name_stddev\": " + Number(spec.name_stddev) +
+           ", \"name_min\": " + std::to_string(spec.name_min) + ", \"name_max\": " + std::to_string(spec.name_max) +
+           ", \"name_bytes\": " + std::to_string(tree.name_bytes) +
+           ", \"generate_seconds\": " + Number(tree.seconds) + "},\n";
+    out += "  \"results\": [";
+    for (size_t r = 0; r < results.size(); r++) {
+        const OpResult& result = results[r];
+        std::vector<double> sorted = result.seconds;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double s : sorted) total += s;
+        double mean = sorted.empty() ? 0.0 : total / sorted.size();
+        double median = Percentile(sorted, 50);
+
+        out += r ? ",\n    {" : "\n    {";
+        out += "\"op\": ";
+        AppendJsonString(out, result.op);
+        out += ", \"samples\": " + std::to_string(sorted.size());
+        out += ", \"items\": " + std::to_string(result.items);
+        out += ", \"throughput_per_sec\": " + Number(median > 0.0 ? result.items / median : 0.0);
+        out += ", \"latency_ms\": {\"min\": " + Number(sorted.empty() ? 0.0 : sorted.front() * 1e3) +
+               ", \"p50\": " + Number(median * 1e3) + ", \"p90\": " + Number(Percentile(sorted, 90) * 1e3) +
+               ", \"p99\": " + Number(Percentile(sorted, 99) * 1e3) +
+               ", \"max\": " + Number(sorted.empty() ? 0.0 : sorted.back() * 1e3) + ", \"mean\": " + Number(mean * 1e3) + "}";
+        out += ", \"peak_rss_bytes\": " + std::to_string(result.peak_rss_bytes);
+        out += ", \"note\": ";
+        AppendJsonString(out, result.note);
+        out += "}";
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+void PrintSummary(const std::vector<OpResult>& results) {
+    std::fprintf(stderr, "%-8s %10s %14s %10s %10s %10s %10s\n", "op", "items", "items/s", "p50 ms", "p90 ms", "max ms", "peak MB");
+    for (const OpResult& result : results) {
+        std::vector<double> sorted = result.seconds;
+        std::sort(sorted.begin(), sorted.end());
+        double median = Percentile(sorted, 50);
+        std::fprintf(stderr, "%-8s %10llu %14.0f %10.2f %10.2f %10.2f %10.1f\n", result.op.c_str(),
+                     (unsigned long long)result.items, median > 0.0 ? result.items / median : 0.0, median * 1e3,
+                     Percentile(sorted, 90) * 1e3, sorted.empty() ? 0.0 : sorted.back() * 1e3,
+                     result.peak_rss_bytes / (1024.0 * 1024.0));
+    }
+}
+
+bool ParseArguments(int argc, char** argv, BenchOptions& options, std::string& error) {
+    TreeSpec& spec = options.spec;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--keep") {
+            options.keep = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "unknown option or missing value: " + arg;
+            return false;
+        }
+        std::string value = argv[++i];
+        char* end = nullptr;
+        unsigned long long number = std::strtoull(value.c_str(), &end, 10);
+        bool numeric = !value.empty() && *end == '\0';
+        double real = std::strtod(value.c_str(), &end);
+        bool is_real = !value.empty() && *end == '\0';
+
+        if (arg == "--root") options.root = value;
+        else if (arg == "--output") options.output = value;
+        else if (arg == "--name-dist") {
+            if (!TreeGenerator::ParseDistribution(value, spec.name_distribution)) {
+                error = "--name-dist takes uniform, normal or lognormal";
+                return false;
+            }
+        } else if (arg == "--ops") {
+            options.ops.clear();
+            for (size_t begin = 0; begin <= value.size();) {
+                size_t comma = value.find(',', begin);
+                if (comma == std::string::npos) comma = value.size();
+                std::string op = value.substr(begin, comma - begin);
+                if (op != "scan" && op != "filter" && op != "rename" && op != "delete") {
+                    error = "unknown operation " + op;
+                    return false;
+                }
+                options.ops.push_back(op);
+                begin = comma + 1;
+            }
+        } else if (arg == "--name-mean" || arg == "--name-stddev") {
+            if (!is_real || real <= 0.0) {
+                error = arg + " takes a positive number";
+                return false;
+            }
+            (arg == "--name-mean" ? spec.name_mean : spec.name_stddev) = real;
+        } else if (!numeric) {
+            error = arg == "--files" || arg == "--fanout" || arg == "--depth" || arg == "--file-bytes" || arg == "--seed" ||
+                    arg == "--runs" || arg == "--name-min" || arg == "--name-max"
+                        ? arg + " takes a whole number"
+                        : "unknown option " + arg;
+            return false;
+        } else if (arg == "--files") spec.files = (uint32_t)number;
+        else if (arg == "--fanout") spec.fanout = (uint32_t)number;
+        else if (arg == "--depth") spec.depth = (uint32_t)number;
+        else if (arg == "--file-bytes") spec.file_bytes = (uint32_t)number;
+        else if (arg == "--seed") spec.seed = number;
+        else if (arg == "--runs") options.runs = (int)(std::max)(1ull, number);
+        else if (arg == "--name-min") spec.name_min = (uint32_t)(std::max)(1ull, number);
+        else if (arg == "--name-max") spec.name_max = (uint32_t)number;
+        else {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+    // Leaves room for the extension and the collision characters within 255 bytes
+    spec.name_max = (std::min)(spec.name_max, 240u);
+    if (spec.name_max < spec.name_min) {
+        error = "--name-max is smaller than --name-min";
+        return false;
+    }
+    if (options.root.empty()) options.root = TreeGenerator::MakeTempRoot(spec.seed);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+        std::fputs(kUsage, stdout);
+        return 0;
+    }
+    BenchOptions options;
+    std::string error;
+    if (!ParseArguments(argc, argv, options, error)) {
+        std::fprintf(stderr, "fnm_bench: %s\n\n%s", error.c_str(), kUsage);
+        return 2;
+    }
+
+    std::error_code ec;
+    if (fs::exists(options.root, ec) && !fs::is_empty(options.root, ec)) {
+        std::fprintf(stderr, "fnm_bench: %s is not empty\n", options.root.c_str());
+        return 2;
+    }
+
+    std::fprintf(stderr, "Generating %u files under %s...\n", options.spec.files, options.root.c_str());
+    TreeStats tree;
+    if (!TreeGenerator::Generate(options.spec, options.root, tree)) {
+        std::fprintf(stderr, "fnm_bench: could not generate the tree under %s\n", options.root.c_str());
+        fs::remove_all(options.root, ec);
+        return 1;
+    }
+    std::fprintf(stderr, "Generated %llu files in %llu folders in %.2f s\n", (unsigned long long)tree.files,
+                 (unsigned long long)tree.dirs, tree.seconds);
+
+    // Delete goes last since it takes the tree down
+    std::vector<OpResult> results;
+    for (const char* op : {"scan", "filter", "rename", "delete"}) {
+        if (std::find(options.ops.begin(), options.ops.end(), op) == options.ops.end()) continue;
+        std::fprintf(stderr, "Running %s...\n", op);
+        if (std::strcmp(op, "scan") == 0) results.push_back(BenchScan(options));
+        else if (std::strcmp(op, "filter") == 0) results.push_back(BenchFilter(options));
+        else if (std::strcmp(op, "rename") == 0) results.push_back(BenchRename(options));
+        else results.push_back(BenchDelete(options));
+    }
+
+    // A kept tree is left the way it was generated
+    bool deleted = std::find(options.ops.begin(), options.ops.end(), "delete") != options.ops.end();
+    TreeStats regenerated;
+    if (options.keep && deleted) Regenerate(options, regenerated);
+    if (!options.keep) fs::remove_all(options.root, ec);
+
+    PrintSummary(results);
+    std::string report = BuildReport(options, tree, results);
+    if (options.output.empty()) {
+        std::fputs(report.c_str(), stdout);
+    } else {
+        std::ofstream out(options.output, std::ios::trunc);
+        out << report;
+        if (!out) {
+            std::fprintf(stderr, "fnm_bench: could not write %s\n", options.output.c_str());
+            return 1;
+        }
+        std::fprintf(stderr, "Report written to %s\n", options.output.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include "ContentSearch.h"
+#include "IoThreads.h"
+#include "LiteralScan.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <string_view>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Files below this are read with one read(); a mapping costs more than it saves on them
+constexpr uint64_t kMapMin = 256 << 10;
+// A NUL in this many leading bytes marks a file as binary
+constexpr size_t kBinaryProbe = 8192;
+// Big files are searched in slices of this much, checking for cancellation in between
+constexpr size_t kSlice = 4 << 20;
+// Excerpts keep this many bytes of the line, starting a little before the match
+constexpr size_t kExcerptBytes = 200;
+constexpr size_t kExcerptBefore = 60;
+// std::regex recurses per input byte; longer lines only get a window around the literal
+constexpr size_t kMaxRegexLine = 16 << 10;
+
+using LiteralScan::FindLiteral;
+using LiteralScan::FoldAscii;
+
+// The matching line, from a little before the match, with tabs and control bytes blanked
+std::string Excerpt(const char* data, size_t line_begin, size_t line_end, size_t match) {
+    if (line_end > line_begin && data[line_end - 1] == '\r') line_end--;
+    size_t begin = match - (std::min)(match - line_begin, kExcerptBefore);
+    size_t end = (std::min)(line_end, begin + kExcerptBytes);
+    // Don't start or end inside a UTF-8 sequence
+    while (begin < match && ((unsigned char)data[begin] & 0xC0) == 0x80) begin++;
+    while (end < line_end && end > begin && ((unsigned char)data[end] & 0xC0) == 0x80) end--;
+    std::string excerpt;
+    if (begin > line_begin) excerpt += "...";
+    for (size_t i = begin; i < end; i++) {
+        unsigned char c = (unsigned char)data[i];
+        excerpt += (c < 0x20 || c == 0x7F) ? ' ' : (char)c;
+    }
+    if (end < line_end) excerpt += "...";
+    return excerpt;
+}
+
+// Looks for the first match in one file's contents. Returns how far it read, for the byte count.
+size_t SearchContents(const char* data, size_t size, const std::string& needle, const ContentQuery& query,
+                      const std::regex* regex, const std::atomic<bool>& cancel, ContentHit& hit, bool& found) {
+    found = false;
+    size_t counted = 0; // newlines before here are in hit.line
+    hit.line = 1;
+    auto report = [&](size_t line_begin, size_t line_end, size_t match) {
+        hit.line += (uint64_t)std::count(data + counted, data + line_begin, '\n');
+        hit.excerpt = Excerpt(data, line_begin, line_end, match);
+        found = true;
+        return line_end;
+    };
+    auto line_begin_of = [&](size_t pos) {
+        while (pos > 0 && data[pos - 1] != '\n') pos--;
+        return pos;
+    };
+    auto line_end_of = [&](size_t pos) {
+        const void* nl = std::memchr(data + pos, '\n', size - pos);
+        return nl ? (size_t)((const char*)nl - data) : size;
+    };
+
+    for (size_t pos = 0; pos < size;) {
+        if (cancel.load(std::memory_order_relaxed)) return pos;
+        size_t match = pos;
+        if (!needle.empty()) {
+            size_t slice = (std::min)(size - pos, kSlice + needle.size() - 1);
+            size_t offset = FindLiteral(data + pos, slice, needle, query.case_sensitive);
+            if (offset == slice) {
+                pos += (std::min)(size - pos, kSlice);
+                continue;
+            }
+            match = pos + offset;
+        }
+        size_t line_begin = line_begin_of(match);
+        size_t line_end = line_end_of(match);
+        if (!regex) return report(line_begin, line_end, match);
+
+        // Overlong lines (minified files, logs without breaks) only get a window around the match
+        size_t from = line_begin, to = line_end;
+        if (to - from > kMaxRegexLine) {
+            from = match - (std::min)(match - line_begin, kMaxRegexLine / 2);
+            to = (std::min)(line_end, from + kMaxRegexLine);
+        }
+        std::cmatch groups;
+        if (std::regex_search(data + from, data + to, groups, *regex)) {
+            return report(line_begin, line_end, from + (size_t)groups.position(0));
+        }
+        // Nothing on this line; newlines up to here are counted once, as the scan moves on
+        hit.line += (uint64_t)std::count(data + counted, data + line_begin, '\n') + 1;
+        counted = (std::min)(line_end + 1, size);
+        pos = counted;
+    }
+    return size;
+}
+
+// Whole contents of one file, mapped or read into a buffer the worker reuses
+class FileContents {
+public:
+    FileContents() = default;
+    FileContents(const FileContents&) = delete;
+    FileContents& operator=(const FileContents&) = delete;
+    ~FileContents() {
+#if defined(__linux__)
+        if (m_mapped) ::munmap(m_mapped, m_size);
+#endif
+    }
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+    bool IsMapped() const { return m_mapped != nullptr; }
+
+    // False with `error` set if the file can't be read; `too_big` if it has grown past `limit`
+    // since the scan, in which case it's left unread
+#if defined(__linux__)
+    bool Load(const std::string& path, uint64_t limit, std::vector<char>& buffer, bool& too_big, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        bool ok = LoadFd(fd, limit, buffer, too_big, error);
+        ::close(fd);
+        return ok;
+    }
+
+private:
+    bool LoadFd(int fd, uint64_t limit, std::vector<char>& buffer, bool& too_big, std::string& error) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        uint64_t size = (uint64_t)st.st_size;
+        too_big = size > limit;
+        if (too_big || size == 0) return true;
+
+        // The mapping outlives the descriptor. Readahead goes sequential, and the pages are
+        // the page cache's own, so nothing is copied.
+        if (size >= kMapMin) {
+            void* mapped = ::mmap(nullptr, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                ::madvise(mapped, (size_t)size, MADV_SEQUENTIAL);
+                m_mapped = mapped;
+                m_data = (const char*)mapped;
+                m_size = (size_t)size;
+                return true;
+            }
+        }
+        if (buffer.size() < size) buffer.resize((size_t)size);
+        size_t length = 0;
+        while (length < size) {
+            ssize_t n = ::read(fd, buffer.data() + length, (size_t)size - length);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                error = std::strerror(errno);
+                return false;
+            }
+            if (n == 0) break; // shrank since the stat; search what's there
+            length += (size_t)n;
+        }
+        m_data = buffer.data();
+        m_size = length;
+        return true;
+    }
+
+    void* m_mapped = nullptr;
+#else
+    bool Load(const std::string& path, uint64_t limit, std::vector<char>& buffer, bool& too_big, std::string& error) {
+        std::ifstream stream(path, std::ios::binary | std::ios::ate);
+        if (!stream) {
+            error = "can't open";
+            return false;
+        }
+        uint64_t size = (uint64_t)stream.tellg();
+        too_big = size > limit;
+        if (too_big || size == 0) return true;
+        if (buffer.size() < size) buffer.resize((size_t)size);
+        stream.seekg(0);
+        stream.read(buffer.data(), (std::streamsize)size);
+        if (stream.bad()) {
+            error = "read failed";
+            return false;
+        }
+        m_data = buffer.data();
+        m_size = (size_t)stream.gcount();
+        return true;
+    }
+
+private:
+    const void* m_mapped = nullptr;
+#endif
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+std::regex::flag_type RegexFlags(const ContentQuery& query) {
+    std::regex::flag_type flags = std::regex::ECMAScript | std::regex::optimize;
+    if (!query.case_sensitive) flags |= std::regex::icase;
+    return flags;
+}
+
+void SearchFiles(ContentSearchJob& job, const std::string& needle, const std::regex* regex) {
+    PROFILE_SCOPE("ContentSearch::Worker");
+    std::vector<char> buffer;
+    std::string error;
+    for (size_t f; !job.cancel.load(std::memory_order_relaxed) && (f = job.next.fetch_add(1, std::memory_order_relaxed)) < job.files.size();) {
+        const ContentSearchJob::File& file = job.files[f];
+        FileContents contents;
+        bool too_big = false;
+        if (!contents.Load(file.path, job.query.max_file_bytes, buffer, too_big, error)) {
+            job.failed.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (job.errors.size() < kMaxFileErrors) job.errors.push_back(file.path + ": " + error);
+        } else if (too_big || std::memchr(contents.Data(), '\0', (std::min)(contents.Size(), kBinaryProbe))) {
+            job.skipped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ContentHit hit;
+            bool found = false;
+            size_t read = SearchContents(contents.Data(), contents.Size(), needle, job.query, regex, job.cancel, hit, found);
+            // Mapped pages past the match were never touched
+            size_t bytes = contents.IsMapped() ? read : contents.Size();
+            job.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+            PROFILE_COUNT("search.bytes", bytes);
+            if (found && !job.cancel.load(std::memory_order_relaxed)) {
+                hit.entry = file.entry;
+                job.matched.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.hits.push_back(std::move(hit));
+            }
+        }
+        job.completed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+bool ContentSearch::CheckQuery(const ContentQuery& query, std::string& error) {
+    if (query.text.empty() && query.regex.empty()) {
+        error = "nothing to search for";
+        return false;
+    }
+    if (!query.regex.empty()) {
+        try {
+            std::regex(query.regex, RegexFlags(query));
+        } catch (const std::regex_error& e) {
+            error = std::string("bad regex: ") + e.what();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<ContentSearchJob> ContentSearch::CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries,
+                                                           const ContentQuery& query, std::string& error) {
+    PROFILE_SCOPE("ContentSearch::CreateJob");
+    if (!CheckQuery(query, error)) return nullptr;
+
+    auto job = std::make_shared<ContentSearchJob>();
+    job->query = query;
+    size_t settled = 0;
+    for (uint32_t i : entries) {
+        if (store.IsDirectory(i)) continue;
+        job->total++;
+        uint64_t size = store.GetSize(i);
+        if (size > query.max_file_bytes) {
+            job->skipped.fetch_add(1, std::memory_order_relaxed);
+            settled++;
+        } else if (size == 0) {
+            settled++;
+        } else {
+            job->files.push_back({i, size, store.GetPath(i)});
+        }
+    }
+    // Scan order keeps the files of a folder together, which the disk likes better than the display order
+    std::sort(job->files.begin(), job->files.end(), [](const ContentSearchJob::File& a, const ContentSearchJob::File& b) { return a.entry < b.entry; });
+    job->completed.store(settled, std::memory_order_relaxed);
+    return job;
+}
+
+void ContentSearch::Run(std::shared_ptr<ContentSearchJob> job) {
+    PROFILE_SCOPE("ContentSearch::Run");
+    std::string needle = job->query.text;
+    if (!job->query.case_sensitive) {
+        for (char& c : needle) c = (char)FoldAscii((unsigned char)c);
+    }
+    // Matching doesn't change the regex, so the workers share one
+    std::unique_ptr<std::regex> regex;
+    if (!job->query.regex.empty()) regex = std::make_unique<std::regex>(job->query.regex, RegexFlags(job->query));
+
+    unsigned thread_count = IoThreadCount(job->files.size());
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < thread_count; t++) {
+        threads.emplace_back([&, t] {
+            Profiler::SetThreadName("search " + std::to_string(t));
+            SearchFiles(*job, needle, regex.get());
+        });
+    }
+    SearchFiles(*job, needle, regex.get());
+    for (auto& thread : threads) thread.join();
+    job->done.store(true, std::memory_order_release);
+    RedrawSignal::Request();
+}
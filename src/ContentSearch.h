@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "EntryStore.h"
+
+// What to look for inside files
+struct ContentQuery {
+    std::string text;                       // literal; may be empty if `regex` is set
+    std::string regex;                      // ECMAScript, checked on each line that contains `text`
+    bool case_sensitive = true;             // ASCII folding for the literal, icase for the regex
+    uint64_t max_file_bytes = 64ull << 20;  // larger files are skipped unread
+};
+
+// First match in a file. Lines count from 1; the excerpt is the matching line, cut to a
+// window around the match when it's long, with control characters blanked.
+struct ContentHit {
+    uint32_t entry = 0;
+    uint64_t line = 0;
+    std::string excerpt;
+};
+
+// Shared state between the caller and ContentSearch::Run(). The caller fills `files` through
+// ContentSearch::CreateJob(), reads the counters and drains `hits` and `errors` as they come.
+struct ContentSearchJob {
+    struct File {
+        uint32_t entry;
+        uint64_t size;
+        std::string path;
+    };
+
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    ContentQuery query;
+    std::vector<File> files;            // in entry order, which keeps folders together on disk
+    size_t total = 0;                   // files asked about, including those settled by CreateJob()
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> completed{0};   // read, skipped or failed, out of `total`
+    std::atomic<size_t> skipped{0};     // binary, or over the size limit
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> matched{0};
+    std::atomic<uint64_t> bytes_read{0};
+
+    std::mutex mutex;
+    std::vector<ContentHit> hits;       // drained by the caller
+    std::vector<std::string> errors;    // "path: reason", drained by the caller, capped
+};
+
+// Finds the files that contain a string. Each file is read whole, through mmap on Linux
+// (small files take a single read() instead, which is cheaper than setting up a mapping) or
+// through a buffered read elsewhere, on a small pool of I/O threads like DuplicateFinder's.
+// The literal is located with LiteralScan, the SSE2 first/last byte filter the name index
+// uses too, so the scan keeps up with the disk; files with a NUL in their first 8 KB count
+// as binary and are skipped. With a regex, only lines containing the literal are handed to it. A file
+// stops being read at its first match.
+class ContentSearch {
+public:
+    // False with `error` set if the query is empty or the regex doesn't compile
+    static bool CheckQuery(const ContentQuery& query, std::string& error);
+
+    // Files among `entries` that could match. Folders are left out; empty files and files
+    // over the size limit are settled without being opened. Returns null with `error` set if
+    // CheckQuery() fails. Paths are built here, so the store can change once this returns.
+    static std::shared_ptr<ContentSearchJob> CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries,
+                                                       const ContentQuery& query, std::string& error);
+
+    // Searches on the calling thread plus the I/O pool, then sets `done`
+    static void Run(std::shared_ptr<ContentSearchJob> job);
+};
@@ -0,0 +1,358 @@
+#include "DirectoryTree.h"
+#include "DirectoryWalker.h"
+#include "EntrySorter.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Listing threads: folders are usually small, so two keep up with expanding while a
+// prefetch of a large folder is running
+constexpr unsigned kListThreads = 2;
+// Subfolders listed ahead of time per expanded folder; the first ones are what's on screen
+constexpr size_t kMaxPrefetch = 256;
+
+} // namespace
+
+DirectoryTree::DirectoryTree() = default;
+
+DirectoryTree::~DirectoryTree() {
+    StopWorkers();
+}
+
+void DirectoryTree::StartWorkers() {
+    if (!m_workers.empty()) return;
+    m_stop.store(false, std::memory_order_relaxed);
+    for (unsigned i = 0; i < kListThreads; i++) {
+        m_workers.emplace_back([this, i] {
+            Profiler::SetThreadName("tree " + std::to_string(i));
+            WorkerLoop();
+        });
+    }
+}
+
+void DirectoryTree::StopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop.store(true, std::memory_order_relaxed);
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) worker.join();
+    m_workers.clear();
+}
+
+void DirectoryTree::WorkerLoop() {
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop.load(std::memory_order_relaxed) || !m_urgent.empty() || !m_prefetch.empty(); });
+            if (m_stop.load(std::memory_order_relaxed)) return;
+            std::deque<Request>& queue = m_urgent.empty() ? m_prefetch : m_urgent;
+            request = std::move(queue.front());
+            queue.pop_front();
+            m_running++;
+        }
+
+        Listing listing = List(request, m_stop);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running--;
+            if (request.epoch != m_epoch) continue;
+            m_done.push_back(std::move(listing));
+        }
+        RedrawSignal::Request();
+    }
+}
+
+DirectoryTree::Listing DirectoryTree::List(const Request& request, const std::atomic<bool>& stop) {
+    PROFILE_SCOPE("DirectoryTree::List");
+    Listing listing;
+    listing.node = request.node;
+    listing.generation = request.generation;
+
+    // A flat walk is a single getdents/statx pass on this thread
+    std::vector<ChildEntry> unsorted;
+    DirectoryWalker walker(1);
+    walker.Run(request.path, false, &stop, [&](ScanBatch&& batch) {
+        for (const ScanRecord& record : batch.records) {
+            unsorted.push_back({(uint32_t)listing.names.size(), record.name_length, record.is_directory, kNoNode, record.size});
+            listing.names.append(batch.Name(record));
+        }
+    });
+
+    // Folders first, then natural name order, as in the flat list's Type column
+    std::vector<uint32_t> order(unsorted.size());
+    std::iota(order.begin(), order.end(), 0);
+    const std::string& names = listing.names;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const ChildEntry& x = unsorted[a];
+        const ChildEntry& y = unsorted[b];
+        if (x.is_directory != y.is_directory) return x.is_directory;
+        int c = EntrySorter::NaturalCompare(std::string_view(names.data() + x.name_offset, x.name_length),
+                                            std::string_view(names.data() + y.name_offset, y.name_length));
+        return c != 0 ? c < 0 : a < b;
+    });
+    listing.children.reserve(order.size());
+    for (uint32_t i : order) listing.children.push_back(unsorted[i]);
+    return listing;
+}
+
+void DirectoryTree::Open(const std::string& root) {
+    Close();
+    StartWorkers();
+    m_root = root;
+    AllocateNode(kNoNode, 0);
+    m_nodes[kRootNode].expanded = true;
+    Enqueue(kRootNode, true);
+}
+
+void DirectoryTree::Close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_epoch++;
+        m_urgent.clear();
+        m_prefetch.clear();
+        m_done.clear();
+    }
+    m_root.clear();
+    m_nodes = std::vector<Node>();
+    m_free_nodes.clear();
+    m_rows.clear();
+    m_rows_dirty = true;
+    m_memory_bytes = 0;
+    m_listed_count = 0;
+}
+
+bool DirectoryTree::IsBusy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running > 0 || !m_urgent.empty() || !m_prefetch.empty() || !m_done.empty();
+}
+
+uint32_t DirectoryTree::AllocateNode(uint32_t parent, uint32_t parent_child) {
+    uint32_t node;
+    if (!m_free_nodes.empty()) {
+        node = m_free_nodes.back();
+        m_free_nodes.pop_back();
+    } else {
+        node = (uint32_t)m_nodes.size();
+        m_nodes.emplace_back();
+    }
+    Node& n = m_nodes[node];
+    n.parent = parent;
+    n.parent_child = parent_child;
+    n.state = State::Unlisted;
+    n.expanded = false;
+    n.last_used = ++m_clock;
+    return node;
+}
+
+void DirectoryTree::FreeSubtree(uint32_t node) {
+    Node& top = m_nodes[node];
+    if (top.parent != kNoNode) m_nodes[top.parent].children[top.parent_child].node = kNoNode;
+
+    std::vector<uint32_t> stack{node};
+    while (!stack.empty()) {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        Node& n = m_nodes[current];
+        for (const ChildEntry& child : n.children) {
+            if (child.node != kNoNode) stack.push_back(child.node);
+        }
+        if (n.state == State::Listed) {
+            m_memory_bytes -= n.bytes;
+            m_listed_count--;
+        }
+        n.generation++;
+        n.state = State::Unlisted;
+        n.expanded = false;
+        n.bytes = 0;
+        n.parent = kNoNode;
+        std::string().swap(n.names);
+        std::vector<ChildEntry>().swap(n.children);
+        m_free_nodes.push_back(current);
+    }
+    m_rows_dirty = true;
+}
+
+std::string DirectoryTree::GetNodePath(uint32_t node) const {
+    std::vector<uint32_t> chain;
+    for (uint32_t n = node; n != kRootNode; n = m_nodes[n].parent) chain.push_back(n);
+    std::string path = m_root;
+    for (size_t k = chain.size(); k-- > 0;) {
+        const Node& n = m_nodes[chain[k]];
+        const ChildEntry& entry = m_nodes[n.parent].children[n.parent_child];
+        if (path.empty() || path.back() != '/') path += '/';
+        path.append(m_nodes[n.parent].names, entry.name_offset, entry.name_length);
+    }
+    return path;
+}
+
+void DirectoryTree::Enqueue(uint32_t node, bool urgent) {
+    Node& n = m_nodes[node];
+    n.state = State::Listing;
+    Request request{0, node, n.generation, GetNodePath(node)};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        request.epoch = m_epoch;
+        (urgent ? m_urgent : m_prefetch).push_back(std::move(request));
+    }
+    m_wake.notify_one();
+}
+
+uint32_t DirectoryTree::RequestListing(uint32_t parent, uint32_t child, bool urgent) {
+    uint32_t node = AllocateNode(parent, child);
+    m_nodes[parent].children[child].node = node;
+    Enqueue(node, urgent);
+    return node;
+}
+
+void DirectoryTree::Prefetch(uint32_t node) {
+    size_t queued = 0;
+    for (uint32_t c = 0; c < m_nodes[node].children.size() && queued < kMaxPrefetch; c++) {
+        const ChildEntry& child = m_nodes[node].children[c];
+        if (!child.is_directory) break; // folders come first
+        if (child.node != kNoNode) continue;
+        RequestListing(node, c, false);
+        queued++;
+    }
+}
+
+size_t DirectoryTree::Poll() {
+    if (m_nodes.empty()) return 0;
+    std::vector<Listing> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        done.swap(m_done);
+    }
+
+    size_t applied = 0;
+    for (Listing& listing : done) {
+        Node& n = m_nodes[listing.node];
+        if (n.generation != listing.generation || n.state != State::Listing) continue; // freed meanwhile
+        n.names = std::move(listing.names);
+        n.children = std::move(listing.children);
+        n.state = State::Listed;
+        n.last_used = ++m_clock;
+        n.bytes = sizeof(Node) + n.names.capacity() + n.children.capacity() * sizeof(ChildEntry);
+        m_memory_bytes += n.bytes;
+        m_listed_count++;
+        applied++;
+        if (n.expanded) {
+            m_rows_dirty = true;
+            Prefetch(listing.node);
+        }
+    }
+    if (m_memory_bytes > m_memory_budget) Trim();
+    return applied;
+}
+
+void DirectoryTree::Trim() {
+    PROFILE_SCOPE("DirectoryTree::Trim");
+    // Collapsed listings, least recently used first. A collapsed folder's subtree is off
+    // screen as a whole, so freeing it with everything below is always safe.
+    struct Candidate {
+        uint64_t last_used;
+        uint32_t node;
+        uint32_t generation;
+    };
+    std::vector<Candidate> candidates;
+    for (uint32_t node = 1; node < m_nodes.size(); node++) {
+        const Node& n = m_nodes[node];
+        if (n.state == State::Listed && !n.expanded) candidates.push_back({n.last_used, node, n.generation});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.last_used < b.last_used; });
+
+    size_t target = m_memory_budget / 4 * 3;
+    for (const Candidate& candidate : candidates) {
+        if (m_memory_bytes <= target) break;
+        const Node& n = m_nodes[candidate.node];
+        if (n.generation != candidate.generation) continue; // went with an earlier subtree
+        FreeSubtree(candidate.node);
+    }
+}
+
+const std::vector<DirectoryTree::Row>& DirectoryTree::GetRows() {
+    if (!m_rows_dirty) return m_rows;
+    m_rows_dirty = false;
+    m_rows.clear();
+    if (m_nodes.empty() || m_nodes[kRootNode].state != State::Listed) return m_rows;
+
+    // Depth-first with an explicit stack: (node, next child to emit)
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{kRootNode, 0}};
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        const Node& n = m_nodes[node];
+        if (next == n.children.size()) {
+            stack.pop_back();
+            continue;
+        }
+        uint32_t child = next++;
+        uint32_t depth = (uint32_t)stack.size() - 1;
+        m_rows.push_back({node, child, depth});
+        uint32_t sub = n.children[child].node;
+        if (sub != kNoNode && m_nodes[sub].expanded && m_nodes[sub].state == State::Listed) stack.push_back({sub, 0});
+    }
+    return m_rows;
+}
+
+std::string_view DirectoryTree::GetName(const Row& row) const {
+    const ChildEntry& entry = Child(row);
+    return std::string_view(m_nodes[row.node].names.data() + entry.name_offset, entry.name_length);
+}
+
+std::string DirectoryTree::GetPath(const Row& row) const {
+    std::string path = GetNodePath(row.node);
+    if (path.empty() || path.back() != '/') path += '/';
+    path += GetName(row);
+    return path;
+}
+
+bool DirectoryTree::IsExpanded(const Row& row) const {
+    uint32_t node = Child(row).node;
+    return node != kNoNode && m_nodes[node].expanded;
+}
+
+DirectoryTree::State DirectoryTree::GetState(const Row& row) const {
+    uint32_t node = Child(row).node;
+    return node != kNoNode ? m_nodes[node].state : State::Unlisted;
+}
+
+size_t DirectoryTree::GetChildCount(const Row& row) const {
+    uint32_t node = Child(row).node;
+    return node != kNoNode && m_nodes[node].state == State::Listed ? m_nodes[node].children.size() : 0;
+}
+
+void DirectoryTree::Expand(const Row& row) {
+    if (!IsDirectory(row)) return;
+    uint32_t node = Child(row).node;
+    if (node == kNoNode) {
+        node = RequestListing(row.node, row.child, true);
+    } else if (m_nodes[node].state == State::Listing && !m_nodes[node].expanded) {
+        // Still waiting as a prefetch: move it to the front (if a thread has it, it's close)
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_prefetch.begin(), m_prefetch.end(), [&](const Request& r) { return r.node == node && r.generation == m_nodes[node].generation; });
+        if (it != m_prefetch.end()) {
+            m_urgent.push_back(std::move(*it));
+            m_prefetch.erase(it);
+        }
+    }
+    Node& n = m_nodes[node];
+    n.expanded = true;
+    n.last_used = ++m_clock;
+    if (n.state == State::Listed) {
+        m_rows_dirty = true;
+        Prefetch(node);
+    }
+}
+
+void DirectoryTree::Collapse(const Row& row) {
+    uint32_t node = Child(row).node;
+    if (node == kNoNode || !m_nodes[node].expanded) return;
+    m_nodes[node].expanded = false;
+    m_nodes[node].last_used = ++m_clock;
+    m_rows_dirty = true;
+}
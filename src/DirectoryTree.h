@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Hierarchical browsing that only lists what is looked at. Opening a folder lists just that
+// folder, so a volume root with fifty million entries below it opens as fast as a small one.
+// A folder's children are listed the first time it's expanded, on background threads, and
+// once an expanded folder's listing is in, its subfolders are listed ahead of time at low
+// priority so the next expand is usually instant.
+//
+// Folders whose listing isn't on screen (collapsed, or inside a collapsed folder) can be
+// dropped again: once the listings take more than the memory budget, the least recently
+// used ones are freed along with everything below them, and are listed again if expanded.
+//
+// Every listed folder is a node holding its children (folders first, natural name order).
+// Rows address a child by (node, position), which stays valid until the next Poll().
+class DirectoryTree {
+public:
+    static constexpr uint32_t kNoNode = 0xFFFFFFFFu;
+    static constexpr uint32_t kRootNode = 0;
+
+    enum class State : uint8_t {
+        Unlisted,
+        Listing, // queued or being read
+        Listed,
+    };
+
+    // One visible line: child `child` of node `node`, `depth` levels below the root
+    struct Row {
+        uint32_t node;
+        uint32_t child;
+        uint32_t depth;
+    };
+
+    DirectoryTree();
+    ~DirectoryTree();
+    DirectoryTree(const DirectoryTree&) = delete;
+    DirectoryTree& operator=(const DirectoryTree&) = delete;
+
+    // Drops the current tree and starts listing `root`
+    void Open(const std::string& root);
+    void Close();
+    bool IsOpen() const { return !m_nodes.empty(); }
+    const std::string& GetRoot() const { return m_root; }
+
+    // Call once per frame: takes in finished listings, queues prefetches, frees old listings
+    // if over budget. Returns the number of listings taken in.
+    size_t Poll();
+    // Listings queued or running, prefetches included
+    bool IsBusy() const;
+
+    // Visible lines in display order, rebuilt after anything was expanded, collapsed or listed
+    const std::vector<Row>& GetRows();
+
+    std::string_view GetName(const Row& row) const;
+    uint64_t GetSize(const Row& row) const { return Child(row).size; }
+    bool IsDirectory(const Row& row) const { return Child(row).is_directory; }
+    // Rebuilt from the parent chain; use for tooltips and syscalls
+    std::string GetPath(const Row& row) const;
+    // Folders only
+    bool IsExpanded(const Row& row) const;
+    State GetState(const Row& row) const;
+    // Number of children of a listed folder, 0 otherwise
+    size_t GetChildCount(const Row& row) const;
+    size_t GetRootChildCount() const { return m_nodes.empty() ? 0 : m_nodes[kRootNode].children.size(); }
+    State GetRootState() const { return m_nodes.empty() ? State::Unlisted : m_nodes[kRootNode].state; }
+
+    void Expand(const Row& row);
+    void Collapse(const Row& row);
+
+    // Memory held by listings; trimming starts above the budget and stops at three quarters of it
+    void SetMemoryBudget(size_t bytes) { m_memory_budget = bytes; }
+    size_t GetMemoryBytes() const { return m_memory_bytes; }
+    size_t GetListedCount() const { return m_listed_count; }
+
+private:
+    struct ChildEntry {
+        uint32_t name_offset; // into the node's names
+        uint16_t name_length;
+        bool is_directory;
+        uint32_t node;        // kNoNode until the folder is queued for listing
+        uint64_t size;
+    };
+
+    struct Node {
+        uint32_t parent = kNoNode;
+        uint32_t parent_child = 0; // position among the parent's children
+        uint32_t generation = 0;   // bumped when the slot is freed, so late listings are ignored
+        State state = State::Unlisted;
+        bool expanded = false;
+        uint64_t last_used = 0;
+        size_t bytes = 0;
+        std::string names;
+        std::vector<ChildEntry> children;
+    };
+
+    struct Request {
+        uint64_t epoch;
+        uint32_t node;
+        uint32_t generation;
+        std::string path;
+    };
+
+    struct Listing {
+        uint32_t node;
+        uint32_t generation;
+        std::string names;
+        std::vector<ChildEntry> children;
+    };
+
+    const ChildEntry& Child(const Row& row) const { return m_nodes[row.node].children[row.child]; }
+    std::string GetNodePath(uint32_t node) const;
+    uint32_t AllocateNode(uint32_t parent, uint32_t parent_child);
+    void FreeSubtree(uint32_t node);
+    // Gives child `child` of `parent` a node and queues its listing
+    uint32_t RequestListing(uint32_t parent, uint32_t child, bool urgent);
+    void Enqueue(uint32_t node, bool urgent);
+    // An expanded folder's listing is in: list its subfolders ahead of time
+    void Prefetch(uint32_t node);
+    void Trim();
+
+    void StartWorkers();
+    void StopWorkers();
+    void WorkerLoop();
+    static Listing List(const Request& request, const std::atomic<bool>& stop);
+
+    std::string m_root;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_free_nodes;
+    std::vector<Row> m_rows;
+    bool m_rows_dirty = true;
+    uint64_t m_clock = 0;        // ticks on every expand, collapse and listing, for LRU order
+    size_t m_memory_bytes = 0;
+    size_t m_memory_budget = (size_t)256 << 20;
+    size_t m_listed_count = 0;
+
+    // Shared with the listing threads
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Request> m_urgent;   // expanded by the user
+    std::deque<Request> m_prefetch;
+    std::vector<Listing> m_done;
+    size_t m_running = 0;
+    uint64_t m_epoch = 0;           // bumped by Open()/Close(); older requests are dropped
+    std::atomic<bool> m_stop{false};
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,539 @@
+#include "DirectoryWalker.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Hand a batch to the sink at this many entries, or after this long, whichever comes first.
+// Batches are only cut between directories.
+constexpr size_t kBatchSize = 4096;
+constexpr auto kBatchInterval = std::chrono::milliseconds(50);
+
+struct WalkTask {
+    std::string path;
+    uint32_t dir_id;
+    uint32_t previous_dir; // same directory in the previous scan, kNoDir if unknown
+};
+
+// One directory's worth of work. Owners push/pop at the back (depth-first, warm dentries),
+// thieves take from the front, which tends to be the biggest untouched subtrees.
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<WalkTask> tasks;
+};
+
+struct WalkState {
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<size_t> pending{0};  // directories queued or being listed
+    std::atomic<size_t> queued{0};   // directories sitting in a deque
+    std::atomic<uint32_t> next_dir_id{EntryStore::kRootDir + 1};
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+
+    bool recursive = false;
+    const std::atomic<bool>* cancel = nullptr;
+    const DirectoryWalker::BatchSink* sink = nullptr;
+
+    // Previous scan, with its entries grouped by parent directory:
+    // children of dir d are previous_children[previous_child_begin[d] .. previous_child_begin[d + 1])
+    const EntryStore* previous = nullptr;
+    std::vector<uint32_t> previous_child_begin;
+    std::vector<uint32_t> previous_children;
+
+    bool IsCancelled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+};
+
+// Directory listings in flight across every walk in the process. Scans of several roots at
+// once draw from the same slots, so together they keep no more requests on the disks than a
+// single scan with the default thread count; a lone scan never waits for one.
+class ListingSlots {
+public:
+    ListingSlots() : m_limit((std::max)(2u, std::thread::hardware_concurrency())) {}
+
+    // False if the walk was cancelled while waiting
+    bool Acquire(const WalkState& state) {
+        unsigned used = m_used.load(std::memory_order_relaxed);
+        while (true) {
+            if (used < m_limit) {
+                if (m_used.compare_exchange_weak(used, used + 1, std::memory_order_acquire)) return true;
+                continue;
+            }
+            if (state.IsCancelled()) return false;
+            // The timeout covers a release that slips in between the check and the wait
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_waiting++;
+            m_cv.wait_for(lock, std::chrono::milliseconds(1));
+            m_waiting--;
+            used = m_used.load(std::memory_order_relaxed);
+        }
+    }
+
+    void Release() {
+        m_used.fetch_sub(1, std::memory_order_release);
+        // Uncontended walks skip the lock altogether
+        if (m_waiting.load(std::memory_order_relaxed) > 0) m_cv.notify_one();
+    }
+
+private:
+    const unsigned m_limit;
+    std::atomic<unsigned> m_used{0};
+    std::atomic<unsigned> m_waiting{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+ListingSlots& GetListingSlots() {
+    static ListingSlots slots;
+    return slots;
+}
+
+class WalkWorker {
+public:
+    WalkWorker(WalkState& state, size_t index) : m_state(state), m_index(index) {
+        m_batch.records.reserve(kBatchSize);
+    }
+
+    void Run() {
+        WalkTask task;
+        while (true) {
+            bool found = PopLocal(task);
+            if (!found) {
+                // Out of local work: anything we were holding back must be published before
+                // we go looking elsewhere, or nobody could ever pick it up
+                if (!m_held.empty()) Flush();
+                found = PopLocal(task) || Steal(task);
+            }
+            if (found) {
+                // A cancelled walk still drains its queues, it just stops listing
+                if (!m_state.IsCancelled() && GetListingSlots().Acquire(m_state)) {
+                    ListDirectory(task);
+                    GetListingSlots().Release();
+                    MaybeFlush();
+                }
+                if (m_state.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    m_state.idle_cv.notify_all();
+                }
+                continue;
+            }
+
+            if (m_state.pending.load(std::memory_order_acquire) == 0) break;
+
+            // Nothing to steal right now; someone is still listing and may publish more work.
+            // The timeout covers the (harmless) lost-wakeup race with PushSubdirs().
+            std::unique_lock<std::mutex> lock(m_state.idle_mutex);
+            m_state.idle_cv.wait_for(lock, std::chrono::milliseconds(1), [&] {
+                return m_state.pending.load(std::memory_order_acquire) == 0 ||
+                       m_state.queued.load(std::memory_order_acquire) > 0;
+            });
+        }
+        Flush();
+    }
+
+private:
+    bool PopLocal(WalkTask& task) {
+        WorkQueue& queue = *m_state.queues[m_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        m_state.queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Steal(WalkTask& task) {
+        if (m_state.queued.load(std::memory_order_acquire) == 0) return false;
+        size_t count = m_state.queues.size();
+        for (size_t i = 1; i < count; i++) {
+            WorkQueue& victim = *m_state.queues[(m_index + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_state.queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Subdirectories found while listing are held back until the batch holding their own
+    // records has gone to the sink. That way a consumer merging batches in arrival order
+    // always sees a directory before any of its children.
+    void HoldSubdir(const std::string& path, uint32_t previous_dir) {
+        uint32_t dir_id = m_state.next_dir_id.fetch_add(1, std::memory_order_relaxed);
+        m_held.push_back({path, dir_id, previous_dir});
+        m_state.pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void PublishHeld() {
+        if (m_held.empty()) return;
+        {
+            WorkQueue& queue = *m_state.queues[m_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (auto& task : m_held) queue.tasks.push_back(std::move(task));
+        }
+        m_state.queued.fetch_add(m_held.size(), std::memory_order_release);
+        m_held.clear();
+        m_state.idle_cv.notify_all();
+    }
+
+    void MaybeFlush() {
+        // Keep batching while there's plenty of work around; flush early when our own deque
+        // is empty or other workers are starving for directories to steal.
+        bool starving = !m_held.empty() &&
+            (m_state.queued.load(std::memory_order_relaxed) < m_state.queues.size() || LocalQueueEmpty());
+        if (starving || m_batch.records.size() >= kBatchSize || std::chrono::steady_clock::now() - m_last_flush >= kBatchInterval) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        m_last_flush = std::chrono::steady_clock::now();
+        // Syscalls are tallied per worker and published here, keeping shared counters off the hot path
+        PROFILE_COUNT("syscall.open", m_opens);
+        PROFILE_COUNT("syscall.getdents64", m_getdents);
+        PROFILE_COUNT("syscall.statx", m_stats);
+        m_opens = m_getdents = m_stats = 0;
+        if (!m_batch.empty()) {
+            PROFILE_COUNT("scan.entries", m_batch.records.size());
+            PROFILE_SCOPE("DirectoryWalker::Sink");
+            (*m_state.sink)(std::move(m_batch));
+            m_batch = ScanBatch();
+            m_batch.records.reserve(kBatchSize);
+        }
+        PublishHeld();
+    }
+
+    bool LocalQueueEmpty() {
+        WorkQueue& queue = *m_state.queues[m_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        return queue.tasks.empty();
+    }
+
+    size_t AddRecord(std::string_view name, uint32_t parent_dir) {
+        ScanRecord record;
+        record.parent_dir = parent_dir;
+        record.dir_id = EntryStore::kNoDir;
+        record.name_offset = (uint32_t)m_batch.names.size();
+        record.name_length = (uint16_t)name.size();
+        record.size = 0;
+        record.is_directory = false;
+        record.source = EntryStore::kNoEntry;
+        if (!m_previous_names.empty()) {
+            auto it = m_previous_names.find(name);
+            if (it != m_previous_names.end()) record.source = it->second;
+        }
+        m_batch.names.append(name);
+        m_batch.names.push_back('\0');
+        m_batch.records.push_back(record);
+        return m_batch.records.size() - 1;
+    }
+
+    void MarkDirectory(size_t record_index, const std::string& prefix) {
+        ScanRecord& record = m_batch.records[record_index];
+        record.is_directory = true;
+        if (m_state.recursive) {
+            // A subdirectory we knew before may still be unchanged even if this one isn't
+            uint32_t previous_dir = record.source != EntryStore::kNoEntry ? m_state.previous->GetDirId(record.source) : EntryStore::kNoDir;
+            HoldSubdir(prefix + (m_batch.names.c_str() + record.name_offset), previous_dir);
+            record.dir_id = m_held.back().dir_id;
+        }
+    }
+
+    // Called with the directory's current mtime before listing it. Returns true if the
+    // previous scan's entries were reused, in which case there's nothing left to list.
+    bool ReuseListing(const WalkTask& task, const std::string& prefix, int64_t mtime) {
+        m_batch.dirs.push_back({task.dir_id, mtime});
+        m_previous_names.clear();
+        if (task.previous_dir == EntryStore::kNoDir) return false;
+
+        const EntryStore& previous = *m_state.previous;
+        uint32_t begin = m_state.previous_child_begin[task.previous_dir];
+        uint32_t end = m_state.previous_child_begin[task.previous_dir + 1];
+
+        // mtimes at or after the old scan's start can't tell us whether the listing we have
+        // was taken before or after the change
+        bool unchanged = mtime != 0 && mtime == previous.GetDirMTime(task.previous_dir) && mtime < previous.GetScanTime();
+        if (!unchanged) {
+            // Relist, but match the new entries to the old ones by name
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t entry = m_state.previous_children[i];
+                m_previous_names.emplace(previous.GetName(entry), entry);
+            }
+            return false;
+        }
+
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t entry = m_state.previous_children[i];
+            size_t index = AddRecord(previous.GetName(entry), task.dir_id);
+            ScanRecord& record = m_batch.records[index];
+            record.source = entry;
+            record.size = previous.GetSize(entry);
+            record.is_directory = previous.IsDirectory(entry);
+            uint32_t previous_dir = previous.GetDirId(entry);
+            if (previous_dir != EntryStore::kNoDir && m_state.recursive) {
+                HoldSubdir(prefix + (m_batch.names.c_str() + record.name_offset), previous_dir);
+                record.dir_id = m_held.back().dir_id;
+            }
+        }
+        return true;
+    }
+
+#if defined(__linux__)
+    // Layout of the records returned by getdents64 (see getdents(2))
+    struct RawDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    // Stats `name` relative to `dir_fd`. Returns false if the entry vanished or is unreadable.
+    static bool StatAt(int dir_fd, const char* name, bool follow, mode_t& mode, uint64_t& size) {
+        int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+#ifdef STATX_SIZE
+        struct statx stx;
+        if (statx(dir_fd, name, flags | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE, &stx) != 0) return false;
+        mode = stx.stx_mode;
+        size = stx.stx_size;
+#else
+        struct stat st;
+        if (fstatat(dir_fd, name, &st, flags) != 0) return false;
+        mode = st.st_mode;
+        size = (uint64_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void ListDirectory(const WalkTask& task) {
+        PROFILE_SCOPE("DirectoryWalker::ListDirectory");
+        m_opens++;
+        int fd = openat(AT_FDCWD, task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return; // permission denied / vanished: skipped, like skip_permission_denied
+
+        std::string prefix = task.path;
+        if (prefix.empty() || prefix.back() != '/') prefix += '/';
+
+        struct stat dir_stat;
+        int64_t mtime = fstat(fd, &dir_stat) == 0 ? (int64_t)dir_stat.st_mtim.tv_sec * 1000000000 + dir_stat.st_mtim.tv_nsec : 0;
+        if (ReuseListing(task, prefix, mtime)) {
+            close(fd);
+            return;
+        }
+
+        if (m_dirent_buffer.empty()) m_dirent_buffer.resize(256 * 1024);
+
+        // Pass 1: read the whole directory, classifying by d_type. Entries whose type
+        // or size we can't tell from d_type are remembered for the stat pass.
+        m_need_stat.clear();
+        while (!m_state.IsCancelled()) {
+            long bytes = syscall(SYS_getdents64, fd, m_dirent_buffer.data(), m_dirent_buffer.size());
+            m_getdents++;
+            if (bytes <= 0) break;
+
+            for (long pos = 0; pos < bytes;) {
+                const auto* d = reinterpret_cast<const RawDirent64*>(m_dirent_buffer.data() + pos);
+                pos += d->d_reclen;
+
+                const char* name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+                size_t record = AddRecord(name, task.dir_id);
+                switch (d->d_type) {
+                case DT_DIR:
+                    MarkDirectory(record, prefix);
+                    break;
+                case DT_REG:
+                case DT_LNK:
+                case DT_UNKNOWN:
+                    m_need_stat.push_back({record, d->d_type});
+                    break;
+                default:
+                    // FIFOs, sockets, devices: not a directory and file_size() would fail
+                    break;
+                }
+            }
+        }
+
+        // Pass 2: stat the remainder back to back against the open directory fd
+        for (const auto& pending : m_need_stat) {
+            const char* name = m_batch.names.c_str() + m_batch.records[pending.index].name_offset;
+            mode_t mode = 0;
+            uint64_t size = 0;
+
+            if (pending.d_type == DT_UNKNOWN) {
+                // Filesystem doesn't fill d_type (some NFS/XFS setups)
+                m_stats++;
+                if (!StatAt(fd, name, false, mode, size)) continue;
+                if (S_ISDIR(mode)) {
+                    MarkDirectory(pending.index, prefix);
+                    continue;
+                }
+                if (!S_ISLNK(mode)) {
+                    if (S_ISREG(mode)) m_batch.records[pending.index].size = size;
+                    continue;
+                }
+            }
+
+            // Symlinks report their target, like directory_entry::is_directory()/file_size(),
+            // but are never descended into
+            bool follow = pending.d_type != DT_REG;
+            m_stats++;
+            if (!StatAt(fd, name, follow, mode, size)) continue;
+            if (S_ISDIR(mode)) m_batch.records[pending.index].is_directory = true;
+            else if (S_ISREG(mode)) m_batch.records[pending.index].size = size;
+        }
+
+        close(fd);
+    }
+
+    struct PendingStat {
+        size_t index;
+        unsigned char d_type;
+    };
+    std::vector<char> m_dirent_buffer;
+    std::vector<PendingStat> m_need_stat;
+#else
+    void ListDirectory(const WalkTask& task) {
+        PROFILE_SCOPE("DirectoryWalker::ListDirectory");
+        std::string prefix = task.path;
+        if (!prefix.empty() && prefix.back() != '/' && prefix.back() != (char)fs::path::preferred_separator) {
+            prefix += (char)fs::path::preferred_separator;
+        }
+
+        if (ReuseListing(task, prefix, DirectoryWalker::ReadMTime(task.path))) return;
+
+        std::error_code ec;
+
+        for (const auto& entry : fs::directory_iterator(task.path, fs::directory_options::skip_permission_denied, ec)) {
+            if (m_state.IsCancelled()) return;
+            size_t record = AddRecord(entry.path().filename().string(), task.dir_id);
+
+            std::error_code status_ec;
+            bool is_directory = entry.is_directory(status_ec);
+            if (status_ec) is_directory = false;
+
+            if (is_directory) {
+                std::error_code link_ec;
+                if (entry.is_symlink(link_ec)) m_batch.records[record].is_directory = true;
+                else MarkDirectory(record, prefix);
+            } else {
+                uint64_t size = entry.file_size(status_ec);
+                m_batch.records[record].size = status_ec ? 0 : size;
+            }
+        }
+    }
+#endif
+
+    WalkState& m_state;
+    size_t m_index;
+    ScanBatch m_batch;
+    std::vector<WalkTask> m_held;
+    std::unordered_map<std::string_view, uint32_t> m_previous_names; // old entries of the directory being relisted
+    std::chrono::steady_clock::time_point m_last_flush = std::chrono::steady_clock::now();
+    uint64_t m_opens = 0;
+    uint64_t m_getdents = 0;
+    uint64_t m_stats = 0;
+};
+
+} // namespace
+
+DirectoryWalker::DirectoryWalker(unsigned thread_count) : m_thread_count(thread_count) {
+    if (m_thread_count == 0) {
+        m_thread_count = (std::max)(2u, std::thread::hardware_concurrency());
+    }
+}
+
+int64_t DirectoryWalker::CurrentStamp() {
+#if defined(__linux__)
+    // Same clock as st_mtim
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    // Same clock as fs::last_write_time()
+    auto now = fs::file_time_type::clock::now().time_since_epoch();
+    return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+#endif
+}
+
+int64_t DirectoryWalker::ReadMTime(const std::string& path) {
+#if defined(__linux__)
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    std::error_code ec;
+    auto write_time = fs::last_write_time(path, ec);
+    return ec ? 0 : (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(write_time.time_since_epoch()).count();
+#endif
+}
+
+void DirectoryWalker::Run(const std::string& root, bool recursive, const std::atomic<bool>* cancel, const BatchSink& sink,
+                          const EntryStore* previous) {
+    PROFILE_SCOPE("DirectoryWalker::Run");
+    std::error_code ec;
+    if (!fs::exists(root, ec) || !fs::is_directory(root, ec)) {
+        return;
+    }
+
+    // A flat listing is a single task, extra workers would only spin up and leave
+    unsigned thread_count = recursive ? m_thread_count : 1;
+
+    WalkState state;
+    state.recursive = recursive;
+    state.cancel = cancel;
+    state.sink = &sink;
+
+    if (previous && !previous->Empty()) {
+        // Counting sort of the old entries by parent directory
+        uint32_t dir_count = previous->GetDirCount();
+        state.previous = previous;
+        state.previous_child_begin.assign((size_t)dir_count + 1, 0);
+        for (uint32_t i = 0; i < previous->Size(); i++) state.previous_child_begin[previous->GetParentDir(i) + 1]++;
+        for (uint32_t d = 0; d < dir_count; d++) state.previous_child_begin[d + 1] += state.previous_child_begin[d];
+        std::vector<uint32_t> next(state.previous_child_begin.begin(), state.previous_child_begin.end() - 1);
+        state.previous_children.resize(previous->Size());
+        for (uint32_t i = 0; i < previous->Size(); i++) state.previous_children[next[previous->GetParentDir(i)]++] = i;
+    }
+    uint32_t previous_root = state.previous ? EntryStore::kRootDir : EntryStore::kNoDir;
+
+    for (unsigned i = 0; i < thread_count; i++) {
+        state.queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    state.queues[0]->tasks.push_back({root, EntryStore::kRootDir, previous_root});
+    state.pending = 1;
+    state.queued = 1;
+
+    // The calling thread doubles as worker 0
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < thread_count; i++) {
+        threads.emplace_back([&state, i] {
+            Profiler::SetThreadName("walker " + std::to_string(i));
+            WalkWorker(state, i).Run();
+        });
+    }
+    WalkWorker(state, 0).Run();
+    for (auto& thread : threads) thread.join();
+}
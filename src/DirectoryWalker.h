@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Parallel directory traversal. Every directory is a task on a small work-stealing
+// pool: a worker lists a directory, emits its entries and pushes the subdirectories
+// onto its own deque, where idle workers can steal them.
+//
+// On Linux directories are read in large chunks with getdents64 and d_type, so only
+// regular files and symlinks need a stat call (batched per directory with statx).
+// Other platforms fall back to std::filesystem for the per-directory listing.
+//
+// Given the result of an earlier scan of the same tree, directories whose modification
+// time hasn't changed are not listed again: their entries are copied from the old scan
+// and only their subdirectories are visited. A directory's mtime only moves when entries
+// are added, removed or renamed in it, so sizes of files rewritten in place stay stale
+// until a full rescan.
+//
+// Walks running at the same time, e.g. scans of several roots, share a process-wide limit
+// of one listing in flight per hardware thread, however many threads each one has.
+class DirectoryWalker {
+public:
+    // Called from worker threads, possibly concurrently, with each finished batch.
+    // A directory's record always reaches the sink before any batch containing its children.
+    using BatchSink = std::function<void(ScanBatch&&)>;
+
+    // thread_count == 0 picks one thread per hardware thread
+    explicit DirectoryWalker(unsigned thread_count = 0);
+
+    // Lists `root` (and its subtree if `recursive`) and returns once every worker is done.
+    // The root itself is not emitted. Symlinked directories are reported but not followed,
+    // matching fs::recursive_directory_iterator.
+    // `previous` (optional) must be a finished scan of the same root and mode; records then
+    // carry the index of the entry they correspond to in it.
+    void Run(const std::string& root, bool recursive, const std::atomic<bool>* cancel, const BatchSink& sink,
+             const EntryStore* previous = nullptr);
+
+    unsigned GetThreadCount() const { return m_thread_count; }
+
+    // Clock used for directory mtimes and EntryStore::GetScanTime(), in nanoseconds
+    static int64_t CurrentStamp();
+    // Modification time of `path` on the same clock, 0 if it can't be read
+    static int64_t ReadMTime(const std::string& path);
+
+private:
+    unsigned m_thread_count;
+};
@@ -0,0 +1,248 @@
+#include "DirectoryWatcher.h"
+#include "DirectoryWalker.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include <chrono>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// How often the polling fallback re-reads every directory's mtime
+constexpr auto kPollInterval = std::chrono::seconds(2);
+
+#if defined(__linux__)
+// Anything that changes a directory's listing, plus finished writes so sizes stay current.
+// IN_MODIFY is left out on purpose: it fires for every write() of a file being copied.
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher() {
+#if defined(__linux__)
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotify_fd < 0 || m_wake_fd < 0) m_polling = true;
+#else
+    m_polling = true;
+#endif
+    m_thread = std::thread([this] { Run(); });
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    m_stop = true;
+    Wake();
+    m_thread.join();
+#if defined(__linux__)
+    if (m_inotify_fd >= 0) close(m_inotify_fd);
+    if (m_wake_fd >= 0) close(m_wake_fd);
+#endif
+}
+
+void DirectoryWatcher::WatchTree(std::shared_ptr<const EntryStore> store) {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_tree_queue.push_back(std::move(store));
+    }
+    Wake();
+}
+
+void DirectoryWatcher::Watch(uint32_t dir_id, std::string path, int64_t mtime) {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_queue.push_back({dir_id, std::move(path), mtime});
+    }
+    Wake();
+}
+
+void DirectoryWatcher::TakeChanges(std::vector<uint32_t>& dirs, bool& overflow) {
+    dirs.clear();
+    std::lock_guard<std::mutex> lock(m_changes_mutex);
+    dirs.swap(m_changed);
+    for (uint32_t dir : dirs) m_changed_flags[dir] = false;
+    overflow = m_overflow;
+    m_overflow = false;
+}
+
+bool DirectoryWatcher::HasChanges() const {
+    std::lock_guard<std::mutex> lock(m_changes_mutex);
+    return !m_changed.empty() || m_overflow;
+}
+
+void DirectoryWatcher::Wake() {
+    m_queue_cv.notify_all();
+#if defined(__linux__)
+    if (m_wake_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+#endif
+}
+
+void DirectoryWatcher::MarkChanged(uint32_t dir_id) {
+    {
+        std::lock_guard<std::mutex> lock(m_changes_mutex);
+        if (dir_id >= m_changed_flags.size()) m_changed_flags.resize((size_t)dir_id + 1, false);
+        if (m_changed_flags[dir_id]) return;
+        m_changed_flags[dir_id] = true;
+        m_changed.push_back(dir_id);
+    }
+    RedrawSignal::Request();
+}
+
+void DirectoryWatcher::Run() {
+    Profiler::SetThreadName("watcher");
+    auto next_poll = std::chrono::steady_clock::now() + kPollInterval;
+    while (!m_stop) {
+        std::vector<Registration> queue;
+        std::vector<std::shared_ptr<const EntryStore>> trees;
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            queue.swap(m_queue);
+            trees.swap(m_tree_queue);
+        }
+#if defined(__linux__)
+        // Events from before the registrations were queued go first: the IN_MOVE_SELF of a
+        // folder that was renamed and is being watched again would otherwise drop the new watch,
+        // since inotify hands out the same descriptor for the same directory
+        if (!m_polling && !queue.empty()) ReadEvents();
+#endif
+        for (const auto& tree : trees) RegisterTree(*tree);
+        for (const auto& registration : queue) Register(registration);
+
+        if (m_polling) {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait_until(lock, next_poll, [&] { return m_stop || !m_queue.empty() || !m_tree_queue.empty(); });
+            lock.unlock();
+            if (std::chrono::steady_clock::now() >= next_poll) {
+                PollMTimes();
+                next_poll = std::chrono::steady_clock::now() + kPollInterval;
+            }
+            continue;
+        }
+
+#if defined(__linux__)
+        pollfd fds[2] = {{m_inotify_fd, POLLIN, 0}, {m_wake_fd, POLLIN, 0}};
+        if (poll(fds, 2, 1000) <= 0) continue;
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t ignored = read(m_wake_fd, &count, sizeof(count));
+            (void)ignored;
+        }
+        if (fds[0].revents & POLLIN) ReadEvents();
+#endif
+    }
+}
+
+void DirectoryWatcher::RegisterTree(const EntryStore& store) {
+    for (uint32_t dir = 0; dir < store.GetDirCount() && !m_stop; dir++) {
+        uint32_t entry = store.GetDirEntry(dir);
+        if (dir != EntryStore::kRootDir && entry == EntryStore::kNoEntry) continue;
+        std::string path = dir == EntryStore::kRootDir ? store.GetRootPath() : store.GetPath(entry);
+        Register({dir, std::move(path), store.GetDirMTime(dir)});
+    }
+}
+
+void DirectoryWatcher::Register(const Registration& registration) {
+    WatchedDir dir{registration.path, registration.mtime, -1};
+#if defined(__linux__)
+    if (!m_polling) {
+        int wd = inotify_add_watch(m_inotify_fd, registration.path.c_str(), kWatchMask);
+        if (wd >= 0) {
+            dir.wd = wd;
+            m_wd_dirs[wd] = registration.dir_id;
+        } else if (errno == ENOSPC) {
+            // Out of watches (fs.inotify.max_user_watches): poll everything from here on
+            SwitchToPolling();
+        }
+    }
+#endif
+    // Read after the watch is in place, so a change is caught by one or the other
+    int64_t mtime = DirectoryWalker::ReadMTime(registration.path);
+    if (mtime == 0) return; // gone already; the parent reports it
+    if (mtime != registration.mtime) {
+        dir.mtime = mtime;
+        MarkChanged(registration.dir_id);
+    }
+    m_dirs[registration.dir_id] = std::move(dir);
+}
+
+void DirectoryWatcher::PollMTimes() {
+    PROFILE_SCOPE("DirectoryWatcher::PollMTimes");
+    for (auto it = m_dirs.begin(); it != m_dirs.end() && !m_stop;) {
+        int64_t mtime = DirectoryWalker::ReadMTime(it->second.path);
+        if (mtime != it->second.mtime) MarkChanged(it->first);
+        if (mtime == 0) {
+            it = m_dirs.erase(it);
+            continue;
+        }
+        it->second.mtime = mtime;
+        ++it;
+    }
+}
+
+void DirectoryWatcher::SwitchToPolling() {
+#if defined(__linux__)
+    // Don't lose what's already queued, then drop every watch at once
+    ReadEvents();
+    close(m_inotify_fd);
+    m_inotify_fd = -1;
+    m_wd_dirs.clear();
+    for (auto& entry : m_dirs) entry.second.wd = -1;
+#endif
+    m_polling = true;
+}
+
+#if defined(__linux__)
+void DirectoryWatcher::ReadEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t bytes = read(m_inotify_fd, buffer, sizeof(buffer));
+        PROFILE_COUNT("syscall.inotify_read", 1);
+        if (bytes <= 0) break;
+
+        for (ssize_t pos = 0; pos < bytes;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            pos += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                {
+                    std::lock_guard<std::mutex> lock(m_changes_mutex);
+                    m_overflow = true;
+                }
+                RedrawSignal::Request();
+                continue;
+            }
+
+            auto it = m_wd_dirs.find(event->wd);
+            if (it == m_wd_dirs.end()) continue;
+            uint32_t dir_id = it->second;
+
+            if (event->mask & IN_IGNORED) {
+                // Watch is gone (directory deleted, or removed below)
+                auto dir = m_dirs.find(dir_id);
+                if (dir != m_dirs.end() && dir->second.wd == event->wd) m_dirs.erase(dir);
+                m_wd_dirs.erase(it);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // The parent's own event covers it, except for the root which has no watched parent.
+                // A moved directory shows up as a new one wherever it lands.
+                if (event->mask & IN_MOVE_SELF) inotify_rm_watch(m_inotify_fd, event->wd);
+                if (dir_id == EntryStore::kRootDir) MarkChanged(dir_id);
+                continue;
+            }
+            MarkChanged(dir_id);
+        }
+    }
+}
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Reports which directories of a scanned tree changed, by EntryStore directory id.
+// It only says *where* to look; relisting and merging is up to the caller.
+//
+// On Linux every directory gets an inotify watch. Everywhere else, or once the inotify
+// watch limit is hit, a background thread compares directory mtimes every few seconds
+// instead. Polling can't see files rewritten in place, since that doesn't touch the
+// directory's mtime.
+//
+// Registration happens on the watcher thread: each directory is stat'ed after its watch
+// is in place, and reported right away if it no longer matches the mtime recorded by
+// the scan, so changes made between the scan and the watch aren't lost.
+class DirectoryWatcher {
+public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Watches every directory of `store` (which must not change afterwards, pass a copy)
+    void WatchTree(std::shared_ptr<const EntryStore> store);
+    // Watches one more directory, e.g. one that was just created, or watches it again under a
+    // new path after a rename
+    void Watch(uint32_t dir_id, std::string path, int64_t mtime);
+
+    // Directories changed since the last call, each reported once however many events it got.
+    // `overflow` is set when events were lost and the whole tree needs checking.
+    void TakeChanges(std::vector<uint32_t>& dirs, bool& overflow);
+    // True if TakeChanges() would report anything
+    bool HasChanges() const;
+
+    // Reports `dir_id` as changed, e.g. to retry an update that had to be dropped
+    void MarkChanged(uint32_t dir_id);
+
+    bool IsPolling() const { return m_polling.load(std::memory_order_relaxed); }
+
+private:
+    struct WatchedDir {
+        std::string path;
+        int64_t mtime;
+        int wd; // inotify watch descriptor, -1 when polled
+    };
+    struct Registration {
+        uint32_t dir_id;
+        std::string path;
+        int64_t mtime;
+    };
+
+    void Run();
+    void Register(const Registration& registration);
+    void RegisterTree(const EntryStore& store);
+    void PollMTimes();
+    void SwitchToPolling();
+    void Wake();
+#if defined(__linux__)
+    void ReadEvents();
+#endif
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_polling{false};
+
+    // Queued by the GUI thread, consumed by the watcher thread
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<Registration> m_queue;
+    std::vector<std::shared_ptr<const EntryStore>> m_tree_queue;
+
+    // Watcher thread only
+    std::unordered_map<uint32_t, WatchedDir> m_dirs;
+    std::unordered_map<int, uint32_t> m_wd_dirs;
+    int m_inotify_fd = -1;
+    int m_wake_fd = -1;
+
+    // Results, shared
+    mutable std::mutex m_changes_mutex;
+    std::vector<uint32_t> m_changed;
+    std::vector<bool> m_changed_flags; // by dir id, to coalesce repeats
+    bool m_overflow = false;
+};
@@ -0,0 +1,357 @@
+#include "DuplicateFinder.h"
+#include "IoThreads.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bytes hashed at each end of a file in the first pass; files up to twice this are read whole
+constexpr uint64_t kEdgeBytes = 4096;
+// Block size for full reads: large enough that the per-call cost disappears
+constexpr size_t kReadBlock = 1 << 20;
+
+constexpr uint64_t kPrime1 = 11400714785074694791ull;
+constexpr uint64_t kPrime2 = 14029467366897019727ull;
+constexpr uint64_t kPrime3 = 1609587929392839161ull;
+constexpr uint64_t kPrime4 = 9650029242287828579ull;
+constexpr uint64_t kPrime5 = 2870177450012600261ull;
+
+inline uint64_t RotateLeft(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t Read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    return RotateLeft(acc, 31) * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+    acc ^= Round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+// Streaming XXH64: feed any number of blocks, then Digest()
+class Hasher {
+public:
+    explicit Hasher(uint64_t seed)
+        : m_seed(seed), m_lanes{seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1} {}
+
+    void Update(const void* data, size_t length) {
+        const unsigned char* p = (const unsigned char*)data;
+        const unsigned char* end = p + length;
+        m_total += length;
+        if (m_buffered + length < 32) {
+            std::memcpy(m_buffer + m_buffered, p, length);
+            m_buffered += length;
+            return;
+        }
+        if (m_buffered > 0) {
+            size_t fill = 32 - m_buffered;
+            std::memcpy(m_buffer + m_buffered, p, fill);
+            Stripe(m_buffer);
+            p += fill;
+            m_buffered = 0;
+        }
+        for (; p + 32 <= end; p += 32) Stripe(p);
+        m_buffered = (size_t)(end - p);
+        std::memcpy(m_buffer, p, m_buffered);
+    }
+
+    uint64_t Digest() const {
+        uint64_t h;
+        if (m_total >= 32) {
+            h = RotateLeft(m_lanes[0], 1) + RotateLeft(m_lanes[1], 7) + RotateLeft(m_lanes[2], 12) + RotateLeft(m_lanes[3], 18);
+            for (uint64_t lane : m_lanes) h = MergeRound(h, lane);
+        } else {
+            h = m_seed + kPrime5;
+        }
+        h += m_total;
+
+        const unsigned char* p = m_buffer;
+        const unsigned char* end = m_buffer + m_buffered;
+        for (; p + 8 <= end; p += 8) h = RotateLeft(h ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+        if (p + 4 <= end) {
+            h = RotateLeft(h ^ ((uint64_t)Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        for (; p < end; p++) h = RotateLeft(h ^ (*p * kPrime5), 11) * kPrime1;
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    void Stripe(const unsigned char* p) {
+        for (int lane = 0; lane < 4; lane++) m_lanes[lane] = Round(m_lanes[lane], Read64(p + lane * 8));
+    }
+
+    uint64_t m_seed;
+    uint64_t m_lanes[4];
+    uint64_t m_total = 0;
+    unsigned char m_buffer[32];
+    size_t m_buffered = 0;
+};
+
+// Reads byte ranges of one file; sequential access is announced to the kernel where we can
+class FileReader {
+public:
+#if defined(__linux__)
+    bool Open(const std::string& path, std::string& error) {
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return true;
+    }
+    ~FileReader() {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+    // Reads exactly `length` bytes at `offset`; a short read means the file shrank
+    bool Read(uint64_t offset, char* buffer, size_t length, std::string& error) {
+        while (length > 0) {
+            ssize_t n = ::pread(m_fd, buffer, length, (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                error = std::strerror(errno);
+                return false;
+            }
+            if (n == 0) {
+                error = "changed since the scan";
+                return false;
+            }
+            buffer += n;
+            offset += (uint64_t)n;
+            length -= (size_t)n;
+        }
+        return true;
+    }
+
+private:
+    int m_fd = -1;
+#else
+    bool Open(const std::string& path, std::string& error) {
+        m_stream.open(path, std::ios::binary);
+        if (!m_stream) error = "can't open";
+        return (bool)m_stream;
+    }
+    bool Read(uint64_t offset, char* buffer, size_t length, std::string& error) {
+        m_stream.seekg((std::streamoff)offset);
+        m_stream.read(buffer, (std::streamsize)length);
+        if ((size_t)m_stream.gcount() == length) return true;
+        error = m_stream.eof() ? "changed since the scan" : "read failed";
+        return false;
+    }
+
+private:
+    std::ifstream m_stream;
+#endif
+};
+
+// Hash of the first and last kEdgeBytes, or of the whole file if that's all there is
+bool HashEdges(const DuplicateJob::File& file, std::vector<char>& buffer, uint64_t& hash, std::string& error) {
+    FileReader reader;
+    if (!reader.Open(file.path, error)) return false;
+    size_t length;
+    if (file.size <= 2 * kEdgeBytes) {
+        length = (size_t)file.size;
+        if (!reader.Read(0, buffer.data(), length, error)) return false;
+    } else {
+        length = 2 * kEdgeBytes;
+        if (!reader.Read(0, buffer.data(), kEdgeBytes, error)) return false;
+        if (!reader.Read(file.size - kEdgeBytes, buffer.data() + kEdgeBytes, kEdgeBytes, error)) return false;
+    }
+    hash = DuplicateFinder::Hash(buffer.data(), length, file.size);
+    return true;
+}
+
+bool HashContents(const DuplicateJob::File& file, std::vector<char>& buffer, const std::atomic<bool>& cancel,
+                  std::atomic<uint64_t>& bytes_read, uint64_t& hash, std::string& error) {
+    FileReader reader;
+    if (!reader.Open(file.path, error)) return false;
+    Hasher hasher(file.size);
+    for (uint64_t offset = 0; offset < file.size;) {
+        if (cancel.load(std::memory_order_relaxed)) {
+            error = "cancelled";
+            return false;
+        }
+        size_t length = (size_t)(std::min)((uint64_t)buffer.size(), file.size - offset);
+        if (!reader.Read(offset, buffer.data(), length, error)) return false;
+        hasher.Update(buffer.data(), length);
+        bytes_read.fetch_add(length, std::memory_order_relaxed);
+        PROFILE_COUNT("duplicates.bytes", length);
+        offset += length;
+    }
+    hash = hasher.Digest();
+    return true;
+}
+
+// Hashes job.files[work[k]] into hashes[] on the I/O pool; failed files get ok[] cleared
+template <typename HashFn>
+void HashFiles(DuplicateJob& job, const std::vector<uint32_t>& work, std::vector<uint64_t>& hashes,
+               std::vector<uint8_t>& ok, size_t buffer_bytes, HashFn hash_file) {
+    job.stage_total.store(work.size(), std::memory_order_relaxed);
+    job.stage_done.store(0, std::memory_order_relaxed);
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        std::vector<char> buffer(buffer_bytes);
+        std::string error;
+        for (size_t k; !job.cancel.load(std::memory_order_relaxed) && (k = next.fetch_add(1, std::memory_order_relaxed)) < work.size();) {
+            uint32_t f = work[k];
+            if (hash_file(job.files[f], buffer, hashes[f], error)) {
+                ok[f] = 1;
+            } else if (!job.cancel.load(std::memory_order_relaxed)) {
+                ok[f] = 0;
+                job.failed.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (job.errors.size() < kMaxFileErrors) job.errors.push_back(job.files[f].path + ": " + error);
+            }
+            job.stage_done.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    unsigned thread_count = IoThreadCount(work.size());
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < thread_count; t++) {
+        threads.emplace_back([&, t] {
+            Profiler::SetThreadName("duplicates " + std::to_string(t));
+            worker();
+        });
+    }
+    worker();
+    for (auto& thread : threads) thread.join();
+}
+
+// Runs of two or more files among `files` with the same size and hash
+std::vector<std::vector<uint32_t>> Collisions(const DuplicateJob& job, std::vector<uint32_t> files, const std::vector<uint64_t>& hashes) {
+    std::sort(files.begin(), files.end(), [&](uint32_t a, uint32_t b) {
+        if (job.files[a].size != job.files[b].size) return job.files[a].size < job.files[b].size;
+        if (hashes[a] != hashes[b]) return hashes[a] < hashes[b];
+        return job.files[a].entry < job.files[b].entry;
+    });
+    std::vector<std::vector<uint32_t>> runs;
+    for (size_t begin = 0; begin < files.size();) {
+        size_t end = begin + 1;
+        while (end < files.size() && job.files[files[end]].size == job.files[files[begin]].size && hashes[files[end]] == hashes[files[begin]]) end++;
+        if (end - begin > 1) runs.emplace_back(files.begin() + begin, files.begin() + end);
+        begin = end;
+    }
+    return runs;
+}
+
+} // namespace
+
+uint64_t DuplicateFinder::Hash(const void* data, size_t length, uint64_t seed) {
+    Hasher hasher(seed);
+    hasher.Update(data, length);
+    return hasher.Digest();
+}
+
+std::shared_ptr<DuplicateJob> DuplicateFinder::CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries) {
+    PROFILE_SCOPE("DuplicateFinder::CreateJob");
+    auto job = std::make_shared<DuplicateJob>();
+    std::vector<uint32_t> files;
+    for (uint32_t i : entries) {
+        if (!store.IsDirectory(i) && store.GetSize(i) > 0) files.push_back(i);
+    }
+    job->candidates = files.size();
+    std::stable_sort(files.begin(), files.end(), [&](uint32_t a, uint32_t b) { return store.GetSize(a) < store.GetSize(b); });
+
+    // A size nobody else has can't be a duplicate; no need to even open those
+    for (size_t begin = 0; begin < files.size();) {
+        size_t end = begin + 1;
+        uint64_t size = store.GetSize(files[begin]);
+        while (end < files.size() && store.GetSize(files[end]) == size) end++;
+        if (end - begin > 1) {
+            for (size_t k = begin; k < end; k++) job->files.push_back({files[k], size, store.GetPath(files[k])});
+        }
+        begin = end;
+    }
+    return job;
+}
+
+void DuplicateFinder::Run(std::shared_ptr<DuplicateJob> job) {
+    size_t count = job->files.size();
+    std::vector<uint64_t> hashes(count);
+    std::vector<uint8_t> ok(count, 0);
+
+    // Stage 1: both ends of every file
+    std::vector<uint32_t> work(count);
+    for (uint32_t f = 0; f < count; f++) work[f] = f;
+    {
+        PROFILE_SCOPE("DuplicateFinder::Edges");
+        HashFiles(*job, work, hashes, ok, (size_t)(2 * kEdgeBytes),
+                  [&](const DuplicateJob::File& file, std::vector<char>& buffer, uint64_t& hash, std::string& error) {
+                      if (!HashEdges(file, buffer, hash, error)) return false;
+                      job->bytes_read.fetch_add((std::min)(file.size, 2 * kEdgeBytes), std::memory_order_relaxed);
+                      return true;
+                  });
+    }
+
+    // Collisions among small files are final; bigger ones go on to a full read
+    std::vector<std::vector<uint32_t>> groups;
+    work.clear();
+    std::vector<uint32_t> hashed;
+    for (uint32_t f = 0; f < count; f++) {
+        if (ok[f]) hashed.push_back(f);
+    }
+    for (auto& run : Collisions(*job, std::move(hashed), hashes)) {
+        if (job->files[run[0]].size <= 2 * kEdgeBytes) groups.push_back(std::move(run));
+        else work.insert(work.end(), run.begin(), run.end());
+    }
+
+    // Stage 2: full contents, biggest files first so one huge file doesn't finish alone at the end
+    if (!work.empty() && !job->cancel.load(std::memory_order_relaxed)) {
+        PROFILE_SCOPE("DuplicateFinder::Contents");
+        job->stage.store(DuplicateJob::kContents, std::memory_order_relaxed);
+        std::stable_sort(work.begin(), work.end(), [&](uint32_t a, uint32_t b) { return job->files[a].size > job->files[b].size; });
+        HashFiles(*job, work, hashes, ok, kReadBlock,
+                  [&](const DuplicateJob::File& file, std::vector<char>& buffer, uint64_t& hash, std::string& error) {
+                      return HashContents(file, buffer, job->cancel, job->bytes_read, hash, error);
+                  });
+        std::vector<uint32_t> full;
+        for (uint32_t f : work) {
+            if (ok[f]) full.push_back(f);
+        }
+        for (auto& run : Collisions(*job, std::move(full), hashes)) groups.push_back(std::move(run));
+    }
+
+    if (!job->cancel.load(std::memory_order_relaxed)) {
+        job->groups.reserve(groups.size());
+        for (const auto& run : groups) {
+            DuplicateGroup group;
+            group.size = job->files[run[0]].size;
+            for (uint32_t f : run) group.entries.push_back(job->files[f].entry);
+            job->groups.push_back(std::move(group));
+        }
+        std::stable_sort(job->groups.begin(), job->groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+            return a.GetWastedBytes() > b.GetWastedBytes();
+        });
+    }
+    job->done.store(true, std::memory_order_release);
+}
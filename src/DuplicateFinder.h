@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Files with identical contents: all the same size, entries in ascending index order
+struct DuplicateGroup {
+    uint64_t size = 0;
+    std::vector<uint32_t> entries;
+
+    uint64_t GetWastedBytes() const { return size * (entries.size() - 1); }
+};
+
+// Shared state between the caller and DuplicateFinder::Run(). The caller fills `files` through
+// DuplicateFinder::CreateJob() and only reads the counters until `done` is set.
+struct DuplicateJob {
+    enum Stage : int { kEdges, kContents };
+
+    struct File {
+        uint32_t entry;
+        uint64_t size;
+        std::string path;
+    };
+
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    std::vector<File> files;         // only sizes shared by two or more files, grouped by size
+    size_t candidates = 0;           // non-empty files looked at
+
+    std::atomic<int> stage{kEdges};
+    std::atomic<size_t> stage_total{0};
+    std::atomic<size_t> stage_done{0};
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<size_t> failed{0};
+
+    std::mutex mutex;
+    std::vector<std::string> errors; // "path: reason", drained by the caller, capped
+
+    // Written by Run() before `done`; largest waste first
+    std::vector<DuplicateGroup> groups;
+};
+
+// Finds files with identical contents in stages, so that as little as possible is read:
+//
+//   1. Files are grouped by size and sizes nobody else has are dropped, without any I/O.
+//   2. The first and last 4 KB of each remaining file are hashed; files that no longer share
+//      (size, hash) with anyone are dropped. Files up to 8 KB are settled here.
+//   3. Only files that still collide are read in full, sequentially in 1 MB blocks.
+//
+// Reads run on a small pool of I/O threads, which is enough to keep an SSD's queue busy
+// without turning a spinning disk into a seek storm. Hashes are 64-bit (XXH64), so a false
+// match needs a collision between two files of the same size with the same edges.
+class DuplicateFinder {
+public:
+    // Files among `entries` sharing their size with another file. Folders and empty files are
+    // skipped. Paths are built here, so the store can change once this returns.
+    static std::shared_ptr<DuplicateJob> CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries);
+
+    // Runs the hashing stages on the calling thread plus the I/O pool, then sets `done`
+    static void Run(std::shared_ptr<DuplicateJob> job);
+
+    static uint64_t Hash(const void* data, size_t length, uint64_t seed = 0);
+};
@@ -0,0 +1,104 @@
+#include "EntryBitset.h"
+#include <algorithm>
+
+namespace {
+
+// Bits [begin, end) of one word, 0 <= begin < end <= 64
+inline uint64_t WordMask(uint32_t begin, uint32_t end) {
+    uint64_t high = end == 64 ? ~0ull : (1ull << end) - 1;
+    return high & (~0ull << begin);
+}
+
+// Plain loops over whole words; compilers turn these into vector code
+uint64_t CountWords(const uint64_t* words, size_t count) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) total += EntryBitset::PopCount(words[i]);
+    return total;
+}
+
+} // namespace
+
+void EntryBitset::Resize(uint32_t size) {
+    // Dropped bits leave the count, and their words must read as zero if the set grows again
+    if (size < m_size) SetRange(size, m_size, false);
+    m_words.resize(((size_t)size + 63) / 64, 0);
+    m_size = size;
+}
+
+void EntryBitset::Clear() {
+    m_words.clear();
+    m_size = 0;
+    m_count = 0;
+}
+
+void EntryBitset::SetRange(uint32_t begin, uint32_t end, bool on) {
+    end = (std::min)(end, m_size);
+    if (begin >= end) return;
+    if (begin == 0 && end == m_size) {
+        // Everything: no need to count what was there
+        std::fill(m_words.begin(), m_words.end(), on ? ~0ull : 0ull);
+        if (on && (m_size & 63)) m_words.back() = WordMask(0, m_size & 63);
+        m_count = on ? m_size : 0;
+        return;
+    }
+    size_t first = begin >> 6;
+    size_t last = (end - 1) >> 6;
+
+    auto apply = [&](uint64_t& word, uint64_t mask) {
+        m_count -= PopCount(word & mask);
+        if (on) {
+            word |= mask;
+            m_count += PopCount(mask);
+        } else {
+            word &= ~mask;
+        }
+    };
+
+    if (first == last) {
+        apply(m_words[first], WordMask(begin & 63, ((end - 1) & 63) + 1));
+        return;
+    }
+    apply(m_words[first], WordMask(begin & 63, 64));
+    // Whole words in between: count what was there, then fill
+    uint64_t* inner = m_words.data() + first + 1;
+    size_t inner_count = last - first - 1;
+    m_count -= (uint32_t)CountWords(inner, inner_count);
+    std::fill_n(inner, inner_count, on ? ~0ull : 0ull);
+    if (on) m_count += (uint32_t)(inner_count * 64);
+    apply(m_words[last], WordMask(0, ((end - 1) & 63) + 1));
+}
+
+void EntryBitset::SetRangeWhereClear(uint32_t begin, uint32_t end, const EntryBitset& mask) {
+    end = (std::min)(end, m_size);
+    if (begin >= end) return;
+    size_t first = begin >> 6;
+    size_t last = (end - 1) >> 6;
+    const uint64_t* masked = mask.m_words.data();
+
+    uint64_t added = 0;
+    auto apply = [&](size_t w, uint64_t range) {
+        uint64_t bits = range & ~masked[w];
+        added += PopCount(bits & ~m_words[w]);
+        m_words[w] |= bits;
+    };
+
+    if (first == last) {
+        apply(first, WordMask(begin & 63, ((end - 1) & 63) + 1));
+    } else {
+        apply(first, WordMask(begin & 63, 64));
+        uint64_t* words = m_words.data();
+        for (size_t w = first + 1; w < last; w++) {
+            uint64_t bits = ~masked[w];
+            added += PopCount(bits & ~words[w]);
+            words[w] |= bits;
+        }
+        apply(last, WordMask(0, ((end - 1) & 63) + 1));
+    }
+    m_count += (uint32_t)added;
+}
+
+uint32_t EntryBitset::CountAndNot(const EntryBitset& mask) const {
+    uint64_t total = 0;
+    for (size_t w = 0; w < m_words.size(); w++) total += PopCount(m_words[w] & ~mask.m_words[w]);
+    return (uint32_t)total;
+}
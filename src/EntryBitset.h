@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// One bit per entry, packed into 64-bit words, with a running count of the set bits.
+// Range updates work a word at a time (the inside of a range is a plain fill), so
+// selecting or clearing ten million entries touches ~150k words, not ten million bytes.
+// Bits past Size() are always zero, which lets the combined operations skip edge checks.
+class EntryBitset {
+public:
+    uint32_t Size() const { return m_size; }
+    uint32_t Count() const { return m_count; }
+    bool Test(uint32_t index) const { return (m_words[index >> 6] >> (index & 63)) & 1; }
+
+    void Set(uint32_t index, bool on) {
+        uint64_t& word = m_words[index >> 6];
+        uint64_t bit = 1ull << (index & 63);
+        if (((word & bit) != 0) == on) return;
+        word ^= bit;
+        if (on) m_count++;
+        else m_count--;
+    }
+
+    // Grown bits start clear
+    void Resize(uint32_t size);
+    void Clear();
+
+    void SetRange(uint32_t begin, uint32_t end, bool on);
+    void SetAll(bool on) { SetRange(0, m_size, on); }
+    // Sets the bits in [begin, end) that are clear in `mask`
+    void SetRangeWhereClear(uint32_t begin, uint32_t end, const EntryBitset& mask);
+    // Number of bits set here and clear in `mask`
+    uint32_t CountAndNot(const EntryBitset& mask) const;
+
+    // Visits set bits in ascending order, skipping empty words
+    template <typename Fn>
+    void ForEachSet(Fn&& fn) const {
+        for (size_t w = 0; w < m_words.size(); w++) {
+            for (uint64_t bits = m_words[w]; bits; bits &= bits - 1) fn((uint32_t)(w * 64 + LowestBit(bits)));
+        }
+    }
+    // Same, for bits set here and clear in `mask` (which must be the same size)
+    template <typename Fn>
+    void ForEachSetAndNot(const EntryBitset& mask, Fn&& fn) const {
+        for (size_t w = 0; w < m_words.size(); w++) {
+            for (uint64_t bits = m_words[w] & ~mask.m_words[w]; bits; bits &= bits - 1) fn((uint32_t)(w * 64 + LowestBit(bits)));
+        }
+    }
+
+    size_t GetMemoryBytes() const { return m_words.capacity() * sizeof(uint64_t); }
+
+    static unsigned PopCount(uint64_t word) {
+        // The instruction only when the build targets it; the portable fallback still vectorizes
+#if defined(__POPCNT__)
+        return (unsigned)__builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__)
+        return (unsigned)__popcnt64(word);
+#else
+        word = word - ((word >> 1) & 0x5555555555555555ull);
+        word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+        word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return (unsigned)((word * 0x0101010101010101ull) >> 56);
+#endif
+    }
+
+private:
+    static unsigned LowestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return (unsigned)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (unsigned long)word)) return (unsigned)index;
+        _BitScanForward(&index, (unsigned long)(word >> 32));
+        return (unsigned)index + 32;
+#else
+        return (unsigned)__builtin_ctzll(word);
+#endif
+    }
+
+    std::vector<uint64_t> m_words;
+    uint32_t m_size = 0;
+    uint32_t m_count = 0;
+};
@@ -0,0 +1,602 @@
+#include "EntryQuery.h"
+#include "MetadataFetcher.h"
+#include "NameIndex.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+namespace {
+
+// Entries per work item for FindMatches; threads pull chunks until none are left
+constexpr uint32_t kMatchChunk = 1 << 16;
+// Distinct names per thread when running name regexes up front
+constexpr size_t kNamesPerThread = 1 << 14;
+// Shorter literals have no trigrams, so the index would scan every name anyway
+constexpr size_t kMinPrefilter = 3;
+
+struct Token {
+    std::string text;
+    size_t quoted_from = std::string::npos; // text from here on was inside quotes
+};
+
+inline unsigned char FoldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c;
+}
+
+inline bool SameChar(char a, char b, bool case_sensitive) {
+    return case_sensitive ? a == b : FoldAscii((unsigned char)a) == FoldAscii((unsigned char)b);
+}
+
+bool SameText(std::string_view a, std::string_view b, bool case_sensitive) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!SameChar(a[i], b[i], case_sensitive)) return false;
+    }
+    return true;
+}
+
+// Splits on whitespace outside double quotes; the quotes themselves are dropped
+bool Tokenize(std::string_view text, std::vector<Token>& out, std::string& error) {
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == ' ' || text[i] == '\t') {
+            i++;
+            continue;
+        }
+        Token token;
+        bool in_quotes = false;
+        for (; i < text.size() && (in_quotes || (text[i] != ' ' && text[i] != '\t')); i++) {
+            if (text[i] == '"') {
+                in_quotes = !in_quotes;
+                if (in_quotes && token.quoted_from == std::string::npos) token.quoted_from = token.text.size();
+                continue;
+            }
+            token.text += text[i];
+        }
+        if (in_quotes) {
+            error = "Unclosed quote";
+            return false;
+        }
+        out.push_back(std::move(token));
+    }
+    return true;
+}
+
+bool IsGlob(std::string_view text) {
+    return text.find_first_of("*?[") != std::string_view::npos;
+}
+
+// Longest run of the glob that every matching name contains as is
+std::string LongestLiteral(std::string_view glob) {
+    std::string best, current;
+    auto flush = [&] {
+        if (current.size() > best.size()) best = current;
+        current.clear();
+    };
+    for (size_t i = 0; i < glob.size(); i++) {
+        char c = glob[i];
+        if (c == '*' || c == '?') {
+            flush();
+        } else if (c == '[') {
+            flush();
+            size_t close = glob.find(']', i + 2);
+            if (close != std::string_view::npos) i = close;
+        } else if (c == '\\' && i + 1 < glob.size()) {
+            current += glob[++i];
+        } else {
+            current += c;
+        }
+    }
+    flush();
+    return best;
+}
+
+// One glob element at `g` against `c`; sets `next` past the element
+bool MatchElement(std::string_view glob, size_t g, char c, bool case_sensitive, size_t& next) {
+    char p = glob[g];
+    if (p == '?') {
+        next = g + 1;
+        return true;
+    }
+    if (p == '[') {
+        size_t i = g + 1;
+        bool invert = i < glob.size() && (glob[i] == '!' || glob[i] == '^');
+        if (invert) i++;
+        // A ']' right at the start is part of the class
+        size_t close = glob.find(']', i + 1);
+        if (close != std::string_view::npos) {
+            bool found = false;
+            for (; i < close; i++) {
+                if (i + 2 < close && glob[i + 1] == '-') {
+                    unsigned char lo = (unsigned char)glob[i], hi = (unsigned char)glob[i + 2];
+                    unsigned char x = (unsigned char)c;
+                    if (x >= lo && x <= hi) found = true;
+                    if (!case_sensitive) {
+                        x = FoldAscii(x);
+                        unsigned char upper = (x >= 'a' && x <= 'z') ? (unsigned char)(x - 32) : x;
+                        if ((x >= lo && x <= hi) || (upper >= lo && upper <= hi)) found = true;
+                    }
+                    i += 2;
+                } else if (SameChar(glob[i], c, case_sensitive)) {
+                    found = true;
+                }
+            }
+            next = close + 1;
+            return found != invert;
+        }
+        // No closing bracket: a plain '['
+    }
+    if (p == '\\' && g + 1 < glob.size()) {
+        next = g + 2;
+        return SameChar(glob[g + 1], c, case_sensitive);
+    }
+    next = g + 1;
+    return SameChar(p, c, case_sensitive);
+}
+
+// "100M", "1.5G", "512", "4KB", "2KiB"
+bool ParseSize(std::string_view text, uint64_t& out) {
+    size_t i = 0;
+    uint64_t whole = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+        if (whole > (UINT64_MAX - 9) / 10) return false;
+        whole = whole * 10 + (uint64_t)(text[i++] - '0');
+    }
+    if (i == 0) return false;
+    double fraction = 0;
+    if (i < text.size() && text[i] == '.') {
+        double scale = 0.1;
+        for (i++; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++, scale /= 10) fraction += (text[i] - '0') * scale;
+    }
+
+    int shift = 0;
+    if (i < text.size()) {
+        switch (FoldAscii((unsigned char)text[i])) {
+        case 'k': shift = 10; break;
+        case 'm': shift = 20; break;
+        case 'g': shift = 30; break;
+        case 't': shift = 40; break;
+        case 'b': break;
+        default: return false;
+        }
+        i++;
+        if (shift && i < text.size() && FoldAscii((unsigned char)text[i]) == 'i') i++;
+        if (shift && i < text.size() && FoldAscii((unsigned char)text[i]) == 'b') i++;
+    }
+    if (i != text.size()) return false;
+    if (shift && whole > (UINT64_MAX >> shift) - 1) return false;
+    out = (whole << shift) + (uint64_t)(fraction * (double)(1ull << shift));
+    return true;
+}
+
+// "30d", "1.5y", "12h", "2w"
+bool ParseAge(std::string_view text, int64_t& out) {
+    constexpr int64_t kHour = 3600ll * 1000000000;
+    size_t unit = text.find_first_not_of("0123456789.");
+    if (unit == 0 || unit == std::string_view::npos || unit + 1 != text.size()) return false;
+    int64_t scale = 0;
+    switch (FoldAscii((unsigned char)text[unit])) {
+    case 'h': scale = kHour; break;
+    case 'd': scale = 24 * kHour; break;
+    case 'w': scale = 7 * 24 * kHour; break;
+    case 'y': scale = 365 * 24 * kHour; break;
+    default: return false;
+    }
+    double number = 0;
+    size_t used = 0;
+    try {
+        number = std::stod(std::string(text.substr(0, unit)), &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (used != unit || number * (double)scale > 9e18) return false;
+    out = (int64_t)(number * (double)scale);
+    return true;
+}
+
+// "2024-01-31" -> [start, end) of that day in local time, in nanoseconds since the epoch
+bool ParseDay(std::string_view text, int64_t& start, int64_t& end) {
+    int year = 0, month = 0, day = 0;
+    char tail = 0;
+    if (text.size() != 10 || std::sscanf(std::string(text).c_str(), "%4d-%2d-%2d%c", &year, &month, &day, &tail) != 3) return false;
+    if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+    // Days aren't always 24 hours long; mktime knows where the next one starts
+    auto midnight = [&](int days_later) {
+        std::tm local{};
+        local.tm_year = year - 1900;
+        local.tm_mon = month - 1;
+        local.tm_mday = day + days_later;
+        local.tm_isdst = -1;
+        return std::mktime(&local);
+    };
+    std::time_t begin = midnight(0);
+    std::time_t next = midnight(1);
+    if (begin == (std::time_t)-1 || next == (std::time_t)-1) return false;
+    start = (int64_t)begin * 1000000000;
+    end = (int64_t)next * 1000000000;
+    return true;
+}
+
+// "size>=100M": the operator after `name` ('<', 'l' for <=, '>', 'g' for >=, '=') and the value
+bool SplitComparison(std::string_view term, std::string_view name, char& op, std::string_view& value) {
+    if (term.size() <= name.size() || term.substr(0, name.size()) != name) return false;
+    op = term[name.size()];
+    if (std::string_view("<>=").find(op) == std::string_view::npos) return false;
+    value = term.substr(name.size() + 1);
+    if (!value.empty() && value[0] == '=' && op != '=') {
+        op = op == '<' ? 'l' : 'g';
+        value.remove_prefix(1);
+    }
+    return true;
+}
+
+bool RegexSearch(const std::regex& regex, std::string_view text) {
+    try {
+        return std::regex_search(text.data(), text.data() + text.size(), regex);
+    } catch (const std::regex_error&) {
+        return false; // pathological backtracking; treat as no match
+    }
+}
+
+// Splits [0, count) into ranges for the available cores, at most one per `min_per_thread`
+template <typename Fn>
+void ParallelRanges(size_t count, size_t min_per_thread, Fn&& fn) {
+    size_t thread_count = (std::min)((size_t)(std::max)(1u, std::thread::hardware_concurrency()), count / min_per_thread + 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < thread_count; t++) threads.emplace_back([&, t] { fn(count * t / thread_count, count * (t + 1) / thread_count); });
+    fn(0, count / thread_count);
+    for (auto& thread : threads) thread.join();
+}
+
+bool StartsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+bool EntryQuery::Parse(std::string_view text, bool case_sensitive, std::string& error) {
+    std::vector<Token> tokens;
+    if (!Tokenize(text, tokens, error)) return false;
+
+    std::vector<Check> checks;
+    auto regex_check = [&](CheckKind kind, const std::string& pattern, Check& check) {
+        if (pattern.empty()) {
+            error = "Empty regex";
+            return false;
+        }
+        try {
+            auto flags = std::regex::ECMAScript | (case_sensitive ? std::regex::flag_type() : std::regex::icase);
+            check.regex = std::make_shared<const std::regex>(pattern, flags);
+        } catch (const std::regex_error& e) {
+            error = "Invalid regex " + pattern + ": " + e.what();
+            return false;
+        }
+        check.kind = kind;
+        return true;
+    };
+
+    for (Token& token : tokens) {
+        Check check;
+        std::string_view term = token.text;
+        size_t plain = token.quoted_from; // length of the leading unquoted part
+        if (plain > 0 && !term.empty() && term[0] == '!') {
+            check.negate = true;
+            term.remove_prefix(1);
+            if (plain != std::string::npos) plain--;
+        }
+        if (term.empty()) {
+            error = "Nothing after !";
+            return false;
+        }
+        // Keywords only count when they aren't inside quotes
+        auto keyword = [&](std::string_view prefix) { return plain >= prefix.size() && StartsWith(term, prefix); };
+        std::string_view value;
+
+        if (keyword("type:")) {
+            std::string_view value = term.substr(5);
+            if (value == "file" || value == "f") check.directory = false;
+            else if (value == "dir" || value == "d" || value == "folder") check.directory = true;
+            else {
+                error = "type: takes file or dir";
+                return false;
+            }
+            check.kind = CheckKind::Type;
+        } else if (keyword("size") && SplitComparison(term, "size", check.op, value)) {
+            if (!ParseSize(value, check.size)) {
+                error = "size needs a number like 100M, not \"" + std::string(value) + "\"";
+                return false;
+            }
+            check.kind = CheckKind::Size;
+        } else if (keyword("age") && SplitComparison(term, "age", check.op, value)) {
+            int64_t age = 0;
+            if (check.op == '=' || !ParseAge(value, age)) {
+                error = "age needs < or > and a time like 30d (h, d, w, y), not \"" + std::string(term.substr(3)) + "\"";
+                return false;
+            }
+            // Older than the age means modified before this point, and the other way around
+            int64_t now = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            int64_t point = now - age;
+            switch (check.op) {
+            case '>': check.before = point; break;
+            case 'g': check.before = point + 1; break;
+            case '<': check.after = point + 1; break;
+            default: check.after = point; break;
+            }
+            check.kind = CheckKind::Modified;
+        } else if (keyword("modified") && SplitComparison(term, "modified", check.op, value)) {
+            int64_t start = 0, end = 0;
+            if (!ParseDay(value, start, end)) {
+                error = "modified needs a date like 2024-01-31, not \"" + std::string(value) + "\"";
+                return false;
+            }
+            switch (check.op) {
+            case '<': check.before = start; break;
+            case 'l': check.before = end; break;
+            case '>': check.after = end; break;
+            case 'g': check.after = start; break;
+            default: check.after = start; check.before = end; break;
+            }
+            check.kind = CheckKind::Modified;
+        } else if (keyword("owner:")) {
+            if (!MetadataFetcher::FindOwner(term.substr(6), check.id)) {
+                error = "Unknown user \"" + std::string(term.substr(6)) + "\"";
+                return false;
+            }
+            check.kind = CheckKind::Owner;
+        } else if (keyword("perm:")) {
+            value = term.substr(5);
+            if (value.empty() || value.size() > 4 || value.find_first_not_of("01234567") != std::string_view::npos) {
+                error = "perm: takes octal bits like 644, not \"" + std::string(value) + "\"";
+                return false;
+            }
+            check.id = (uint32_t)std::stoul(std::string(value), nullptr, 8);
+            check.kind = CheckKind::Permissions;
+        } else if (keyword("ext:")) {
+            std::string_view list = term.substr(4);
+            while (!list.empty()) {
+                size_t comma = list.find(',');
+                std::string_view ext = list.substr(0, comma);
+                if (!ext.empty() && ext[0] == '.') ext.remove_prefix(1);
+                if (!ext.empty()) check.extensions.emplace_back(ext);
+                list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            }
+            if (check.extensions.empty()) {
+                error = "ext: needs an extension, e.g. ext:jpg,png";
+                return false;
+            }
+            check.kind = CheckKind::Extension;
+        } else if (keyword("re:")) {
+            if (!regex_check(CheckKind::NameRegex, std::string(term.substr(3)), check)) return false;
+        } else if (keyword("path:")) {
+            if (!regex_check(CheckKind::PathRegex, std::string(term.substr(5)), check)) return false;
+        } else if (token.quoted_from == std::string::npos && IsGlob(term)) {
+            check.kind = CheckKind::Glob;
+            check.text = std::string(term);
+        } else {
+            check.kind = CheckKind::Substring;
+            check.text = std::string(term);
+        }
+        checks.push_back(std::move(check));
+    }
+
+    std::stable_sort(checks.begin(), checks.end(), [](const Check& a, const Check& b) { return a.kind < b.kind; });
+
+    // The longest literal every match contains; only positive terms promise one
+    std::string prefilter;
+    for (const Check& check : checks) {
+        if (check.negate) continue;
+        std::string literal;
+        if (check.kind == CheckKind::Substring) literal = check.text;
+        else if (check.kind == CheckKind::Glob) literal = LongestLiteral(check.text);
+        else if (check.kind == CheckKind::Extension && check.extensions.size() == 1) literal = "." + check.extensions[0];
+        if (literal.size() > prefilter.size()) prefilter = std::move(literal);
+    }
+
+    m_checks = std::move(checks);
+    m_case_sensitive = case_sensitive;
+    m_prefilter = prefilter.size() >= kMinPrefilter ? std::move(prefilter) : std::string();
+    return true;
+}
+
+bool EntryQuery::NeedsMetadata() const {
+    for (const Check& check : m_checks) {
+        if (IsMetadataCheck(check.kind)) return true;
+    }
+    return false;
+}
+
+bool EntryQuery::IsPlainSubstring() const {
+    return m_checks.size() == 1 && m_checks[0].kind == CheckKind::Substring && !m_checks[0].negate;
+}
+
+bool EntryQuery::GlobMatch(std::string_view name, std::string_view glob, bool case_sensitive) {
+    // Greedy with one backtrack point: on a mismatch, the last '*' takes one more character
+    size_t n = 0, g = 0;
+    size_t star = std::string_view::npos, star_n = 0;
+    while (n < name.size()) {
+        if (g < glob.size()) {
+            if (glob[g] == '*') {
+                star = ++g;
+                star_n = n;
+                continue;
+            }
+            size_t next;
+            if (MatchElement(glob, g, name[n], case_sensitive, next)) {
+                g = next;
+                n++;
+                continue;
+            }
+        }
+        if (star == std::string_view::npos) return false;
+        g = star;
+        n = ++star_n;
+    }
+    while (g < glob.size() && glob[g] == '*') g++;
+    return g == glob.size();
+}
+
+bool EntryQuery::PassesName(const Check& check, std::string_view name) const {
+    bool pass = false;
+    switch (check.kind) {
+    case CheckKind::Extension: {
+        // A suffix after a dot, so "tar.gz" works too. Dot files (".bashrc") are all name, no
+        // extension: the dot can't be the first character.
+        for (const std::string& wanted : check.extensions) {
+            if (name.size() < wanted.size() + 2) continue;
+            size_t dot = name.size() - wanted.size() - 1;
+            if (name[dot] == '.' && SameText(name.substr(dot + 1), wanted, m_case_sensitive)) {
+                pass = true;
+                break;
+            }
+        }
+        break;
+    }
+    case CheckKind::Substring:
+        pass = NameIndex::Contains(name, check.text, m_case_sensitive);
+        break;
+    case CheckKind::Glob:
+        pass = GlobMatch(name, check.text, m_case_sensitive);
+        break;
+    default:
+        pass = RegexSearch(*check.regex, name);
+        break;
+    }
+    return pass != check.negate;
+}
+
+bool EntryQuery::Passes(const Check& check, const EntryStore& store, uint32_t index) const {
+    bool pass = false;
+    switch (check.kind) {
+    case CheckKind::Type:
+        pass = store.IsDirectory(index) == check.directory;
+        break;
+    case CheckKind::Size: {
+        uint64_t size = store.GetTotalSize(index);
+        switch (check.op) {
+        case '<': pass = size < check.size; break;
+        case 'l': pass = size <= check.size; break;
+        case '>': pass = size > check.size; break;
+        case 'g': pass = size >= check.size; break;
+        default: pass = size == check.size; break;
+        }
+        break;
+    }
+    case CheckKind::Modified:
+    case CheckKind::Owner:
+    case CheckKind::Permissions: {
+        // Unknown either way, so the entry stays out until its metadata arrives
+        if (!store.HasMetadata(index)) return false;
+        const EntryMetadata& meta = store.GetMetadata(index);
+        if (check.kind == CheckKind::Modified) pass = meta.mtime >= check.after && meta.mtime < check.before;
+        else if (check.kind == CheckKind::Owner) pass = meta.uid == check.id;
+        else pass = (meta.mode & 07777) == check.id;
+        break;
+    }
+    case CheckKind::PathRegex:
+        pass = RegexSearch(*check.regex, store.GetPath(index));
+        break;
+    default:
+        return PassesName(check, store.GetName(index));
+    }
+    return pass != check.negate;
+}
+
+bool EntryQuery::Matches(const EntryStore& store, uint32_t index) const {
+    for (const Check& check : m_checks) {
+        if (!Passes(check, store, index)) return false;
+    }
+    return true;
+}
+
+void EntryQuery::FindMatches(const EntryStore& store, const NameIndex& index, std::vector<uint32_t>& out) const {
+    PROFILE_SCOPE("EntryQuery::FindMatches");
+    out.clear();
+    uint32_t count = store.Size();
+
+    // Names that can match, as one bit per arena byte at their offsets. With only literal
+    // checks that's the names containing the prefilter literal. A name regex is run here too,
+    // once per distinct name, with the other name checks in front of it; the entry loop then
+    // only looks at the columns and the bit.
+    const NamePool& pool = store.GetNamePool();
+    bool has_name_regex = false;
+    for (const Check& check : m_checks) has_name_regex |= check.kind == CheckKind::NameRegex;
+    std::vector<uint64_t> name_bits;
+    if (!m_prefilter.empty() || has_name_regex) {
+        std::vector<uint32_t> names;
+        if (!m_prefilter.empty()) {
+            index.FindNames(pool, m_prefilter, m_case_sensitive, names);
+        } else {
+            for (size_t offset = 0; offset < pool.GetArenaBytes(); offset += std::strlen(pool.CStr((uint32_t)offset)) + 1) {
+                names.push_back((uint32_t)offset);
+            }
+        }
+        if (has_name_regex) {
+            std::vector<uint8_t> pass(names.size());
+            ParallelRanges(names.size(), kNamesPerThread, [&](size_t begin, size_t end) {
+                for (size_t n = begin; n < end; n++) {
+                    const char* name = pool.CStr(names[n]);
+                    std::string_view view(name, std::strlen(name));
+                    pass[n] = 1;
+                    for (const Check& check : m_checks) {
+                        if (IsNameCheck(check.kind) && !PassesName(check, view)) {
+                            pass[n] = 0;
+                            break;
+                        }
+                    }
+                }
+            });
+            size_t out = 0;
+            for (size_t n = 0; n < names.size(); n++) {
+                if (pass[n]) names[out++] = names[n];
+            }
+            names.resize(out);
+        }
+        if (names.empty()) return;
+        name_bits.resize(pool.GetArenaBytes() / 64 + 1);
+        for (uint32_t offset : names) name_bits[offset >> 6] |= 1ull << (offset & 63);
+    }
+    // The name bits go after the column checks, which don't touch the names at all
+    size_t literal_begin = 0;
+    while (literal_begin < m_checks.size() && m_checks[literal_begin].kind < CheckKind::Extension) literal_begin++;
+
+    size_t chunks = ((size_t)count + kMatchChunk - 1) / kMatchChunk;
+    std::vector<std::vector<uint32_t>> results(chunks);
+    std::atomic<size_t> next_chunk{0};
+    auto work = [&] {
+        for (size_t chunk; (chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+            std::vector<uint32_t>& matches = results[chunk];
+            uint32_t end = (uint32_t)(std::min)((size_t)count, (chunk + 1) * kMatchChunk);
+            for (uint32_t i = (uint32_t)(chunk * kMatchChunk); i < end; i++) {
+                size_t c = 0;
+                for (; c < literal_begin; c++) {
+                    if (!Passes(m_checks[c], store, i)) break;
+                }
+                if (c < literal_begin) continue;
+                if (!name_bits.empty()) {
+                    uint32_t offset = store.GetNameOffset(i);
+                    if (!((name_bits[offset >> 6] >> (offset & 63)) & 1)) continue;
+                }
+                for (; c < m_checks.size(); c++) {
+                    if (has_name_regex && IsNameCheck(m_checks[c].kind)) continue; // settled by the bit
+                    if (!Passes(m_checks[c], store, i)) break;
+                }
+                if (c == m_checks.size()) matches.push_back(i);
+            }
+        }
+    };
+    size_t thread_count = (std::min)((size_t)(std::max)(1u, std::thread::hardware_concurrency()), chunks);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < thread_count; t++) threads.emplace_back(work);
+    work();
+    for (auto& thread : threads) thread.join();
+
+    size_t total = 0;
+    for (const auto& matches : results) total += matches.size();
+    out.reserve(total);
+    for (const auto& matches : results) out.insert(out.end(), matches.begin(), matches.end());
+}
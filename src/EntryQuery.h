@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "EntryStore.h"
+
+class NameIndex;
+
+// Filter queries, parsed once into a list of checks. Every term has to hold:
+//
+//   report          name contains "report"         "two words"   quoted, spaces included
+//   *.log  IMG_??   glob over the whole name, with [abc], [a-z] and [!abc] classes
+//   ext:jpg,png     extension is one of these; ext:tar.gz matches a whole dotted suffix
+//   size>100M       also >= < <= =; K, M, G, T are powers of 1024, "1.5G" works;
+//                   a folder's size is everything below it
+//   type:file       or type:dir (f and d for short)
+//   age>30d         modified longer ago than that; also < >= <=, with h, d, w or y
+//   modified<2024-01-31   modified before that day (local time); also > >= <= =
+//   owner:alice     owned by that user (or uid)
+//   perm:644        permission bits, in octal, are exactly these
+//   re:^\d+\.txt$   regex (ECMAScript) searched in the name
+//   path:src/.*\.h  regex searched in the full path
+//   !term           any of the above, negated
+//
+// Case sensitivity covers names, globs, extensions and both regex kinds. Age, date, owner and
+// permission terms need the extended metadata (see MetadataFetcher); entries that don't have
+// it yet match none of them, negated or not.
+//
+// Checks run cheapest first: type and size read one column, then the literal checks, then
+// the regexes, with path ones last since they rebuild the path. When every match has to
+// contain some literal (a word, or the longest fixed part of a glob), the name index narrows
+// the list to the names containing it before any entry is looked at. Name regexes run once
+// per distinct name rather than once per entry.
+class EntryQuery {
+public:
+    // On a syntax error, returns false with a message in `error` and leaves the query as it was
+    bool Parse(std::string_view text, bool case_sensitive, std::string& error);
+
+    bool IsEmpty() const { return m_checks.empty(); }
+    // A single positive substring term, which the name index answers on its own
+    bool IsPlainSubstring() const;
+    const std::string& GetSubstring() const { return m_checks.front().text; }
+    bool IsCaseSensitive() const { return m_case_sensitive; }
+    // Some term looks at extended metadata
+    bool NeedsMetadata() const;
+
+    bool Matches(const EntryStore& store, uint32_t index) const;
+
+    // Every matching entry, ascending. `index` must be up to date with the store's name pool.
+    // Large lists are split into chunks that are checked on several threads.
+    void FindMatches(const EntryStore& store, const NameIndex& index, std::vector<uint32_t>& out) const;
+
+    static bool GlobMatch(std::string_view name, std::string_view glob, bool case_sensitive);
+
+private:
+    // In the order they run
+    enum class CheckKind : uint8_t { Type, Size, Modified, Owner, Permissions, Extension, Substring, Glob, NameRegex, PathRegex };
+
+    struct Check {
+        CheckKind kind;
+        bool negate = false;
+        char op = '=';          // Size: '<', 'l' (<=), '>', 'g' (>=), '='
+        uint64_t size = 0;
+        int64_t after = INT64_MIN; // Modified: mtime in [after, before)
+        int64_t before = INT64_MAX;
+        uint32_t id = 0;        // Owner: uid, Permissions: mode bits
+        bool directory = false; // Type
+        std::string text;       // Substring, Glob
+        std::vector<std::string> extensions;
+        std::shared_ptr<const std::regex> regex; // shared so queries copy cheaply
+    };
+
+    static bool IsNameCheck(CheckKind kind) { return kind >= CheckKind::Extension && kind <= CheckKind::NameRegex; }
+    static bool IsMetadataCheck(CheckKind kind) { return kind >= CheckKind::Modified && kind <= CheckKind::Permissions; }
+    bool PassesName(const Check& check, std::string_view name) const;
+    bool Passes(const Check& check, const EntryStore& store, uint32_t index) const;
+
+    std::vector<Check> m_checks;
+    bool m_case_sensitive = true;
+    std::string m_prefilter; // every matching name contains this; empty if nothing qualifies
+};
@@ -0,0 +1,289 @@
+#include "EntrySorter.h"
+#include "MetadataFetcher.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// Below this many items per thread, starting threads costs more than it saves
+constexpr size_t kParallelSortMin = 1 << 16;
+// Names are re-keyed at most this many times (64 bytes) before ties go to full comparisons
+constexpr size_t kMaxNameSegments = 8;
+
+struct SortItem {
+    uint64_t key;
+    uint32_t index;
+};
+
+inline unsigned char FoldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c;
+}
+
+inline bool IsDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+// In natural order a digit run behaves like one character, '0' + its length (9 for anything
+// longer), followed by its digits with leading zeros dropped. Raw digits never meet other
+// characters, so the run byte decides against letters and punctuation as a digit would.
+inline unsigned char RunByte(size_t length) {
+    return (unsigned char)('0' + (std::min)(length, (size_t)9));
+}
+
+// Digit run starting at `begin`: [digits, end) without leading zeros ("0" keeps one)
+inline void ScanRun(std::string_view name, size_t begin, size_t& digits, size_t& end) {
+    end = begin;
+    while (end < name.size() && IsDigit((unsigned char)name[end])) end++;
+    digits = begin;
+    while (digits + 1 < end && name[digits] == '0') digits++;
+}
+
+// Bytes [8 * segment, 8 * segment + 8) of a name in natural order, big-endian, so that a < b
+// implies key(a) <= key(b) when the earlier segments are equal. Natural-order bytes are never
+// zero, so a zero low byte means the name ended in this segment; so does a run of 9+ digits,
+// where the length byte no longer tells.
+uint64_t NameKey(std::string_view name, size_t segment = 0) {
+    size_t skip = segment * 8;
+    uint64_t key = 0;
+    int bytes = 0;
+    auto emit = [&](unsigned char c) {
+        if (skip > 0) {
+            skip--;
+        } else if (bytes < 8) {
+            key = (key << 8) | c;
+            bytes++;
+        }
+    };
+    for (size_t i = 0; i < name.size() && bytes < 8;) {
+        unsigned char c = (unsigned char)name[i];
+        if (!IsDigit(c)) {
+            emit(FoldAscii(c));
+            i++;
+            continue;
+        }
+        size_t digits, end;
+        ScanRun(name, i, digits, end);
+        emit(RunByte(end - digits));
+        if (end - digits >= 9) break;
+        for (size_t d = digits; d < end; d++) emit((unsigned char)name[d]);
+        i = end;
+    }
+    return bytes == 0 ? 0 : key << (8 * (8 - bytes));
+}
+
+template <typename Fn>
+void ParallelFor(size_t count, Fn&& fn) {
+    unsigned threads = (unsigned)(std::min)((size_t)(std::max)(1u, std::thread::hardware_concurrency()), count / kParallelSortMin + 1);
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) workers.emplace_back([&, t] { fn(count * t / threads, count * (t + 1) / threads); });
+    fn(0, count / threads);
+    for (auto& worker : workers) worker.join();
+}
+
+// Each thread sorts a slice, then neighbouring slices are merged pairwise, in parallel,
+// until one run is left
+template <typename Less>
+void ParallelSort(std::vector<SortItem>& items, Less less) {
+    size_t count = items.size();
+    size_t hardware = (std::max)(1u, std::thread::hardware_concurrency());
+    size_t slices = 1;
+    while (slices * 2 <= hardware && count / (slices * 2) >= kParallelSortMin) slices *= 2;
+    if (slices == 1) {
+        std::sort(items.begin(), items.end(), less);
+        return;
+    }
+
+    std::vector<size_t> bounds(slices + 1);
+    for (size_t s = 0; s <= slices; s++) bounds[s] = count * s / slices;
+    {
+        std::vector<std::thread> workers;
+        for (size_t s = 0; s < slices; s++) {
+            workers.emplace_back([&, s] { std::sort(items.begin() + bounds[s], items.begin() + bounds[s + 1], less); });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    std::vector<SortItem> buffer(count);
+    SortItem* from = items.data();
+    SortItem* to = buffer.data();
+    for (size_t width = 1; width < slices; width *= 2) {
+        std::vector<std::thread> workers;
+        for (size_t s = 0; s < slices; s += 2 * width) {
+            size_t begin = bounds[s];
+            size_t middle = bounds[(std::min)(s + width, slices)];
+            size_t end = bounds[(std::min)(s + 2 * width, slices)];
+            workers.emplace_back([=] { std::merge(from + begin, from + middle, from + middle, from + end, to + begin, less); });
+        }
+        for (auto& worker : workers) worker.join();
+        std::swap(from, to);
+    }
+    if (from != items.data()) items.swap(buffer);
+}
+
+// Orders the tied names in [begin, end), all of which have the same natural-order bytes
+// before `segment`. Each pass keys the run with the next 8 bytes and sorts it, which keeps
+// the full comparisons (a cache miss into the name pool each) for names that really tie.
+template <typename Less>
+void SortTies(const EntryStore& store, SortItem* begin, SortItem* end, size_t segment, Less full_less) {
+    if (segment >= kMaxNameSegments) {
+        std::sort(begin, end, full_less);
+        return;
+    }
+    for (SortItem* item = begin; item != end; item++) item->key = NameKey(store.GetName(item->index), segment);
+    std::sort(begin, end, [](const SortItem& a, const SortItem& b) { return a.key < b.key; });
+    for (SortItem* run = begin; run != end;) {
+        SortItem* run_end = run + 1;
+        while (run_end != end && run_end->key == run->key) run_end++;
+        if (run_end - run > 1) {
+            // Names that ended in this segment are equal in natural order
+            if ((run->key & 0xFF) == 0) std::sort(run, run_end, full_less);
+            else SortTies(store, run, run_end, segment + 1, full_less);
+        }
+        run = run_end;
+    }
+}
+
+} // namespace
+
+int EntrySorter::NaturalCompare(std::string_view a, std::string_view b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        unsigned char ca = (unsigned char)a[i];
+        unsigned char cb = (unsigned char)b[j];
+        bool run_a = IsDigit(ca);
+        bool run_b = IsDigit(cb);
+        if (!run_a && !run_b) {
+            ca = FoldAscii(ca);
+            cb = FoldAscii(cb);
+            if (ca != cb) return ca < cb ? -1 : 1;
+            i++;
+            j++;
+            continue;
+        }
+
+        size_t digits_a = i, end_a = i, digits_b = j, end_b = j;
+        if (run_a) ScanRun(a, i, digits_a, end_a);
+        if (run_b) ScanRun(b, j, digits_b, end_b);
+        size_t length_a = end_a - digits_a;
+        size_t length_b = end_b - digits_b;
+        if (!run_a || !run_b) {
+            // A run against any other character; never equal
+            unsigned char left = run_a ? RunByte(length_a) : FoldAscii(ca);
+            unsigned char right = run_b ? RunByte(length_b) : FoldAscii(cb);
+            return left < right ? -1 : 1;
+        }
+        // Two numbers: fewer digits is smaller, then digit by digit
+        if (length_a != length_b) return length_a < length_b ? -1 : 1;
+        if (int c = a.substr(digits_a, length_a).compare(b.substr(digits_b, length_b))) return c < 0 ? -1 : 1;
+        i = end_a;
+        j = end_b;
+    }
+    // Whichever ran out first is a prefix of the other
+    return (i < a.size() ? 1 : 0) - (j < b.size() ? 1 : 0);
+}
+
+void EntrySorter::Clear() {
+    for (Cache& cache : m_cache) cache = Cache();
+}
+
+void EntrySorter::PageOut() {
+    for (Cache& cache : m_cache) cache.order.PageOut();
+}
+
+const PagedArray<uint32_t>& EntrySorter::GetOrder(const EntryStore& store, SortColumn column) {
+    static const PagedArray<uint32_t> kScanOrder;
+    if (column == SortColumn::None) return kScanOrder;
+
+    Cache& cache = m_cache[(int)column - 1];
+    bool metadata = IsMetadataColumn(column);
+    if (cache.valid && cache.revision == store.GetRevision() && cache.size == store.Size() &&
+        (!metadata || cache.metadata_revision == store.GetMetadataRevision())) {
+        return cache.order;
+    }
+    PROFILE_SCOPE("EntrySorter::GetOrder");
+
+    // Owners go by name: the few distinct uids are ranked once and entries keyed by rank
+    std::unordered_map<uint32_t, uint32_t> owner_rank;
+    if (column == SortColumn::Owner) {
+        std::vector<uint32_t> uids;
+        for (uint32_t i = 0; i < store.Size(); i++) {
+            if (store.HasMetadata(i) && owner_rank.emplace(store.GetMetadata(i).uid, 0).second) uids.push_back(store.GetMetadata(i).uid);
+        }
+        std::sort(uids.begin(), uids.end(), [](uint32_t a, uint32_t b) {
+            return MetadataFetcher::GetOwnerName(a) < MetadataFetcher::GetOwnerName(b);
+        });
+        for (uint32_t rank = 0; rank < uids.size(); rank++) owner_rank[uids[rank]] = rank;
+    }
+
+    std::vector<SortItem> items(store.Size());
+    ParallelFor(items.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t index = (uint32_t)i;
+            uint64_t key = 0;
+            switch (column) {
+            case SortColumn::Name: key = NameKey(store.GetName(index)); break;
+            case SortColumn::Size: key = store.GetTotalSize(index); break;
+            // Top bit puts folders first; the name key loses its last bit, ties sort that out
+            case SortColumn::Type: key = (store.IsDirectory(index) ? 0 : 1ull << 63) | (NameKey(store.GetName(index)) >> 1); break;
+            case SortColumn::Modified:
+            case SortColumn::Permissions:
+            case SortColumn::Owner: {
+                if (!store.HasMetadata(index)) {
+                    key = UINT64_MAX;
+                    break;
+                }
+                const EntryMetadata& meta = store.GetMetadata(index);
+                // Flipping the sign bit orders signed times as unsigned keys
+                if (column == SortColumn::Modified) key = (uint64_t)meta.mtime ^ (1ull << 63);
+                else if (column == SortColumn::Permissions) key = meta.mode & 07777;
+                else key = owner_rank.find(meta.uid)->second;
+                break;
+            }
+            case SortColumn::None: break;
+            }
+            items[i] = {key, index};
+        }
+    });
+
+    // Sort on the keys alone, then order each run of equal keys by name. Within a run, names
+    // go by the rest of their natural-order bytes, then raw bytes, then scan order, so the
+    // order is total.
+    ParallelSort(items, [](const SortItem& a, const SortItem& b) { return a.key < b.key; });
+
+    std::vector<std::pair<size_t, size_t>> ties;
+    for (size_t run = 0; run < items.size();) {
+        size_t run_end = run + 1;
+        while (run_end < items.size() && items[run_end].key == items[run].key) run_end++;
+        if (run_end - run > 1) ties.push_back({run, run_end});
+        run = run_end;
+    }
+    auto full_less = [&](const SortItem& a, const SortItem& b) {
+        std::string_view name_a = store.GetName(a.index);
+        std::string_view name_b = store.GetName(b.index);
+        if (int c = NaturalCompare(name_a, name_b)) return c < 0;
+        if (int c = name_a.compare(name_b)) return c < 0;
+        return a.index < b.index;
+    };
+    // The name key already covers the first segment; the other keys cover none of it
+    size_t first_segment = column == SortColumn::Name ? 1 : 0;
+    ParallelFor(ties.size(), [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            SortItem* run = items.data() + ties[t].first;
+            SortItem* run_end = items.data() + ties[t].second;
+            if (column == SortColumn::Name && (run->key & 0xFF) == 0) std::sort(run, run_end, full_less);
+            else SortTies(store, run, run_end, first_segment, full_less);
+        }
+    });
+
+    cache.order.resize(items.size());
+    ParallelFor(items.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) cache.order[i] = items[i].index;
+    });
+    cache.revision = store.GetRevision();
+    cache.metadata_revision = store.GetMetadataRevision();
+    cache.size = store.Size();
+    cache.valid = true;
+    return cache.order;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "EntryStore.h"
+
+enum class SortColumn {
+    None, // scan order
+    Name,
+    Size,
+    Type, // folders first, then by name
+    // Extended metadata; entries without any sort last, see EntryStore::GetMetadataState()
+    Modified,
+    Permissions,
+    Owner, // by user name
+};
+
+inline bool IsMetadataColumn(SortColumn column) {
+    return column >= SortColumn::Modified;
+}
+
+// Sorted permutations of an EntryStore, one per column, built on first use and kept until
+// the store changes. Entries are never moved: each one gets a compact 64-bit key (a prefix
+// of its natural-order name, its size, ...) and (key, index) pairs are sorted on all cores.
+// Full comparisons only run when two keys tie.
+//
+// Orders are ascending; descending is the same order read backwards. Like the entry columns
+// they're PagedArrays, so they spill to temp files past the memory budget too.
+class EntrySorter {
+public:
+    const PagedArray<uint32_t>& GetOrder(const EntryStore& store, SortColumn column);
+    void Clear();
+    // Drops the pages of spilled orders from memory, see PagedBuffer::PageOut()
+    void PageOut();
+
+    // Case-insensitive (ASCII) order with digit runs compared by value: "file2" < "file10".
+    // Returns <0, 0 or >0. Names that differ only in leading zeros compare equal.
+    static int NaturalCompare(std::string_view a, std::string_view b);
+
+private:
+    struct Cache {
+        PagedArray<uint32_t> order;
+        uint64_t revision = 0;
+        uint64_t metadata_revision = 0;
+        uint32_t size = 0;
+        bool valid = false;
+    };
+    Cache m_cache[6]; // Name, Size, Type, Modified, Permissions, Owner
+};
@@ -0,0 +1,432 @@
+#include "EntryStore.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+uint32_t HashName(std::string_view name) {
+    // FNV-1a; names are short so this beats anything fancier
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1; // 0 marks an empty slot
+}
+
+inline void Prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+bool IsSeparator(char c) {
+    return c == '/' || c == (char)std::filesystem::path::preferred_separator;
+}
+
+} // namespace
+
+// --- NamePool ---
+
+uint32_t NamePool::Intern(std::string_view name) {
+    if ((m_count + 1) * 2 > m_slots.size()) Grow();
+
+    uint32_t hash = HashName(name);
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = m_slots[i];
+        if (slot.hash == 0) {
+            uint32_t offset = (uint32_t)m_arena.size();
+            m_arena.append(name.data(), name.size());
+            m_arena.push_back('\0');
+            slot.offset = offset;
+            slot.hash = hash;
+            m_count++;
+            return offset;
+        }
+        if (slot.hash == hash) {
+            const char* existing = m_arena.data() + slot.offset;
+            if (std::memcmp(existing, name.data(), name.size()) == 0 && existing[name.size()] == '\0') {
+                return slot.offset;
+            }
+        }
+    }
+}
+
+void NamePool::Grow() {
+    PagedArray<Slot> old = std::move(m_slots);
+    m_slots.assign(old.empty() ? 1024 : old.size() * 2, Slot{0, 0});
+
+    size_t mask = m_slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.hash == 0) continue;
+        size_t i = slot.hash & mask;
+        while (m_slots[i].hash != 0) i = (i + 1) & mask;
+        m_slots[i] = slot;
+    }
+}
+
+void NamePool::RebuildSlots() {
+    const char* arena = m_arena.data();
+    size_t bytes = m_arena.size();
+    m_count = 0;
+    for (const char* p = arena; p < arena + bytes; p = static_cast<const char*>(std::memchr(p, '\0', (size_t)(arena + bytes - p))) + 1) m_count++;
+    size_t slot_count = 1024;
+    while (slot_count < m_count * 2 + 2) slot_count *= 2;
+    m_slots.assign(slot_count, Slot{0, 0});
+
+    // Slots are hit at random, so hashes are worked out a few names ahead and their slots
+    // prefetched; by the time a name is inserted its slot is usually in cache
+    constexpr size_t kAhead = 16;
+    Slot pending[kAhead];
+    size_t queued = 0;
+    size_t mask = slot_count - 1;
+    auto insert = [&](const Slot& slot) {
+        size_t i = slot.hash & mask;
+        while (m_slots[i].hash != 0) i = (i + 1) & mask;
+        m_slots[i] = slot;
+    };
+    for (size_t offset = 0; offset < bytes;) {
+        std::string_view name(arena + offset);
+        uint32_t hash = HashName(name);
+        Prefetch(&m_slots[hash & mask]);
+        if (queued >= kAhead) insert(pending[queued % kAhead]);
+        pending[queued++ % kAhead] = Slot{(uint32_t)offset, hash};
+        offset += name.size() + 1;
+    }
+    for (size_t i = queued > kAhead ? queued - kAhead : 0; i < queued; i++) insert(pending[i % kAhead]);
+}
+
+void NamePool::Clear() {
+    m_arena.Free();
+    m_slots.Free();
+    m_count = 0;
+}
+
+// --- EntryStore ---
+
+uint64_t EntryStore::NextRevision() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EntryStore::Clear(const std::string& root_path, std::shared_ptr<NamePool> names) {
+    m_root = root_path;
+    m_revision = NextRevision();
+    m_scan_time = 0;
+    // A shared pool keeps its names, other stores point into it
+    m_names = names ? NamePoolRef(std::move(names)) : NamePoolRef();
+    // Freed rather than cleared, so a spilled list gives its temp files back
+    m_name.Free();
+    m_name_length.Free();
+    m_parent.Free();
+    m_dir.Free();
+    m_size.Free();
+    m_flags.Free();
+    m_selected.Clear();
+    m_filtered.Clear();
+    m_dir_entry.assign(1, kNoEntry); // dir 0 is the scan root, which has no entry of its own
+    m_dir_mtime.assign(1, 0);
+    m_dir_bytes.assign(1, 0);
+    m_dir_files.assign(1, 0);
+    m_dir_totals_valid = false;
+    m_meta = std::vector<EntryMetadata>();
+    m_meta_state = std::vector<uint8_t>();
+    m_meta_resolved = 0;
+    m_meta_revision = NextRevision();
+}
+
+void EntryStore::AppendBatch(const ScanBatch& batch) {
+    for (const ScanRecord& record : batch.records) {
+        uint32_t index = (uint32_t)m_size.size();
+        m_name.push_back(m_names->Intern(batch.Name(record)));
+        m_name_length.push_back(record.name_length);
+        m_parent.push_back(record.parent_dir);
+        m_dir.push_back(record.dir_id);
+        m_size.push_back(record.size);
+        m_flags.push_back(record.is_directory ? kFlagDirectory : 0);
+
+        if (record.parent_dir >= m_dir_entry.size()) GrowDirs(record.parent_dir);
+        if (record.dir_id != kNoDir) {
+            if (record.dir_id >= m_dir_entry.size()) GrowDirs(record.dir_id);
+            m_dir_entry[record.dir_id] = index;
+        } else {
+            AddToDirTotals(record.parent_dir, (int64_t)record.size, 1);
+        }
+    }
+    for (const DirStamp& stamp : batch.dirs) {
+        if (stamp.dir_id >= m_dir_entry.size()) GrowDirs(stamp.dir_id);
+        m_dir_mtime[stamp.dir_id] = stamp.mtime;
+    }
+    m_selected.Resize(Size());
+    m_filtered.Resize(Size());
+}
+
+bool EntryStore::IsSpilled() const {
+    return m_names->IsSpilled() || m_name.IsSpilled() || m_name_length.IsSpilled() || m_parent.IsSpilled() ||
+           m_dir.IsSpilled() || m_size.IsSpilled() || m_flags.IsSpilled();
+}
+
+void EntryStore::PageOut() {
+    m_names->PageOut();
+    m_name.PageOut();
+    m_name_length.PageOut();
+    m_parent.PageOut();
+    m_dir.PageOut();
+    m_size.PageOut();
+    m_flags.PageOut();
+}
+
+void EntryStore::GrowDirs(uint32_t dir) {
+    m_dir_entry.resize((size_t)dir + 1, kNoEntry);
+    m_dir_mtime.resize((size_t)dir + 1, 0);
+    m_dir_bytes.resize((size_t)dir + 1, 0);
+    m_dir_files.resize((size_t)dir + 1, 0);
+}
+
+void EntryStore::AddToDirTotals(uint32_t dir, int64_t bytes, int64_t files) {
+    for (;;) {
+        m_dir_bytes[dir] += (uint64_t)bytes;
+        m_dir_files[dir] += (uint64_t)files;
+        if (!m_dir_totals_valid || dir == kRootDir) return;
+        uint32_t entry = m_dir_entry[dir];
+        if (entry == kNoEntry) return;
+        dir = m_parent[entry];
+    }
+}
+
+void EntryStore::RollUpDirTotals() {
+    if (m_dir_totals_valid) return;
+    // Highest ids first: by the time a folder is added to its parent, all of its own
+    // subfolders have been added to it
+    for (uint32_t dir = (uint32_t)m_dir_entry.size(); dir-- > 1;) {
+        uint32_t entry = m_dir_entry[dir];
+        if (entry == kNoEntry) continue; // removed, or never listed
+        uint32_t parent = m_parent[entry];
+        m_dir_bytes[parent] += m_dir_bytes[dir];
+        m_dir_files[parent] += m_dir_files[dir];
+    }
+    m_dir_totals_valid = true;
+    m_revision = NextRevision();
+}
+
+void EntryStore::RebuildDirTotals() {
+    m_dir_bytes.assign(m_dir_entry.size(), 0);
+    m_dir_files.assign(m_dir_entry.size(), 0);
+    m_dir_totals_valid = false;
+    for (uint32_t i = 0; i < Size(); i++) {
+        if (m_dir[i] != kNoDir) continue;
+        m_dir_bytes[m_parent[i]] += m_size[i];
+        m_dir_files[m_parent[i]]++;
+    }
+    RollUpDirTotals();
+}
+
+bool EntryStore::IsWellFormed() const {
+    size_t arena_bytes = m_names->GetArenaBytes();
+    if (arena_bytes > 0 && m_names->Data()[arena_bytes - 1] != '\0') return false;
+    uint32_t dir_count = GetDirCount();
+    if (dir_count == 0 || m_dir_mtime.size() != dir_count) return false;
+    for (uint32_t i = 0; i < Size(); i++) {
+        if ((uint64_t)m_name[i] + m_name_length[i] >= arena_bytes || m_parent[i] >= dir_count ||
+            (m_dir[i] != kNoDir && m_dir[i] >= dir_count)) {
+            return false;
+        }
+    }
+    // Folders always come after their parent in id order; the size roll-up relies on it
+    for (uint32_t dir = 0; dir < dir_count; dir++) {
+        uint32_t entry = m_dir_entry[dir];
+        if (entry == kNoEntry) continue;
+        if (entry >= Size() || m_parent[entry] >= dir) return false;
+    }
+    return true;
+}
+
+std::string EntryStore::GetPath(uint32_t index) const {
+    // Collect the chain leaf -> root, then write it out root -> leaf. Any depth works: chains
+    // longer than the stack buffer carry on in a vector.
+    constexpr size_t kLocalDepth = 64;
+    uint32_t local[kLocalDepth];
+    std::vector<uint32_t> deep;
+    size_t depth = 0;
+    size_t length = m_root.size() + 1;
+
+    for (uint32_t e = index; e != kNoEntry;) {
+        if (depth < kLocalDepth) {
+            local[depth] = e;
+        } else {
+            if (deep.empty()) deep.assign(local, local + kLocalDepth);
+            deep.push_back(e);
+        }
+        depth++;
+        length += m_name_length[e] + 1;
+        uint32_t dir = m_parent[e];
+        e = dir == kRootDir ? kNoEntry : m_dir_entry[dir];
+    }
+    const uint32_t* chain = deep.empty() ? local : deep.data();
+
+    std::string path;
+    path.reserve(length);
+    path = m_root;
+    for (size_t i = depth; i-- > 0;) {
+        if (path.empty() || !IsSeparator(path.back())) path += (char)std::filesystem::path::preferred_separator;
+        path.append(GetName(chain[i]));
+    }
+    return path;
+}
+
+void EntryStore::SetName(uint32_t index, std::string_view name) {
+    m_name[index] = m_names->Intern(name);
+    m_name_length[index] = (uint16_t)name.size();
+    m_revision = NextRevision();
+    InvalidateMetadata(index);
+}
+
+void EntryStore::TrimNames() {
+    if (!m_names.IsShared()) return;
+    NamePoolRef own;
+    for (uint32_t i = 0; i < Size(); i++) m_name[i] = own->Intern(GetName(i));
+    m_names = std::move(own);
+    m_revision = NextRevision(); // name offsets changed
+}
+
+void EntryStore::SetMetadataPending(uint32_t index) {
+    if (m_meta_state.size() < Size()) {
+        m_meta.resize(Size());
+        m_meta_state.resize(Size(), kMetadataUnknown);
+    }
+    if (m_meta_state[index] == kMetadataKnown || m_meta_state[index] == kMetadataFailed) m_meta_resolved--;
+    m_meta_state[index] = kMetadataPending;
+}
+
+void EntryStore::SetMetadata(uint32_t index, const EntryMetadata& metadata) {
+    SetMetadataPending(index);
+    m_meta[index] = metadata;
+    m_meta_state[index] = kMetadataKnown;
+    m_meta_resolved++;
+    m_meta_revision = NextRevision();
+}
+
+void EntryStore::SetMetadataFailed(uint32_t index) {
+    SetMetadataPending(index);
+    m_meta_state[index] = kMetadataFailed;
+    m_meta_resolved++;
+    m_meta_revision = NextRevision();
+}
+
+void EntryStore::ResetPendingMetadata() {
+    for (uint8_t& state : m_meta_state) {
+        if (state == kMetadataPending) state = kMetadataUnknown;
+    }
+}
+
+void EntryStore::InvalidateMetadata(uint32_t index) {
+    if (index >= m_meta_state.size() || m_meta_state[index] == kMetadataUnknown) return;
+    if (m_meta_state[index] != kMetadataPending) m_meta_resolved--;
+    m_meta_state[index] = kMetadataUnknown;
+    m_meta_revision = NextRevision();
+}
+
+void EntryStore::Compact(const std::vector<bool>& removed, std::vector<uint32_t>* remap) {
+    // A directory is dead if it was removed itself or any ancestor was. Resolved lazily with
+    // memoization since entries added after the scan may not be in parent-first order.
+    enum : uint8_t { kUnknown, kAlive, kDead };
+    std::vector<uint8_t> dir_state(m_dir_entry.size(), kUnknown);
+    dir_state[kRootDir] = kAlive;
+    for (uint32_t i = 0; i < Size(); i++) {
+        if (removed[i] && m_dir[i] != kNoDir) dir_state[m_dir[i]] = kDead;
+    }
+
+    std::vector<uint32_t> walk;
+    auto resolve = [&](uint32_t dir) {
+        while (dir_state[dir] == kUnknown) {
+            walk.push_back(dir);
+            uint32_t entry = m_dir_entry[dir];
+            if (entry == kNoEntry) {
+                dir_state[dir] = kDead; // directory record itself is gone
+                break;
+            }
+            dir = m_parent[entry];
+        }
+        uint8_t state = dir_state[dir];
+        for (uint32_t d : walk) dir_state[d] = state;
+        walk.clear();
+        return state;
+    };
+
+    // Take whatever goes away out of the totals first, while the parent chains are intact.
+    // Only the top of each removed subtree counts: its totals already cover what's inside.
+    for (uint32_t i = 0; i < Size(); i++) {
+        if (!removed[i] || resolve(m_parent[i]) == kDead) continue;
+        if (m_dir[i] == kNoDir) AddToDirTotals(m_parent[i], -(int64_t)m_size[i], -1);
+        else if (m_dir_totals_valid) AddToDirTotals(m_parent[i], -(int64_t)m_dir_bytes[m_dir[i]], -(int64_t)m_dir_files[m_dir[i]]);
+    }
+
+    // Fetches in flight hold the old indices and get dropped, so nothing stays pending
+    bool has_meta = !m_meta_state.empty();
+    if (has_meta) {
+        ResetPendingMetadata();
+        m_meta.resize(Size());
+        m_meta_state.resize(Size(), kMetadataUnknown);
+    }
+
+    if (remap) remap->assign(Size(), kNoEntry);
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < Size(); i++) {
+        bool drop = removed[i] || resolve(m_parent[i]) == kDead;
+        if (m_dir[i] != kNoDir) m_dir_entry[m_dir[i]] = drop ? kNoEntry : out;
+        if (drop) continue;
+        if (remap) (*remap)[i] = out;
+
+        if (out != i) {
+            m_name[out] = m_name[i];
+            m_name_length[out] = m_name_length[i];
+            m_parent[out] = m_parent[i];
+            m_dir[out] = m_dir[i];
+            m_size[out] = m_size[i];
+            m_flags[out] = m_flags[i];
+            m_selected.Set(out, m_selected.Test(i));
+            m_filtered.Set(out, m_filtered.Test(i));
+            if (has_meta) {
+                m_meta[out] = m_meta[i];
+                m_meta_state[out] = m_meta_state[i];
+            }
+        }
+        out++;
+    }
+
+    m_name.resize(out);
+    m_name_length.resize(out);
+    m_parent.resize(out);
+    m_dir.resize(out);
+    m_size.resize(out);
+    m_flags.resize(out);
+    m_selected.Resize(out);
+    m_filtered.Resize(out);
+    if (has_meta) {
+        m_meta.resize(out);
+        m_meta_state.resize(out);
+        m_meta_resolved = (uint32_t)std::count_if(m_meta_state.begin(), m_meta_state.end(), [](uint8_t state) { return state != kMetadataUnknown; });
+        m_meta_revision = NextRevision();
+    }
+    m_revision = NextRevision();
+}
+
+size_t EntryStore::GetMemoryBytes() const {
+    return m_names->GetMemoryBytes() +
+           m_name.capacity() * sizeof(uint32_t) +
+           m_name_length.capacity() * sizeof(uint16_t) +
+           m_parent.capacity() * sizeof(uint32_t) +
+           m_dir.capacity() * sizeof(uint32_t) +
+           m_size.capacity() * sizeof(uint64_t) +
+           m_flags.capacity() * sizeof(uint8_t) +
+           m_selected.GetMemoryBytes() + m_filtered.GetMemoryBytes() +
+           m_dir_entry.capacity() * sizeof(uint32_t) +
+           m_dir_mtime.capacity() * sizeof(int64_t) +
+           (m_dir_bytes.capacity() + m_dir_files.capacity()) * sizeof(uint64_t) +
+           m_meta.capacity() * sizeof(EntryMetadata) + m_meta_state.capacity();
+}
@@ -0,0 +1,320 @@
+#pragma once
+#include "EntryBitset.h"
+#include "PagedArray.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Interned file names. Each distinct name is stored once, NUL-terminated, in a single
+// arena and identified by its byte offset. Common names ("index.js", ".git", "README.md")
+// cost nothing after the first occurrence.
+class NamePool {
+public:
+    uint32_t Intern(std::string_view name);
+
+    std::string_view Get(uint32_t offset, uint16_t length) const { return std::string_view(m_arena.data() + offset, length); }
+    const char* CStr(uint32_t offset) const { return m_arena.data() + offset; }
+    const char* Data() const { return m_arena.data(); }
+
+    size_t GetArenaBytes() const { return m_arena.size(); }
+    bool IsSpilled() const { return m_arena.IsSpilled() || m_slots.IsSpilled(); }
+    void PageOut() {
+        m_arena.PageOut();
+        m_slots.PageOut();
+    }
+    size_t GetMemoryBytes() const { return m_arena.capacity() + m_slots.capacity() * sizeof(Slot); }
+    void Clear();
+
+private:
+    friend class ScanExport;
+    friend class ScanSnapshot;
+
+    struct Slot {
+        uint32_t offset;
+        uint32_t hash; // 0 = empty
+    };
+    void Grow();
+    // Hashes every name in the arena again, for an arena read from a file without its table
+    void RebuildSlots();
+
+    PagedArray<char> m_arena;
+    PagedArray<Slot> m_slots;
+    size_t m_count = 0;
+};
+
+// The pool behind an EntryStore, which other stores may intern into as well (see
+// EntryStore::Clear()). A copy gets a pool of its own with the same names, so it can be read
+// on another thread while the stores sharing the original keep interning. Moving hands the
+// pool over and leaves an empty one behind.
+class NamePoolRef {
+public:
+    NamePoolRef() : m_pool(std::make_shared<NamePool>()) {}
+    explicit NamePoolRef(std::shared_ptr<NamePool> shared) : m_pool(std::move(shared)), m_shared(true) {}
+    NamePoolRef(const NamePoolRef& other) : m_pool(std::make_shared<NamePool>(*other.m_pool)), m_shared(other.m_shared) {}
+    NamePoolRef(NamePoolRef&& other) : NamePoolRef() {
+        std::swap(m_pool, other.m_pool);
+        std::swap(m_shared, other.m_shared);
+    }
+    NamePoolRef& operator=(const NamePoolRef& other) {
+        if (this != &other) *this = NamePoolRef(other);
+        return *this;
+    }
+    NamePoolRef& operator=(NamePoolRef&& other) {
+        if (this == &other) return *this;
+        m_pool = std::exchange(other.m_pool, std::make_shared<NamePool>());
+        m_shared = std::exchange(other.m_shared, false);
+        return *this;
+    }
+
+    NamePool* operator->() const { return m_pool.get(); }
+    NamePool& operator*() const { return *m_pool; }
+    // Came from a shared pool, so it may hold names of other stores too
+    bool IsShared() const { return m_shared; }
+
+private:
+    std::shared_ptr<NamePool> m_pool;
+    bool m_shared = false;
+};
+
+// Output of the scan workers: entries of one or more directories with names packed into
+// a single buffer. Directories are identified by ids handed out by the walker (0 = scan root);
+// every record names the directory it lives in, and directory records carry their own id.
+struct ScanRecord {
+    uint32_t parent_dir;
+    uint32_t dir_id;        // EntryStore::kNoDir for non-directories
+    uint32_t name_offset;   // into ScanBatch::names, NUL-terminated
+    uint16_t name_length;
+    uint64_t size;
+    bool is_directory;
+    uint32_t source;        // entry index in the previous scan of the same tree, EntryStore::kNoEntry if new
+};
+
+// Modification time of a directory at the moment it was listed, in DirectoryWalker::CurrentStamp() units
+struct DirStamp {
+    uint32_t dir_id;
+    int64_t mtime;
+};
+
+struct ScanBatch {
+    std::string names;
+    std::vector<ScanRecord> records;
+    std::vector<DirStamp> dirs; // one per directory listed into this batch
+
+    bool empty() const { return records.empty() && dirs.empty(); }
+    std::string_view Name(const ScanRecord& record) const { return std::string_view(names.data() + record.name_offset, record.name_length); }
+};
+
+// Fields the scan doesn't read, fetched afterwards for the entries that need them (see MetadataFetcher)
+struct EntryMetadata {
+    int64_t mtime = 0;  // nanoseconds since the Unix epoch
+    uint32_t mode = 0;  // st_mode: file type and permission bits
+    uint32_t uid = 0;   // MetadataFetcher::kNoOwner where there are no owners
+};
+
+class EntryStore;
+
+// Lightweight view of one entry. Cheap to copy; valid until the store is modified.
+class FileEntry {
+public:
+    FileEntry(const EntryStore& store, uint32_t index) : m_store(&store), m_index(index) {}
+
+    uint32_t Index() const { return m_index; }
+    std::string_view Name() const;
+    const char* NameCStr() const;
+    // Rebuilt from the parent chain on every call, use for tooltips and syscalls only
+    std::string Path() const;
+    uint64_t Size() const;
+    bool IsDirectory() const;
+    bool IsSelected() const;
+    bool IsFiltered() const; // true if hidden by filter
+
+private:
+    const EntryStore* m_store;
+    uint32_t m_index;
+};
+
+// Scanned entries in structure-of-arrays form. Instead of a full path, each entry keeps the
+// id of its parent directory and an interned name; full paths are rebuilt on demand.
+// Roughly 23 bytes per entry plus the (deduplicated) name bytes. Selection and filter state
+// are bitsets, so whole-list selection changes are word operations.
+class EntryStore {
+public:
+    static constexpr uint32_t kNoDir = 0xFFFFFFFFu;
+    static constexpr uint32_t kNoEntry = 0xFFFFFFFFu;
+    static constexpr uint32_t kRootDir = 0;
+
+    enum Flags : uint8_t {
+        kFlagDirectory = 1 << 0,
+    };
+
+    enum MetadataState : uint8_t {
+        kMetadataUnknown,
+        kMetadataPending,   // being fetched
+        kMetadataKnown,
+        kMetadataFailed,    // gone or unreadable when it was fetched
+    };
+
+    // Starts an empty list. Given `names`, the list interns into that pool instead of one of its
+    // own, so names common to every store handed the same pool are stored once. Stores sharing
+    // a pool must all be changed from one thread; copies get a pool of their own.
+    void Clear(const std::string& root_path, std::shared_ptr<NamePool> names = nullptr);
+    // Entries must arrive parent-directory-first, which the walker guarantees
+    void AppendBatch(const ScanBatch& batch);
+
+    uint32_t Size() const { return (uint32_t)m_size.size(); }
+    bool Empty() const { return m_size.empty(); }
+    FileEntry operator[](uint32_t index) const { return FileEntry(*this, index); }
+
+    std::string_view GetName(uint32_t index) const { return m_names->Get(m_name[index], m_name_length[index]); }
+    const char* GetNameCStr(uint32_t index) const { return m_names->CStr(m_name[index]); }
+    // Interned name identity: entries with equal names share the offset
+    uint32_t GetNameOffset(uint32_t index) const { return m_name[index]; }
+    std::string GetPath(uint32_t index) const;
+    uint64_t GetSize(uint32_t index) const { return m_size[index]; }
+    uint32_t GetParentDir(uint32_t index) const { return m_parent[index]; }
+    uint32_t GetDirId(uint32_t index) const { return m_dir[index]; }
+    uint32_t GetDirCount() const { return (uint32_t)m_dir_entry.size(); }
+    uint32_t GetDirEntry(uint32_t dir) const { return m_dir_entry[dir]; }
+    // 0 if the directory was never listed (unreadable, or the scan was cancelled first)
+    int64_t GetDirMTime(uint32_t dir) const { return m_dir_mtime[dir]; }
+
+    // Everything below a directory: total file bytes and file count. While a scan streams in,
+    // each file only counts toward its own folder; RollUpDirTotals() then adds every folder
+    // into its parent in one bottom-up pass over the directory ids (children always have
+    // higher ids than their parent). From then on appends, resizes and removals update the
+    // totals along the parent chain as they happen.
+    void RollUpDirTotals();
+    bool HasDirTotals() const { return m_dir_totals_valid; }
+    // Folders that were never descended into (non-recursive scans) have no totals
+    bool HasDirTotals(uint32_t index) const { return m_dir_totals_valid && m_dir[index] != kNoDir; }
+    uint64_t GetDirBytes(uint32_t dir) const { return m_dir_bytes[dir]; }
+    uint64_t GetDirFiles(uint32_t dir) const { return m_dir_files[dir]; }
+    // File size, or for a directory the bytes below it (0 until the totals are rolled up)
+    uint64_t GetTotalSize(uint32_t index) const {
+        if (m_dir[index] == kNoDir) return m_size[index]; // also 0 for unlisted folders
+        return m_dir_totals_valid ? m_dir_bytes[m_dir[index]] : 0;
+    }
+    bool IsDirectory(uint32_t index) const { return m_flags[index] & kFlagDirectory; }
+    bool IsSelected(uint32_t index) const { return m_selected.Test(index); }
+    bool IsFiltered(uint32_t index) const { return m_filtered.Test(index); }
+
+    void SetSelected(uint32_t index, bool selected) { m_selected.Set(index, selected); }
+    void SetFiltered(uint32_t index, bool filtered) { m_filtered.Set(index, filtered); }
+
+    // Kept up to date on every change, free to call per frame
+    uint32_t GetSelectedCount() const { return m_selected.Count(); }
+    // Selected entries the filter lets through; one pass over the bit words
+    uint32_t GetSelectedVisibleCount() const { return m_selected.CountAndNot(m_filtered); }
+    // Selects the entries in [begin, end) that aren't filtered out
+    void SelectVisible(uint32_t begin, uint32_t end) { m_selected.SetRangeWhereClear(begin, end, m_filtered); }
+    void ClearSelection() { m_selected.SetAll(false); }
+    // Selected, unfiltered entries in index order
+    template <typename Fn>
+    void ForEachSelectedVisible(Fn&& fn) const { m_selected.ForEachSetAndNot(m_filtered, fn); }
+    void SetName(uint32_t index, std::string_view name);
+    void SetSize(uint32_t index, uint64_t size) {
+        if (m_dir[index] == kNoDir) AddToDirTotals(m_parent[index], (int64_t)(size - m_size[index]), 0);
+        m_size[index] = size;
+        m_revision = NextRevision();
+        InvalidateMetadata(index);
+    }
+
+    // Extended metadata sits in side columns, allocated the first time an entry gets some and
+    // never saved. Entries whose name or size changes go back to unknown; removals carry it
+    // along like the other columns. Changes here don't touch GetRevision(), which would
+    // throw away every sorted order, but GetMetadataRevision().
+    MetadataState GetMetadataState(uint32_t index) const {
+        return index < m_meta_state.size() ? (MetadataState)m_meta_state[index] : kMetadataUnknown;
+    }
+    bool HasMetadata(uint32_t index) const { return GetMetadataState(index) == kMetadataKnown; }
+    // Only meaningful when HasMetadata()
+    const EntryMetadata& GetMetadata(uint32_t index) const { return m_meta[index]; }
+    void SetMetadataPending(uint32_t index);
+    void SetMetadata(uint32_t index, const EntryMetadata& metadata);
+    void SetMetadataFailed(uint32_t index);
+    // Pending entries back to unknown, for fetches that were dropped
+    void ResetPendingMetadata();
+    // Every entry is known or failed
+    bool HasAllMetadata() const { return m_meta_resolved == Size(); }
+    uint64_t GetMetadataRevision() const { return m_meta_revision; }
+
+    // Single compaction pass: drops every entry with removed[i] set, plus anything that lived
+    // underneath a removed directory. Indices of the surviving entries shift down; `remap`, if
+    // given, receives each old index's new one (kNoEntry if dropped) for state kept elsewhere.
+    void Compact(const std::vector<bool>& removed, std::vector<uint32_t>* remap = nullptr);
+
+    // When the scan that produced this store started. Directories modified at or after this
+    // point may have changed while they were being listed, so a rescan can't trust them.
+    int64_t GetScanTime() const { return m_scan_time; }
+    void SetScanTime(int64_t stamp) { m_scan_time = stamp; }
+
+    // Changes whenever existing entries do (names, sizes, removals, a whole new list); appends
+    // only grow Size(). Unique across stores, so a result cached for one list never matches another.
+    uint64_t GetRevision() const { return m_revision; }
+
+    const std::string& GetRootPath() const { return m_root; }
+    const NamePool& GetNamePool() const { return *m_names; }
+    // A copy of a store sharing its pool carries the names of every store that shares it. This
+    // moves its own names into a pool of their own and drops the rest, e.g. before writing the
+    // copy to a file; a store with a pool of its own is left as it is.
+    void TrimNames();
+    size_t GetMemoryBytes() const;
+    // Past the PagedBuffer budget the columns live in temp files; PageOut() drops their pages
+    // from memory after a sweep over the whole list
+    bool IsSpilled() const;
+    void PageOut();
+
+private:
+    friend class ScanExport;
+    friend class ScanSnapshot;
+
+    void GrowDirs(uint32_t dir);
+    void InvalidateMetadata(uint32_t index);
+    // Adds to `dir` alone before the roll-up, to `dir` and all its ancestors after it
+    void AddToDirTotals(uint32_t dir, int64_t bytes, int64_t files);
+    // Recomputes the totals from scratch, for stores filled without AppendBatch()
+    void RebuildDirTotals();
+    // For columns read from a file: names inside the arena, parents and folder ids in range,
+    // folders after their parent. A damaged file must not turn into out-of-range reads later on.
+    bool IsWellFormed() const;
+    static uint64_t NextRevision();
+
+    std::string m_root;
+    uint64_t m_revision = NextRevision();
+    int64_t m_scan_time = 0;
+    NamePoolRef m_names;
+
+    // Per-entry columns, paged out to a temp file past the memory budget (see PagedBuffer)
+    PagedArray<uint32_t> m_name;         // NamePool offset
+    PagedArray<uint16_t> m_name_length;
+    PagedArray<uint32_t> m_parent;       // directory id of the containing directory
+    PagedArray<uint32_t> m_dir;          // own directory id, kNoDir for files
+    PagedArray<uint64_t> m_size;
+    PagedArray<uint8_t>  m_flags;
+    EntryBitset m_selected;
+    EntryBitset m_filtered;              // hidden by the current filter
+
+    // Directory id -> entry index (kNoEntry for the root or removed directories)
+    std::vector<uint32_t> m_dir_entry;
+    std::vector<int64_t> m_dir_mtime;
+    std::vector<uint64_t> m_dir_bytes;
+    std::vector<uint64_t> m_dir_files;
+    bool m_dir_totals_valid = false;
+
+    // Extended metadata, empty until the first fetch; entries past the end are unknown
+    std::vector<EntryMetadata> m_meta;
+    std::vector<uint8_t> m_meta_state;   // MetadataState
+    uint32_t m_meta_resolved = 0;        // entries known or failed
+    uint64_t m_meta_revision = NextRevision();
+};
+
+inline std::string_view FileEntry::Name() const { return m_store->GetName(m_index); }
+inline const char* FileEntry::NameCStr() const { return m_store->GetNameCStr(m_index); }
+inline std::string FileEntry::Path() const { return m_store->GetPath(m_index); }
+inline uint64_t FileEntry::Size() const { return m_store->GetSize(m_index); }
+inline bool FileEntry::IsDirectory() const { return m_store->IsDirectory(m_index); }
+inline bool FileEntry::IsSelected() const { return m_store->IsSelected(m_index); }
+inline bool FileEntry::IsFiltered() const { return m_store->IsFiltered(m_index); }
@@ -1,115 +1,1465 @@
 #include "FileScanner.h"
+#include "DirectoryWalker.h"
+#include "DirectoryWatcher.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include "ScanExport.h"
+#include "ScanSnapshot.h"
 #include <algorithm>
-#include <iostream>
 #include <system_error>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
-void FileScanner::ScanDirectory(const std::string& path, bool recursive) {
-    m_files.clear();
-    m_current_path = path;
-    
+// Worker/GUI hand-off for StartScan(). Walker threads append finished batches under
+// the mutex; the GUI thread swaps them out in PollScanResults().
+struct ScanJob {
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    std::mutex mutex;
+    std::vector<ScanBatch> batches;
+    std::shared_ptr<const EntryStore> previous; // list being refreshed, if any; read by the walker
+};
+
+// Current children of a changed directory, as the list has them
+struct ChildInfo {
+    std::string name;
+    uint64_t size;
+    bool is_directory;
+};
+
+struct RelistRequest {
+    uint32_t dir_id;
+    std::string path;
+    std::vector<ChildInfo> children;
+};
+
+// What changed in one directory. Directory ids in `added` are local to the update:
+// 0 is the relisted directory itself, anything else is a directory that didn't exist before.
+struct DirUpdate {
+    uint32_t dir_id;
+    std::vector<std::string> removed;
+    std::vector<std::pair<std::string, uint64_t>> resized;
+    std::vector<ScanBatch> added;
+};
+
+// Relists the directories the watcher reported. The GUI thread fills `requests`, the worker
+// fills `updates`, and the GUI thread reads them back once `done` is set.
+struct WatchJob {
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    bool recursive = false;
+    std::vector<RelistRequest> requests;
+    std::vector<DirUpdate> updates;
+};
+
+// Targets of a batch delete. Workers claim them through `next` and record the outcome
+// in `deleted`, which the GUI thread reads once `done` is set.
+struct DeleteJob {
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    std::vector<uint32_t> entries;
+    std::vector<std::string> paths;
+    std::vector<bool> is_directory;
+    std::vector<uint8_t> deleted;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> completed{0};
+    std::atomic<size_t> failed{0};
+
+    std::mutex mutex;
+    std::vector<std::string> errors;  // drained by the GUI thread
+    size_t suppressed_errors = 0;     // past kMaxDeleteErrors, only counted
+};
+
+namespace {
+
+// Per-file errors beyond this many are only counted, so a mass permission failure doesn't
+// bury the log
+constexpr size_t kMaxDeleteErrors = 1000;
+// Targets claimed per trip to the shared counter
+constexpr size_t kDeleteChunk = 64;
+
+// Watch updates are applied at most this often; events arriving in between are merged
+constexpr auto kWatchInterval = std::chrono::milliseconds(100);
+// Watch updates are written to the snapshot once things have been quiet for this long
+constexpr auto kSnapshotDelay = std::chrono::seconds(5);
+// Sorted lists take in streamed entries unsorted at the end and are re-sorted at most this
+// often, or less often when sorting takes a while
+constexpr auto kResortInterval = std::chrono::milliseconds(250);
+
+// Like unlinks, stats are metadata-bound: several in flight keep the disk (or the network
+// filesystem) busy even on a small machine
+unsigned MetadataThreads() {
+    return (std::min)((std::max)(4u, std::thread::hardware_concurrency()), 16u);
+}
+
+void RunScanJob(std::shared_ptr<ScanJob> job, std::string path, bool recursive) {
+    Profiler::SetThreadName("scan");
+    DirectoryWalker walker;
+    walker.Run(path, recursive, &job->cancel, [&](ScanBatch&& batch) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->batches.push_back(std::move(batch));
+    }, job->previous.get());
+    job->done.store(true, std::memory_order_release);
+}
+
+bool DeleteTarget(const std::string& path, bool is_directory, std::string& error) {
+#if defined(__linux__)
+    // Plain files are a single unlink; remove_all would lstat first
+    if (!is_directory) {
+        if (unlink(path.c_str()) == 0 || errno == ENOENT) return true;
+        if (errno != EISDIR && errno != EPERM) {
+            error = std::error_code(errno, std::generic_category()).message();
+            return false;
+        }
+        // Became a directory since the scan
+    }
+#else
+    (void)is_directory;
+#endif
     std::error_code ec;
-    if (!fs::exists(path, ec) || !fs::is_directory(path, ec)) {
-        return;
+    fs::remove_all(path, ec);
+    if (ec) {
+        error = ec.message();
+        return false;
     }
+    return true;
+}
+
+void RunDeleteWorker(DeleteJob& job) {
+    PROFILE_SCOPE("DeleteJob::Worker");
+    std::string error;
+    while (!job.cancel.load(std::memory_order_relaxed)) {
+        size_t begin = job.next.fetch_add(kDeleteChunk, std::memory_order_relaxed);
+        if (begin >= job.paths.size()) break;
+        size_t end = (std::min)(begin + kDeleteChunk, job.paths.size());
+        PROFILE_COUNT("delete.entries", end - begin);
 
-    try {
-        auto add_entry = [&](const fs::directory_entry& entry) {
-            FileEntry file;
-            file.path = entry.path().string();
-            // Store relative path or full path? Using full path effectively.
-            // For display, we might want just filename, but if recursive, maybe relative path to root?
-            // For now, keeping simple filename for display, but user might want to see structure.
-            // Let's stick to filename for now, maybe tooltip for full path?
-            // Actually, if recursive, duplicates of filenames are possible.
-            file.name = entry.path().filename().string();
-            
-            std::error_code status_ec;
-            file.is_directory = entry.is_directory(status_ec);
-            if (status_ec) file.is_directory = false;
-
-            if (file.is_directory) {
-                file.size = 0;
+        for (size_t t = begin; t < end && !job.cancel.load(std::memory_order_relaxed); t++) {
+            if (DeleteTarget(job.paths[t], job.is_directory[t], error)) {
+                job.deleted[t] = 1;
             } else {
-                file.size = entry.file_size(status_ec);
-                if (status_ec) file.size = 0;
+                job.failed.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (job.errors.size() < kMaxDeleteErrors) job.errors.push_back(job.paths[t] + ": " + error);
+                else job.suppressed_errors++;
             }
-            
-            file.is_selected = false;
-            file.is_filtered = false;
-            m_files.push_back(file);
-        };
+            job.completed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void RunDeleteJob(std::shared_ptr<DeleteJob> job) {
+    // Unlinks are metadata-bound: several in flight keep the disk (or the network filesystem)
+    // busy even on a small machine
+    size_t chunks = (job->paths.size() + kDeleteChunk - 1) / kDeleteChunk;
+    unsigned thread_count = (unsigned)(std::min)((size_t)(std::min)((std::max)(4u, std::thread::hardware_concurrency()), 16u), chunks);
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < thread_count; i++) {
+        workers.emplace_back([job, i] {
+            Profiler::SetThreadName("delete " + std::to_string(i));
+            RunDeleteWorker(*job);
+        });
+    }
+    RunDeleteWorker(*job);
+    for (auto& worker : workers) worker.join();
+    job->done.store(true, std::memory_order_release);
+}
 
-        if (recursive) {
-            for (const auto& entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec)) {
-                if (ec) continue;
-                add_entry(entry);
+void ScanNewDirectory(DirectoryWalker& walker, const std::string& path, uint32_t local_id, uint32_t& next_local,
+                      const std::atomic<bool>* cancel, DirUpdate& update) {
+    // Walker ids -> ids local to the update; the walker's root is the new directory itself
+    std::vector<uint32_t> ids(1, local_id);
+    auto map = [&](uint32_t id) {
+        if (id >= ids.size()) ids.resize((size_t)id + 1, EntryStore::kNoDir);
+        if (ids[id] == EntryStore::kNoDir) ids[id] = next_local++;
+        return ids[id];
+    };
+
+    std::mutex mutex;
+    walker.Run(path, true, cancel, [&](ScanBatch&& batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& record : batch.records) {
+            record.parent_dir = map(record.parent_dir);
+            if (record.dir_id != EntryStore::kNoDir) record.dir_id = map(record.dir_id);
+        }
+        for (auto& stamp : batch.dirs) stamp.dir_id = map(stamp.dir_id);
+        update.added.push_back(std::move(batch));
+    });
+}
+
+void RunWatchJob(std::shared_ptr<WatchJob> job) {
+    Profiler::SetThreadName("watch relist");
+    PROFILE_SCOPE("WatchJob");
+    DirectoryWalker lister(1);
+    DirectoryWalker walker;
+    for (const auto& request : job->requests) {
+        if (job->cancel.load(std::memory_order_relaxed)) break;
+
+        std::vector<ScanBatch> listing;
+        lister.Run(request.path, false, &job->cancel, [&](ScanBatch&& batch) { listing.push_back(std::move(batch)); });
+
+        std::unordered_map<std::string_view, const ChildInfo*> known;
+        for (const auto& child : request.children) known.emplace(child.name, &child);
+
+        DirUpdate update;
+        update.dir_id = request.dir_id;
+        ScanBatch added;
+        uint32_t next_local = 1;
+        std::vector<std::pair<std::string, uint32_t>> new_dirs;
+
+        for (const auto& batch : listing) {
+            added.dirs.insert(added.dirs.end(), batch.dirs.begin(), batch.dirs.end());
+            for (const auto& record : batch.records) {
+                std::string_view name = batch.Name(record);
+                auto it = known.find(name);
+                if (it != known.end()) {
+                    const ChildInfo& child = *it->second;
+                    known.erase(it);
+                    if (child.is_directory == record.is_directory) {
+                        if (!record.is_directory && child.size != record.size) update.resized.push_back({std::string(name), record.size});
+                        continue;
+                    }
+                    // Same name, different type: replace the entry
+                    update.removed.push_back(std::string(name));
+                }
+
+                ScanRecord copy = record;
+                copy.parent_dir = 0;
+                copy.dir_id = EntryStore::kNoDir;
+                copy.source = EntryStore::kNoEntry;
+                copy.name_offset = (uint32_t)added.names.size();
+                added.names.append(name);
+                added.names.push_back('\0');
+                if (copy.is_directory && job->recursive) {
+                    // The flat listing doesn't say whether it's a symlink, which we never descend into
+                    std::string path = (fs::path(request.path) / fs::path(std::string(name))).string();
+                    std::error_code ec;
+                    if (!fs::is_symlink(path, ec)) {
+                        copy.dir_id = next_local++;
+                        new_dirs.push_back({std::move(path), copy.dir_id});
+                    }
+                }
+                added.records.push_back(copy);
             }
-        } else {
-            for (const auto& entry : fs::directory_iterator(path, fs::directory_options::skip_permission_denied, ec)) {
-                if (ec) continue;
-                add_entry(entry);
+        }
+        for (const auto& entry : known) update.removed.push_back(std::string(entry.first));
+        update.added.push_back(std::move(added));
+
+        // New directories arrive with their whole subtree
+        for (const auto& dir : new_dirs) {
+            ScanNewDirectory(walker, dir.first, dir.second, next_local, &job->cancel, update);
+        }
+        job->updates.push_back(std::move(update));
+    }
+    job->done.store(true, std::memory_order_release);
+    RedrawSignal::Request();
+}
+
+} // namespace
+
+FileScanner::FileScanner(std::shared_ptr<SharedNames> names) : m_shared_names(std::move(names)) {}
+
+FileScanner::~FileScanner() {
+    CancelScan();
+    AbandonDelete();
+    CancelFindDuplicates();
+    CancelContentSearch();
+    CancelMetadataFetch();
+    StopWatching();
+    if (m_snapshot_dirty) SaveSnapshot();
+    if (m_save_thread.joinable()) m_save_thread.join();
+}
+
+void FileScanner::ScanDirectory(const std::string& path, bool recursive) {
+    PROFILE_SCOPE("FileScanner::ScanDirectory");
+    ResetList(path, recursive);
+    // Interned from the walker threads, so never into a shared pool
+    m_files.Clear(path);
+    m_files.SetScanTime(DirectoryWalker::CurrentStamp());
+
+    // Workers deliver batches concurrently; the lock also keeps them in delivery order,
+    // which the store relies on (directories before their children)
+    std::mutex files_mutex;
+    DirectoryWalker walker;
+    walker.Run(path, recursive, nullptr, [&](ScanBatch&& batch) {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        uint32_t first = m_files.Size();
+        m_files.AppendBatch(batch);
+        FilterRange(first, m_files.Size());
+    });
+    m_files.RollUpDirTotals();
+    RefreshSortedRows(true);
+    m_name_index.Update(m_files.GetNamePool());
+    PageOutColumns();
+    if (m_watch_enabled) StartWatching();
+}
+
+void FileScanner::StartScan(const std::string& path, bool recursive, bool use_snapshot) {
+    ResetList(path, recursive);
+    m_scan_cancelled = false;
+
+    bool loaded = false;
+    if (use_snapshot && m_snapshots_enabled) {
+        PROFILE_SCOPE("ScanSnapshot::Load");
+        loaded = ScanSnapshot::Load(ScanSnapshot::GetSnapshotPath(path, recursive), path, recursive, m_files);
+    }
+    if (loaded) {
+        FilterRange(0, m_files.Size());
+        RefreshSortedRows(true);
+        GetNameIndex().Update(m_files.GetNamePool());
+        StartRefresh();
+        return;
+    }
+
+    m_files.Clear(path, GetSharedPool());
+    m_files.SetScanTime(DirectoryWalker::CurrentStamp());
+    LaunchScanJob(nullptr);
+}
+
+void FileScanner::ResetList(const std::string& path, bool recursive) {
+    CancelScan();
+    StopWatching();
+    if (m_snapshot_dirty) SaveSnapshot();
+    AbandonDelete();
+    m_child_index_valid = false;
+    CancelFindDuplicates();
+    SetDuplicateGroups({});
+    CancelContentSearch();
+    SetContentHits({}, false);
+    CancelMetadataFetch();
+    m_visible_rows.clear();
+    m_sorter.Clear();
+    m_name_index.Clear();
+    m_matched_names_valid = false;
+    m_current_path = path;
+    m_recursive = recursive;
+}
+
+bool FileScanner::ExportListing(const std::string& file, ScanExport::Format format, std::string& error) const {
+    PROFILE_SCOPE("FileScanner::ExportListing");
+    if (format == ScanExport::Format::Binary && m_shared_names && &m_files.GetNamePool() == m_shared_names->pool.get()) {
+        // A binary listing carries the name pool; the other tabs' names stay out of it
+        EntryStore trimmed(m_files);
+        trimmed.TrimNames();
+        return ScanExport::Write(trimmed, m_visible_rows, format, m_recursive, file, error);
+    }
+    return ScanExport::Write(m_files, m_visible_rows, format, m_recursive, file, error);
+}
+
+bool FileScanner::ImportListing(const std::string& file, std::string& error) {
+    PROFILE_SCOPE("FileScanner::ImportListing");
+    EntryStore loaded;
+    bool recursive = false;
+    if (!ScanExport::Read(file, loaded, recursive, error)) return false;
+
+    std::string root = loaded.GetRootPath();
+    ResetList(root, recursive);
+    m_scan_cancelled = false;
+    m_files = std::move(loaded);
+    FilterRange(0, m_files.Size());
+    RefreshSortedRows(true);
+    GetNameIndex().Update(m_files.GetNamePool());
+    PageOutColumns();
+    return true;
+}
+
+void FileScanner::LaunchScanJob(std::shared_ptr<const EntryStore> previous) {
+    m_scanned_count = 0;
+    m_changed_during_scan = false;
+    m_compacted_during_scan = false;
+    m_scan_start = std::chrono::steady_clock::now();
+
+    // The worker owns a reference to the job, so a cancelled worker can keep running
+    // briefly after we've moved on without touching this scanner.
+    m_job = std::make_shared<ScanJob>();
+    m_job->previous = std::move(previous);
+    std::thread(RunScanJob, m_job, m_current_path, m_recursive).detach();
+}
+
+void FileScanner::StartRefresh() {
+    // Directory ids change with the new list, so the watches are set up again afterwards
+    StopWatching();
+    m_refreshing = true;
+    m_pending.Clear(m_current_path, GetSharedPool());
+    m_pending.SetScanTime(DirectoryWalker::CurrentStamp());
+    m_pending_index.Clear();
+    m_pending_source.clear();
+    // The walker gets its own copy since the GUI may delete/rename entries meanwhile
+    LaunchScanJob(std::make_shared<const EntryStore>(m_files));
+}
+
+void FileScanner::FinishRefresh() {
+    // Selection follows entries that still exist, unless deletions shifted the old indices
+    if (!m_compacted_during_scan) {
+        for (uint32_t i = 0; i < m_pending.Size(); i++) {
+            uint32_t source = m_pending_source[i];
+            if (source < m_files.Size() && m_files.IsSelected(source)) m_pending.SetSelected(i, true);
+        }
+    }
+
+    m_pending.RollUpDirTotals();
+    m_files = std::move(m_pending);
+    m_child_index_valid = false;
+    CancelMetadataFetch();
+    std::swap(m_name_index, m_pending_index);
+    m_pending.Clear(m_current_path);
+    m_pending_index.Clear();
+    m_pending_source = std::vector<uint32_t>();
+    m_refreshing = false;
+
+    m_matched_names_valid = false;
+    ApplyFilter(m_filter_text, m_filter_case_sensitive);
+}
+
+void FileScanner::CancelScan() {
+    if (!m_job) return;
+    m_job->cancel.store(true, std::memory_order_relaxed);
+    m_job.reset();
+    m_scan_cancelled = true;
+    m_scan_end = std::chrono::steady_clock::now();
+    // Totals of whatever was listed so far
+    if (!m_refreshing) m_files.RollUpDirTotals();
+
+    // A cancelled refresh leaves the snapshot in place
+    if (m_refreshing) {
+        m_refreshing = false;
+        m_pending.Clear(m_current_path);
+        m_pending_index.Clear();
+        m_pending_source = std::vector<uint32_t>();
+    }
+}
+
+void FileScanner::SaveSnapshot() {
+    m_snapshot_dirty = false;
+    if (m_current_path.empty() || !m_snapshots_enabled) return;
+    if (m_save_thread.joinable()) m_save_thread.join();
+
+    // Written from a copy so the GUI can keep editing the list
+    auto store = std::make_shared<EntryStore>(m_files);
+    std::string file = ScanSnapshot::GetSnapshotPath(m_current_path, m_recursive);
+    bool recursive = m_recursive;
+    m_save_thread = std::thread([store, file, recursive] {
+        Profiler::SetThreadName("snapshot");
+        PROFILE_SCOPE("ScanSnapshot::Save");
+        store->TrimNames();
+        ScanSnapshot::Save(*store, recursive, file);
+    });
+}
+
+size_t FileScanner::PollScanResults() {
+    if (!m_job) return 0;
+    PROFILE_SCOPE("FileScanner::PollScanResults");
+
+    // Check completion before taking the batches so the last batch is never missed
+    bool done = m_job->done.load(std::memory_order_acquire);
+
+    std::vector<ScanBatch> batches;
+    {
+        std::lock_guard<std::mutex> lock(m_job->mutex);
+        batches.swap(m_job->batches);
+    }
+
+    size_t added = 0;
+    if (m_refreshing) {
+        // Built on the side, the snapshot stays on screen until the refresh is complete
+        uint32_t first = m_pending.Size();
+        for (const auto& batch : batches) {
+            m_pending.AppendBatch(batch);
+            for (const auto& record : batch.records) m_pending_source.push_back(record.source);
+        }
+        GetPendingIndex().Update(m_pending.GetNamePool());
+        added = m_pending.Size() - first;
+    } else {
+        uint32_t first = m_files.Size();
+        for (const auto& batch : batches) {
+            m_files.AppendBatch(batch);
+        }
+        FilterRange(first, m_files.Size());
+        if (done) m_files.RollUpDirTotals();
+        RefreshSortedRows(done);
+        // Index the new names as they arrive so the first keystroke after the scan doesn't pay for it
+        GetNameIndex().Update(m_files.GetNamePool());
+        added = m_files.Size() - first;
+    }
+    m_scanned_count += added;
+
+    if (done) {
+        m_job.reset();
+        m_scan_end = std::chrono::steady_clock::now();
+        bool changed = m_changed_during_scan;
+        if (m_refreshing) FinishRefresh();
+
+        // Entries deleted or renamed while the walk was running may or may not be reflected
+        // in what it saw; refresh again, which only relists the directories that changed
+        if (changed) StartRefresh();
+        else SaveSnapshot();
+        if (!m_job && m_watch_enabled) StartWatching();
+        PageOutColumns();
+    }
+    return added;
+}
+
+double FileScanner::GetScanSeconds() const {
+    auto end = m_job ? std::chrono::steady_clock::now() : m_scan_end;
+    return std::chrono::duration<double>(end - m_scan_start).count();
+}
+
+double FileScanner::GetScanRate() const {
+    double seconds = GetScanSeconds();
+    return seconds > 0.0 ? m_scanned_count / seconds : 0.0;
+}
+
+// Filters [begin, end) and appends the survivors to the visible rows. Callers pass either
+// freshly appended entries or the whole store after clearing m_visible_rows.
+void FileScanner::FilterRange(uint32_t begin, uint32_t end) {
+    if (begin < end) {
+        m_matched_names_valid = false; // new names aren't in m_matched_names
+        m_sort_stale = m_sort_column != SortColumn::None;
+    }
+    for (uint32_t i = begin; i < end; i++) {
+        bool filtered = !m_query.Matches(m_files, i);
+        m_files.SetFiltered(i, filtered);
+        if (!filtered && !IsShowingSubset()) m_visible_rows.push_back(i);
+    }
+}
+
+void FileScanner::RebuildVisibleRows() {
+    PROFILE_SCOPE("FileScanner::RebuildVisibleRows");
+    m_visible_rows.clear();
+    m_sort_stale = false;
+    if (m_showing_duplicates) {
+        // Group by group, whatever the sort; the filter still applies
+        for (const DuplicateGroup& group : m_duplicate_groups) {
+            for (uint32_t i : group.entries) {
+                if (!m_files.IsFiltered(i)) m_visible_rows.push_back(i);
             }
         }
+        return;
+    }
+    // Hits keep whatever order the list is in
+    auto shown = [&](uint32_t i) {
+        return !m_files.IsFiltered(i) && (!m_showing_content_hits || GetContentHit(i));
+    };
+    if (m_sort_column == SortColumn::None) {
+        for (uint32_t i = 0; i < m_files.Size(); i++) {
+            if (shown(i)) m_visible_rows.push_back(i);
+        }
+        return;
+    }
 
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error during scan: " << e.what() << std::endl;
+    // The permutation covers the whole list and is cached, so a new filter only walks it again
+    auto start = std::chrono::steady_clock::now();
+    const PagedArray<uint32_t>& order = m_sorter.GetOrder(m_files, m_sort_column);
+    if (m_sort_ascending) {
+        for (uint32_t i : order) {
+            if (shown(i)) m_visible_rows.push_back(i);
+        }
+    } else {
+        for (size_t row = order.size(); row-- > 0;) {
+            if (shown(order[row])) m_visible_rows.push_back(order[row]);
+        }
     }
+    m_last_sort = std::chrono::steady_clock::now();
+    m_sort_interval = (std::max)(std::chrono::steady_clock::duration(kResortInterval), 4 * (m_last_sort - start));
 }
 
-void FileScanner::ApplyFilter(const std::string& pattern) {
-    for (auto& file : m_files) {
-        if (pattern.empty()) {
-            file.is_filtered = false;
-        } else {
-            // Case-insensitive search could be done here, keeping it simple for now
-            if (file.name.find(pattern) == std::string::npos) {
-                file.is_filtered = true;
-            } else {
-                file.is_filtered = false;
+NameIndex& FileScanner::GetNameIndex() {
+    // Lists read from a snapshot or a listing keep the pool they were read into
+    if (m_shared_names && &m_files.GetNamePool() == m_shared_names->pool.get()) return m_shared_names->index;
+    return m_name_index;
+}
+
+NameIndex& FileScanner::GetPendingIndex() {
+    return m_shared_names ? m_shared_names->index : m_pending_index;
+}
+
+void FileScanner::PageOutColumns() {
+    // Heap buffers ignore PageOut(), so with nothing spilled there's nothing to do
+    if (PagedBuffer::GetSpilledBytes() == 0) return;
+    PROFILE_SCOPE("FileScanner::PageOutColumns");
+    m_files.PageOut();
+    GetNameIndex().PageOut();
+    m_sorter.PageOut();
+    m_visible_rows.PageOut();
+}
+
+void FileScanner::RefreshSortedRows(bool force) {
+    if (!m_sort_stale) return;
+    if (!force && std::chrono::steady_clock::now() - m_last_sort < m_sort_interval) return;
+    RebuildVisibleRows();
+    PageOutColumns();
+}
+
+void FileScanner::SetSort(SortColumn column, bool ascending) {
+    if (column == m_sort_column && (ascending == m_sort_ascending || column == SortColumn::None)) return;
+    m_sort_column = column;
+    m_sort_ascending = ascending;
+    RebuildVisibleRows();
+    PageOutColumns();
+    UpdateMetadataFetch();
+}
+
+void FileScanner::ApplyFilter(const std::string& query, bool case_sensitive) {
+    PROFILE_SCOPE("FileScanner::ApplyFilter");
+    // However the filter ends up running, it swept the whole list
+    struct PageOutOnReturn {
+        FileScanner* scanner;
+        ~PageOutOnReturn() { scanner->PageOutColumns(); }
+    } page_out{this};
+    EntryQuery parsed;
+    if (!parsed.Parse(query, case_sensitive, m_filter_error)) return;
+    m_filter_error.clear();
+    bool same_case = case_sensitive == m_filter_case_sensitive;
+    m_filter_text = query;
+    m_filter_case_sensitive = case_sensitive;
+    m_query = std::move(parsed);
+    UpdateMetadataFetch();
+
+    if (m_query.IsEmpty()) {
+        m_filter_pattern.clear();
+        m_matched_names_valid = false;
+        m_visible_rows.clear();
+        FilterRange(0, m_files.Size());
+        if (IsShowingSubset()) RebuildVisibleRows();
+        else RefreshSortedRows(true);
+        return;
+    }
+
+    if (!m_query.IsPlainSubstring()) {
+        m_filter_pattern.clear();
+        m_matched_names_valid = false;
+        GetNameIndex().Update(m_files.GetNamePool());
+        std::vector<uint32_t> matches;
+        m_query.FindMatches(m_files, GetNameIndex(), matches);
+        size_t next = 0;
+        for (uint32_t i = 0; i < m_files.Size(); i++) {
+            bool match = next < matches.size() && matches[next] == i;
+            if (match) next++;
+            m_files.SetFiltered(i, !match);
+        }
+        if (IsEntryOrder()) {
+            m_visible_rows.clear();
+            m_visible_rows.append(matches.data(), matches.size());
+        }
+        else RebuildVisibleRows();
+        return;
+    }
+
+    // Typing one more character: everything that matches now matched before too
+    const std::string& pattern = m_query.GetSubstring();
+    bool narrowing = m_matched_names_valid && !m_filter_pattern.empty() && same_case &&
+                     pattern.find(m_filter_pattern) != std::string::npos;
+    m_filter_pattern = pattern;
+
+    // Find the matching names. Re-checking the previous matches one by one only beats the
+    // index while that set is small.
+    const NamePool& pool = m_files.GetNamePool();
+    GetNameIndex().Update(pool);
+    std::vector<uint32_t> names;
+    if (narrowing && m_matched_names.size() < 65536) {
+        NameIndex::NarrowNames(pool, pattern, case_sensitive, m_matched_names, names);
+    } else {
+        GetNameIndex().FindNames(pool, pattern, case_sensitive, names);
+    }
+    m_matched_names.swap(names);
+    m_matched_names_valid = true;
+
+    // Entries match through their interned name offset
+    m_name_bits.resize(pool.GetArenaBytes() / 64 + 1);
+    for (uint32_t offset : m_matched_names) m_name_bits[offset >> 6] |= 1ull << (offset & 63);
+    auto matches = [&](uint32_t i) {
+        uint32_t offset = m_files.GetNameOffset(i);
+        return (m_name_bits[offset >> 6] >> (offset & 63)) & 1;
+    };
+
+    // A subset view's rows aren't every unfiltered entry, so the others need their flags redone too
+    if (narrowing && !IsShowingSubset()) {
+        // Only rows visible under the shorter pattern can survive
+        size_t out = 0;
+        for (uint32_t i : m_visible_rows) {
+            if (matches(i)) m_visible_rows[out++] = i;
+            else m_files.SetFiltered(i, true);
+        }
+        m_visible_rows.resize(out);
+    } else {
+        // Sorted lists take the rows from the cached permutation instead, duplicates from the
+        // groups, content hits from the hit list
+        bool sorted = !IsEntryOrder();
+        m_visible_rows.clear();
+        for (uint32_t i = 0; i < m_files.Size(); i++) {
+            bool match = matches(i);
+            m_files.SetFiltered(i, !match);
+            if (match && !sorted) m_visible_rows.push_back(i);
+        }
+        if (sorted) RebuildVisibleRows();
+    }
+
+    for (uint32_t offset : m_matched_names) m_name_bits[offset >> 6] = 0;
+}
+
+bool FileScanner::StartDelete() {
+    if (!BeginDelete()) return false;
+    std::thread(RunDeleteJob, m_delete_job).detach();
+    return true;
+}
+
+FileScanner::DeleteStatus FileScanner::ExecuteDelete() {
+    // Same job, but the calling thread joins the pool instead of polling it
+    if (!BeginDelete()) return DeleteStatus();
+    RunDeleteJob(m_delete_job);
+    return PollDelete();
+}
+
+bool FileScanner::BeginDelete() {
+    if (m_delete_job || m_job || m_duplicate_job || m_content_job) return false;
+    PROFILE_SCOPE("FileScanner::BeginDelete");
+
+    // A selected folder takes everything inside it along, so selected entries below one are
+    // skipped. That also keeps two workers from racing on the same subtree.
+    enum : uint8_t { kUnknown, kCovered, kClear };
+    std::vector<uint8_t> dir_state(m_files.GetDirCount(), kUnknown);
+    dir_state[EntryStore::kRootDir] = kClear;
+    std::vector<uint32_t> walk;
+    auto covered = [&](uint32_t dir) {
+        while (dir_state[dir] == kUnknown) {
+            walk.push_back(dir);
+            uint32_t entry = m_files.GetDirEntry(dir);
+            if (entry == EntryStore::kNoEntry) {
+                dir_state[dir] = kClear;
+                break;
+            }
+            if (m_files.IsSelected(entry) && !m_files.IsFiltered(entry) && IsInSubset(entry)) {
+                dir_state[dir] = kCovered;
+                break;
             }
+            dir = m_files.GetParentDir(entry);
+        }
+        uint8_t state = dir_state[dir];
+        for (uint32_t d : walk) dir_state[d] = state;
+        walk.clear();
+        return state == kCovered;
+    };
+
+    auto job = std::make_shared<DeleteJob>();
+    // Only what the table shows: in a subset view, entries outside it stay whatever their flags say
+    m_files.ForEachSelectedVisible([&](uint32_t i) {
+        if (!IsInSubset(i) || covered(m_files.GetParentDir(i))) return;
+        job->entries.push_back(i);
+        job->paths.push_back(m_files.GetPath(i));
+        job->is_directory.push_back(m_files.IsDirectory(i));
+    });
+    if (job->entries.empty()) return false;
+    job->deleted.assign(job->entries.size(), 0);
+
+    // Entries must keep their indices until the results are merged, so watch updates wait.
+    // One already under way was listed before the delete and would bring entries back.
+    RequeueWatchJob();
+
+    m_delete_job = job;
+    return true;
+}
+
+// Drops the relist in flight and hands its directories back to the watcher for the next round
+void FileScanner::RequeueWatchJob() {
+    if (!m_watch_job) return;
+    m_watch_job->cancel.store(true, std::memory_order_relaxed);
+    for (const auto& request : m_watch_job->requests) m_watcher->MarkChanged(request.dir_id);
+    m_watch_job.reset();
+}
+
+void FileScanner::CancelDelete() {
+    if (m_delete_job) m_delete_job->cancel.store(true, std::memory_order_relaxed);
+}
+
+void FileScanner::AbandonDelete() {
+    // The list is about to be replaced, so the results don't matter anymore
+    CancelDelete();
+    m_delete_job.reset();
+}
+
+FileScanner::DeleteStatus FileScanner::PollDelete() {
+    DeleteStatus status;
+    if (!m_delete_job) return status;
+    DeleteJob& job = *m_delete_job;
+
+    // Check completion before draining so the last errors are never missed
+    bool done = job.done.load(std::memory_order_acquire);
+    status.total = job.entries.size();
+    status.completed = job.completed.load(std::memory_order_relaxed);
+    status.failed = job.failed.load(std::memory_order_relaxed);
+    status.cancelled = job.cancel.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        status.errors.swap(job.errors);
+    }
+    if (!done) return status;
+    PROFILE_SCOPE("FileScanner::FinishDelete");
+
+    // One pass drops the deleted entries (and anything that lived inside deleted folders)
+    std::vector<bool> removed(m_files.Size(), false);
+    size_t count = 0;
+    for (size_t t = 0; t < job.entries.size(); t++) {
+        if (!job.deleted[t]) continue;
+        removed[job.entries[t]] = true;
+        count++;
+    }
+    if (job.suppressed_errors > 0) {
+        status.errors.push_back("... and " + std::to_string(job.suppressed_errors) + " more errors");
+    }
+    m_delete_job.reset();
+
+    if (count > 0) {
+        std::vector<uint32_t> remap;
+        m_files.Compact(removed, &remap);
+        m_child_index_valid = false;
+        RemapDuplicates(remap);
+        RemapContentHits(remap);
+        CancelMetadataFetch();
+        RebuildVisibleRows();
+        OnFilesChanged(true);
+    }
+    status.finished = true;
+    return status;
+}
+
+bool FileScanner::StartFindDuplicates() {
+    if (m_duplicate_job || m_content_job || m_delete_job || m_job) return false;
+    std::vector<uint32_t> files;
+    for (uint32_t i : m_visible_rows) {
+        if (!m_files.IsDirectory(i)) files.push_back(i);
+    }
+    if (files.empty()) return false;
+    m_duplicate_job = DuplicateFinder::CreateJob(m_files, files);
+    std::thread([job = m_duplicate_job] {
+        Profiler::SetThreadName("duplicates");
+        DuplicateFinder::Run(job);
+    }).detach();
+    return true;
+}
+
+FileScanner::DuplicateStatus FileScanner::ExecuteFindDuplicates() {
+    if (m_duplicate_job || m_content_job || m_delete_job || m_job) return DuplicateStatus();
+    std::vector<uint32_t> files;
+    for (uint32_t i : m_visible_rows) {
+        if (!m_files.IsDirectory(i)) files.push_back(i);
+    }
+    m_duplicate_job = DuplicateFinder::CreateJob(m_files, files);
+    DuplicateFinder::Run(m_duplicate_job);
+    return PollDuplicates();
+}
+
+void FileScanner::CancelFindDuplicates() {
+    // The worker finishes the files it's reading and drops the results
+    if (!m_duplicate_job) return;
+    m_duplicate_job->cancel.store(true, std::memory_order_relaxed);
+    m_duplicate_job.reset();
+}
+
+FileScanner::DuplicateStatus FileScanner::PollDuplicates() {
+    DuplicateStatus status;
+    if (!m_duplicate_job) return status;
+    DuplicateJob& job = *m_duplicate_job;
+
+    bool done = job.done.load(std::memory_order_acquire);
+    status.stage = job.stage.load(std::memory_order_relaxed);
+    status.stage_done = job.stage_done.load(std::memory_order_relaxed);
+    status.stage_total = job.stage_total.load(std::memory_order_relaxed);
+    status.bytes_read = job.bytes_read.load(std::memory_order_relaxed);
+    status.failed = job.failed.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        status.errors.swap(job.errors);
+    }
+    if (!done) return status;
+
+    status.finished = true;
+    status.cancelled = job.cancel.load(std::memory_order_relaxed);
+    std::vector<DuplicateGroup> groups = std::move(job.groups);
+    m_duplicate_job.reset();
+    if (!status.cancelled) SetDuplicateGroups(std::move(groups));
+    return status;
+}
+
+void FileScanner::SetDuplicateGroups(std::vector<DuplicateGroup> groups) {
+    bool was_showing = m_showing_duplicates;
+    m_duplicate_groups = std::move(groups);
+    m_duplicate_group_of.assign(m_duplicate_groups.empty() ? 0 : m_files.Size(), kNoGroup);
+    for (uint32_t g = 0; g < m_duplicate_groups.size(); g++) {
+        for (uint32_t i : m_duplicate_groups[g].entries) m_duplicate_group_of[i] = g;
+    }
+    m_showing_duplicates = !m_duplicate_groups.empty();
+    // A selection made in the other view would act on rows that aren't shown
+    if (m_showing_duplicates != was_showing) m_files.ClearSelection();
+    if (m_showing_duplicates || was_showing) RebuildVisibleRows();
+}
+
+void FileScanner::RemapDuplicates(const std::vector<uint32_t>& remap) {
+    if (m_duplicate_groups.empty()) return;
+    std::vector<DuplicateGroup> groups;
+    for (DuplicateGroup& group : m_duplicate_groups) {
+        size_t out = 0;
+        for (uint32_t i : group.entries) {
+            if (remap[i] != EntryStore::kNoEntry) group.entries[out++] = remap[i];
         }
+        group.entries.resize(out);
+        if (out > 1) groups.push_back(std::move(group));
     }
+    SetDuplicateGroups(std::move(groups));
 }
 
-int FileScanner::ExecuteDelete() {
-    int count = 0;
-    for (auto it = m_files.begin(); it != m_files.end(); ) {
-        if (it->is_selected && !it->is_filtered) {
-            std::error_code ec;
-            std::uintmax_t result = fs::remove_all(it->path, ec);
-            if (!ec && result > 0) {
-                it = m_files.erase(it);
+size_t FileScanner::SelectDuplicateCopies() {
+    m_files.ClearSelection();
+    size_t count = 0;
+    for (const DuplicateGroup& group : m_duplicate_groups) {
+        bool kept = false;
+        for (uint32_t i : group.entries) {
+            if (m_files.IsFiltered(i)) continue;
+            if (kept) {
+                m_files.SetSelected(i, true);
                 count++;
-            } else {
-                ++it;
             }
-        } else {
-            ++it;
+            kept = true;
         }
     }
     return count;
 }
 
-int FileScanner::ExecuteRename(const std::string& suffix) {
-    int count = 0;
-    if (suffix.empty()) return 0;
-    
-    for (auto& file : m_files) {
-        if (file.is_selected && !file.is_filtered) {
-            fs::path old_path(file.path);
-            std::string new_name = old_path.stem().string() + suffix + old_path.extension().string();
-            fs::path new_path = old_path.parent_path() / new_name;
-            
-            std::error_code ec;
-            fs::rename(old_path, new_path, ec);
-            if (!ec) {
-                file.path = new_path.string();
-                file.name = new_name;
-                count++;
+void FileScanner::ShowAllEntries() {
+    SetDuplicateGroups({});
+    SetContentHits({}, false);
+}
+
+bool FileScanner::StartContentSearch(const ContentQuery& query, std::string& error) {
+    if (!BeginContentSearch(query, error)) return false;
+    std::thread([job = m_content_job] {
+        Profiler::SetThreadName("search");
+        ContentSearch::Run(job);
+    }).detach();
+    return true;
+}
+
+FileScanner::ContentSearchStatus FileScanner::ExecuteContentSearch(const ContentQuery& query, std::string& error) {
+    if (!BeginContentSearch(query, error)) return ContentSearchStatus();
+    ContentSearch::Run(m_content_job);
+    return PollContentSearch();
+}
+
+bool FileScanner::BeginContentSearch(const ContentQuery& query, std::string& error) {
+    if (m_content_job || m_duplicate_job || m_delete_job || m_job) {
+        error = "a scan, delete or search is running";
+        return false;
+    }
+    // Searching the hit view again narrows the hits down
+    std::vector<uint32_t> files;
+    for (uint32_t i : m_visible_rows) {
+        if (!m_files.IsDirectory(i)) files.push_back(i);
+    }
+    if (files.empty()) {
+        error = "no files to search";
+        return false;
+    }
+    auto job = ContentSearch::CreateJob(m_files, files, query, error);
+    if (!job) return false;
+    m_content_job = job;
+    SetDuplicateGroups({});
+    // The hits start over, so nothing selected is shown until it's found again
+    m_files.ClearSelection();
+    SetContentHits({}, true);
+    return true;
+}
+
+void FileScanner::CancelContentSearch() {
+    // Workers finish the files they're reading; what was found so far stays
+    if (!m_content_job) return;
+    m_content_job->cancel.store(true, std::memory_order_relaxed);
+    MergeContentHits(*m_content_job);
+    m_content_job.reset();
+    if (m_showing_content_hits) RebuildVisibleRows();
+}
+
+FileScanner::ContentSearchStatus FileScanner::PollContentSearch() {
+    ContentSearchStatus status;
+    if (!m_content_job) return status;
+    ContentSearchJob& job = *m_content_job;
+
+    // Check completion before draining so the last hits are never missed
+    bool done = job.done.load(std::memory_order_acquire);
+    status.total = job.total;
+    status.completed = job.completed.load(std::memory_order_relaxed);
+    status.skipped = job.skipped.load(std::memory_order_relaxed);
+    status.failed = job.failed.load(std::memory_order_relaxed);
+    status.bytes_read = job.bytes_read.load(std::memory_order_relaxed);
+    status.cancelled = job.cancel.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        status.errors.swap(job.errors);
+    }
+    MergeContentHits(job);
+    status.hits = m_content_hits.size();
+    if (!done) return status;
+
+    // Streamed hits were appended as they came; now they take their place in the order
+    status.finished = true;
+    m_content_job.reset();
+    if (m_showing_content_hits) RebuildVisibleRows();
+    return status;
+}
+
+void FileScanner::MergeContentHits(ContentSearchJob& job) {
+    std::vector<ContentHit> hits;
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        hits.swap(job.hits);
+    }
+    if (hits.empty()) return;
+    // Entries can't come or go while the search runs, see BeginDelete() and PollWatchEvents()
+    m_content_hit_of.resize(m_files.Size(), kNoGroup);
+    for (ContentHit& hit : hits) {
+        m_content_hit_of[hit.entry] = (uint32_t)m_content_hits.size();
+        if (m_showing_content_hits && !m_showing_duplicates && !m_files.IsFiltered(hit.entry)) m_visible_rows.push_back(hit.entry);
+        m_content_hits.push_back(std::move(hit));
+    }
+}
+
+void FileScanner::SetContentHits(std::vector<ContentHit> hits, bool show) {
+    bool was_showing = m_showing_content_hits;
+    m_content_hits = std::move(hits);
+    m_content_hit_of.assign(m_content_hits.empty() ? 0 : m_files.Size(), kNoGroup);
+    for (uint32_t h = 0; h < m_content_hits.size(); h++) m_content_hit_of[m_content_hits[h].entry] = h;
+    m_showing_content_hits = show;
+    if (show != was_showing) m_files.ClearSelection();
+    if (show || was_showing) RebuildVisibleRows();
+}
+
+void FileScanner::RemapContentHits(const std::vector<uint32_t>& remap) {
+    if (m_content_hits.empty()) return;
+    size_t out = 0;
+    for (size_t h = 0; h < m_content_hits.size(); h++) {
+        uint32_t entry = remap[m_content_hits[h].entry];
+        if (entry == EntryStore::kNoEntry) continue;
+        if (out != h) m_content_hits[out] = std::move(m_content_hits[h]);
+        m_content_hits[out++].entry = entry;
+    }
+    m_content_hits.resize(out);
+    // Once the last hit is deleted the whole list shows again, as with duplicate groups
+    SetContentHits(std::move(m_content_hits), m_showing_content_hits && out > 0);
+}
+
+void FileScanner::RequestMetadata(size_t first, size_t last) {
+    if (m_metadata_window_job) return;
+    last = (std::min)(last, m_visible_rows.size());
+    std::vector<uint32_t> entries;
+    for (size_t row = first; row < last; row++) {
+        uint32_t i = m_visible_rows[row];
+        if (m_files.GetMetadataState(i) == EntryStore::kMetadataUnknown) entries.push_back(i);
+    }
+    if (entries.empty()) return;
+    for (uint32_t i : entries) m_files.SetMetadataPending(i);
+    m_metadata_window_job = MetadataFetcher::CreateJob(m_files, entries);
+    std::thread([job = m_metadata_window_job] {
+        Profiler::SetThreadName("metadata");
+        MetadataFetcher::Run(job, MetadataThreads());
+    }).detach();
+}
+
+void FileScanner::UpdateMetadataFetch() {
+    if (!m_query.NeedsMetadata() && !IsMetadataColumn(m_sort_column)) {
+        // Keeps what already arrived
+        if (m_metadata_job) {
+            m_metadata_job->cancel.store(true, std::memory_order_relaxed);
+            MergeMetadata(*m_metadata_job);
+            m_metadata_job.reset();
+            m_files.ResetPendingMetadata();
+        }
+        return;
+    }
+    // Entries still streaming in are picked up once the scan is done; rows on screen that
+    // are being fetched already are left to that
+    if (m_metadata_job || m_metadata_window_job || m_job || m_files.HasAllMetadata()) return;
+
+    std::vector<uint32_t> entries;
+    for (uint32_t i = 0; i < m_files.Size(); i++) {
+        if (m_files.GetMetadataState(i) == EntryStore::kMetadataUnknown) entries.push_back(i);
+    }
+    if (entries.empty()) return;
+    for (uint32_t i : entries) m_files.SetMetadataPending(i);
+    m_metadata_job = MetadataFetcher::CreateJob(m_files, entries);
+    std::thread([job = m_metadata_job] {
+        Profiler::SetThreadName("metadata");
+        MetadataFetcher::Run(job, MetadataThreads());
+    }).detach();
+}
+
+void FileScanner::CancelMetadataFetch() {
+    // Workers finish the folder they're in and the results are dropped
+    for (auto* job : {&m_metadata_job, &m_metadata_window_job}) {
+        if (!*job) continue;
+        (*job)->cancel.store(true, std::memory_order_relaxed);
+        job->reset();
+    }
+    m_files.ResetPendingMetadata();
+}
+
+void FileScanner::MergeMetadata(MetadataJob& job) {
+    std::vector<uint32_t> finished;
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        finished.swap(job.finished);
+    }
+    for (uint32_t c : finished) {
+        const MetadataJob::Chunk& chunk = job.chunks[c];
+        for (uint32_t k = chunk.begin; k < chunk.end; k++) {
+            // Entries renamed or resized since they were asked for went back to unknown
+            uint32_t i = job.entries[k];
+            if (m_files.GetMetadataState(i) != EntryStore::kMetadataPending) continue;
+            if (job.ok[k]) m_files.SetMetadata(i, job.results[k]);
+            else m_files.SetMetadataFailed(i);
+        }
+    }
+}
+
+FileScanner::MetadataStatus FileScanner::PollMetadata() {
+    UpdateMetadataFetch();
+    MetadataStatus status;
+    if (m_metadata_window_job) {
+        bool done = m_metadata_window_job->done.load(std::memory_order_acquire);
+        MergeMetadata(*m_metadata_window_job);
+        if (done) m_metadata_window_job.reset();
+    }
+    if (!m_metadata_job) return status;
+    PROFILE_SCOPE("FileScanner::PollMetadata");
+
+    MetadataJob& job = *m_metadata_job;
+    bool done = job.done.load(std::memory_order_acquire);
+    status.total = job.entries.size();
+    status.completed = job.completed.load(std::memory_order_relaxed);
+    status.fetching = true;
+    MergeMetadata(job);
+    if (!done) {
+        // Sorted rows fall into place as the values arrive, at the throttled re-sort rate
+        if (IsMetadataColumn(m_sort_column)) m_sort_stale = true;
+        return status;
+    }
+
+    m_metadata_job.reset();
+    status.finished = true;
+    // Filtering again also sorts again
+    if (m_query.NeedsMetadata()) ApplyFilter(m_filter_text, m_filter_case_sensitive);
+    else if (IsMetadataColumn(m_sort_column)) RebuildVisibleRows();
+    return status;
+}
+
+RenamePlan FileScanner::PlanRename(const RenameOptions& options) const {
+    PROFILE_SCOPE("FileScanner::PlanRename");
+    // Unsorted, visible rows are in entry order and the set bits already come in display order
+    std::vector<uint32_t> targets;
+    if (IsEntryOrder()) {
+        m_files.ForEachSelectedVisible([&](uint32_t i) { targets.push_back(i); });
+    } else {
+        for (uint32_t i : m_visible_rows) {
+            if (m_files.IsSelected(i)) targets.push_back(i);
+        }
+    }
+    return RenamePlanner::Plan(m_files, targets, options);
+}
+
+void FileScanner::SelectRows(size_t first, size_t last) {
+    if (first > last) std::swap(first, last);
+    if (last >= m_visible_rows.size()) return;
+    if (!IsEntryOrder()) {
+        for (size_t row = first; row <= last; row++) m_files.SetSelected(m_visible_rows[row], true);
+        return;
+    }
+    // Otherwise rows are the unfiltered entries in index order, so a row range is an index range
+    m_files.SelectVisible(m_visible_rows[first], m_visible_rows[last] + 1);
+}
+
+void FileScanner::SelectAll() {
+    if (IsShowingSubset()) {
+        for (uint32_t i : m_visible_rows) m_files.SetSelected(i, true);
+        return;
+    }
+    m_files.SelectVisible(0, m_files.Size());
+}
+
+bool FileScanner::IsInSubset(uint32_t entry) const {
+    if (m_showing_duplicates) return GetDuplicateGroup(entry) != kNoGroup;
+    if (m_showing_content_hits) return GetContentHit(entry) != nullptr;
+    return true;
+}
+
+RenameResult FileScanner::ExecuteRename(const RenameOptions& options) {
+    if (m_delete_job) return RenameResult();
+    return ExecuteRename(PlanRename(options));
+}
+
+RenameResult FileScanner::ExecuteRename(const RenamePlan& plan) {
+    RenameResult result;
+    if (m_delete_job || !plan.CanExecute()) return result;
+    PROFILE_SCOPE("FileScanner::ExecuteRename");
+
+    // A relist that's already under way would see the directories half renamed
+    RequeueWatchJob();
+    result = RenamePlanner::Execute(m_files, plan);
+
+    // Paths are rebuilt from the parent chain, so children of a renamed folder
+    // automatically pick up its new name
+    for (const auto& change : result.changed) m_files.SetName(change.first, change.second);
+    if (m_watcher) RewatchRenamed(result.changed);
+    if (!result.changed.empty()) {
+        m_matched_names_valid = false;
+        if (m_sort_column != SortColumn::None) RebuildVisibleRows();
+        OnFilesChanged(false);
+    }
+    return result;
+}
+
+void FileScanner::RewatchRenamed(const std::vector<std::pair<uint32_t, std::string>>& changed) {
+    // A renamed folder loses its inotify watch (IN_MOVE_SELF), and the watcher knows it and
+    // everything below it by their old paths, which polling would find gone
+    enum : uint8_t { kUnknown, kMoved, kKept };
+    std::vector<uint8_t> dir_state;
+    for (const auto& change : changed) {
+        uint32_t dir = m_files.GetDirId(change.first);
+        if (dir == EntryStore::kNoDir) continue;
+        if (dir_state.empty()) {
+            dir_state.assign(m_files.GetDirCount(), kUnknown);
+            dir_state[EntryStore::kRootDir] = kKept;
+        }
+        dir_state[dir] = kMoved;
+    }
+    if (dir_state.empty()) return;
+
+    std::vector<uint32_t> walk;
+    for (uint32_t dir = 0; dir < m_files.GetDirCount(); dir++) {
+        uint32_t d = dir;
+        while (dir_state[d] == kUnknown) {
+            uint32_t entry = m_files.GetDirEntry(d);
+            if (entry == EntryStore::kNoEntry) {
+                dir_state[d] = kKept;
+                break;
             }
+            walk.push_back(d);
+            d = m_files.GetParentDir(entry);
         }
+        for (uint32_t w : walk) dir_state[w] = dir_state[d];
+        walk.clear();
+        if (dir_state[dir] == kMoved) m_watcher->Watch(dir, m_files.GetPath(m_files.GetDirEntry(dir)), m_files.GetDirMTime(dir));
+    }
+}
+
+void FileScanner::OnFilesChanged(bool compacted) {
+    if (m_job) {
+        // Saved when the scan finishes
+        m_changed_during_scan = true;
+        m_compacted_during_scan |= compacted;
+    } else {
+        SaveSnapshot();
+    }
+}
+
+void FileScanner::SetWatchEnabled(bool enabled) {
+    m_watch_enabled = enabled;
+    if (!enabled) StopWatching();
+    else if (!m_watcher && !m_job && !m_current_path.empty()) StartWatching();
+}
+
+bool FileScanner::IsWatchPolling() const {
+    return m_watcher && m_watcher->IsPolling();
+}
+
+void FileScanner::StartWatching() {
+    StopWatching();
+    m_watcher = std::make_unique<DirectoryWatcher>();
+    m_watcher->WatchTree(std::make_shared<const EntryStore>(m_files));
+    m_last_watch_update = std::chrono::steady_clock::now();
+}
+
+void FileScanner::StopWatching() {
+    if (m_watch_job) {
+        m_watch_job->cancel.store(true, std::memory_order_relaxed);
+        m_watch_job.reset();
+    }
+    m_watcher.reset();
+}
+
+size_t FileScanner::PollWatchEvents() {
+    // Also the place where a sorted list catches up with entries appended since the last sort
+    RefreshSortedRows(false);
+
+    // Scans replace the list, deletes and searches need stable indices; changes wait in the watcher
+    if (!m_watcher || m_job || m_delete_job || m_duplicate_job || m_content_job) return 0;
+    PROFILE_SCOPE("FileScanner::PollWatchEvents");
+
+    size_t changes = 0;
+    if (m_watch_job) {
+        if (!m_watch_job->done.load(std::memory_order_acquire)) return 0;
+        changes = ApplyWatchJob(*m_watch_job);
+        m_watch_job.reset();
+    }
+
+    // Events keep piling up in the watcher until the next update, each directory only once,
+    // so a burst costs one relist per directory rather than one per event
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_watch_update >= kWatchInterval) {
+        std::vector<uint32_t> dirs;
+        bool overflow = false;
+        m_watcher->TakeChanges(dirs, overflow);
+        if (overflow) {
+            // Events were dropped; the mtime-driven refresh finds whatever we missed
+            StartRefresh();
+            return changes;
+        }
+
+        auto job = std::make_shared<WatchJob>();
+        job->recursive = m_recursive;
+        EnsureChildIndex(dirs.size());
+        for (uint32_t dir : dirs) {
+            uint32_t entry = dir < m_files.GetDirCount() ? m_files.GetDirEntry(dir) : EntryStore::kNoEntry;
+            if (dir != EntryStore::kRootDir && entry == EntryStore::kNoEntry) continue; // deleted in the meantime
+
+            RelistRequest request;
+            request.dir_id = dir;
+            request.path = dir == EntryStore::kRootDir ? m_current_path : m_files.GetPath(entry);
+            ForEachChild(dir, m_files.Size(), [&](uint32_t i) {
+                request.children.push_back({std::string(m_files.GetName(i)), m_files.GetSize(i), m_files.IsDirectory(i)});
+            });
+            job->requests.push_back(std::move(request));
+        }
+        if (!job->requests.empty()) {
+            m_watch_job = job;
+            std::thread(RunWatchJob, job).detach();
+            m_last_watch_update = now;
+        }
+    }
+
+    if (m_snapshot_dirty && now - m_last_watch_change >= kSnapshotDelay) SaveSnapshot();
+    return changes;
+}
+
+bool FileScanner::HasPendingUpdates() const {
+    return m_sort_stale || m_watch_job || (m_watcher && m_watcher->HasChanges());
+}
+
+size_t FileScanner::ApplyWatchJob(WatchJob& job) {
+    PROFILE_SCOPE("FileScanner::ApplyWatchJob");
+    size_t changes = 0;
+    uint32_t first_new = m_files.Size();
+    uint32_t next_dir = m_files.GetDirCount();
+    std::vector<uint32_t> removed_entries;
+    std::vector<uint32_t> new_dirs;
+
+    EnsureChildIndex(job.updates.size());
+    for (auto& update : job.updates) {
+        uint32_t dir = update.dir_id;
+        if (dir != EntryStore::kRootDir && m_files.GetDirEntry(dir) == EntryStore::kNoEntry) continue;
+
+        if (!update.removed.empty() || !update.resized.empty()) {
+            std::unordered_set<std::string_view> removed(update.removed.begin(), update.removed.end());
+            std::unordered_map<std::string_view, uint64_t> resized(update.resized.begin(), update.resized.end());
+            ForEachChild(dir, first_new, [&](uint32_t i) {
+                std::string_view name = m_files.GetName(i);
+                if (removed.count(name)) {
+                    removed_entries.push_back(i);
+                    changes++;
+                } else if (auto it = resized.find(name); it != resized.end()) {
+                    m_files.SetSize(i, it->second);
+                    changes++;
+                }
+            });
+        }
+
+        // Update-local directory ids -> fresh ids in the store
+        std::vector<uint32_t> ids(1, dir);
+        auto map = [&](uint32_t id) {
+            if (id >= ids.size()) ids.resize((size_t)id + 1, EntryStore::kNoDir);
+            if (ids[id] == EntryStore::kNoDir) {
+                ids[id] = next_dir++;
+                new_dirs.push_back(ids[id]);
+            }
+            return ids[id];
+        };
+        for (auto& batch : update.added) {
+            for (auto& record : batch.records) {
+                record.parent_dir = map(record.parent_dir);
+                if (record.dir_id != EntryStore::kNoDir) record.dir_id = map(record.dir_id);
+            }
+            for (auto& stamp : batch.dirs) stamp.dir_id = map(stamp.dir_id);
+            m_files.AppendBatch(batch);
+        }
+    }
+
+    uint32_t added = m_files.Size() - first_new;
+    changes += added;
+    if (added > 0) {
+        FilterRange(first_new, m_files.Size());
+        GetNameIndex().Update(m_files.GetNamePool());
+    }
+    if (!removed_entries.empty()) {
+        // Selected/filtered flags travel with the surviving entries
+        std::vector<bool> removed(m_files.Size(), false);
+        for (uint32_t i : removed_entries) removed[i] = true;
+        std::vector<uint32_t> remap;
+        m_files.Compact(removed, &remap);
+        m_child_index_valid = false;
+        RemapDuplicates(remap);
+        RemapContentHits(remap);
+        CancelMetadataFetch();
+        RebuildVisibleRows();
+    }
+
+    for (uint32_t new_dir : new_dirs) {
+        uint32_t entry = m_files.GetDirEntry(new_dir);
+        if (entry != EntryStore::kNoEntry) m_watcher->Watch(new_dir, m_files.GetPath(entry), m_files.GetDirMTime(new_dir));
+    }
+
+    if (changes > 0) {
+        m_snapshot_dirty = true;
+        m_last_watch_change = std::chrono::steady_clock::now();
+        // New sizes or names may move rows; picked up by the throttled re-sort
+        if (m_sort_column != SortColumn::None) m_sort_stale = true;
+    }
+    return changes;
+}
+
+void FileScanner::EnsureChildIndex(size_t lookups) {
+    // Entries appended since the last build are found by scanning the tail, which is cheaper
+    // than a rebuild as long as it stays small compared to the whole list
+    uint32_t size = m_files.Size();
+    if (m_child_index_valid && m_child_index_size <= size &&
+        (uint64_t)(size - m_child_index_size) * lookups <= size) {
+        return;
+    }
+
+    uint32_t dir_count = m_files.GetDirCount();
+    m_child_begin.assign((size_t)dir_count + 1, 0);
+    for (uint32_t i = 0; i < size; i++) m_child_begin[m_files.GetParentDir(i) + 1]++;
+    for (uint32_t d = 0; d < dir_count; d++) m_child_begin[d + 1] += m_child_begin[d];
+    std::vector<uint32_t> next(m_child_begin.begin(), m_child_begin.end() - 1);
+    m_children.resize(size);
+    for (uint32_t i = 0; i < size; i++) m_children[next[m_files.GetParentDir(i)]++] = i;
+
+    m_child_index_size = size;
+    m_child_index_valid = true;
+}
+
+template <typename Fn>
+void FileScanner::ForEachChild(uint32_t dir, uint32_t limit, Fn&& fn) const {
+    if ((size_t)dir + 1 < m_child_begin.size()) {
+        for (uint32_t k = m_child_begin[dir]; k < m_child_begin[dir + 1]; k++) fn(m_children[k]);
+    }
+    for (uint32_t i = m_child_index_size; i < limit; i++) {
+        if (m_files.GetParentDir(i) == dir) fn(i);
     }
-    return count;
 }
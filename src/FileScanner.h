@@ -2,37 +2,368 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <memory>
+#include <chrono>
+#include <string_view>
+#include <thread>
+
+#include "ContentSearch.h"
+#include "DuplicateFinder.h"
+#include "EntryQuery.h"
+#include "EntrySorter.h"
+#include "EntryStore.h"
+#include "MetadataFetcher.h"
+#include "NameIndex.h"
+#include "RenamePlanner.h"
+#include "ScanExport.h"
 
 enum class ActionType {
     Delete,
     Rename
 };
 
-struct FileEntry {
-    std::string name;
-    std::string path;
-    uintmax_t size;
-    bool is_directory;
-    bool is_selected = false;
-    bool is_filtered = false; // true if hidden by filter
-};
+// Shared state between the GUI thread and a background scan worker (defined in FileScanner.cpp)
+struct ScanJob;
+struct WatchJob;
+struct DeleteJob;
+class DirectoryWatcher;
 
 class FileScanner {
 public:
+    // Scanners given the same `names` intern their lists into one pool with one index over it,
+    // so a name common to several of them is stored and indexed once. They must all be used
+    // from the same thread, which StartScan() and the Poll functions are anyway. Without
+    // `names`, every list has a pool of its own.
+    explicit FileScanner(std::shared_ptr<SharedNames> names = nullptr);
+    ~FileScanner();
+
+    // Blocking scan on the calling thread. The list gets a pool of its own even when the
+    // scanner has shared names, since it's filled from the walker threads.
     void ScanDirectory(const std::string& path, bool recursive = false);
-    void ApplyFilter(const std::string& pattern);
-    
-    // Returns number of successes
-    int ExecuteDelete();
-    
-    // Simple rename: appends suffix to selected files
-    int ExecuteRename(const std::string& suffix);
-
-    const std::vector<FileEntry>& GetFiles() const { return m_files; }
-    std::vector<FileEntry>& GetFilesModifiable() { return m_files; }
+
+    // Asynchronous scan: worker threads produce ScanBatches which are
+    // merged into the file list by PollScanResults(). Starting a new scan cancels
+    // the previous one without waiting for its thread to exit.
+    //
+    // With `use_snapshot`, a cached snapshot of the same folder and mode is loaded first so
+    // the table is filled immediately, and the scan becomes a refresh that only relists
+    // directories whose mtime changed. The refreshed list replaces the snapshot once it's
+    // complete. Finished scans are written back to the cache in the background.
+    void StartScan(const std::string& path, bool recursive = false, bool use_snapshot = true);
+    void CancelScan();
+
+    // Writes the visible rows in display order as CSV or NDJSON, or the whole list as a binary
+    // listing, see ScanExport
+    bool ExportListing(const std::string& file, ScanExport::Format format, std::string& error) const;
+    // Replaces the list with a binary listing from ExportListing(), possibly made on another
+    // machine. The listing is shown as it was saved and nothing is rescanned, since its folder
+    // may not even exist here; watching stays off until the next scan or until it's turned on again.
+    bool ImportListing(const std::string& file, std::string& error);
+
+    // Snapshots are on by default; one-off tools can skip reading and writing the cache
+    void SetSnapshotsEnabled(bool enabled) { m_snapshots_enabled = enabled; }
+
+    // Call once per frame from the GUI thread. Returns number of entries added.
+    size_t PollScanResults();
+
+    bool IsScanning() const { return m_job != nullptr; }
+    bool IsRefreshing() const { return m_refreshing; } // showing a snapshot while it's being refreshed
+    bool WasScanCancelled() const { return m_scan_cancelled; }
+    size_t GetScannedCount() const { return m_scanned_count; }
+    double GetScanSeconds() const;
+    double GetScanRate() const; // entries/sec
+
+    // Watch mode: keeps the list in sync with changes made by other programs. Changed
+    // directories are relisted on a worker thread and the differences merged into the list in
+    // place, so selection and filter state carry over. Updates are applied at most every
+    // 100 ms however many events arrive. Suspended while a scan is running.
+    void SetWatchEnabled(bool enabled);
+    bool IsWatchEnabled() const { return m_watch_enabled; }
+    bool IsWatchPolling() const; // true when falling back to mtime polling
+
+    // Call once per frame from the GUI thread. Returns number of entries added, removed or resized.
+    size_t PollWatchEvents();
+    // Watch changes or a re-sort wait for their interval to pass, or a relist is running;
+    // PollWatchEvents() has work coming up
+    bool HasPendingUpdates() const;
+
+    // Filters the list with an EntryQuery ("*.log size>100M type:file"). A plain word is a
+    // substring search on names that goes straight to the name index, and when it extends the
+    // previous word only the previous matches are re-checked. Other queries run over the whole
+    // list in parallel. If `query` doesn't parse, the list keeps the last valid filter and
+    // GetFilterError() says what's wrong.
+    void ApplyFilter(const std::string& query, bool case_sensitive = true);
+    const std::string& GetFilterError() const { return m_filter_error; }
+
+    // Progress of an asynchronous delete, see PollDelete()
+    struct DeleteStatus {
+        size_t total = 0;
+        size_t completed = 0;   // deleted or failed so far
+        size_t failed = 0;
+        bool finished = false;
+        bool cancelled = false;
+        std::vector<std::string> errors; // "path: reason", new since the previous poll
+    };
+
+    // Deletes the selected, visible entries on a pool of worker threads. Selected entries
+    // inside a selected folder are left to the folder's removal. Returns false if there is
+    // nothing to delete, or a scan or another delete is running.
+    bool StartDelete();
+    // Stops handing out new entries; ones already being removed finish first
+    void CancelDelete();
+    bool IsDeleting() const { return m_delete_job != nullptr; }
+
+    // Call once per frame while deleting. Once the workers are done, the deleted entries
+    // (and anything inside deleted folders) are dropped from the list in a single pass and
+    // the returned status is `finished`.
+    DeleteStatus PollDelete();
+
+    // Blocking delete on the calling thread plus the same worker pool; returns the final status
+    DeleteStatus ExecuteDelete();
+
+    // Dry run of a batch rename over the selected, visible entries in display order (which is
+    // what the counter follows). Nothing is touched; the plan lists every new name and conflict.
+    RenamePlan PlanRename(const RenameOptions& options) const;
+    // Plans again against the current list and, if nothing conflicts, runs the renames on a
+    // worker pool and updates the list. Refused while a delete is running.
+    RenameResult ExecuteRename(const RenameOptions& options);
+    // Runs a plan from PlanRename() as is; the list must not have changed in between
+    RenameResult ExecuteRename(const RenamePlan& plan);
+
+    // Progress of a duplicate search, see PollDuplicates()
+    struct DuplicateStatus {
+        int stage = DuplicateJob::kEdges;
+        size_t stage_done = 0;  // files hashed in the current stage
+        size_t stage_total = 0;
+        uint64_t bytes_read = 0;
+        size_t failed = 0;      // unreadable files, left out of the groups
+        bool finished = false;
+        bool cancelled = false;
+        std::vector<std::string> errors; // "path: reason", new since the previous poll
+    };
+
+    // Looks for files with identical contents among the visible files on a pool of I/O
+    // threads (see DuplicateFinder). Once it's done, the table shows only the duplicate groups,
+    // largest waste first, so extra copies can be selected and removed with the usual delete.
+    // Returns false if there are no files to compare, or a scan, delete or search is running.
+    bool StartFindDuplicates();
+    void CancelFindDuplicates();
+    bool IsFindingDuplicates() const { return m_duplicate_job != nullptr; }
+    // Call once per frame while searching; switches to the duplicate view when `finished`
+    DuplicateStatus PollDuplicates();
+    // Blocking search on the calling thread plus the I/O pool; returns the final status
+    DuplicateStatus ExecuteFindDuplicates();
+
+    bool IsShowingDuplicates() const { return m_showing_duplicates; }
+    // Groups stay in step with the list: deleted copies leave their group, and groups left
+    // with a single file are dropped
+    const std::vector<DuplicateGroup>& GetDuplicateGroups() const { return m_duplicate_groups; }
+    // Position of the entry's group in GetDuplicateGroups(), kNoGroup if it has none
+    static constexpr uint32_t kNoGroup = 0xFFFFFFFFu;
+    uint32_t GetDuplicateGroup(uint32_t entry) const {
+        return entry < m_duplicate_group_of.size() ? m_duplicate_group_of[entry] : kNoGroup;
+    }
+    // Selects every visible copy but the first of each group, clearing the rest; returns how many
+    size_t SelectDuplicateCopies();
+    // Leaves the duplicate view and shows the whole list again
+    void ShowAllEntries();
+
+    // Progress of a content search, see PollContentSearch()
+    struct ContentSearchStatus {
+        size_t total = 0;       // files searched, folders aside
+        size_t completed = 0;   // read, skipped or failed so far
+        size_t skipped = 0;     // binary, or over the size limit
+        size_t failed = 0;
+        size_t hits = 0;
+        uint64_t bytes_read = 0;
+        bool finished = false;
+        bool cancelled = false;
+        std::vector<std::string> errors; // "path: reason", new since the previous poll
+    };
+
+    // Looks for the visible files whose contents match `query` on a pool of I/O threads (see
+    // ContentSearch). The table switches to the hit view right away: matching files show up
+    // at the end as they're found, and fall into the sort order once the search is done.
+    // Returns false with `error` set if the query is bad or there are no files to search, or
+    // a scan, delete or duplicate search is running.
+    bool StartContentSearch(const ContentQuery& query, std::string& error);
+    // Stops handing out files; the hits found so far stay on show
+    void CancelContentSearch();
+    bool IsSearchingContents() const { return m_content_job != nullptr; }
+    // Call once per frame while searching; merges the hits that arrived since the last poll
+    ContentSearchStatus PollContentSearch();
+    // Blocking search on the calling thread plus the I/O pool; returns the final status
+    ContentSearchStatus ExecuteContentSearch(const ContentQuery& query, std::string& error);
+
+    bool IsShowingContentHits() const { return m_showing_content_hits; }
+    // Hits in the order they were found; like duplicate groups, they follow deletes
+    const std::vector<ContentHit>& GetContentHits() const { return m_content_hits; }
+    // First match in the entry's file, null if it has none
+    const ContentHit* GetContentHit(uint32_t entry) const {
+        uint32_t hit = entry < m_content_hit_of.size() ? m_content_hit_of[entry] : kNoGroup;
+        return hit == kNoGroup ? nullptr : &m_content_hits[hit];
+    }
+
+    // Progress of a full metadata fetch, see PollMetadata()
+    struct MetadataStatus {
+        size_t total = 0;
+        size_t completed = 0;
+        bool fetching = false;
+        bool finished = false;
+    };
+
+    // Extended metadata (modification time, permissions, owner) isn't read by the scan. The
+    // table asks for the rows it shows plus a margin, which are fetched in the background.
+    // Sorting on a metadata column or filtering on a metadata term fetches the whole list on
+    // a pool of threads instead, then sorts or filters again once it's all there; entries
+    // the scan or the watcher adds later are fetched the same way. Fetches in flight are
+    // dropped when entries are removed, since they hold indices.
+    //
+    // Visible rows [first, last), either end clamped; ignored while a previous request runs
+    void RequestMetadata(size_t first, size_t last);
+    bool IsFetchingMetadata() const { return m_metadata_job || m_metadata_window_job; }
+    // Call once per frame; merges what arrived since the last poll
+    MetadataStatus PollMetadata();
+
+    const EntryStore& GetFiles() const { return m_files; }
+    EntryStore& GetFilesModifiable() { return m_files; }
+    // Indices of the entries that pass the filter, in display order. Maintained incrementally
+    // as scan batches arrive and rebuilt only when the filter or the file list changes. Spills
+    // past the memory budget like the entry columns.
+    const PagedArray<uint32_t>& GetVisibleRows() const { return m_visible_rows; }
+
+    // Display order of the visible rows; SortColumn::None is scan order. Sorted orders are
+    // cached per column, so switching back, flipping direction or changing the filter doesn't
+    // sort again. Entries streamed in by a scan or the watcher show up at the end and are
+    // sorted in every few hundred ms.
+    void SetSort(SortColumn column, bool ascending);
+    SortColumn GetSortColumn() const { return m_sort_column; }
+    bool IsSortAscending() const { return m_sort_ascending; }
+    // Adds the visible rows first..last (positions in GetVisibleRows(), either order) to the selection
+    void SelectRows(size_t first, size_t last);
+    // Adds every visible row to the selection; in the duplicate or hit view only the rows it shows
+    void SelectAll();
     const std::string& GetCurrentPath() const { return m_current_path; }
+    bool IsRecursive() const { return m_recursive; }
 
 private:
-    std::vector<FileEntry> m_files;
+    // Stops everything working on the current list and drops what was derived from it, before
+    // a new list for `path` replaces it
+    void ResetList(const std::string& path, bool recursive);
+    void LaunchScanJob(std::shared_ptr<const EntryStore> previous);
+    void StartRefresh();
+    void FinishRefresh();
+    void SaveSnapshot();
+    void OnFilesChanged(bool compacted);
+    bool BeginDelete();
+    void AbandonDelete();
+    void RequeueWatchJob();
+    // Registers renamed folders and their subfolders with the watcher again, under their new paths
+    void RewatchRenamed(const std::vector<std::pair<uint32_t, std::string>>& changed);
+
+    void StartWatching();
+    void StopWatching();
+    size_t ApplyWatchJob(WatchJob& job);
+    void EnsureChildIndex(size_t lookups);
+    // Children of `dir` among the first `limit` entries
+    template <typename Fn> void ForEachChild(uint32_t dir, uint32_t limit, Fn&& fn) const;
+
+    void FilterRange(uint32_t begin, uint32_t end);
+    // Visible rows are the unfiltered entries in index order (no sort, no duplicate or hit view)
+    bool IsEntryOrder() const { return m_sort_column == SortColumn::None && !IsShowingSubset(); }
+    // The table shows duplicate groups or content hits rather than every unfiltered entry
+    bool IsShowingSubset() const { return m_showing_duplicates || m_showing_content_hits; }
+    // Whether the subset being shown, if any, includes the entry (the filter aside)
+    bool IsInSubset(uint32_t entry) const;
+    void SetDuplicateGroups(std::vector<DuplicateGroup> groups);
+    void RemapDuplicates(const std::vector<uint32_t>& remap);
+    bool BeginContentSearch(const ContentQuery& query, std::string& error);
+    void MergeContentHits(ContentSearchJob& job);
+    void SetContentHits(std::vector<ContentHit> hits, bool show);
+    void RemapContentHits(const std::vector<uint32_t>& remap);
+    void RebuildVisibleRows();
+    // Re-sorts if entries were added or changed since the last sort, and (unless forced)
+    // the re-sort interval has passed
+    void RefreshSortedRows(bool force);
+    // Drops what a sweep over a spilled list, its sort orders or its rows paged in, see PagedBuffer
+    void PageOutColumns();
+    // Index over the pool m_files / m_pending intern into: the shared one, or the scanner's own
+    NameIndex& GetNameIndex();
+    NameIndex& GetPendingIndex();
+    std::shared_ptr<NamePool> GetSharedPool() const { return m_shared_names ? m_shared_names->pool : nullptr; }
+
+    // Starts a full fetch when the sort or filter needs every entry's metadata, and stops
+    // one that nothing needs anymore
+    void UpdateMetadataFetch();
+    void CancelMetadataFetch();
+    void MergeMetadata(MetadataJob& job);
+
+    EntryStore m_files;
+    PagedArray<uint32_t> m_visible_rows;
     std::string m_current_path;
+    bool m_recursive = false;
+    std::string m_filter_text;               // last query that parsed
+    bool m_filter_case_sensitive = true;
+    EntryQuery m_query;
+    std::string m_filter_pattern;            // the word, when m_query is a plain substring
+    std::string m_filter_error;
+
+    EntrySorter m_sorter;
+    SortColumn m_sort_column = SortColumn::None;
+    bool m_sort_ascending = true;
+    bool m_sort_stale = false;               // rows appended or entries changed since the last sort
+    std::chrono::steady_clock::time_point m_last_sort;
+    std::chrono::steady_clock::duration m_sort_interval{};
+
+    std::shared_ptr<SharedNames> m_shared_names; // null: lists keep pools of their own
+    NameIndex m_name_index;                      // for a list with a pool of its own
+    std::vector<uint32_t> m_matched_names;   // name offsets matching m_filter_pattern
+    bool m_matched_names_valid = false;      // false once names were added/changed since the last query
+    std::vector<uint64_t> m_name_bits;       // scratch: one bit per arena byte, set at matched name offsets
+
+    // Refresh in progress: the walker fills m_pending while m_files keeps showing the old list
+    bool m_refreshing = false;
+    EntryStore m_pending;
+    NameIndex m_pending_index;
+    std::vector<uint32_t> m_pending_source;  // per pending entry, index of the same entry in m_files
+    bool m_changed_during_scan = false;      // entries deleted/renamed while a scan was running
+    bool m_compacted_during_scan = false;    // m_files indices shifted, so m_pending_source is stale
+
+    bool m_snapshots_enabled = true;
+    std::thread m_save_thread;
+    bool m_snapshot_dirty = false;           // watch updates not saved yet
+
+    bool m_watch_enabled = false;
+    std::unique_ptr<DirectoryWatcher> m_watcher;
+    std::shared_ptr<WatchJob> m_watch_job;
+    std::chrono::steady_clock::time_point m_last_watch_update;
+    std::chrono::steady_clock::time_point m_last_watch_change;
+
+    // Entries grouped by parent directory, for diffing relisted directories. Covers the first
+    // m_child_index_size entries; later appends are found by scanning the tail.
+    std::vector<uint32_t> m_child_begin;
+    std::vector<uint32_t> m_children;
+    uint32_t m_child_index_size = 0;
+    bool m_child_index_valid = false;
+
+    std::shared_ptr<DeleteJob> m_delete_job;
+
+    std::shared_ptr<DuplicateJob> m_duplicate_job;
+    bool m_showing_duplicates = false;
+    std::vector<DuplicateGroup> m_duplicate_groups;
+    std::vector<uint32_t> m_duplicate_group_of; // per entry, kNoGroup if in none
+
+    std::shared_ptr<ContentSearchJob> m_content_job;
+    bool m_showing_content_hits = false;
+    std::vector<ContentHit> m_content_hits;
+    std::vector<uint32_t> m_content_hit_of;     // per entry, into m_content_hits, kNoGroup if none
+
+    std::shared_ptr<MetadataJob> m_metadata_job;        // whole list, for a sort or filter
+    std::shared_ptr<MetadataJob> m_metadata_window_job; // rows on screen
+
+    std::shared_ptr<ScanJob> m_job;
+    size_t m_scanned_count = 0;
+    bool m_scan_cancelled = false;
+    std::chrono::steady_clock::time_point m_scan_start;
+    std::chrono::steady_clock::time_point m_scan_end;
 };
@@ -0,0 +1,19 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+// Sizing shared by the jobs that read file contents (DuplicateFinder, ContentSearch)
+
+// Enough to keep an SSD busy, few enough not to thrash a spinning disk
+constexpr unsigned kMaxIoThreads = 8;
+
+// Per-file errors a job keeps for display; beyond this they're only counted
+constexpr size_t kMaxFileErrors = 1000;
+
+// Threads, the caller's included, for `work` files: at least two, since reads mostly wait,
+// at most kMaxIoThreads or one per file
+inline unsigned IoThreadCount(size_t work) {
+    unsigned threads = (std::min)((std::max)(2u, std::thread::hardware_concurrency()), kMaxIoThreads);
+    return (unsigned)(std::min)((size_t)threads, work);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNM_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Literal search kernel shared by NameIndex (over the name arena) and ContentSearch (over
+// file contents). Case-insensitive search folds ASCII only; needles are passed pre-folded.
+//
+// The SSE2 filter compares 16 candidate positions at once against the needle's first and
+// last bytes, and only the survivors are compared in full.
+namespace LiteralScan {
+
+inline unsigned char FoldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c;
+}
+
+inline unsigned CountTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+inline unsigned HighestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (unsigned)index;
+#else
+    return 31u - (unsigned)__builtin_clz(mask);
+#endif
+}
+
+inline bool EqualAt(const char* text, std::string_view needle, bool case_sensitive) {
+    if (case_sensitive) return std::memcmp(text, needle.data(), needle.size()) == 0;
+    for (size_t i = 0; i < needle.size(); i++) {
+        if (FoldAscii((unsigned char)text[i]) != (unsigned char)needle[i]) return false;
+    }
+    return true;
+}
+
+#if FNM_HAVE_SSE2
+inline __m128i FoldAscii16(__m128i v) {
+    // Signed compares: bytes >= 0x80 are negative and never fall in 'A'..'Z'
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// First/last byte filter for one needle (never empty)
+class Filter {
+public:
+    Filter(std::string_view needle, bool case_sensitive)
+        : m_k(needle.size()), m_case_sensitive(case_sensitive),
+          m_middle(needle.size() >= 2 ? needle.substr(1, needle.size() - 2) : std::string_view()),
+          m_first(_mm_set1_epi8(needle[0])), m_last(_mm_set1_epi8(needle[needle.size() - 1])) {}
+
+    // Reads at + 0 .. at + 15 + k - 1
+    size_t Reach() const { return m_k - 1 + 16; }
+
+    // Bit b set: the needle's first and last bytes line up at `at + b`
+    unsigned Candidates(const char* at) const {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+        __m128i b = m_k >= 2 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(at + m_k - 1)) : a;
+        if (!m_case_sensitive) {
+            a = FoldAscii16(a);
+            b = m_k >= 2 ? FoldAscii16(b) : a;
+        }
+        return (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, m_first), _mm_cmpeq_epi8(b, m_last)));
+    }
+
+    // Full check of a candidate, given its position
+    bool Verify(const char* candidate) const { return EqualAt(candidate + 1, m_middle, m_case_sensitive); }
+
+private:
+    size_t m_k;
+    bool m_case_sensitive;
+    std::string_view m_middle;
+    __m128i m_first;
+    __m128i m_last;
+};
+#endif
+
+// Offset of the first `needle` (pre-folded when !case_sensitive, never empty) in
+// [data, data + size), or `size` if there is none
+inline size_t FindLiteral(const char* data, size_t size, std::string_view needle, bool case_sensitive) {
+    const size_t k = needle.size();
+    if (k > size) return size;
+    size_t i = 0;
+#if FNM_HAVE_SSE2
+    const Filter filter(needle, case_sensitive);
+    for (; i + filter.Reach() <= size; i += 16) {
+        for (unsigned mask = filter.Candidates(data + i); mask; mask &= mask - 1) {
+            unsigned bit = CountTrailingZeros(mask);
+            if (filter.Verify(data + i + bit)) return i + bit;
+        }
+    }
+#else
+    if (case_sensitive) return (std::min)(std::string_view(data, size).find(needle), size);
+#endif
+    for (; i + k <= size; i++) {
+        if (EqualAt(data + i, needle, case_sensitive)) return i;
+    }
+    return size;
+}
+
+} // namespace LiteralScan
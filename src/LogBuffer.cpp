@@ -0,0 +1,91 @@
+#include "LogBuffer.h"
+#include "RedrawSignal.h"
+#include <algorithm>
+
+LogBuffer::LogBuffer(size_t capacity) : m_head(&m_stub), m_tail(&m_stub), m_lines(std::max<size_t>(capacity, 1)) {}
+
+LogBuffer::~LogBuffer() {
+    // No producers are left by now; free whatever they queued that was never drained
+    while (Node* node = Dequeue()) delete node;
+}
+
+void LogBuffer::Push(std::string_view text) {
+    if (text.empty()) return;
+    Node* node = new Node;
+    node->text.assign(text);
+    Enqueue(node);
+    RedrawSignal::Request();
+}
+
+void LogBuffer::Enqueue(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+    // Until this store lands the reader sees the list end at `prev` and picks the rest up
+    // on a later Drain()
+    prev->next.store(node, std::memory_order_release);
+}
+
+LogBuffer::Node* LogBuffer::Dequeue() {
+    Node* tail = m_tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &m_stub) {
+        if (!next) return nullptr;
+        m_tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        m_tail = next;
+        return tail;
+    }
+
+    // `tail` looks like the last node. If a producer is halfway through Enqueue() it isn't,
+    // and its link shows up soon; otherwise put the stub behind it so it can be handed out.
+    if (tail != m_head.load(std::memory_order_acquire)) return nullptr;
+    Enqueue(&m_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (!next) return nullptr;
+    m_tail = next;
+    return tail;
+}
+
+size_t LogBuffer::Drain() {
+    uint64_t end = m_end;
+    while (Node* node = Dequeue()) {
+        std::string_view text = node->text;
+        size_t begin = 0;
+        for (;;) {
+            size_t newline = text.find('\n', begin);
+            std::string_view piece = text.substr(begin, newline == std::string_view::npos ? std::string_view::npos : newline - begin);
+            if (newline == std::string_view::npos || !m_partial.empty()) {
+                size_t room = kMaxLineLength - std::min(m_partial.size(), kMaxLineLength);
+                m_partial.append(piece.substr(0, room));
+            }
+            if (newline == std::string_view::npos) break;
+            if (m_partial.empty()) {
+                AppendLine(piece);
+            } else {
+                AppendLine(m_partial);
+                m_partial.clear();
+            }
+            begin = newline + 1;
+        }
+        delete node;
+    }
+    return (size_t)(m_end - end);
+}
+
+void LogBuffer::AppendLine(std::string_view line) {
+    if (Size() == m_lines.size()) {
+        m_first++;
+        m_dropped++;
+    }
+    m_lines[m_end % m_lines.size()].assign(line.substr(0, kMaxLineLength));
+    m_end++;
+}
+
+void LogBuffer::Clear() {
+    m_first = m_end;
+    m_dropped = 0;
+    m_partial.clear();
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Log lines from any thread, kept in a fixed number of slots: once the ring is full each new
+// line replaces the oldest one, so a bulk operation logging per file can't grow it without
+// bound. Lines are numbered from 0 for the lifetime of the buffer and never renumbered, which
+// lets readers cache things by line number (a filter result, a scroll position) and only look
+// at lines past the last one they saw.
+//
+// Writers push onto a lock-free multi-producer queue: one atomic exchange per message, no lock
+// a slow reader could hold. The reading thread moves queued messages into the ring with
+// Drain(); everything except Push() belongs to that thread.
+class LogBuffer {
+public:
+    static constexpr size_t kMaxLineLength = 1024; // longer lines are cut
+
+    explicit LogBuffer(size_t capacity = 10000);
+    ~LogBuffer();
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+
+    // Any thread. Text is split into lines at '\n'; text without a final '\n' is continued
+    // by the next message, as with printf.
+    void Push(std::string_view text);
+
+    // Moves queued messages into the ring, returns the number of lines completed
+    size_t Drain();
+    // Drops every line; numbering carries on from where it was
+    void Clear();
+
+    // Lines [GetFirstLine(), GetEndLine()) are held
+    uint64_t GetFirstLine() const { return m_first; }
+    uint64_t GetEndLine() const { return m_end; }
+    size_t Size() const { return (size_t)(m_end - m_first); }
+    size_t GetCapacity() const { return m_lines.size(); }
+    std::string_view GetLine(uint64_t line) const { return m_lines[line % m_lines.size()]; }
+    // Lines pushed out by newer ones since the last Clear()
+    uint64_t GetDroppedCount() const { return m_dropped; }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::string text;
+    };
+
+    void Enqueue(Node* node);
+    Node* Dequeue();
+    void AppendLine(std::string_view line);
+
+    // Queue (Vyukov's intrusive MPSC): producers swap themselves in at m_head, the reader
+    // follows `next` links from m_tail. m_stub keeps the list non-empty.
+    std::atomic<Node*> m_head;
+    Node* m_tail;
+    Node m_stub;
+
+    // Ring, reader thread only. Slots keep their capacity when reused.
+    std::vector<std::string> m_lines;
+    uint64_t m_first = 0;
+    uint64_t m_end = 0;
+    uint64_t m_dropped = 0;
+    std::string m_partial; // start of a line still waiting for its '\n'
+};
@@ -0,0 +1,219 @@
+#include "MetadataFetcher.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Entries per chunk: a huge folder is shared out between threads instead of holding one up
+constexpr uint32_t kChunkEntries = 512;
+
+// st_mode file type bits, spelled out since not every platform has the S_IF* macros
+constexpr uint32_t kModeTypeMask = 0170000;
+constexpr uint32_t kModeDirectory = 0040000;
+constexpr uint32_t kModeRegular = 0100000;
+constexpr uint32_t kModeSymlink = 0120000;
+
+#if defined(__linux__)
+bool FetchEntry(int dir_fd, const char* name, EntryMetadata& out) {
+    // Never follows symlinks, like the scan; DONT_SYNC keeps network filesystems from
+    // asking the server for attributes they already have cached
+#if defined(STATX_BASIC_STATS)
+    struct statx st;
+    if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE | STATX_UID | STATX_MTIME, &st) != 0) return false;
+    out.mtime = (int64_t)st.stx_mtime.tv_sec * 1000000000 + st.stx_mtime.tv_nsec;
+    out.mode = st.stx_mode;
+    out.uid = st.stx_uid;
+#else
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return false;
+    out.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    out.mode = st.st_mode;
+    out.uid = st.st_uid;
+#endif
+    return true;
+}
+#else
+bool FetchEntry(const fs::path& folder, const char* name, EntryMetadata& out) {
+    std::error_code ec;
+    fs::path path = folder / fs::u8path(name);
+    fs::file_status status = fs::symlink_status(path, ec);
+    if (ec) return false;
+    auto write_time = fs::last_write_time(path, ec);
+    if (ec) return false;
+    // file_time_type has its own epoch; move it onto the system clock's
+    auto system_time = std::chrono::system_clock::now() + (write_time - fs::file_time_type::clock::now());
+    out.mtime = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(system_time.time_since_epoch()).count();
+    out.mode = (uint32_t)status.permissions() & 07777;
+    if (fs::is_symlink(status)) out.mode |= kModeSymlink;
+    else if (fs::is_directory(status)) out.mode |= kModeDirectory;
+    else if (fs::is_regular_file(status)) out.mode |= kModeRegular;
+    out.uid = MetadataFetcher::kNoOwner;
+    return true;
+}
+#endif
+
+void FetchChunk(MetadataJob& job, const MetadataJob::Chunk& chunk) {
+#if defined(__linux__)
+    // One path walk for the folder, then every name is a single lookup inside it
+    int dir_fd = open(chunk.folder.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    for (uint32_t k = chunk.begin; k < chunk.end; k++) {
+        job.ok[k] = dir_fd >= 0 && FetchEntry(dir_fd, job.names.data() + job.name_offsets[k], job.results[k]);
+    }
+    if (dir_fd >= 0) close(dir_fd);
+#else
+    fs::path folder = fs::u8path(chunk.folder);
+    for (uint32_t k = chunk.begin; k < chunk.end; k++) {
+        job.ok[k] = FetchEntry(folder, job.names.data() + job.name_offsets[k], job.results[k]);
+    }
+#endif
+}
+
+void RunWorker(MetadataJob& job) {
+    PROFILE_SCOPE("MetadataJob::Worker");
+    while (!job.cancel.load(std::memory_order_relaxed)) {
+        size_t c = job.next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (c >= job.chunks.size()) break;
+        const MetadataJob::Chunk& chunk = job.chunks[c];
+        FetchChunk(job, chunk);
+        PROFILE_COUNT("metadata.entries", chunk.end - chunk.begin);
+        job.completed.fetch_add(chunk.end - chunk.begin, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.finished.push_back((uint32_t)c);
+    }
+}
+
+} // namespace
+
+std::shared_ptr<MetadataJob> MetadataFetcher::CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries) {
+    PROFILE_SCOPE("MetadataFetcher::CreateJob");
+    auto job = std::make_shared<MetadataJob>();
+
+    // Counting sort by folder: one pass to count, one to place
+    uint32_t dir_count = store.GetDirCount();
+    std::vector<uint32_t> begin((size_t)dir_count + 1, 0);
+    for (uint32_t i : entries) begin[store.GetParentDir(i) + 1]++;
+    for (uint32_t d = 0; d < dir_count; d++) begin[d + 1] += begin[d];
+    job->entries.resize(entries.size());
+    std::vector<uint32_t> next(begin.begin(), begin.end() - 1);
+    for (uint32_t i : entries) job->entries[next[store.GetParentDir(i)]++] = i;
+
+    job->name_offsets.resize(entries.size());
+    for (size_t k = 0; k < job->entries.size(); k++) {
+        job->name_offsets[k] = (uint32_t)job->names.size();
+        job->names.append(store.GetName(job->entries[k]));
+        job->names.push_back('\0');
+    }
+    for (uint32_t dir = 0; dir < dir_count; dir++) {
+        if (begin[dir] == begin[dir + 1]) continue;
+        std::string folder = dir == EntryStore::kRootDir ? store.GetRootPath() : store.GetPath(store.GetDirEntry(dir));
+        for (uint32_t k = begin[dir]; k < begin[dir + 1]; k += kChunkEntries) {
+            job->chunks.push_back({folder, k, (std::min)(k + kChunkEntries, begin[dir + 1])});
+        }
+    }
+    job->results.resize(entries.size());
+    job->ok.assign(entries.size(), 0);
+    return job;
+}
+
+void MetadataFetcher::Run(std::shared_ptr<MetadataJob> job, unsigned max_threads) {
+    unsigned thread_count = (unsigned)(std::min)((size_t)(std::max)(1u, max_threads), job->chunks.size());
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < thread_count; i++) {
+        workers.emplace_back([job, i] {
+            Profiler::SetThreadName("metadata " + std::to_string(i));
+            RunWorker(*job);
+        });
+    }
+    RunWorker(*job);
+    for (auto& worker : workers) worker.join();
+    job->done.store(true, std::memory_order_release);
+    RedrawSignal::Request();
+}
+
+std::string MetadataFetcher::FormatMode(uint32_t mode, bool is_directory) {
+    std::string text(10, '-');
+    uint32_t type = mode & kModeTypeMask;
+    if (type == kModeSymlink) text[0] = 'l';
+    else if (type == kModeDirectory || (type == 0 && is_directory)) text[0] = 'd';
+    else if (type != kModeRegular && type != 0) text[0] = '?'; // devices, fifos, sockets
+    static const char kLetters[] = "rwxrwxrwx";
+    for (int bit = 0; bit < 9; bit++) {
+        if (mode & (0400u >> bit)) text[1 + bit] = kLetters[bit];
+    }
+    // setuid, setgid and sticky show in place of the execute bits
+    if (mode & 04000) text[3] = (mode & 0100) ? 's' : 'S';
+    if (mode & 02000) text[6] = (mode & 0010) ? 's' : 'S';
+    if (mode & 01000) text[9] = (mode & 0001) ? 't' : 'T';
+    return text;
+}
+
+std::string MetadataFetcher::FormatTime(int64_t mtime) {
+    std::time_t seconds = (std::time_t)(mtime >= 0 ? mtime / 1000000000 : (mtime + 1) / 1000000000 - 1);
+    std::tm local{};
+#if defined(_WIN32)
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M", &local);
+    return text;
+}
+
+const std::string& MetadataFetcher::GetOwnerName(uint32_t uid) {
+    // A list has few distinct owners, and the table asks for them every frame
+    static std::mutex mutex;
+    static std::unordered_map<uint32_t, std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = names.find(uid);
+    if (it != names.end()) return it->second;
+
+    std::string name;
+    if (uid != kNoOwner) {
+#if defined(__linux__)
+        struct passwd pw;
+        struct passwd* found = nullptr;
+        std::vector<char> buffer(4096);
+        if (getpwuid_r((uid_t)uid, &pw, buffer.data(), buffer.size(), &found) == 0 && found) name = found->pw_name;
+#endif
+        if (name.empty()) name = std::to_string(uid);
+    }
+    // References stay valid: unordered_map never moves its elements
+    return names.emplace(uid, std::move(name)).first->second;
+}
+
+bool MetadataFetcher::FindOwner(std::string_view name, uint32_t& uid) {
+    if (name.empty()) return false;
+#if defined(__linux__)
+    struct passwd pw;
+    struct passwd* found = nullptr;
+    std::vector<char> buffer(4096);
+    if (getpwnam_r(std::string(name).c_str(), &pw, buffer.data(), buffer.size(), &found) == 0 && found) {
+        uid = (uint32_t)found->pw_uid;
+        return true;
+    }
+#endif
+    uint64_t number = 0;
+    for (char c : name) {
+        if (c < '0' || c > '9') return false;
+        number = number * 10 + (uint64_t)(c - '0');
+        if (number >= kNoOwner) return false;
+    }
+    uid = (uint32_t)number;
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Shared state between the caller and MetadataFetcher::Run(). Entries are grouped into
+// chunks of one folder each; workers claim chunks through `next_chunk` and post them to
+// `finished` once their results are written, so the caller can merge them as they come.
+struct MetadataJob {
+    struct Chunk {
+        std::string folder;  // path of the folder every entry of the chunk is in
+        uint32_t begin;      // range in `entries`
+        uint32_t end;
+    };
+
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> name_offsets;  // per entry, into `names`, NUL-terminated
+    std::string names;
+    std::vector<Chunk> chunks;
+
+    // Per entry, written by the worker that owns its chunk
+    std::vector<EntryMetadata> results;
+    std::vector<uint8_t> ok;
+
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> completed{0};    // entries looked at, for progress
+
+    std::mutex mutex;
+    std::vector<uint32_t> finished;      // chunk indices, drained by the caller
+};
+
+// Reads modification time, permissions and owner, which the scan leaves out: one stat per
+// entry would roughly double its time. Entries are fetched folder by folder, each name
+// relative to a descriptor for its folder (statx on Linux), so the kernel walks each path
+// once per folder instead of once per entry. Folders are spread over a small pool of
+// threads, which keeps a disk's or a network filesystem's queue busy.
+class MetadataFetcher {
+public:
+    // Owner of entries on systems without owners
+    static constexpr uint32_t kNoOwner = 0xFFFFFFFFu;
+
+    // Paths and names are copied here, so the store can change once this returns; the
+    // entries' indices must stay put until the results are merged
+    static std::shared_ptr<MetadataJob> CreateJob(const EntryStore& store, const std::vector<uint32_t>& entries);
+
+    // Fetches on the calling thread plus up to `max_threads - 1` more, then sets `done`
+    static void Run(std::shared_ptr<MetadataJob> job, unsigned max_threads);
+
+    // "drwxr-xr-x"
+    static std::string FormatMode(uint32_t mode, bool is_directory);
+    // "2024-05-01 13:45", local time
+    static std::string FormatTime(int64_t mtime);
+    // User name for a uid, cached after the first lookup; the number if it has no name
+    static const std::string& GetOwnerName(uint32_t uid);
+    // User name or number -> uid
+    static bool FindOwner(std::string_view name, uint32_t& uid);
+};
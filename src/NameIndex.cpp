@@ -0,0 +1,253 @@
+#include "NameIndex.h"
+#include "LiteralScan.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+using LiteralScan::CountTrailingZeros;
+using LiteralScan::EqualAt;
+using LiteralScan::FoldAscii;
+using LiteralScan::HighestBit;
+
+inline uint32_t TrigramBit(unsigned char a, unsigned char b, unsigned char c) {
+    uint32_t trigram = ((uint32_t)a << 16) | ((uint32_t)b << 8) | c;
+    return (trigram * 2654435761u) >> 20; // 12 bits -> 0..4095
+}
+
+// Reports the start offset of every NUL-separated name in [begin, end) that contains
+// `needle` (pre-folded when !case_sensitive). `begin` must be the start of a name.
+template <typename OnMatch>
+void ScanNames(const char* data, size_t begin, size_t end, std::string_view needle, bool case_sensitive, OnMatch&& on_match) {
+    const size_t k = needle.size();
+
+    // Start of the name the scan is currently in, and whether it has been reported already.
+    // Tracked from the NUL terminators as we go, so a hit never has to search for its name.
+    size_t name_start = begin;
+    bool reported = false;
+
+    size_t i = begin;
+#if FNM_HAVE_SSE2
+    // First/last byte filter (see LiteralScan), with the chunk's NUL terminators tracked on
+    // the side. Needle bytes are never NUL, so a match can't straddle two names.
+    const LiteralScan::Filter filter(needle, case_sensitive);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + filter.Reach() <= end; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned nuls = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+        unsigned mask = filter.Candidates(data + i);
+
+        while (mask) {
+            unsigned bit = CountTrailingZeros(mask);
+            unsigned below = nuls & ((1u << bit) - 1);
+            if (below) {
+                name_start = i + HighestBit(below) + 1;
+                reported = false;
+            }
+            if (!reported && filter.Verify(data + i + bit)) {
+                on_match((uint32_t)name_start);
+                reported = true;
+                // Nothing else in this name matters; jump to the next terminator in the chunk
+                unsigned after = nuls & ~((2u << bit) - 1);
+                mask = after ? mask & ~((2u << CountTrailingZeros(after)) - 1) : 0;
+            } else {
+                mask &= mask - 1;
+            }
+        }
+        if (nuls) {
+            // Entering the name after the chunk's last terminator, unless a hit got us there already
+            size_t next = i + HighestBit(nuls) + 1;
+            if (next != name_start) {
+                name_start = next;
+                reported = false;
+            }
+        }
+    }
+#endif
+    for (; i < end; i++) {
+        if (data[i] == '\0') {
+            name_start = i + 1;
+            reported = false;
+        } else if (!reported && i + k <= end && EqualAt(data + i, needle, case_sensitive)) {
+            on_match((uint32_t)name_start);
+            reported = true;
+        }
+    }
+}
+
+// First name start at or after `pos`
+size_t NameStartAtOrAfter(const char* data, size_t size, size_t pos) {
+    if (pos == 0 || pos >= size) return (std::min)(pos, size);
+    if (data[pos - 1] == '\0') return pos;
+    const void* nul = std::memchr(data + pos, '\0', size - pos);
+    return nul ? (size_t)((const char*)nul - data) + 1 : size;
+}
+
+} // namespace
+
+void NameIndex::Clear() {
+    m_signatures.Free();
+    m_indexed_bytes = 0;
+}
+
+void NameIndex::Update(const NamePool& pool) {
+    const char* data = pool.Data();
+    size_t size = pool.GetArenaBytes();
+    if (size < m_indexed_bytes) Clear(); // pool was cleared and refilled
+    if (size == m_indexed_bytes) return;
+
+    size_t blocks = (size + kBlockBytes - 1) / kBlockBytes;
+    m_signatures.resize(blocks * kSignatureWords, 0);
+
+    // Names are interned whole, so the arena always ends on a NUL
+    for (size_t pos = m_indexed_bytes; pos < size;) {
+        size_t length = std::strlen(data + pos);
+        uint64_t* signature = Signature(pos / kBlockBytes);
+        for (size_t i = 0; i + 3 <= length; i++) {
+            uint32_t bit = TrigramBit(FoldAscii((unsigned char)data[pos + i]),
+                                      FoldAscii((unsigned char)data[pos + i + 1]),
+                                      FoldAscii((unsigned char)data[pos + i + 2]));
+            signature[bit >> 6] |= 1ull << (bit & 63);
+        }
+        pos += length + 1;
+    }
+    m_indexed_bytes = size;
+}
+
+void NameIndex::FindNames(const NamePool& pool, std::string_view pattern, bool case_sensitive, std::vector<uint32_t>& out) const {
+    out.clear();
+    if (pattern.empty()) return;
+    PROFILE_SCOPE("NameIndex::FindNames");
+
+    std::string needle(pattern);
+    if (!case_sensitive) {
+        for (char& c : needle) c = (char)FoldAscii((unsigned char)c);
+    }
+
+    const char* data = pool.Data();
+    size_t size = pool.GetArenaBytes();
+
+    // Byte ranges of the arena that may contain a match, each starting on a name
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (needle.size() < 3) {
+        // No trigrams to go on: scan everything
+        if (size > 0) ranges.push_back({0, size});
+    } else {
+        // Bits the pattern's trigrams set; a block is a candidate only if it has all of them
+        std::vector<std::pair<size_t, uint64_t>> required;
+        uint64_t words[kSignatureWords] = {};
+        for (size_t i = 0; i + 3 <= needle.size(); i++) {
+            uint32_t bit = TrigramBit(FoldAscii((unsigned char)needle[i]), FoldAscii((unsigned char)needle[i + 1]),
+                                      FoldAscii((unsigned char)needle[i + 2]));
+            words[bit >> 6] |= 1ull << (bit & 63);
+        }
+        for (size_t w = 0; w < kSignatureWords; w++) {
+            if (words[w]) required.push_back({w, words[w]});
+        }
+
+        // Anything interned after the last Update() has no signature yet and is always scanned.
+        // Runs of consecutive candidate blocks are merged into one range.
+        size_t indexed_blocks = (std::min)(m_indexed_bytes, size) / kBlockBytes;
+        size_t run_begin = SIZE_MAX;
+        for (size_t block = 0; block <= indexed_blocks; block++) {
+            bool candidate = block == indexed_blocks;
+            if (!candidate) {
+                const uint64_t* signature = Signature(block);
+                candidate = true;
+                for (const auto& req : required) {
+                    if ((signature[req.first] & req.second) != req.second) {
+                        candidate = false;
+                        break;
+                    }
+                }
+            }
+            if (candidate) {
+                if (run_begin == SIZE_MAX) run_begin = block;
+                continue;
+            }
+            if (run_begin != SIZE_MAX) {
+                size_t begin = NameStartAtOrAfter(data, size, run_begin * kBlockBytes);
+                size_t end = NameStartAtOrAfter(data, size, block * kBlockBytes);
+                if (begin < end) ranges.push_back({begin, end});
+                run_begin = SIZE_MAX;
+            }
+        }
+        size_t begin = NameStartAtOrAfter(data, size, run_begin * kBlockBytes);
+        if (begin < size) ranges.push_back({begin, size});
+    }
+
+    size_t total = 0;
+    for (const auto& range : ranges) total += range.second - range.first;
+
+    // Big scans (short or very common patterns) are split across threads at name boundaries
+    unsigned threads = (unsigned)(std::min)((size_t)(std::max)(1u, std::thread::hardware_concurrency()), total / kParallelScanBytes + 1);
+    if (threads <= 1) {
+        for (const auto& range : ranges) {
+            ScanNames(data, range.first, range.second, needle, case_sensitive, [&](uint32_t offset) { out.push_back(offset); });
+        }
+        return;
+    }
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> parts(threads);
+    size_t share = total / threads + 1;
+    size_t part = 0, filled = 0;
+    for (auto range : ranges) {
+        while (range.first < range.second) {
+            size_t room = share - filled;
+            size_t cut = range.second;
+            if (part + 1 < threads && range.second - range.first > room) {
+                cut = NameStartAtOrAfter(data, range.second, range.first + room);
+            }
+            parts[part].push_back({range.first, cut});
+            filled += cut - range.first;
+            range.first = cut;
+            if (filled >= share && part + 1 < threads) {
+                part++;
+                filled = 0;
+            }
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> results(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (const auto& range : parts[t]) {
+                ScanNames(data, range.first, range.second, needle, case_sensitive, [&](uint32_t offset) { results[t].push_back(offset); });
+            }
+        });
+    }
+    for (const auto& range : parts[0]) {
+        ScanNames(data, range.first, range.second, needle, case_sensitive, [&](uint32_t offset) { results[0].push_back(offset); });
+    }
+    for (auto& worker : workers) worker.join();
+
+    for (const auto& result : results) out.insert(out.end(), result.begin(), result.end());
+}
+
+void NameIndex::NarrowNames(const NamePool& pool, std::string_view pattern, bool case_sensitive,
+                            const std::vector<uint32_t>& candidates, std::vector<uint32_t>& out) {
+    out.clear();
+    for (uint32_t offset : candidates) {
+        const char* name = pool.CStr(offset);
+        if (Contains(std::string_view(name, std::strlen(name)), pattern, case_sensitive)) out.push_back(offset);
+    }
+}
+
+bool NameIndex::Contains(std::string_view name, std::string_view pattern, bool case_sensitive) {
+    if (pattern.empty()) return true;
+    if (case_sensitive) return name.find(pattern) != std::string_view::npos;
+    if (pattern.size() > name.size()) return false;
+
+    unsigned char first = FoldAscii((unsigned char)pattern[0]);
+    for (size_t i = 0; i + pattern.size() <= name.size(); i++) {
+        if (FoldAscii((unsigned char)name[i]) != first) continue;
+        size_t j = 1;
+        while (j < pattern.size() && FoldAscii((unsigned char)name[i + j]) == FoldAscii((unsigned char)pattern[j])) j++;
+        if (j == pattern.size()) return true;
+    }
+    return false;
+}
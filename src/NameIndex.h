@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Substring index over the unique names of a NamePool.
+//
+// The pool arena is cut into fixed-size blocks and every block gets a small Bloom
+// signature of the (ASCII case-folded) trigrams of the names that start in it. A query
+// only scans blocks whose signature contains every trigram of the pattern, using an
+// SSE2 first/last-byte filter. Patterns shorter than three bytes have no trigrams and
+// fall back to scanning the whole arena with the same kernel.
+//
+// Scans larger than a few MB are split across threads.
+//
+// Results are name offsets, so entries sharing an interned name are matched once.
+// The arena is append-only, so Update() just indexes whatever was interned since the
+// previous call.
+class NameIndex {
+public:
+    void Clear();
+    void Update(const NamePool& pool);
+
+    // Offsets of all pool names containing `pattern`, ascending
+    void FindNames(const NamePool& pool, std::string_view pattern, bool case_sensitive, std::vector<uint32_t>& out) const;
+
+    // Keeps the names of `candidates` that contain `pattern`. Used when the user extends
+    // the previous pattern, since the new result set is a subset of the old one.
+    static void NarrowNames(const NamePool& pool, std::string_view pattern, bool case_sensitive,
+                            const std::vector<uint32_t>& candidates, std::vector<uint32_t>& out);
+
+    static bool Contains(std::string_view name, std::string_view pattern, bool case_sensitive);
+
+    size_t GetMemoryBytes() const { return m_signatures.capacity() * sizeof(uint64_t); }
+    void PageOut() { m_signatures.PageOut(); }
+
+private:
+    static constexpr size_t kBlockBytes = 1024;
+    static constexpr size_t kSignatureWords = 64; // 4096 bits per block
+    static constexpr size_t kParallelScanBytes = 4 << 20; // per extra scan thread
+
+    uint64_t* Signature(size_t block) { return m_signatures.data() + block * kSignatureWords; }
+    const uint64_t* Signature(size_t block) const { return m_signatures.data() + block * kSignatureWords; }
+
+    PagedArray<uint64_t> m_signatures;
+    size_t m_indexed_bytes = 0;
+};
+
+// Names interned once for several lists, such as the scans open side by side in tabs, with
+// one index over all of them (see EntryStore::Clear()). The pool only grows: names stay until
+// the last scanner sharing it is gone.
+struct SharedNames {
+    std::shared_ptr<NamePool> pool = std::make_shared<NamePool>();
+    NameIndex index;
+};
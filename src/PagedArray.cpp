@@ -0,0 +1,158 @@
+#include "PagedArray.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <utility>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+std::atomic<size_t> PagedBuffer::s_budget{0};
+std::atomic<size_t> PagedBuffer::s_heap_bytes{0};
+std::atomic<size_t> PagedBuffer::s_spilled_bytes{0};
+
+namespace {
+
+#if defined(__linux__)
+// Address space set aside per spilled buffer. Entry indices and name offsets are 32-bit, so
+// no column gets near this; it only costs page table entries once touched.
+constexpr size_t kReserveBytes = (size_t)64 << 30;
+
+size_t RoundUp(size_t bytes, size_t unit) { return (bytes + unit - 1) / unit * unit; }
+
+// Unlinked right away, so it goes when the process does, however it ends
+int OpenTempFile() {
+    std::error_code ec;
+    std::string dir = std::filesystem::temp_directory_path(ec).string();
+    if (ec || dir.empty()) dir = "/tmp";
+#if defined(O_TMPFILE)
+    int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+#endif
+    std::string path = dir + "/fnm-spill-XXXXXX";
+    int fd2 = mkstemp(&path[0]);
+    if (fd2 >= 0) unlink(path.c_str());
+    return fd2;
+}
+#endif
+
+} // namespace
+
+void PagedBuffer::Reserve(size_t bytes, size_t used) {
+    if (bytes <= m_capacity) return;
+#if defined(__linux__)
+    if (IsSpilled()) {
+        size_t capacity = RoundUp(bytes, kChunkBytes);
+        if (capacity > m_reserved || ftruncate(m_fd, (off_t)capacity) != 0) throw std::bad_alloc();
+        void* mapped = mmap(m_data + m_capacity, capacity - m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_fd, (off_t)m_capacity);
+        if (mapped == MAP_FAILED) throw std::bad_alloc();
+        madvise(mapped, capacity - m_capacity, MADV_SEQUENTIAL);
+        s_spilled_bytes.fetch_add(capacity - m_capacity, std::memory_order_relaxed);
+        m_capacity = capacity;
+        return;
+    }
+    size_t budget = GetBudget();
+    if (budget && GetHeapBytes() - m_capacity + bytes > budget && Spill(bytes, used)) return;
+#else
+    (void)used;
+#endif
+    // Trivially copyable contents, so realloc can move them
+    char* data = static_cast<char*>(std::realloc(m_data, bytes));
+    if (!data) throw std::bad_alloc();
+    s_heap_bytes.fetch_add(bytes - m_capacity, std::memory_order_relaxed);
+    m_data = data;
+    m_capacity = bytes;
+}
+
+bool PagedBuffer::Spill(size_t bytes, size_t used) {
+#if defined(__linux__)
+    // Anything going wrong here leaves the buffer on the heap, over budget but working
+    size_t capacity = RoundUp(bytes, kChunkBytes);
+    size_t reserved = std::max(kReserveBytes, RoundUp(capacity * 2, kChunkBytes));
+    int fd = OpenTempFile();
+    if (fd < 0) return false;
+    if (ftruncate(fd, (off_t)capacity) != 0) {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    if (mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, reserved);
+        close(fd);
+        return false;
+    }
+    madvise(base, capacity, MADV_SEQUENTIAL);
+
+    char* data = static_cast<char*>(base);
+    if (used) std::memcpy(data, m_data, used);
+    std::free(m_data);
+    s_heap_bytes.fetch_sub(m_capacity, std::memory_order_relaxed);
+    s_spilled_bytes.fetch_add(capacity, std::memory_order_relaxed);
+    m_data = data;
+    m_capacity = capacity;
+    m_fd = fd;
+    m_reserved = reserved;
+    PageOut(0, used);
+    return true;
+#else
+    (void)bytes;
+    (void)used;
+    return false;
+#endif
+}
+
+void PagedBuffer::Free() {
+#if defined(__linux__)
+    if (IsSpilled()) {
+        munmap(m_data, m_reserved);
+        close(m_fd);
+        s_spilled_bytes.fetch_sub(m_capacity, std::memory_order_relaxed);
+        m_data = nullptr;
+        m_capacity = 0;
+        m_fd = -1;
+        m_reserved = 0;
+        return;
+    }
+#endif
+    std::free(m_data);
+    s_heap_bytes.fetch_sub(m_capacity, std::memory_order_relaxed);
+    m_data = nullptr;
+    m_capacity = 0;
+}
+
+void PagedBuffer::PageOut(size_t begin, size_t end) {
+#if defined(__linux__)
+    if (!IsSpilled()) return;
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    begin = RoundUp(begin, page);
+    end = std::min(end, m_capacity) / page * page;
+    if (begin >= end) return;
+    char* start = m_data + begin;
+    size_t length = end - begin;
+#if defined(MADV_PAGEOUT)
+    if (madvise(start, length, MADV_PAGEOUT) == 0) return;
+#endif
+    // Older kernels: start the writeback, unmap the pages, and let the page cache drop
+    // whatever is already clean
+    msync(start, length, MS_ASYNC);
+    madvise(start, length, MADV_DONTNEED);
+    posix_fadvise(m_fd, (off_t)begin, (off_t)length, POSIX_FADV_DONTNEED);
+#else
+    (void)begin;
+    (void)end;
+#endif
+}
+
+void PagedBuffer::Swap(PagedBuffer& other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_capacity, other.m_capacity);
+    std::swap(m_fd, other.m_fd);
+    std::swap(m_reserved, other.m_reserved);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Growable block of memory behind PagedArray. It lives on the heap while the heap bytes of all
+// paged buffers in the process fit the budget. Past that, a buffer that has to grow moves to a
+// memory-mapped temp file instead, and it stays there until it is freed. The file grows in
+// fixed 64 MB chunks, mapped one after another into an address range reserved up front, so the
+// buffer stays contiguous and pointers into it stay valid while it grows.
+//
+// Pages of a file-backed buffer are ordinary page cache: the kernel writes them back and
+// drops them under pressure rather than swapping. PageOut() drops them on purpose. Appends do
+// it for every chunk they fill, and sequential sweeps do it when they finish, so the resident
+// part of a spilled scan stays a window around what is being read or written.
+//
+// Spilling needs mmap (Linux); elsewhere buffers always stay on the heap.
+class PagedBuffer {
+public:
+    static constexpr size_t kChunkBytes = (size_t)64 << 20;
+
+    // 0 (the default) never spills
+    static void SetBudget(size_t bytes) { s_budget.store(bytes, std::memory_order_relaxed); }
+    static size_t GetBudget() { return s_budget.load(std::memory_order_relaxed); }
+    static size_t GetHeapBytes() { return s_heap_bytes.load(std::memory_order_relaxed); }
+    static size_t GetSpilledBytes() { return s_spilled_bytes.load(std::memory_order_relaxed); }
+
+    PagedBuffer() = default;
+    ~PagedBuffer() { Free(); }
+    PagedBuffer(const PagedBuffer&) = delete;
+    PagedBuffer& operator=(const PagedBuffer&) = delete;
+    PagedBuffer(PagedBuffer&& other) noexcept { Swap(other); }
+    PagedBuffer& operator=(PagedBuffer&& other) noexcept {
+        if (this != &other) {
+            Free();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    char* Data() const { return m_data; }
+    size_t Capacity() const { return m_capacity; }
+    bool IsSpilled() const { return m_fd >= 0; }
+
+    // Grows to at least `bytes`, keeping the first `used`. Throws std::bad_alloc on failure.
+    void Reserve(size_t bytes, size_t used);
+    void Free();
+    // Drops the pages inside [begin, end) from memory, writing them back first if needed; they
+    // are read back from the file when next touched. Does nothing for heap buffers.
+    void PageOut(size_t begin, size_t end);
+
+    void Swap(PagedBuffer& other) noexcept;
+
+private:
+    bool Spill(size_t bytes, size_t used);
+
+    static std::atomic<size_t> s_budget;
+    static std::atomic<size_t> s_heap_bytes;
+    static std::atomic<size_t> s_spilled_bytes;
+
+    char* m_data = nullptr;
+    size_t m_capacity = 0;
+    int m_fd = -1;         // temp file, once spilled
+    size_t m_reserved = 0; // address range reserved for the mapping
+};
+
+// The parts of std::vector the entry columns use, for trivially copyable types, on top of a
+// PagedBuffer. Indexing is a plain pointer access whether the data is on the heap or mapped.
+template <typename T>
+class PagedArray {
+    static_assert(std::is_trivially_copyable<T>::value, "PagedArray holds plain data");
+
+public:
+    using value_type = T;
+
+    PagedArray() = default;
+    PagedArray(const PagedArray& other) { *this = other; }
+    PagedArray(PagedArray&& other) noexcept : m_buffer(std::move(other.m_buffer)), m_size(other.m_size) { other.m_size = 0; }
+    PagedArray& operator=(PagedArray&& other) noexcept {
+        m_buffer = std::move(other.m_buffer);
+        m_size = other.m_size;
+        other.m_size = 0;
+        return *this;
+    }
+    PagedArray& operator=(const PagedArray& other) {
+        if (this == &other) return *this;
+        m_size = 0;
+        reserve(other.m_size);
+        if (other.m_size) std::memcpy(data(), other.data(), other.m_size * sizeof(T));
+        m_size = other.m_size;
+        return *this;
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_buffer.Capacity() / sizeof(T); }
+    bool empty() const { return m_size == 0; }
+    T* data() { return reinterpret_cast<T*>(m_buffer.Data()); }
+    const T* data() const { return reinterpret_cast<const T*>(m_buffer.Data()); }
+    T* begin() { return data(); }
+    T* end() { return data() + m_size; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + m_size; }
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+    T& back() { return data()[m_size - 1]; }
+    const T& back() const { return data()[m_size - 1]; }
+
+    void reserve(size_t count) {
+        if (count > capacity()) m_buffer.Reserve(count * sizeof(T), m_size * sizeof(T));
+    }
+
+    void push_back(const T& value) {
+        if (m_size == capacity()) Grow(m_size + 1);
+        data()[m_size++] = value;
+        if (m_buffer.IsSpilled()) PageOutFilled(m_size - 1);
+    }
+
+    void append(const T* values, size_t count) {
+        if (m_size + count > capacity()) Grow(m_size + count);
+        if (count) std::memcpy(data() + m_size, values, count * sizeof(T));
+        m_size += count;
+        if (m_buffer.IsSpilled()) PageOutFilled(m_size - count);
+    }
+
+    void resize(size_t count, const T& value = T()) {
+        if (count > capacity()) Grow(count);
+        for (size_t i = m_size; i < count; i++) data()[i] = value;
+        m_size = count;
+    }
+
+    void assign(size_t count, const T& value) {
+        m_size = 0;
+        resize(count, value);
+    }
+
+    void clear() { m_size = 0; }
+
+    // Gives the memory back, unlike clear()
+    void Free() {
+        m_buffer.Free();
+        m_size = 0;
+    }
+
+    bool IsSpilled() const { return m_buffer.IsSpilled(); }
+    void PageOut() { m_buffer.PageOut(0, m_size * sizeof(T)); }
+
+private:
+    // Chunks of a spilled array filled since it had `old_size` elements leave memory as the
+    // append moves on
+    void PageOutFilled(size_t old_size) {
+        size_t from = old_size * sizeof(T) / PagedBuffer::kChunkBytes;
+        size_t to = m_size * sizeof(T) / PagedBuffer::kChunkBytes;
+        if (to > from) m_buffer.PageOut(from * PagedBuffer::kChunkBytes, to * PagedBuffer::kChunkBytes);
+    }
+
+    void Grow(size_t count) {
+        size_t doubled = capacity() * 2;
+        m_buffer.Reserve((count > doubled ? count : doubled) * sizeof(T), m_size * sizeof(T));
+    }
+
+    PagedBuffer m_buffer;
+    size_t m_size = 0;
+};
@@ -0,0 +1,378 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+
+namespace {
+
+// Trace collection stops here; about 40 bytes per event
+constexpr size_t kMaxTraceEvents = 4 << 20;
+
+const auto g_epoch = std::chrono::steady_clock::now();
+
+std::atomic<ProfileScopeSite*> g_scopes{nullptr};
+std::atomic<ProfileCounterSite*> g_counters{nullptr};
+
+template <typename Site>
+void Register(std::atomic<Site*>& head, Site* site) {
+    site->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(site->next, site, std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+// --- Allocations ---
+
+// Each thread counts into a slot of its own with plain load/store pairs, so allocation-heavy
+// workers never fight over a cache line. Readers add up every slot.
+struct AllocationSlot {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<bool> in_use{false};
+};
+
+constexpr size_t kAllocationSlots = 256;
+AllocationSlot g_allocation_slots[kAllocationSlots];
+AllocationSlot g_shared_slot;                 // for threads beyond kAllocationSlots, counted with atomic adds
+std::atomic<uint64_t> g_retired_bytes{0};     // from threads that have exited
+std::atomic<uint64_t> g_retired_count{0};
+
+struct ThreadAllocations {
+    AllocationSlot* slot = nullptr;
+
+    ~ThreadAllocations() {
+        if (slot && slot != &g_shared_slot) {
+            g_retired_bytes.fetch_add(slot->bytes.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            g_retired_count.fetch_add(slot->count.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            slot->in_use.store(false, std::memory_order_release);
+        }
+        // Anything allocated by later thread-exit code still gets counted
+        slot = &g_shared_slot;
+    }
+};
+
+thread_local ThreadAllocations t_allocations;
+
+#if FNM_PROFILING && FNM_ALLOCATION_HOOKS
+AllocationSlot* ClaimSlot() {
+    for (AllocationSlot& slot : g_allocation_slots) {
+        bool expected = false;
+        if (!slot.in_use.load(std::memory_order_relaxed) && slot.in_use.compare_exchange_strong(expected, true)) return &slot;
+    }
+    return &g_shared_slot;
+}
+
+void CountAllocation(size_t size) {
+    AllocationSlot* slot = t_allocations.slot;
+    if (!slot) slot = t_allocations.slot = ClaimSlot();
+    if (slot == &g_shared_slot) {
+        slot->bytes.fetch_add(size, std::memory_order_relaxed);
+        slot->count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        slot->bytes.store(slot->bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+        slot->count.store(slot->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+#endif
+
+// --- Frames ---
+
+std::mutex g_frame_mutex;
+float g_frame_ms[Profiler::kFrameHistory];
+int g_frame_next = 0;
+int g_frame_count = 0;
+
+// --- Trace ---
+
+struct TraceEvent {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t duration_ns; // 'X' events
+    uint64_t value;       // 'C' events
+    uint32_t thread;
+    char phase;
+};
+
+std::atomic<bool> g_tracing{false};
+std::mutex g_trace_mutex;
+std::vector<TraceEvent> g_trace;
+size_t g_trace_dropped = 0;
+std::vector<std::pair<uint32_t, std::string>> g_thread_names;
+
+std::atomic<uint32_t> g_next_thread{1};
+thread_local uint32_t t_thread = 0;
+
+uint32_t ThreadId() {
+    if (!t_thread) t_thread = g_next_thread.fetch_add(1, std::memory_order_relaxed);
+    return t_thread;
+}
+
+void AddTraceEvent(const TraceEvent& event) {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    if (!g_tracing.load(std::memory_order_relaxed)) return;
+    if (g_trace.size() >= kMaxTraceEvents) {
+        g_trace_dropped++;
+        return;
+    }
+    g_trace.push_back(event);
+}
+
+void AppendJsonString(std::string& out, const char* text) {
+    out += '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out += '\\';
+        if ((unsigned char)*c < 0x20) continue;
+        out += *c;
+    }
+    out += '"';
+}
+
+} // namespace
+
+ProfileScopeSite::ProfileScopeSite(const char* name) : name(name) {
+    Register(g_scopes, this);
+}
+
+ProfileCounterSite::ProfileCounterSite(const char* name) : name(name) {
+    Register(g_counters, this);
+}
+
+uint64_t Profiler::Now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void Profiler::RecordScope(ProfileScopeSite& site, uint64_t begin_ns, uint64_t end_ns) {
+    uint64_t duration = end_ns - begin_ns;
+    site.calls.fetch_add(1, std::memory_order_relaxed);
+    site.total_ns.fetch_add(duration, std::memory_order_relaxed);
+    site.last_ns.store(duration, std::memory_order_relaxed);
+    uint64_t max = site.max_ns.load(std::memory_order_relaxed);
+    while (duration > max && !site.max_ns.compare_exchange_weak(max, duration, std::memory_order_relaxed)) {}
+
+    if (g_tracing.load(std::memory_order_relaxed)) AddTraceEvent({site.name, begin_ns, duration, 0, ThreadId(), 'X'});
+}
+
+void Profiler::GetScopes(std::vector<ScopeStats>& out) {
+    out.clear();
+    for (ProfileScopeSite* site = g_scopes.load(std::memory_order_acquire); site; site = site->next) {
+        out.push_back({site->name, site->calls.load(std::memory_order_relaxed), site->total_ns.load(std::memory_order_relaxed),
+                       site->max_ns.load(std::memory_order_relaxed), site->last_ns.load(std::memory_order_relaxed)});
+    }
+    std::sort(out.begin(), out.end(), [](const ScopeStats& a, const ScopeStats& b) { return std::strcmp(a.name, b.name) < 0; });
+}
+
+void Profiler::GetCounters(std::vector<CounterStats>& out) {
+    out.clear();
+    for (ProfileCounterSite* site = g_counters.load(std::memory_order_acquire); site; site = site->next) {
+        out.push_back({site->name, site->value.load(std::memory_order_relaxed)});
+    }
+#if FNM_PROFILING && FNM_ALLOCATION_HOOKS
+    out.push_back({"alloc.bytes", GetAllocatedBytes()});
+    out.push_back({"alloc.count", GetAllocationCount()});
+#endif
+    std::sort(out.begin(), out.end(), [](const CounterStats& a, const CounterStats& b) { return std::strcmp(a.name, b.name) < 0; });
+}
+
+uint64_t Profiler::GetAllocatedBytes() {
+    uint64_t total = g_retired_bytes.load(std::memory_order_relaxed) + g_shared_slot.bytes.load(std::memory_order_relaxed);
+    for (const AllocationSlot& slot : g_allocation_slots) total += slot.bytes.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t Profiler::GetAllocationCount() {
+    uint64_t total = g_retired_count.load(std::memory_order_relaxed) + g_shared_slot.count.load(std::memory_order_relaxed);
+    for (const AllocationSlot& slot : g_allocation_slots) total += slot.count.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Profiler::Reset() {
+    for (ProfileScopeSite* site = g_scopes.load(std::memory_order_acquire); site; site = site->next) {
+        site->calls = 0;
+        site->total_ns = 0;
+        site->max_ns = 0;
+        site->last_ns = 0;
+    }
+    for (ProfileCounterSite* site = g_counters.load(std::memory_order_acquire); site; site = site->next) site->value = 0;
+    std::lock_guard<std::mutex> lock(g_frame_mutex);
+    g_frame_next = 0;
+    g_frame_count = 0;
+}
+
+void Profiler::RecordFrame(uint64_t begin_ns, uint64_t end_ns) {
+    {
+        std::lock_guard<std::mutex> lock(g_frame_mutex);
+        g_frame_ms[g_frame_next] = (float)((end_ns - begin_ns) / 1e6);
+        g_frame_next = (g_frame_next + 1) % kFrameHistory;
+        g_frame_count = (std::min)(g_frame_count + 1, kFrameHistory);
+    }
+    if (!g_tracing.load(std::memory_order_relaxed)) return;
+
+    uint32_t thread = ThreadId();
+    AddTraceEvent({"Frame", begin_ns, end_ns - begin_ns, 0, thread, 'X'});
+    // Counters become graphs in the trace viewer
+    std::vector<CounterStats> counters;
+    GetCounters(counters);
+    for (const CounterStats& counter : counters) AddTraceEvent({counter.name, end_ns, 0, counter.value, thread, 'C'});
+}
+
+void Profiler::GetFrameTimes(std::vector<float>& out) {
+    std::lock_guard<std::mutex> lock(g_frame_mutex);
+    out.clear();
+    int first = (g_frame_next - g_frame_count + kFrameHistory) % kFrameHistory;
+    for (int i = 0; i < g_frame_count; i++) out.push_back(g_frame_ms[(first + i) % kFrameHistory]);
+}
+
+void Profiler::StartTrace() {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    g_trace.clear();
+    g_trace_dropped = 0;
+    g_tracing = true;
+}
+
+bool Profiler::IsTracing() {
+    return g_tracing.load(std::memory_order_relaxed);
+}
+
+bool Profiler::StopTrace(const std::string& file, size_t& event_count) {
+    std::vector<TraceEvent> events;
+    std::vector<std::pair<uint32_t, std::string>> names;
+    size_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(g_trace_mutex);
+        g_tracing = false;
+        events.swap(g_trace);
+        names = g_thread_names;
+        dropped = g_trace_dropped;
+    }
+    event_count = events.size();
+
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    // Trace Event Format: timestamps and durations in microseconds
+    std::string text = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" + std::to_string(dropped) + "},\"traceEvents\":[\n";
+    text += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"FileNamesManager\"}}";
+    for (const auto& name : names) {
+        text += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(name.first) + ",\"args\":{\"name\":";
+        AppendJsonString(text, name.second.c_str());
+        text += "}}";
+    }
+    char number[64];
+    for (const TraceEvent& event : events) {
+        text += ",\n{\"name\":";
+        AppendJsonString(text, event.name);
+        std::snprintf(number, sizeof(number), ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", event.phase, event.thread,
+                      event.begin_ns / 1e3);
+        text += number;
+        if (event.phase == 'X') {
+            std::snprintf(number, sizeof(number), ",\"dur\":%.3f}", event.duration_ns / 1e3);
+        } else {
+            std::snprintf(number, sizeof(number), ",\"args\":{\"value\":%llu}}", (unsigned long long)event.value);
+        }
+        text += number;
+        if (text.size() > (1 << 20)) {
+            out.write(text.data(), (std::streamsize)text.size());
+            text.clear();
+        }
+    }
+    text += "\n]}\n";
+    out.write(text.data(), (std::streamsize)text.size());
+    return (bool)out;
+}
+
+void Profiler::SetThreadName(const std::string& name) {
+    uint32_t thread = ThreadId();
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    for (auto& entry : g_thread_names) {
+        if (entry.first == thread) {
+            entry.second = name;
+            return;
+        }
+    }
+    g_thread_names.emplace_back(thread, name);
+}
+
+// --- Global allocation hooks ---
+
+#if FNM_PROFILING && FNM_ALLOCATION_HOOKS
+namespace {
+
+// Every replaced operator new allocates through here and every operator delete frees through
+// FreeCounted(), so the two always pair up, including for over-aligned types
+void* AllocateCounted(std::size_t size, std::size_t alignment) {
+    CountAllocation(size);
+    if (size == 0) size = 1;
+    bool aligned = alignment > alignof(std::max_align_t);
+    while (true) {
+        void* memory;
+#if defined(_WIN32)
+        memory = aligned ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+        // aligned_alloc wants a multiple of the alignment
+        memory = aligned ? std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1)) : std::malloc(size);
+#endif
+        if (memory) return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* AllocateCountedNoThrow(std::size_t size, std::size_t alignment) noexcept {
+    try {
+        return AllocateCounted(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void FreeCounted(void* memory, std::size_t alignment) noexcept {
+#if defined(_WIN32)
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(memory);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    std::free(memory);
+}
+
+constexpr std::size_t kDefaultAlignment = alignof(std::max_align_t);
+
+} // namespace
+
+void* operator new(std::size_t size) { return AllocateCounted(size, kDefaultAlignment); }
+void* operator new[](std::size_t size) { return AllocateCounted(size, kDefaultAlignment); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return AllocateCountedNoThrow(size, kDefaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return AllocateCountedNoThrow(size, kDefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateCounted(size, (std::size_t)alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateCounted(size, (std::size_t)alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateCountedNoThrow(size, (std::size_t)alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateCountedNoThrow(size, (std::size_t)alignment);
+}
+
+void operator delete(void* memory) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete[](void* memory) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete(void* memory, std::size_t) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete[](void* memory, std::size_t) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { FreeCounted(memory, kDefaultAlignment); }
+void operator delete(void* memory, std::align_val_t alignment) noexcept { FreeCounted(memory, (std::size_t)alignment); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept { FreeCounted(memory, (std::size_t)alignment); }
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept { FreeCounted(memory, (std::size_t)alignment); }
+void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept { FreeCounted(memory, (std::size_t)alignment); }
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    FreeCounted(memory, (std::size_t)alignment);
+}
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    FreeCounted(memory, (std::size_t)alignment);
+}
+#endif
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lightweight instrumentation: scoped timers, event counters, allocation totals, frame
+// times and an optional Chrome/Perfetto trace.
+//
+//   PROFILE_SCOPE("FileScanner::ApplyFilter");   // times the rest of the enclosing block
+//   PROFILE_COUNT("syscall.getdents64", 1);      // adds to a named counter
+//
+// Every call site owns a static record that registers itself on first use, so timing a
+// scope costs two clock reads and a few relaxed atomic adds, and counting costs one. Trace
+// events are only collected between StartTrace() and StopTrace().
+//
+// Allocations are counted by replacing the global operator new and delete, per thread
+// without contention. That's opt-in (FNM_ALLOCATION_HOOKS=1), since it replaces them for
+// the whole program. Building with FNM_PROFILING=0 compiles all of it out.
+
+#ifndef FNM_PROFILING
+#define FNM_PROFILING 1
+#endif
+#ifndef FNM_ALLOCATION_HOOKS
+#define FNM_ALLOCATION_HOOKS 0
+#endif
+
+struct ProfileScopeSite {
+    explicit ProfileScopeSite(const char* name);
+
+    const char* name;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::atomic<uint64_t> last_ns{0};
+    ProfileScopeSite* next = nullptr;
+};
+
+struct ProfileCounterSite {
+    explicit ProfileCounterSite(const char* name);
+
+    const char* name;
+    std::atomic<uint64_t> value{0};
+    ProfileCounterSite* next = nullptr;
+};
+
+class Profiler {
+public:
+    struct ScopeStats {
+        const char* name;
+        uint64_t calls;
+        uint64_t total_ns;
+        uint64_t max_ns;
+        uint64_t last_ns;
+    };
+    struct CounterStats {
+        const char* name;
+        uint64_t value;
+    };
+
+    static constexpr int kFrameHistory = 300;
+
+    // Nanoseconds on a steady clock, counted from program start
+    static uint64_t Now();
+
+    static void RecordScope(ProfileScopeSite& site, uint64_t begin_ns, uint64_t end_ns);
+
+    // Sorted by name. Counters include "alloc.bytes" and "alloc.count".
+    static void GetScopes(std::vector<ScopeStats>& out);
+    static void GetCounters(std::vector<CounterStats>& out);
+    static uint64_t GetAllocatedBytes();
+    static uint64_t GetAllocationCount();
+    // Zeroes timers, counters and frame history (allocation totals keep running)
+    static void Reset();
+
+    // Once per rendered frame, from the GUI thread. Also samples counters into the trace.
+    static void RecordFrame(uint64_t begin_ns, uint64_t end_ns);
+    // Most recent frame times in ms, oldest first
+    static void GetFrameTimes(std::vector<float>& out);
+
+    // Trace for chrome://tracing or ui.perfetto.dev. Collection stops at a few million
+    // events; the rest are counted as dropped.
+    static void StartTrace();
+    static bool IsTracing();
+    // Writes the Trace Event Format JSON and stops collecting
+    static bool StopTrace(const std::string& file, size_t& event_count);
+
+    // Shown as the thread's name in traces
+    static void SetThreadName(const std::string& name);
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileScopeSite& site) : m_site(site), m_begin(Profiler::Now()) {}
+    ~ProfileScope() { Profiler::RecordScope(m_site, m_begin, Profiler::Now()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileScopeSite& m_site;
+    uint64_t m_begin;
+};
+
+#if FNM_PROFILING
+#define FNM_PROFILE_JOIN2(a, b) a##b
+#define FNM_PROFILE_JOIN(a, b) FNM_PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name)                                                             \
+    static ProfileScopeSite FNM_PROFILE_JOIN(profile_site_, __LINE__)(name);            \
+    ProfileScope FNM_PROFILE_JOIN(profile_scope_, __LINE__)(FNM_PROFILE_JOIN(profile_site_, __LINE__))
+#define PROFILE_COUNT(name, amount)                                                     \
+    do {                                                                                \
+        static ProfileCounterSite profile_counter_site(name);                          \
+        profile_counter_site.value.fetch_add((uint64_t)(amount), std::memory_order_relaxed); \
+    } while (0)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNT(name, amount) do {} while (0)
+#endif
@@ -0,0 +1,17 @@
+#include "RedrawSignal.h"
+
+std::atomic<bool> RedrawSignal::s_pending{false};
+std::atomic<void (*)()> RedrawSignal::s_wake{nullptr};
+
+void RedrawSignal::Request() {
+    if (s_pending.exchange(true, std::memory_order_acq_rel)) return;
+    if (auto wake = s_wake.load(std::memory_order_acquire)) wake();
+}
+
+bool RedrawSignal::Consume() {
+    return s_pending.exchange(false, std::memory_order_acq_rel);
+}
+
+void RedrawSignal::SetWakeHandler(void (*handler)()) {
+    s_wake.store(handler, std::memory_order_release);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+
+// Tells an idle GUI that something it shows has changed. The GUI sleeps between input events
+// when nothing is running; background threads (the log, the watcher, tree listings) call
+// Request() when they have news, which wakes it up for a frame.
+//
+// Requests are coalesced: only the first one after the GUI picked up the last calls the wake
+// handler, so calling it for every log line or event costs an atomic exchange.
+class RedrawSignal {
+public:
+    // Any thread
+    static void Request();
+    // GUI thread, once per frame before reading state: true if anything was requested since
+    static bool Consume();
+
+    // Called (from any thread) to wake the GUI, e.g. glfwPostEmptyEvent. Without one, requests
+    // are only seen by Consume().
+    static void SetWakeHandler(void (*handler)());
+
+private:
+    static std::atomic<bool> s_pending;
+    static std::atomic<void (*)()> s_wake;
+};
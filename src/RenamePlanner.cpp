@@ -0,0 +1,656 @@
+#include "RenamePlanner.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <regex>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t kNoItem = 0xFFFFFFFFu;
+// Entries expanded per planning thread, below this it isn't worth a thread
+constexpr size_t kExpandPerThread = 4096;
+// Steps per execution task; chains and cycles are never split, so a task can be longer
+constexpr size_t kTaskSteps = 256;
+constexpr size_t kMaxRenameErrors = 1000;
+
+// Windows and macOS volumes usually ignore case, so "a.txt" and "A.txt" are the same name there
+#if defined(_WIN32) || defined(__APPLE__)
+constexpr bool kFoldCase = true;
+#else
+constexpr bool kFoldCase = false;
+#endif
+
+char FoldChar(char c) {
+    return (kFoldCase && c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+// A name inside one directory, for the collision sets
+struct NameKey {
+    uint32_t dir;
+    std::string_view name;
+};
+
+struct NameKeyHash {
+    size_t operator()(const NameKey& key) const {
+        uint64_t hash = 14695981039346656037ull ^ key.dir;
+        for (char c : key.name) {
+            hash ^= (unsigned char)FoldChar(c);
+            hash *= 1099511628211ull;
+        }
+        return (size_t)hash;
+    }
+};
+
+struct NameKeyEqual {
+    bool operator()(const NameKey& a, const NameKey& b) const {
+        if (a.dir != b.dir || a.name.size() != b.name.size()) return false;
+        for (size_t i = 0; i < a.name.size(); i++) {
+            if (FoldChar(a.name[i]) != FoldChar(b.name[i])) return false;
+        }
+        return true;
+    }
+};
+
+using NameMap = std::unordered_map<NameKey, uint32_t, NameKeyHash, NameKeyEqual>;
+
+// --- Templates ---
+
+enum class TokenKind : uint8_t { Literal, Stem, Extension, Full, Counter, Capture };
+enum class CaseMode : uint8_t { Keep, Upper, Lower, Title };
+
+struct Token {
+    TokenKind kind = TokenKind::Literal;
+    CaseMode mode = CaseMode::Keep;
+    int value = 0;     // counter width or capture index
+    std::string text;  // literal text
+};
+
+bool CompileTemplate(const std::string& text, std::vector<Token>& tokens, std::string& error) {
+    auto literal = [&](char c) {
+        if (tokens.empty() || tokens.back().kind != TokenKind::Literal) tokens.emplace_back();
+        tokens.back().text += c;
+    };
+
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '}') {
+            if (i + 1 < text.size() && text[i + 1] == '}') {
+                literal('}');
+                i++;
+                continue;
+            }
+            error = "Unmatched '}' in template (write '}}' for a literal brace)";
+            return false;
+        }
+        if (c != '{') {
+            literal(c);
+            continue;
+        }
+        if (i + 1 < text.size() && text[i + 1] == '{') {
+            literal('{');
+            i++;
+            continue;
+        }
+
+        size_t close = text.find('}', i);
+        if (close == std::string::npos) {
+            error = "Unterminated '{' in template";
+            return false;
+        }
+        std::string body = text.substr(i + 1, close - i - 1);
+        std::string key = body.substr(0, body.find(':'));
+        std::string modifier = key.size() < body.size() ? body.substr(key.size() + 1) : std::string();
+        i = close;
+
+        Token token;
+        if (key == "name") token.kind = TokenKind::Stem;
+        else if (key == "ext") token.kind = TokenKind::Extension;
+        else if (key == "full") token.kind = TokenKind::Full;
+        else if (key == "n") token.kind = TokenKind::Counter;
+        else if (key.size() == 1 && key[0] >= '0' && key[0] <= '9') {
+            token.kind = TokenKind::Capture;
+            token.value = key[0] - '0';
+        } else {
+            error = "Unknown field {" + body + "}";
+            return false;
+        }
+
+        if (token.kind == TokenKind::Counter) {
+            // {n:3} pads to three digits
+            if (!modifier.empty()) {
+                if (modifier.size() > 2 || modifier.find_first_not_of("0123456789") != std::string::npos) {
+                    error = "Counter width must be a number: {" + body + "}";
+                    return false;
+                }
+                token.value = (std::min)(std::stoi(modifier), 20);
+            }
+        } else if (modifier == "upper") token.mode = CaseMode::Upper;
+        else if (modifier == "lower") token.mode = CaseMode::Lower;
+        else if (modifier == "title") token.mode = CaseMode::Title;
+        else if (!modifier.empty()) {
+            error = "Unknown modifier in {" + body + "} (upper, lower or title)";
+            return false;
+        }
+        tokens.push_back(std::move(token));
+    }
+    return true;
+}
+
+// ASCII only, so multi-byte UTF-8 sequences pass through untouched
+void AppendCased(std::string& out, std::string_view text, CaseMode mode) {
+    bool word_start = true;
+    for (char c : text) {
+        bool upper = c >= 'A' && c <= 'Z';
+        bool lower = c >= 'a' && c <= 'z';
+        bool to_upper = mode == CaseMode::Upper || (mode == CaseMode::Title && word_start);
+        bool to_lower = mode == CaseMode::Lower || (mode == CaseMode::Title && !word_start);
+        if (to_upper && lower) c = (char)(c - ('a' - 'A'));
+        else if (to_lower && upper) c = (char)(c + ('a' - 'A'));
+        out += c;
+        word_start = !(upper || lower || (c >= '0' && c <= '9'));
+    }
+}
+
+void Expand(const std::vector<Token>& tokens, std::string_view name, const std::cmatch* match, int64_t counter,
+            std::string& out) {
+    // Dot files (".bashrc") are all name, no extension
+    size_t dot = name.rfind('.');
+    if (dot == 0) dot = std::string_view::npos;
+    std::string_view stem = name.substr(0, dot);
+    std::string_view extension = dot == std::string_view::npos ? std::string_view() : name.substr(dot);
+
+    out.clear();
+    for (const Token& token : tokens) {
+        switch (token.kind) {
+        case TokenKind::Literal: out += token.text; break;
+        case TokenKind::Stem: AppendCased(out, stem, token.mode); break;
+        case TokenKind::Extension: AppendCased(out, extension, token.mode); break;
+        case TokenKind::Full: AppendCased(out, name, token.mode); break;
+        case TokenKind::Counter: {
+            std::string digits = std::to_string(counter < 0 ? -counter : counter);
+            if (counter < 0) out += '-';
+            if ((int)digits.size() < token.value) out.append(token.value - digits.size(), '0');
+            out += digits;
+            break;
+        }
+        case TokenKind::Capture:
+            if (match && (size_t)token.value < match->size() && (*match)[token.value].matched) {
+                const auto& group = (*match)[token.value];
+                AppendCased(out, std::string_view(group.first, (size_t)(group.second - group.first)), token.mode);
+            }
+            break;
+        }
+    }
+}
+
+const char* ValidateName(const std::string& name) {
+    if (name.empty()) return "new name is empty";
+    if (name == "." || name == "..") return "new name is not a valid file name";
+    if (name.size() > 255) return "new name is longer than 255 bytes";
+    for (char c : name) {
+        if (c == '/' || c == '\0') return "new name contains '/'";
+#if defined(_WIN32)
+        if (c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|' ||
+            (unsigned char)c < 32) {
+            return "new name contains a character Windows doesn't allow";
+        }
+#endif
+    }
+    return nullptr;
+}
+
+// --- Execution ---
+
+std::string TempName(uint32_t item, uint64_t salt) {
+    char name[64];
+    std::snprintf(name, sizeof(name), ".fnm-rename-%llx-%u", (unsigned long long)salt, item);
+    return name;
+}
+
+// Renames `from` to `to` inside one directory without ever replacing an existing file
+class DirectoryRenamer {
+public:
+    explicit DirectoryRenamer(const std::string& dir_path) : m_path(dir_path) {
+#if defined(__linux__)
+        m_fd = open(dir_path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (m_fd < 0) m_open_error = std::error_code(errno, std::generic_category()).message();
+#endif
+    }
+    ~DirectoryRenamer() {
+#if defined(__linux__)
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+    DirectoryRenamer(const DirectoryRenamer&) = delete;
+    DirectoryRenamer& operator=(const DirectoryRenamer&) = delete;
+
+    bool Rename(const std::string& from, const std::string& to, std::string& error) {
+#if defined(__linux__)
+        if (m_fd < 0) {
+            error = m_open_error;
+            return false;
+        }
+#if defined(RENAME_NOREPLACE)
+        if (!m_no_replace_unsupported) {
+            if (renameat2(m_fd, from.c_str(), m_fd, to.c_str(), RENAME_NOREPLACE) == 0) return true;
+            if (errno != EINVAL && errno != ENOSYS) {
+                error = std::error_code(errno, std::generic_category()).message();
+                return false;
+            }
+            // Filesystem without RENAME_NOREPLACE (some network and FUSE mounts)
+            m_no_replace_unsupported = true;
+        }
+#endif
+        if (faccessat(m_fd, to.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+            error = std::error_code(EEXIST, std::generic_category()).message();
+            return false;
+        }
+        if (renameat(m_fd, from.c_str(), m_fd, to.c_str()) == 0) return true;
+        error = std::error_code(errno, std::generic_category()).message();
+        return false;
+#else
+        fs::path dir(m_path);
+        std::error_code ec;
+        fs::path source = dir / fs::path(from);
+        fs::path target = dir / fs::path(to);
+        // On a case-insensitive volume a case-only change "exists" already, as itself
+        if (fs::exists(fs::symlink_status(target, ec)) && !fs::equivalent(source, target, ec)) {
+            error = std::error_code(EEXIST, std::generic_category()).message();
+            return false;
+        }
+        fs::rename(source, target, ec);
+        if (!ec) return true;
+        error = ec.message();
+        return false;
+#endif
+    }
+
+private:
+    std::string m_path;
+#if defined(__linux__)
+    int m_fd = -1;
+    std::string m_open_error;
+    bool m_no_replace_unsupported = false;
+#endif
+};
+
+struct ExecuteState {
+    ExecuteState(const EntryStore& store, const RenamePlan& plan) : store(store), plan(plan) {}
+
+    const EntryStore& store;
+    const RenamePlan& plan;
+    uint64_t salt = 0;
+    std::vector<std::string> dir_paths; // by task
+    std::vector<uint8_t> location;      // by item: where the entry is now
+
+    std::atomic<size_t> next_task{0};
+    size_t task_end = 0;
+
+    std::mutex mutex;
+    std::vector<std::string> errors;
+    size_t suppressed_errors = 0;
+};
+
+enum : uint8_t { kAtOld, kAtTemp, kAtNew };
+
+void ReportError(ExecuteState& state, const std::string& dir_path, std::string_view name, const std::string& error) {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.errors.size() >= kMaxRenameErrors) {
+        state.suppressed_errors++;
+        return;
+    }
+    state.errors.push_back((fs::path(dir_path) / fs::path(name)).string() + ": " + error);
+}
+
+void RunTask(ExecuteState& state, size_t task_index) {
+    const RenamePlan& plan = state.plan;
+    const RenamePlan::Task& task = plan.tasks[task_index];
+    const std::string& dir_path = state.dir_paths[task_index];
+    DirectoryRenamer renamer(dir_path);
+    PROFILE_COUNT("syscall.renameat", task.step_end - task.step_begin);
+
+    std::string error;
+    bool sequence_failed = false;
+    for (uint32_t s = task.step_begin; s < task.step_end; s++) {
+        const RenamePlan::Step& step = plan.steps[s];
+        const RenamePlan::Item& item = plan.items[step.item];
+        std::string old_name(state.store.GetName(item.entry));
+
+        if (sequence_failed) {
+            // The name this step needed is still taken. An entry parked under its temporary
+            // name goes back where it came from if it can.
+            if (step.from_temp && state.location[step.item] == kAtTemp &&
+                renamer.Rename(TempName(step.item, state.salt), old_name, error)) {
+                state.location[step.item] = kAtOld;
+            }
+        } else {
+            std::string from = step.from_temp ? TempName(step.item, state.salt) : old_name;
+            std::string to = step.to_temp ? TempName(step.item, state.salt) : item.new_name;
+            if (renamer.Rename(from, to, error)) {
+                state.location[step.item] = step.to_temp ? kAtTemp : kAtNew;
+            } else {
+                ReportError(state, dir_path, from, error);
+                sequence_failed = true;
+            }
+        }
+        if (step.sequence_end) sequence_failed = false;
+    }
+}
+
+void RunWorker(ExecuteState& state) {
+    while (true) {
+        size_t task = state.next_task.fetch_add(1, std::memory_order_relaxed);
+        if (task >= state.task_end) break;
+        RunTask(state, task);
+    }
+}
+
+} // namespace
+
+RenamePlan RenamePlanner::Plan(const EntryStore& store, const std::vector<uint32_t>& entries, const RenameOptions& options) {
+    RenamePlan plan;
+
+    std::vector<Token> tokens;
+    if (!CompileTemplate(options.name_template, tokens, plan.template_error)) return plan;
+
+    std::regex pattern;
+    bool has_pattern = !options.match.empty();
+    if (has_pattern) {
+        try {
+            auto flags = std::regex::ECMAScript | (options.match_case_sensitive ? std::regex::flag_type() : std::regex::icase);
+            pattern = std::regex(options.match, flags);
+        } catch (const std::regex_error& e) {
+            plan.template_error = std::string("Invalid pattern: ") + e.what();
+            return plan;
+        }
+    }
+    for (const Token& token : tokens) {
+        if (token.kind != TokenKind::Capture || token.value == 0) continue;
+        if (!has_pattern || (size_t)token.value > pattern.mark_count()) {
+            plan.template_error = "{" + std::to_string(token.value) + "} refers to a group the pattern doesn't have";
+            return plan;
+        }
+    }
+
+    // Expand every name. Entries only read the store and write their own slot, so this
+    // splits across threads without any locking.
+    enum : uint8_t { kUnchanged, kChanged, kInvalid };
+    size_t count = entries.size();
+    size_t thread_count = (std::min)((size_t)(std::max)(1u, std::thread::hardware_concurrency()), count / kExpandPerThread + 1);
+    auto split = [&](auto&& fn) {
+        if (thread_count == 1) {
+            fn((size_t)0, count);
+            return;
+        }
+        std::vector<std::thread> threads;
+        size_t per_thread = (count + thread_count - 1) / thread_count;
+        for (size_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(fn, (std::min)(i * per_thread, count), (std::min)((i + 1) * per_thread, count));
+        }
+        fn((size_t)0, (std::min)(per_thread, count));
+        for (auto& thread : threads) thread.join();
+    };
+    auto search = [&](std::string_view name, std::cmatch& match) {
+        try {
+            return std::regex_search(name.data(), name.data() + name.size(), match, pattern);
+        } catch (const std::regex_error&) {
+            return false; // pathological backtracking; leave the entry alone
+        }
+    };
+
+    // The counter only counts entries the regex matched, so it has to know them all first
+    std::vector<uint32_t> ordinal(count);
+    if (has_pattern) {
+        std::vector<uint8_t> matched(count, 0);
+        split([&](size_t begin, size_t end) {
+            std::cmatch match;
+            for (size_t t = begin; t < end; t++) matched[t] = search(store.GetName(entries[t]), match);
+        });
+        uint32_t next = 0;
+        for (size_t t = 0; t < count; t++) ordinal[t] = matched[t] ? next++ : kNoItem;
+        plan.matched = next;
+    } else {
+        for (size_t t = 0; t < count; t++) ordinal[t] = (uint32_t)t;
+        plan.matched = count;
+    }
+
+    std::vector<std::string> new_names(count);
+    std::vector<uint8_t> outcome(count, kUnchanged);
+    std::vector<const char*> invalid_reason(count, nullptr);
+    split([&](size_t begin, size_t end) {
+        std::cmatch match;
+        for (size_t t = begin; t < end; t++) {
+            if (ordinal[t] == kNoItem) continue;
+            std::string_view name = store.GetName(entries[t]);
+            // Again for the captures; it matched the first time, so it does now
+            if (has_pattern && !search(name, match)) continue;
+            Expand(tokens, name, has_pattern ? &match : nullptr,
+                   options.counter_start + (int64_t)ordinal[t] * options.counter_step, new_names[t]);
+            if (new_names[t] == name) continue;
+            invalid_reason[t] = ValidateName(new_names[t]);
+            outcome[t] = invalid_reason[t] ? kInvalid : kChanged;
+        }
+    });
+
+    std::vector<uint32_t> item_of_entry(store.Size(), kNoItem);
+    std::vector<uint8_t> affected_dirs(store.GetDirCount(), 0);
+    for (size_t t = 0; t < count; t++) {
+        if (outcome[t] == kUnchanged || item_of_entry[entries[t]] != kNoItem) {
+            plan.unchanged++;
+            continue;
+        }
+        uint32_t entry = entries[t];
+        item_of_entry[entry] = (uint32_t)plan.items.size();
+        affected_dirs[store.GetParentDir(entry)] = 1;
+        plan.items.push_back({entry, std::move(new_names[t]), invalid_reason[t] ? invalid_reason[t] : ""});
+    }
+    new_names.clear();
+    std::vector<RenamePlan::Item>& items = plan.items;
+    auto key_of = [&](uint32_t item) { return NameKey{store.GetParentDir(items[item].entry), items[item].new_name}; };
+
+    // Two entries ending up with the same name in one directory
+    NameMap planned;
+    planned.reserve(items.size());
+    for (uint32_t i = 0; i < items.size(); i++) {
+        if (!items[i].error.empty()) continue;
+        auto inserted = planned.emplace(key_of(i), i);
+        if (inserted.second) continue;
+        uint32_t other = inserted.first->second;
+        items[i].error = "same new name as '" + std::string(store.GetName(items[other].entry)) + "'";
+        if (items[other].error.empty()) {
+            items[other].error = "same new name as '" + std::string(store.GetName(items[i].entry)) + "'";
+        }
+    }
+
+    // Every name currently in the affected directories. A new name that's taken is only fine
+    // if the entry holding it is being renamed away, and then that rename has to go first.
+    NameMap occupied;
+    occupied.reserve(items.size() * 2);
+    for (uint32_t e = 0; e < store.Size(); e++) {
+        uint32_t dir = store.GetParentDir(e);
+        if (affected_dirs[dir]) occupied.emplace(NameKey{dir, store.GetName(e)}, e);
+    }
+    std::vector<uint32_t> depends_on(items.size(), kNoItem); // item whose old name this one takes
+    std::vector<uint32_t> dependent(items.size(), kNoItem);  // item taking this one's old name
+    for (uint32_t i = 0; i < items.size(); i++) {
+        if (!items[i].error.empty()) continue;
+        auto it = occupied.find(key_of(i));
+        if (it == occupied.end()) continue;
+        uint32_t holder = item_of_entry[it->second];
+        if (holder == i) continue; // case-only change on a case-insensitive volume
+        if (holder == kNoItem) {
+            items[i].error = "'" + items[i].new_name + "' already exists";
+        } else if (!items[holder].error.empty()) {
+            items[i].error = "'" + items[i].new_name + "' is kept by a conflicting rename";
+        } else {
+            depends_on[i] = holder;
+            dependent[holder] = i;
+        }
+    }
+    // A conflict keeps its entry in place, which blocks whatever wanted that name
+    for (uint32_t i = 0; i < items.size(); i++) {
+        if (items[i].error.empty()) continue;
+        for (uint32_t next = dependent[i]; next != kNoItem && items[next].error.empty(); next = dependent[next]) {
+            items[next].error = "'" + items[next].new_name + "' is kept by a conflicting rename";
+        }
+    }
+    for (const auto& item : items) plan.conflicts += !item.error.empty();
+
+    // Chains (c -> d, then b -> c, then a -> b) run from the end whose target is free.
+    // What's left over are cycles; one member is parked under a temporary name first.
+    struct Sequence {
+        uint32_t depth;
+        uint32_t dir;
+        uint32_t step_begin;
+        uint32_t step_end;
+    };
+    std::vector<RenamePlan::Step> steps;
+    std::vector<Sequence> sequences;
+    std::vector<uint8_t> sequenced(items.size(), 0);
+
+    std::vector<int32_t> dir_depth(store.GetDirCount(), -1);
+    dir_depth[EntryStore::kRootDir] = 0;
+    std::vector<uint32_t> walk;
+    auto depth_of = [&](uint32_t dir) {
+        while (dir_depth[dir] < 0) {
+            uint32_t entry = store.GetDirEntry(dir);
+            if (entry == EntryStore::kNoEntry) {
+                dir_depth[dir] = 0;
+                break;
+            }
+            walk.push_back(dir);
+            dir = store.GetParentDir(entry);
+        }
+        int32_t depth = dir_depth[dir];
+        for (; !walk.empty(); walk.pop_back()) dir_depth[walk.back()] = ++depth;
+        return (uint32_t)depth;
+    };
+    auto begin_sequence = [&](uint32_t item) {
+        uint32_t dir = store.GetParentDir(items[item].entry);
+        sequences.push_back({depth_of(dir), dir, (uint32_t)steps.size(), 0});
+    };
+    auto add_step = [&](uint32_t item, bool from_temp, bool to_temp) {
+        steps.push_back({item, from_temp, to_temp, false});
+        sequenced[item] = 1;
+    };
+    auto end_sequence = [&]() {
+        steps.back().sequence_end = true;
+        sequences.back().step_end = (uint32_t)steps.size();
+    };
+
+    for (uint32_t i = 0; i < items.size(); i++) {
+        if (!items[i].error.empty() || depends_on[i] != kNoItem) continue;
+        begin_sequence(i);
+        for (uint32_t next = i; next != kNoItem; next = dependent[next]) add_step(next, false, false);
+        end_sequence();
+    }
+    for (uint32_t i = 0; i < items.size(); i++) {
+        if (!items[i].error.empty() || sequenced[i]) continue;
+        plan.cycles++;
+        begin_sequence(i);
+        add_step(i, false, true);
+        for (uint32_t next = dependent[i]; next != i; next = dependent[next]) add_step(next, false, false);
+        add_step(i, true, false);
+        end_sequence();
+    }
+
+    // Deepest first; within a level, group by directory so a task opens its directory once
+    std::stable_sort(sequences.begin(), sequences.end(), [](const Sequence& a, const Sequence& b) {
+        return a.depth != b.depth ? a.depth > b.depth : a.dir < b.dir;
+    });
+    plan.steps.reserve(steps.size());
+    uint32_t level_depth = 0;
+    for (const Sequence& sequence : sequences) {
+        bool new_level = plan.tasks.empty() || sequence.depth != level_depth;
+        if (new_level) {
+            plan.level_begin.push_back((uint32_t)plan.tasks.size());
+            level_depth = sequence.depth;
+        }
+        RenamePlan::Task* task = plan.tasks.empty() ? nullptr : &plan.tasks.back();
+        if (new_level || task->dir != sequence.dir || task->step_end - task->step_begin >= kTaskSteps) {
+            uint32_t begin = (uint32_t)plan.steps.size();
+            plan.tasks.push_back({sequence.dir, begin, begin});
+            task = &plan.tasks.back();
+        }
+        plan.steps.insert(plan.steps.end(), steps.begin() + sequence.step_begin, steps.begin() + sequence.step_end);
+        task->step_end = (uint32_t)plan.steps.size();
+    }
+    return plan;
+}
+
+RenameResult RenamePlanner::Execute(const EntryStore& store, const RenamePlan& plan) {
+    RenameResult result;
+    if (!plan.CanExecute()) return result;
+    PROFILE_SCOPE("RenamePlanner::Execute");
+
+    ExecuteState state(store, plan);
+    state.salt = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    state.location.assign(plan.items.size(), kAtOld);
+
+    // Directory paths are worked out before anything moves. Deeper levels run first, so a
+    // directory's own path is still intact when its contents are renamed.
+    state.dir_paths.reserve(plan.tasks.size());
+    std::unordered_map<uint32_t, std::string> dir_paths;
+    for (const RenamePlan::Task& task : plan.tasks) {
+        auto it = dir_paths.find(task.dir);
+        if (it == dir_paths.end()) {
+            uint32_t entry = store.GetDirEntry(task.dir);
+            it = dir_paths.emplace(task.dir, entry == EntryStore::kNoEntry ? store.GetRootPath() : store.GetPath(entry)).first;
+        }
+        state.dir_paths.push_back(it->second);
+    }
+
+    // Renames are metadata-bound like deletes: several in flight help even on a small machine
+    unsigned pool_size = (std::min)((std::max)(4u, std::thread::hardware_concurrency()), 16u);
+    for (size_t level = 0; level < plan.level_begin.size(); level++) {
+        size_t begin = plan.level_begin[level];
+        size_t end = level + 1 < plan.level_begin.size() ? plan.level_begin[level + 1] : plan.tasks.size();
+        state.next_task.store(begin, std::memory_order_relaxed);
+        state.task_end = end;
+
+        size_t thread_count = (std::min)((size_t)pool_size, end - begin);
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < thread_count; i++) workers.emplace_back([&state] { RunWorker(state); });
+        RunWorker(state);
+        for (auto& worker : workers) worker.join();
+    }
+
+    for (uint32_t i = 0; i < plan.items.size(); i++) {
+        switch (state.location[i]) {
+        case kAtNew:
+            result.renamed++;
+            result.changed.emplace_back(plan.items[i].entry, plan.items[i].new_name);
+            break;
+        case kAtTemp:
+            // A failed swap that couldn't be undone; the list has to show where it really is
+            result.failed++;
+            result.changed.emplace_back(plan.items[i].entry, TempName(i, state.salt));
+            state.errors.push_back(store.GetPath(plan.items[i].entry) + ": left as '" + TempName(i, state.salt) + "'");
+            break;
+        default:
+            result.failed++;
+            break;
+        }
+    }
+    result.errors = std::move(state.errors);
+    if (state.suppressed_errors > 0) {
+        result.errors.push_back("... and " + std::to_string(state.suppressed_errors) + " more errors");
+    }
+    return result;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "EntryStore.h"
+
+// What a batch rename should produce. `name_template` is expanded once per entry:
+//
+//   {name}   name without its last extension      {ext}   the extension with its dot, or nothing
+//   {full}   the whole current name               {n}     counter, {n:3} pads it to three digits
+//   {0}-{9}  capture groups of `match`            {{ }}   literal braces
+//
+// {name}, {ext}, {full} and the captures take a case modifier: {name:upper}, {ext:lower},
+// {1:title}. Extensions are rewritten by spelling them out, e.g. "{name}.jpeg".
+//
+// With a `match` regex (ECMAScript, searched anywhere in the name), entries whose name
+// doesn't match are left alone and don't use up a counter value: {n} numbers the matching
+// entries only, in the order they were given in.
+struct RenameOptions {
+    std::string name_template = "{name}{ext}";
+    std::string match;
+    bool match_case_sensitive = true;
+    int64_t counter_start = 1;
+    int64_t counter_step = 1;
+};
+
+// Result of planning a rename. Nothing has touched the disk yet; the items double as the
+// preview. Items whose `error` is set are conflicts and are never executed.
+struct RenamePlan {
+    struct Item {
+        uint32_t entry;
+        std::string new_name;
+        std::string error;
+    };
+
+    std::string template_error; // bad template or regex; no items then
+    std::vector<Item> items;    // only entries whose name actually changes, in the order given
+    size_t unchanged = 0;       // same name after expansion, or no regex match
+    size_t matched = 0;         // entries the counter stepped for: all of them without a regex
+    size_t conflicts = 0;
+    size_t cycles = 0;          // renames that trade names (a -> b, b -> a), done through a temporary name
+
+    // Execution order. Steps are grouped into tasks that each stay inside one directory, and
+    // tasks into levels, deepest first: everything inside a folder is renamed before the
+    // folder itself, so the paths worked out up front stay valid.
+    struct Step {
+        uint32_t item;
+        uint8_t from_temp : 1;    // source is the item's temporary name
+        uint8_t to_temp : 1;      // target is the item's temporary name
+        uint8_t sequence_end : 1; // later steps of the same chain/cycle depend on this one otherwise
+    };
+    struct Task {
+        uint32_t dir;
+        uint32_t step_begin;
+        uint32_t step_end;
+    };
+    std::vector<Step> steps;
+    std::vector<Task> tasks;
+    std::vector<uint32_t> level_begin; // task index where each level starts
+
+    bool CanExecute() const { return template_error.empty() && conflicts == 0 && !items.empty(); }
+};
+
+struct RenameResult {
+    size_t renamed = 0;
+    size_t failed = 0;
+    std::vector<std::string> errors; // "path: reason", capped
+    // (entry, name it has on disk now) for every entry whose name changed, including ones
+    // stranded under a temporary name by a failed swap
+    std::vector<std::pair<uint32_t, std::string>> changed;
+};
+
+class RenamePlanner {
+public:
+    // Expands the template for `entries` (expansion runs on several threads for large
+    // batches), then checks the result against every name in the affected directories using
+    // a hash set: two entries landing on the same name, a name that's taken by an entry that
+    // stays put, invalid names. Renames that only work in a particular order (chains, swaps)
+    // are ordered here as well.
+    static RenamePlan Plan(const EntryStore& store, const std::vector<uint32_t>& entries, const RenameOptions& options);
+
+    // Runs a plan made from `store`, which must not have changed since. Each level is spread
+    // over a worker pool; on Linux every rename is a renameat() against the parent directory's
+    // descriptor that refuses to overwrite anything that appeared since the scan. A failed
+    // step also skips the steps of its chain that depend on it.
+    static RenameResult Execute(const EntryStore& store, const RenamePlan& plan);
+};
@@ -0,0 +1,513 @@
+#include "ScanExport.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'N', 'M', 'L', 'I', 'S', 'T', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 64;
+constexpr uint32_t kFlagRecursive = 1;
+
+// Output is gathered in a buffer this large (or passed through as whole columns) between writes
+constexpr size_t kBufferBytes = (size_t)4 << 20;
+// Pieces per writev; well under IOV_MAX everywhere
+constexpr size_t kMaxPieces = 64;
+
+size_t Align8(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+bool IsLittleEndian() {
+    const uint16_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+template <typename T>
+T ByteSwap(T value) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    std::reverse(bytes, bytes + sizeof(T));
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+// Buffered output to a file or stdout. Small appends are copied into the buffer; large blocks
+// (whole columns) are queued by reference and go out with it in the same writev, so they're
+// never copied. Queued blocks must stay valid until the next Flush().
+class Sink {
+public:
+    Sink() : m_buffer(kBufferBytes) {}
+    ~Sink() { Close(); }
+
+    bool Open(const std::string& file, std::string& error) {
+#if defined(__linux__)
+        m_owned = file != "-";
+        m_fd = m_owned ? ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : STDOUT_FILENO;
+        bool opened = m_fd >= 0;
+#else
+        m_owned = file != "-";
+        m_file = m_owned ? std::fopen(file.c_str(), "wb") : stdout;
+        bool opened = m_file != nullptr;
+#endif
+        if (!opened) {
+            m_owned = false;
+            error = file + ": " + std::strerror(errno);
+        }
+        return opened;
+    }
+
+    void Append(const void* data, size_t bytes) {
+        if (m_used + bytes > m_buffer.size()) Flush();
+        if (bytes > m_buffer.size()) {
+            AppendBlock(data, bytes);
+            return;
+        }
+        std::memcpy(m_buffer.data() + m_used, data, bytes);
+        m_used += bytes;
+    }
+    void Append(std::string_view text) { Append(text.data(), text.size()); }
+
+    void AppendBlock(const void* data, size_t bytes) {
+        if (bytes == 0) return;
+        Pin();
+        m_pieces.push_back({static_cast<const char*>(data), bytes});
+        if (m_pieces.size() >= kMaxPieces) Flush();
+    }
+
+    // Columns in little-endian order: passed through as they are, or swapped through the buffer
+    template <typename T>
+    void AppendColumn(const T* values, size_t count) {
+        if (sizeof(T) == 1 || IsLittleEndian()) {
+            AppendBlock(values, count * sizeof(T));
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            T swapped = ByteSwap(values[i]);
+            Append(&swapped, sizeof(T));
+        }
+    }
+
+    template <typename T>
+    void AppendLittleEndian(T value) {
+        if (!IsLittleEndian()) value = ByteSwap(value);
+        Append(&value, sizeof(T));
+    }
+
+    void Pad(size_t bytes) {
+        static const char padding[8] = {};
+        Append(padding, Align8(bytes) - bytes);
+    }
+
+    void Flush() {
+        Pin();
+        PROFILE_SCOPE("ScanExport::Flush");
+        if (m_error == 0) {
+#if defined(__linux__)
+            size_t first = 0;
+            while (first < m_pieces.size()) {
+                iovec vectors[kMaxPieces];
+                size_t count = std::min(m_pieces.size() - first, kMaxPieces);
+                for (size_t i = 0; i < count; i++) {
+                    vectors[i].iov_base = const_cast<char*>(m_pieces[first + i].data);
+                    vectors[i].iov_len = m_pieces[first + i].bytes;
+                }
+                ssize_t written = ::writev(m_fd, vectors, (int)count);
+                PROFILE_COUNT("syscall.writev", 1);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) {
+                    m_error = written < 0 ? errno : EIO;
+                    break;
+                }
+                // Partial write: drop what went out and retry the rest
+                size_t left = (size_t)written;
+                while (left > 0 && left >= m_pieces[first].bytes) left -= m_pieces[first++].bytes;
+                if (left > 0) {
+                    m_pieces[first].data += left;
+                    m_pieces[first].bytes -= left;
+                }
+            }
+#else
+            for (const Piece& piece : m_pieces) {
+                if (std::fwrite(piece.data, 1, piece.bytes, m_file) != piece.bytes) {
+                    m_error = errno ? errno : EIO;
+                    break;
+                }
+            }
+#endif
+        }
+        m_pieces.clear();
+        m_used = 0;
+        m_pinned = 0;
+    }
+
+    // Flushes and closes; false if anything failed to write
+    bool Close(std::string* error = nullptr) {
+        Flush();
+#if defined(__linux__)
+        if (m_owned && ::close(m_fd) != 0 && m_error == 0) m_error = errno;
+        m_fd = -1;
+#else
+        if (m_file && std::fflush(m_file) != 0 && m_error == 0) m_error = EIO;
+        if (m_owned) std::fclose(m_file);
+        m_file = nullptr;
+#endif
+        m_owned = false;
+        if (m_error != 0 && error) *error = std::strerror(m_error);
+        return m_error == 0;
+    }
+
+private:
+    struct Piece {
+        const char* data;
+        size_t bytes;
+    };
+
+    // Buffered bytes not yet queued become a piece, so blocks queued after them keep their place
+    void Pin() {
+        if (m_used > m_pinned) m_pieces.push_back({m_buffer.data() + m_pinned, m_used - m_pinned});
+        m_pinned = m_used;
+    }
+
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+    size_t m_pinned = 0;
+    std::vector<Piece> m_pieces;
+    int m_error = 0;
+    bool m_owned = false;
+#if defined(__linux__)
+    int m_fd = -1;
+#else
+    std::FILE* m_file = nullptr;
+#endif
+};
+
+// Sequential reads straight into the destination columns
+class Source {
+public:
+#if defined(__linux__)
+    ~Source() {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+    bool Open(const std::string& file, uint64_t& size) {
+        m_fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) return false;
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) return false;
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        size = (uint64_t)st.st_size;
+        return true;
+    }
+    bool Read(void* data, size_t bytes) {
+        char* out = static_cast<char*>(data);
+        while (bytes > 0) {
+            ssize_t n = ::read(m_fd, out, bytes);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            out += n;
+            bytes -= (size_t)n;
+        }
+        return true;
+    }
+#else
+    bool Open(const std::string& file, uint64_t& size) {
+        m_stream.open(file, std::ios::binary | std::ios::ate);
+        if (!m_stream) return false;
+        size = (uint64_t)m_stream.tellg();
+        m_stream.seekg(0);
+        return (bool)m_stream;
+    }
+    bool Read(void* data, size_t bytes) {
+        m_stream.read(static_cast<char*>(data), (std::streamsize)bytes);
+        return (size_t)m_stream.gcount() == bytes;
+    }
+#endif
+
+    bool SkipPadding(size_t bytes) {
+        char padding[8];
+        return Read(padding, Align8(bytes) - bytes);
+    }
+
+    // std::vector or PagedArray, little-endian on disk
+    template <typename Column>
+    bool ReadColumn(Column& out, size_t count) {
+        using T = typename Column::value_type;
+        out.resize(count);
+        if (!Read(out.data(), count * sizeof(T)) || !SkipPadding(count * sizeof(T))) return false;
+        if (sizeof(T) > 1 && !IsLittleEndian()) {
+            for (size_t i = 0; i < count; i++) out[i] = ByteSwap(out[i]);
+        }
+        return true;
+    }
+
+private:
+#if defined(__linux__)
+    int m_fd = -1;
+#else
+    std::ifstream m_stream;
+#endif
+};
+
+template <typename T>
+T ReadLittleEndian(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return IsLittleEndian() ? value : ByteSwap(value);
+}
+
+void AppendNumber(std::string& out, uint64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, (size_t)(result.ptr - digits));
+}
+
+// JSON string contents, without the quotes. Names rarely need escaping, so plain runs are
+// copied whole.
+void AppendJsonEscaped(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char u = (unsigned char)text[i];
+        if (u >= 0x20 && u != '"' && u != '\\') continue;
+        out.append(text.data() + run, i - run);
+        run = i + 1;
+        if (u >= 0x20) {
+            out += '\\';
+            out += (char)u;
+        } else {
+            out += "\\u00";
+            out += hex[u >> 4];
+            out += hex[u & 15];
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+}
+
+// RFC 4180: a field is quoted only when it has to be, with quotes doubled
+bool NeedsCsvQuotes(std::string_view text) {
+    bool quote = false;
+    for (char c : text) quote |= c == ',' || c == '"' || c == '\n' || c == '\r';
+    return quote;
+}
+
+void AppendCsvQuoted(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+bool IsSeparator(char c) {
+    return c == '/' || c == (char)std::filesystem::path::preferred_separator;
+}
+
+void WriteText(const EntryStore& store, const PagedArray<uint32_t>& rows, ScanExport::Format format, Sink& sink) {
+    bool csv = format == ScanExport::Format::Csv;
+    // Entries mostly come grouped by folder, so the folder's path (escaped for JSON, checked
+    // for CSV quoting) is kept until an entry from another folder shows up, instead of walking
+    // the parent chain for every entry
+    uint32_t prefix_dir = EntryStore::kNoDir;
+    std::string prefix;
+    std::string prefix_json;
+    bool prefix_quoted = false;
+    std::string line;
+    if (csv) sink.Append("path,type,size,files\n");
+
+    for (uint32_t i : rows) {
+        uint32_t dir = store.GetParentDir(i);
+        if (dir != prefix_dir) {
+            uint32_t entry = dir == EntryStore::kRootDir ? EntryStore::kNoEntry : store.GetDirEntry(dir);
+            prefix = entry == EntryStore::kNoEntry ? store.GetRootPath() : store.GetPath(entry);
+            if (prefix.empty() || !IsSeparator(prefix.back())) prefix += (char)std::filesystem::path::preferred_separator;
+            prefix_json.clear();
+            AppendJsonEscaped(prefix_json, prefix);
+            prefix_quoted = NeedsCsvQuotes(prefix);
+            prefix_dir = dir;
+        }
+        std::string_view name = store.GetName(i);
+        bool is_directory = store.IsDirectory(i);
+        // Folders: everything below them, when the scan went that deep
+        bool has_size = !is_directory || store.HasDirTotals(i);
+
+        line.clear();
+        if (csv) {
+            if (prefix_quoted || NeedsCsvQuotes(name)) {
+                AppendCsvQuoted(line, prefix + std::string(name));
+            } else {
+                line += prefix;
+                line += name;
+            }
+            line += is_directory ? ",dir," : ",file,";
+            if (has_size) AppendNumber(line, store.GetTotalSize(i));
+            line += ',';
+            if (is_directory && has_size) AppendNumber(line, store.GetDirFiles(store.GetDirId(i)));
+        } else {
+            line += "{\"path\":\"";
+            line += prefix_json;
+            AppendJsonEscaped(line, name);
+            line += is_directory ? "\",\"type\":\"dir\"" : "\",\"type\":\"file\"";
+            if (has_size) {
+                line += ",\"size\":";
+                AppendNumber(line, store.GetTotalSize(i));
+            }
+            if (is_directory && has_size) {
+                line += ",\"files\":";
+                AppendNumber(line, store.GetDirFiles(store.GetDirId(i)));
+            }
+            line += '}';
+        }
+        line += '\n';
+        sink.Append(line);
+    }
+}
+
+} // namespace
+
+bool ScanExport::ParseFormat(std::string_view name, Format& format) {
+    if (name == "csv") format = Format::Csv;
+    else if (name == "ndjson" || name == "jsonl") format = Format::Ndjson;
+    else if (name == "bin") format = Format::Binary;
+    else return false;
+    return true;
+}
+
+ScanExport::Format ScanExport::GuessFormat(const std::string& file) {
+    std::string extension = std::filesystem::path(file).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (extension == ".csv") return Format::Csv;
+    if (extension == ".ndjson" || extension == ".jsonl") return Format::Ndjson;
+    return Format::Binary;
+}
+
+const char* ScanExport::GetExtension(Format format) {
+    switch (format) {
+    case Format::Csv: return ".csv";
+    case Format::Ndjson: return ".ndjson";
+    case Format::Binary: break;
+    }
+    return ".fnml";
+}
+
+bool ScanExport::Write(const EntryStore& store, const PagedArray<uint32_t>& rows, Format format, bool recursive,
+                       const std::string& file, std::string& error) {
+    PROFILE_SCOPE("ScanExport::Write");
+    Sink sink;
+    if (!sink.Open(file, error)) return false;
+
+    if (format != Format::Binary) {
+        WriteText(store, rows, format, sink);
+    } else {
+        sink.Append(kMagic, sizeof(kMagic));
+        sink.AppendLittleEndian<uint32_t>(kVersion);
+        sink.AppendLittleEndian<uint32_t>(recursive ? kFlagRecursive : 0);
+        sink.AppendLittleEndian<uint32_t>(store.Size());
+        sink.AppendLittleEndian<uint32_t>(store.GetDirCount());
+        sink.AppendLittleEndian<uint32_t>((uint32_t)store.m_root.size());
+        sink.AppendLittleEndian<uint32_t>(0);
+        sink.AppendLittleEndian<uint64_t>(store.m_names->m_arena.size());
+        sink.AppendLittleEndian<int64_t>(store.m_scan_time);
+        sink.AppendLittleEndian<uint64_t>(0);
+        sink.AppendLittleEndian<uint64_t>(0);
+
+        auto column = [&](const auto& values) {
+            sink.AppendColumn(values.data(), values.size());
+            sink.Pad(values.size() * sizeof(values[0]));
+        };
+        sink.Append(store.m_root);
+        sink.Pad(store.m_root.size());
+        column(store.m_names->m_arena);
+        column(store.m_name);
+        column(store.m_name_length);
+        column(store.m_parent);
+        column(store.m_dir);
+        column(store.m_size);
+        column(store.m_flags);
+        column(store.m_dir_entry);
+        column(store.m_dir_mtime);
+    }
+    if (!sink.Close(&error)) {
+        error = file + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool ScanExport::Read(const std::string& file, EntryStore& store, bool& recursive, std::string& error) {
+    PROFILE_SCOPE("ScanExport::Read");
+    Source source;
+    uint64_t file_size = 0;
+    if (!source.Open(file, file_size)) {
+        error = file + ": " + std::strerror(errno);
+        return false;
+    }
+
+    unsigned char header[kHeaderBytes];
+    if (file_size < kHeaderBytes || !source.Read(header, sizeof(header)) || std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        error = file + ": not a listing";
+        return false;
+    }
+    if (ReadLittleEndian<uint32_t>(header + 8) != kVersion) {
+        error = file + ": listing from an unsupported version";
+        return false;
+    }
+    uint32_t flags = ReadLittleEndian<uint32_t>(header + 12);
+    uint32_t entry_count = ReadLittleEndian<uint32_t>(header + 16);
+    uint32_t dir_count = ReadLittleEndian<uint32_t>(header + 20);
+    uint32_t root_length = ReadLittleEndian<uint32_t>(header + 24);
+    uint64_t arena_bytes = ReadLittleEndian<uint64_t>(header + 32);
+    int64_t scan_time = ReadLittleEndian<int64_t>(header + 40);
+
+    // Sizes are checked against the file before anything is allocated for them
+    uint64_t expected = kHeaderBytes + Align8(root_length) + Align8(arena_bytes) + Align8((uint64_t)entry_count * 4) * 3 +
+                        Align8((uint64_t)entry_count * 2) + Align8((uint64_t)entry_count * 8) + Align8(entry_count) +
+                        Align8((uint64_t)dir_count * 4) + Align8((uint64_t)dir_count * 8);
+    if (dir_count == 0 || arena_bytes > file_size || expected != file_size) {
+        error = file + ": damaged listing";
+        return false;
+    }
+
+    EntryStore loaded;
+    bool ok = source.ReadColumn(loaded.m_root, root_length) &&
+              source.ReadColumn(loaded.m_names->m_arena, arena_bytes) &&
+              source.ReadColumn(loaded.m_name, entry_count) &&
+              source.ReadColumn(loaded.m_name_length, entry_count) &&
+              source.ReadColumn(loaded.m_parent, entry_count) &&
+              source.ReadColumn(loaded.m_dir, entry_count) &&
+              source.ReadColumn(loaded.m_size, entry_count) &&
+              source.ReadColumn(loaded.m_flags, entry_count) &&
+              source.ReadColumn(loaded.m_dir_entry, dir_count) &&
+              source.ReadColumn(loaded.m_dir_mtime, dir_count);
+    if (!ok || !loaded.IsWellFormed()) {
+        error = file + ": damaged listing";
+        return false;
+    }
+
+    // The hash table isn't stored (its layout is up to the build), so names are rehashed
+    loaded.m_names->RebuildSlots();
+    loaded.m_selected.Resize(entry_count);
+    loaded.m_filtered.Resize(entry_count);
+    loaded.m_scan_time = scan_time;
+    loaded.RebuildDirTotals();
+    recursive = (flags & kFlagRecursive) != 0;
+    store = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "EntryStore.h"
+
+// Scan results for other tools: CSV and NDJSON for reading, and a compact binary listing
+// that can be loaded back into the scanner (see FileScanner::ImportListing).
+//
+// Output is streamed through a large buffer in a few big writes, never built in memory as a
+// whole. Text formats hold one line per entry with the same fields as `fnm list`: path, type,
+// size (for folders, everything below them) and, for folders, the number of files below.
+//
+// The binary listing is the store's columns back to back, like a snapshot but without the
+// name hash table, and in little-endian byte order on every machine, so a listing made on one
+// machine loads on any other. Columns go straight from the store to the file in one writev
+// per section batch where the host is little-endian.
+class ScanExport {
+public:
+    enum class Format : uint8_t {
+        Csv,
+        Ndjson,
+        Binary,
+    };
+
+    // "csv", "ndjson" (or "jsonl"), "bin"
+    static bool ParseFormat(std::string_view name, Format& format);
+    // From the file extension (.csv, .ndjson/.jsonl, anything else is binary)
+    static Format GuessFormat(const std::string& file);
+    static const char* GetExtension(Format format);
+
+    // Writes the entries in `rows`, in that order, as CSV or NDJSON. A binary listing always
+    // holds the whole store, since paths are rebuilt from the folders above each entry; `rows`
+    // is ignored there. `file` "-" is stdout.
+    static bool Write(const EntryStore& store, const PagedArray<uint32_t>& rows, Format format, bool recursive,
+                      const std::string& file, std::string& error);
+
+    // Loads a binary listing; `recursive` is the scan mode it was made with
+    static bool Read(const std::string& file, EntryStore& store, bool& recursive, std::string& error);
+};
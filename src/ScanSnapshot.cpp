@@ -0,0 +1,296 @@
+#include "ScanSnapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'N', 'M', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;    // kByteOrderMark as the writer saw it
+    uint32_t recursive;
+    uint32_t entry_count;
+    uint32_t dir_count;
+    uint32_t root_length;
+    uint64_t arena_bytes;
+    uint64_t slot_count;
+    uint64_t name_count;
+    int64_t scan_time;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+
+// Every section starts 8-byte aligned so the mapped columns could be read in place
+size_t Align8(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+// Read-only view of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& file) {
+#if defined(_WIN32)
+        m_file = CreateFileW(fs::path(file).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) return;
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) return;
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_data) m_size = (size_t)size.QuadPart;
+#else
+        m_fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) return;
+        struct stat st;
+        if (fstat(m_fd, &st) != 0 || st.st_size == 0) return;
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (data == MAP_FAILED) return;
+        // Everything is read front to back exactly once
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(data);
+        m_size = (size_t)st.st_size;
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) munmap(const_cast<char*>(m_data), m_size);
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+// Sequential section reader over the mapped file
+class SectionReader {
+public:
+    SectionReader(const char* data, size_t size, size_t offset) : m_data(data), m_size(size), m_offset(offset) {}
+
+    // std::vector or PagedArray
+    template <typename Column>
+    bool Read(Column& out, size_t count) {
+        size_t bytes = count * sizeof(typename Column::value_type);
+        if (m_offset > m_size || m_size - m_offset < bytes) return false;
+        out.resize(count);
+        if (bytes) std::memcpy(out.data(), m_data + m_offset, bytes);
+        m_offset += Align8(bytes);
+        return true;
+    }
+
+    bool Read(std::string& out, size_t count) {
+        if (m_offset > m_size || m_size - m_offset < count) return false;
+        out.assign(m_data + m_offset, count);
+        m_offset += Align8(count);
+        return true;
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_offset;
+};
+
+class SectionWriter {
+public:
+    explicit SectionWriter(std::ofstream& out) : m_out(out) {}
+
+    void Write(const void* data, size_t bytes) {
+        static const char padding[8] = {};
+        if (bytes) m_out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+        m_out.write(padding, (std::streamsize)(Align8(bytes) - bytes));
+    }
+
+    template <typename Column>
+    void Write(const Column& column) { Write(column.data(), column.size() * sizeof(typename Column::value_type)); }
+
+private:
+    std::ofstream& m_out;
+};
+
+uint64_t HashPath(const std::string& text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+std::string ScanSnapshot::GetCacheDirectory() {
+    fs::path base;
+#if defined(_WIN32)
+    if (const char* local = std::getenv("LOCALAPPDATA")) base = local;
+#elif defined(__APPLE__)
+    if (const char* home = std::getenv("HOME")) base = fs::path(home) / "Library" / "Caches";
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) base = xdg;
+    else if (const char* home = std::getenv("HOME")) base = fs::path(home) / ".cache";
+#endif
+    if (base.empty()) {
+        std::error_code ec;
+        base = fs::temp_directory_path(ec);
+    }
+    return (base / "FileNamesManager").string();
+}
+
+std::string ScanSnapshot::GetSnapshotPath(const std::string& root, bool recursive) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx-%c.snap", (unsigned long long)HashPath(root), recursive ? 'r' : 'f');
+    return (fs::path(GetCacheDirectory()) / name).string();
+}
+
+bool ScanSnapshot::Save(const EntryStore& store, bool recursive, const std::string& file) {
+    std::error_code ec;
+    fs::create_directories(fs::path(file).parent_path(), ec);
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.recursive = recursive ? 1 : 0;
+    header.entry_count = store.Size();
+    header.dir_count = store.GetDirCount();
+    header.root_length = (uint32_t)store.m_root.size();
+    header.arena_bytes = store.m_names->m_arena.size();
+    header.slot_count = store.m_names->m_slots.size();
+    header.name_count = store.m_names->m_count;
+    header.scan_time = store.m_scan_time;
+
+    std::string temp = file + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        SectionWriter writer(out);
+        writer.Write(&header, sizeof(header));
+        writer.Write(store.m_root.data(), store.m_root.size());
+        writer.Write(store.m_names->m_arena);
+        writer.Write(store.m_names->m_slots);
+        writer.Write(store.m_name);
+        writer.Write(store.m_name_length);
+        writer.Write(store.m_parent);
+        writer.Write(store.m_dir);
+        writer.Write(store.m_size);
+        writer.Write(store.m_flags);
+        writer.Write(store.m_dir_entry);
+        writer.Write(store.m_dir_mtime);
+        out.flush();
+        if (!out) {
+            out.close();
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+
+    fs::rename(temp, file, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ScanSnapshot::Load(const std::string& file, const std::string& root, bool recursive, EntryStore& store) {
+    MappedFile mapped(file);
+    if (!mapped.Data() || mapped.Size() < sizeof(SnapshotHeader)) return false;
+
+    SnapshotHeader header;
+    std::memcpy(&header, mapped.Data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.byte_order != kByteOrderMark || header.recursive != (recursive ? 1u : 0u) || header.dir_count == 0) {
+        return false;
+    }
+    // Slot count must stay a power of two for the probe mask
+    if (header.slot_count & (header.slot_count - 1)) return false;
+
+    EntryStore loaded;
+    SectionReader reader(mapped.Data(), mapped.Size(), Align8(sizeof(header)));
+    std::vector<uint8_t> flags;
+    bool ok = reader.Read(loaded.m_root, header.root_length) &&
+              reader.Read(loaded.m_names->m_arena, header.arena_bytes) &&
+              reader.Read(loaded.m_names->m_slots, header.slot_count) &&
+              reader.Read(loaded.m_name, header.entry_count) &&
+              reader.Read(loaded.m_name_length, header.entry_count) &&
+              reader.Read(loaded.m_parent, header.entry_count) &&
+              reader.Read(loaded.m_dir, header.entry_count) &&
+              reader.Read(loaded.m_size, header.entry_count) &&
+              reader.Read(loaded.m_flags, header.entry_count) &&
+              reader.Read(loaded.m_dir_entry, header.dir_count) &&
+              reader.Read(loaded.m_dir_mtime, header.dir_count);
+    // Hash collisions on the file name are possible, the stored root settles it
+    if (!ok || loaded.m_root != root) return false;
+
+    if (!loaded.IsWellFormed()) return false;
+    const auto& arena = loaded.m_names->m_arena;
+    for (const auto& slot : loaded.m_names->m_slots) {
+        if (slot.hash != 0 && slot.offset >= arena.size()) return false;
+    }
+
+    // Selection and filter state belong to the session, not the scan, and aren't stored
+    loaded.m_selected.Resize(header.entry_count);
+    loaded.m_filtered.Resize(header.entry_count);
+    loaded.m_names->m_count = (size_t)header.name_count;
+    loaded.m_scan_time = header.scan_time;
+    loaded.RebuildDirTotals(); // cheaper to recompute than to store
+    store = std::move(loaded);
+    return true;
+}
+
+void ScanSnapshot::SaveLastSession(const std::string& root, bool recursive) {
+    std::error_code ec;
+    fs::path dir(GetCacheDirectory());
+    fs::create_directories(dir, ec);
+    std::ofstream out(dir / "session.txt", std::ios::trunc);
+    out << (recursive ? 1 : 0) << '\n' << root << '\n';
+}
+
+bool ScanSnapshot::LoadLastSession(std::string& root, bool& recursive) {
+    std::ifstream in(fs::path(GetCacheDirectory()) / "session.txt");
+    int mode = 0;
+    std::string line;
+    if (!(in >> mode) || !std::getline(in, line) || !std::getline(in, root) || root.empty()) return false;
+    recursive = mode != 0;
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+
+#include "EntryStore.h"
+
+// On-disk copy of a finished scan, kept in the per-user cache directory so reopening a
+// folder fills the table straight away. The file is the store's columns back to back behind
+// a small header (including the name pool's hash table, so nothing is rehashed on load),
+// and is mapped into memory and copied out column by column.
+//
+// Snapshots are tied to a root path and scan mode. Files written by a different format
+// version or byte order are ignored and simply get overwritten by the next save.
+class ScanSnapshot {
+public:
+    static std::string GetCacheDirectory();
+    static std::string GetSnapshotPath(const std::string& root, bool recursive);
+
+    // Writes to a temporary file first and renames it over the old snapshot, so a crash
+    // mid-write leaves the previous one intact. Selection/filter state isn't saved.
+    static bool Save(const EntryStore& store, bool recursive, const std::string& file);
+    static bool Load(const std::string& file, const std::string& root, bool recursive, EntryStore& store);
+
+    // Last opened folder, so the app can reopen it on start
+    static void SaveLastSession(const std::string& root, bool recursive);
+    static bool LoadLastSession(std::string& root, bool& recursive);
+};
@@ -0,0 +1,589 @@
+// fnm: headless front end to the scanner core, for scripts, cron jobs and servers without
+// a display. Every command scans the folder (or loads a listing saved by `export`), applies
+// the filter and works through the matching entries as fast as the core allows; there's no
+// render loop to wait on.
+//
+// Output is one JSON object per line on stdout (or bare paths with --paths). A summary
+// object goes to stderr when the command is done, except for `scan` where it is the output.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "EntryQuery.h"
+#include "FileScanner.h"
+#include "RenamePlanner.h"
+#include "ScanExport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum ExitCode {
+    kExitOk = 0,
+    kExitFailures = 1, // some entries failed, or the rename plan has conflicts
+    kExitUsage = 2,
+};
+
+const char* kUsage =
+    "usage: fnm <command> [options] <folder>\n"
+    "       fnm <command> [options] --import LISTING\n"
+    "\n"
+    "commands:\n"
+    "  scan      scan the folder and print a summary\n"
+    "  list      print the entries that pass the filter\n"
+    "  delete    delete the entries that pass the filter (needs --filter, --type or --all)\n"
+    "  rename    rename the entries that pass the filter (needs --template)\n"
+    "  dupes     list groups of files with identical contents among those that pass the filter\n"
+    "  grep      list the files among those that pass the filter whose contents match --text\n"
+    "            and/or --regex, with the first matching line\n"
+    "  export    write the entries that pass the filter as CSV or NDJSON, or the whole scan as\n"
+    "            a binary listing that --import (here or on another machine) loads back\n"
+    "\n"
+    "options:\n"
+    "  -r, --recursive      include subfolders\n"
+    "  -f, --filter QUERY   only entries matching QUERY (see below)\n"
+    "  -i, --ignore-case    match the filter (and --match, --text, --regex) case-insensitively\n"
+    "  -t, --type f|d       only files, or only folders\n"
+    "      --all            delete everything inside the folder\n"
+    "  -n, --dry-run        print what delete or rename would do, change nothing\n"
+    "      --paths          print bare paths instead of JSON lines\n"
+    "      --template T     rename template: {name} {ext} {full} {n} {n:3} {1}..{9},\n"
+    "                       case modifiers :upper :lower :title\n"
+    "      --match REGEX    rename only names matching REGEX; groups feed {1}..{9}\n"
+    "      --start N        first counter value (default 1)\n"
+    "      --step N         counter increment (default 1)\n"
+    "      --text T         grep for this string\n"
+    "      --regex REGEX    grep for lines matching REGEX; with --text, only lines containing it\n"
+    "      --max-file S     grep skips files larger than S (default 64M)\n"
+    "      --cache          also read and update the GUI's scan cache\n"
+    "  -o, --output FILE    where export writes to (default stdout)\n"
+    "      --format F       csv, ndjson or bin (default from the --output extension, else ndjson)\n"
+    "      --import LISTING use a binary listing instead of scanning a folder (scan, list, export)\n"
+    "      --memory-limit S keep the entry list within S bytes of memory (K M G suffixes);\n"
+    "                       beyond that it is paged to temp files (TMPDIR)\n"
+    "\n"
+    "queries: terms separated by spaces, all of which must hold\n"
+    "  report           name contains report (\"two words\" for spaces)\n"
+    "  *.log  IMG_??    glob over the whole name, [abc] classes too\n"
+    "  ext:jpg,tar.gz   name ends in one of these extensions\n"
+    "  size>100M        also >= < <= =, with K M G T suffixes; folders count everything below\n"
+    "  type:file        or type:dir\n"
+    "  age>30d          modified longer ago than that (also <, with h d w y)\n"
+    "  modified<2024-01-31  modified before that day (also > >= <= =)\n"
+    "  owner:NAME       owned by that user (or uid)\n"
+    "  perm:644         permission bits, in octal, are exactly these\n"
+    "  re:REGEX         regex searched in the name\n"
+    "  path:REGEX       regex searched in the full path\n"
+    "  !term            negation\n";
+
+struct Options {
+    std::string command;
+    std::string folder;
+    bool recursive = false;
+    std::string filter;
+    bool ignore_case = false;
+    char type = 0; // 'f', 'd' or 0 for both
+    bool all = false;
+    bool dry_run = false;
+    bool paths = false;
+    bool cache = false;
+    uint64_t memory_limit = 0; // 0: no limit
+    std::string output = "-";
+    std::string format;
+    std::string import;
+    RenameOptions rename;
+    bool has_template = false;
+    ContentQuery content;
+};
+
+// Output is accumulated and written in large blocks; millions of lines go through here
+class Output {
+public:
+    explicit Output(FILE* file) : m_file(file) {}
+    ~Output() { Flush(); }
+
+    std::string& Line() { return m_buffer; }
+    void EndLine() {
+        m_buffer += '\n';
+        if (m_buffer.size() >= (1 << 20)) Flush();
+    }
+    void Flush() {
+        if (!m_buffer.empty()) std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+        m_buffer.clear();
+        std::fflush(m_file);
+    }
+
+private:
+    FILE* m_file;
+    std::string m_buffer;
+};
+
+void AppendJsonString(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        unsigned char u = (unsigned char)c;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20) {
+            out += "\\u00";
+            out += hex[u >> 4];
+            out += hex[u & 15];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void AppendField(std::string& out, const char* key, std::string_view value) {
+    if (out.back() != '{') out += ',';
+    AppendJsonString(out, key);
+    out += ':';
+    AppendJsonString(out, value);
+}
+
+void AppendField(std::string& out, const char* key, uint64_t value) {
+    if (out.back() != '{') out += ',';
+    AppendJsonString(out, key);
+    out += ':';
+    out += std::to_string(value);
+}
+
+void AppendField(std::string& out, const char* key, double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.3f", value);
+    if (out.back() != '{') out += ',';
+    AppendJsonString(out, key);
+    out += ':';
+    out += number;
+}
+
+bool ParseInt(const char* text, int64_t& value) {
+    char* end = nullptr;
+    long long parsed = std::strtoll(text, &end, 10);
+    if (end == text || *end) return false;
+    value = parsed;
+    return true;
+}
+
+// "512M", "2G", "1048576"
+bool ParseBytes(const char* text, uint64_t& value) {
+    char* end = nullptr;
+    double parsed = std::strtod(text, &end);
+    if (end == text || parsed < 0) return false;
+    int shift = 0;
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    case 't': case 'T': shift = 40; end++; break;
+    }
+    if (*end) return false;
+    value = (uint64_t)(parsed * (double)(1ull << shift));
+    return true;
+}
+
+bool ParseArguments(int argc, char** argv, Options& options, std::string& error) {
+    if (argc < 2) return false;
+    options.command = argv[1];
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&](const char*& out) {
+            if (i + 1 >= argc) {
+                error = arg + " needs a value";
+                return false;
+            }
+            out = argv[++i];
+            return true;
+        };
+        const char* text = nullptr;
+        if (arg == "-r" || arg == "--recursive") options.recursive = true;
+        else if (arg == "-i" || arg == "--ignore-case") options.ignore_case = true;
+        else if (arg == "--all") options.all = true;
+        else if (arg == "-n" || arg == "--dry-run") options.dry_run = true;
+        else if (arg == "--paths") options.paths = true;
+        else if (arg == "--cache") options.cache = true;
+        else if (arg == "-f" || arg == "--filter") {
+            if (!value(text)) return false;
+            options.filter = text;
+        } else if (arg == "-t" || arg == "--type") {
+            if (!value(text)) return false;
+            if (std::strcmp(text, "f") != 0 && std::strcmp(text, "d") != 0) {
+                error = "--type takes f or d";
+                return false;
+            }
+            options.type = text[0];
+        } else if (arg == "--template") {
+            if (!value(text)) return false;
+            options.rename.name_template = text;
+            options.has_template = true;
+        } else if (arg == "--match") {
+            if (!value(text)) return false;
+            options.rename.match = text;
+        } else if (arg == "--text") {
+            if (!value(text)) return false;
+            options.content.text = text;
+        } else if (arg == "--regex") {
+            if (!value(text)) return false;
+            options.content.regex = text;
+        } else if (arg == "--max-file") {
+            if (!value(text)) return false;
+            if (!ParseBytes(text, options.content.max_file_bytes)) {
+                error = "--max-file takes a size such as 64M";
+                return false;
+            }
+        } else if (arg == "-o" || arg == "--output") {
+            if (!value(text)) return false;
+            options.output = text;
+        } else if (arg == "--format") {
+            if (!value(text)) return false;
+            ScanExport::Format format;
+            if (!ScanExport::ParseFormat(text, format)) {
+                error = "--format takes csv, ndjson or bin";
+                return false;
+            }
+            options.format = text;
+        } else if (arg == "--import") {
+            if (!value(text)) return false;
+            options.import = text;
+        } else if (arg == "--memory-limit") {
+            if (!value(text)) return false;
+            if (!ParseBytes(text, options.memory_limit) || options.memory_limit == 0) {
+                error = "--memory-limit takes a size such as 512M or 4G";
+                return false;
+            }
+        } else if (arg == "--start" || arg == "--step") {
+            if (!value(text)) return false;
+            int64_t& target = arg == "--start" ? options.rename.counter_start : options.rename.counter_step;
+            if (!ParseInt(text, target)) {
+                error = arg + " takes a number";
+                return false;
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            error = "unknown option " + arg;
+            return false;
+        } else if (options.folder.empty()) {
+            options.folder = arg;
+        } else {
+            error = "more than one folder given";
+            return false;
+        }
+    }
+    options.rename.match_case_sensitive = !options.ignore_case;
+    options.content.case_sensitive = !options.ignore_case;
+
+    if (options.command != "scan" && options.command != "list" && options.command != "delete" && options.command != "rename" &&
+        options.command != "dupes" && options.command != "grep" && options.command != "export") {
+        error = "unknown command " + options.command;
+        return false;
+    }
+    if (!options.import.empty()) {
+        // A listing may come from another machine; nothing on this one gets touched
+        if (options.command != "scan" && options.command != "list" && options.command != "export") {
+            error = "--import works with scan, list and export";
+            return false;
+        }
+        if (!options.folder.empty()) {
+            error = "--import replaces the folder";
+            return false;
+        }
+    } else if (options.folder.empty()) {
+        error = "no folder given";
+        return false;
+    }
+    EntryQuery query;
+    if (!query.Parse(options.filter, !options.ignore_case, error)) {
+        error = "--filter: " + error;
+        return false;
+    }
+    // Deleting everything by accident should take more than a forgotten option
+    if (options.command == "delete" && options.filter.empty() && options.type == 0 && !options.all) {
+        error = "delete needs --filter, --type or --all";
+        return false;
+    }
+    if (options.command == "rename" && !options.has_template) {
+        error = "rename needs --template";
+        return false;
+    }
+    if (options.command == "grep") {
+        if (options.content.text.empty() && options.content.regex.empty()) {
+            error = "grep needs --text or --regex";
+            return false;
+        }
+        if (!ContentSearch::CheckQuery(options.content, error)) return false;
+    }
+    return true;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Selects every visible entry of the requested type; returns how many
+size_t SelectMatches(FileScanner& scanner, char type) {
+    EntryStore& files = scanner.GetFilesModifiable();
+    if (type == 0) {
+        scanner.SelectAll();
+        return files.GetSelectedCount();
+    }
+    size_t count = 0;
+    for (uint32_t i : scanner.GetVisibleRows()) {
+        bool wanted = (type == 'd') == files.IsDirectory(i);
+        files.SetSelected(i, wanted);
+        count += wanted;
+    }
+    return count;
+}
+
+void WriteEntry(Output& out, const EntryStore& files, uint32_t i, bool paths) {
+    std::string& line = out.Line();
+    if (paths) {
+        line += files.GetPath(i);
+    } else {
+        line += '{';
+        AppendField(line, "path", files.GetPath(i));
+        AppendField(line, "type", files.IsDirectory(i) ? "dir" : "file");
+        if (!files.IsDirectory(i)) {
+            AppendField(line, "size", files.GetSize(i));
+        } else if (files.HasDirTotals(i)) {
+            // Everything below the folder
+            AppendField(line, "size", files.GetTotalSize(i));
+            AppendField(line, "files", files.GetDirFiles(files.GetDirId(i)));
+        }
+        // Only fetched when the filter asked for it
+        if (files.HasMetadata(i)) {
+            const EntryMetadata& meta = files.GetMetadata(i);
+            char mode[8];
+            std::snprintf(mode, sizeof(mode), "%04o", meta.mode & 07777);
+            AppendField(line, "modified", (uint64_t)(std::max)(meta.mtime, (int64_t)0) / 1000000000);
+            AppendField(line, "mode", mode);
+            if (meta.uid != MetadataFetcher::kNoOwner) AppendField(line, "owner", MetadataFetcher::GetOwnerName(meta.uid));
+        }
+        line += '}';
+    }
+    out.EndLine();
+}
+
+void WriteError(Output& out, std::string_view error) {
+    std::string& line = out.Line();
+    line += '{';
+    AppendField(line, "error", error);
+    line += '}';
+    out.EndLine();
+}
+
+int Run(const Options& options) {
+    std::error_code ec;
+    if (options.import.empty() && !fs::is_directory(options.folder, ec)) {
+        std::fprintf(stderr, "fnm: %s is not a folder\n", options.folder.c_str());
+        return kExitUsage;
+    }
+
+    Output out(stdout);
+    Output summary(options.command == "scan" ? stdout : stderr);
+    auto start = std::chrono::steady_clock::now();
+
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(options.cache);
+    if (!options.import.empty()) {
+        std::string error;
+        if (!scanner.ImportListing(options.import, error)) {
+            std::fprintf(stderr, "fnm: %s\n", error.c_str());
+            return kExitUsage;
+        }
+    } else if (options.cache) {
+        // Refresh from the cached snapshot: only changed directories are relisted
+        scanner.StartScan(options.folder, options.recursive);
+        while (scanner.IsScanning()) {
+            scanner.PollScanResults();
+            if (scanner.IsScanning()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    } else {
+        scanner.ScanDirectory(options.folder, options.recursive);
+    }
+    double scan_seconds = SecondsSince(start);
+
+    if (!options.filter.empty()) scanner.ApplyFilter(options.filter, !options.ignore_case);
+    // Age, owner and permission terms fetch metadata for the whole list; the filter runs
+    // again once it's all in
+    while (scanner.IsFetchingMetadata()) {
+        scanner.PollMetadata();
+        if (scanner.IsFetchingMetadata()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    size_t matched = SelectMatches(scanner, options.type);
+    const EntryStore& files = scanner.GetFiles();
+
+    std::string& line = summary.Line();
+    line += '{';
+    AppendField(line, "command", options.command);
+    AppendField(line, "entries", (uint64_t)files.Size());
+    AppendField(line, "matched", (uint64_t)matched);
+    AppendField(line, "scan_seconds", scan_seconds);
+
+    int exit_code = kExitOk;
+    if (options.command == "scan") {
+        uint64_t bytes = 0, dirs = 0;
+        for (uint32_t i = 0; i < files.Size(); i++) {
+            if (files.IsDirectory(i)) dirs++;
+            else bytes += files.GetSize(i);
+        }
+        AppendField(line, "dirs", dirs);
+        AppendField(line, "files", (uint64_t)files.Size() - dirs);
+        AppendField(line, "bytes", bytes);
+        AppendField(line, "memory_bytes", (uint64_t)files.GetMemoryBytes());
+        if (PagedBuffer::GetSpilledBytes()) AppendField(line, "spilled_bytes", (uint64_t)PagedBuffer::GetSpilledBytes());
+    } else if (options.command == "list" || (options.command == "delete" && options.dry_run)) {
+        files.ForEachSelectedVisible([&](uint32_t i) { WriteEntry(out, files, i, options.paths); });
+    } else if (options.command == "export") {
+        ScanExport::Format format = ScanExport::Format::Ndjson;
+        if (!options.format.empty()) ScanExport::ParseFormat(options.format, format);
+        else if (options.output != "-") format = ScanExport::GuessFormat(options.output);
+        PagedArray<uint32_t> rows;
+        rows.reserve(matched);
+        files.ForEachSelectedVisible([&](uint32_t i) { rows.push_back(i); });
+
+        std::string error;
+        out.Flush();
+        if (!ScanExport::Write(files, rows, format, scanner.IsRecursive(), options.output, error)) {
+            std::fprintf(stderr, "fnm: %s\n", error.c_str());
+            return kExitFailures;
+        }
+        AppendField(line, "exported", format == ScanExport::Format::Binary ? (uint64_t)files.Size() : (uint64_t)rows.size());
+    } else if (options.command == "delete") {
+        FileScanner::DeleteStatus status = scanner.ExecuteDelete();
+        for (const std::string& error : status.errors) WriteError(out, error);
+        AppendField(line, "deleted", (uint64_t)(status.completed - status.failed));
+        AppendField(line, "failed", (uint64_t)status.failed);
+        if (status.failed > 0) exit_code = kExitFailures;
+    } else if (options.command == "dupes") {
+        FileScanner::DuplicateStatus status = scanner.ExecuteFindDuplicates();
+        for (const std::string& error : status.errors) WriteError(out, error);
+        uint64_t copies = 0, wasted = 0;
+        for (const DuplicateGroup& group : scanner.GetDuplicateGroups()) {
+            copies += group.entries.size() - 1;
+            wasted += group.GetWastedBytes();
+            // Bare paths: one group per paragraph
+            std::string& entry = out.Line();
+            if (options.paths) {
+                for (uint32_t i : group.entries) {
+                    entry += files.GetPath(i);
+                    entry += '\n';
+                }
+            } else {
+                entry += '{';
+                AppendField(entry, "size", group.size);
+                entry += ",\"paths\":[";
+                for (size_t k = 0; k < group.entries.size(); k++) {
+                    if (k > 0) entry += ',';
+                    AppendJsonString(entry, files.GetPath(group.entries[k]));
+                }
+                entry += "]}";
+            }
+            out.EndLine();
+        }
+        AppendField(line, "groups", (uint64_t)scanner.GetDuplicateGroups().size());
+        AppendField(line, "copies", copies);
+        AppendField(line, "wasted_bytes", wasted);
+        AppendField(line, "bytes_read", status.bytes_read);
+        AppendField(line, "failed", (uint64_t)status.failed);
+        if (status.failed > 0) exit_code = kExitFailures;
+    } else if (options.command == "grep") {
+        // The query was checked up front; the only refusal left is having no files to search
+        std::string error;
+        FileScanner::ContentSearchStatus status = scanner.ExecuteContentSearch(options.content, error);
+        const PagedArray<uint32_t>& rows = scanner.GetVisibleRows();
+        for (const std::string& failure : status.errors) WriteError(out, failure);
+        for (uint32_t i : rows) {
+            const ContentHit* hit = scanner.GetContentHit(i);
+            if (!hit) continue;
+            std::string& entry = out.Line();
+            if (options.paths) {
+                entry += files.GetPath(i);
+            } else {
+                entry += '{';
+                AppendField(entry, "path", files.GetPath(i));
+                AppendField(entry, "line", hit->line);
+                AppendField(entry, "text", hit->excerpt);
+                entry += '}';
+            }
+            out.EndLine();
+        }
+        AppendField(line, "searched", (uint64_t)status.total);
+        AppendField(line, "hits", (uint64_t)status.hits);
+        AppendField(line, "skipped", (uint64_t)status.skipped);
+        AppendField(line, "bytes_read", status.bytes_read);
+        AppendField(line, "failed", (uint64_t)status.failed);
+        if (status.failed > 0) exit_code = kExitFailures;
+    } else if (options.command == "rename") {
+        RenamePlan plan = scanner.PlanRename(options.rename);
+        if (!plan.template_error.empty()) {
+            std::fprintf(stderr, "fnm: %s\n", plan.template_error.c_str());
+            return kExitUsage;
+        }
+        AppendField(line, "unchanged", (uint64_t)plan.unchanged);
+        AppendField(line, "conflicts", (uint64_t)plan.conflicts);
+        AppendField(line, "swaps", (uint64_t)plan.cycles);
+
+        // Conflicts are always listed; a dry run lists every planned rename too
+        for (const RenamePlan::Item& item : plan.items) {
+            if (!options.dry_run && item.error.empty()) continue;
+            std::string& entry = out.Line();
+            if (options.paths) {
+                entry += files.GetPath(item.entry);
+                entry += '\t';
+                entry += item.new_name;
+            } else {
+                entry += '{';
+                AppendField(entry, "path", files.GetPath(item.entry));
+                AppendField(entry, "new_name", item.new_name);
+                if (!item.error.empty()) AppendField(entry, "error", item.error);
+                entry += '}';
+            }
+            out.EndLine();
+        }
+
+        if (plan.conflicts > 0) {
+            exit_code = kExitFailures;
+        } else if (!options.dry_run) {
+            RenameResult result = scanner.ExecuteRename(plan);
+            for (const std::string& error : result.errors) WriteError(out, error);
+            AppendField(line, "renamed", (uint64_t)result.renamed);
+            AppendField(line, "failed", (uint64_t)result.failed);
+            if (result.failed > 0) exit_code = kExitFailures;
+        }
+    }
+
+    out.Flush();
+    AppendField(line, "seconds", SecondsSince(start));
+    line += '}';
+    summary.EndLine();
+    return exit_code;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string error;
+    if (argc >= 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+        std::fputs(kUsage, stdout);
+        return kExitOk;
+    }
+    if (!ParseArguments(argc, argv, options, error)) {
+        if (!error.empty()) std::fprintf(stderr, "fnm: %s\n\n", error.c_str());
+        std::fputs(kUsage, stderr);
+        return kExitUsage;
+    }
+    PagedBuffer::SetBudget((size_t)options.memory_limit);
+    return Run(options);
+}
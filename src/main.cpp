@@ -4,6 +4,11 @@
 #include <vector>
 #include <string>
 #include <algorithm> // for std::min/std::max
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <unordered_map>
 
 // Loader must be included before GLFW/ImGui internals usually, or ImGui backend handles it
 // #include <GL/gl3w.h> 
@@ -13,19 +18,28 @@
 #include "imgui_impl_opengl3.h"
 #include "portable-file-dialogs.h"
 
+#include "DirectoryTree.h"
 #include "FileScanner.h"
+#include "LogBuffer.h"
+#include "Profiler.h"
+#include "RedrawSignal.h"
+#include "ScanSnapshot.h"
 
 static void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-// Simple Log Helper
+// Log window. AddLog() may be called from any thread; lines are kept in a bounded LogBuffer
+// and only the visible ones are drawn. With a filter active, the numbers of matching lines
+// are cached and only lines logged since the last frame are tested.
 struct AppLog {
-    ImGuiTextBuffer     Buf;
+    LogBuffer           Lines{10000};
     ImGuiTextFilter     Filter;
-    ImVector<int>       LineOffsets; // Index to lines offset. We maintain this with AddLog() calls.
-    bool                AutoScroll;  // Keep scrolling if already at the bottom.
+    std::deque<uint64_t> FilteredLines;  // line numbers passing Filter, ascending
+    uint64_t            FilteredEnd = 0; // lines before this one have been tested
+    std::string         FilteredFor;     // filter text FilteredLines was built with
+    bool                AutoScroll;      // Keep scrolling if already at the bottom.
 
     AppLog() {
         AutoScroll = true;
@@ -33,23 +47,47 @@ struct AppLog {
     }
 
     void Clear() {
-        Buf.clear();
-        LineOffsets.clear();
-        LineOffsets.push_back(0);
+        Lines.Clear();
+        FilteredLines.clear();
+        FilteredEnd = Lines.GetEndLine();
     }
 
     void AddLog(const char* fmt, ...) IM_FMTARGS(2) {
-        int old_size = Buf.size();
+        char text[512];
         va_list args;
         va_start(args, fmt);
-        Buf.appendfv(fmt, args);
+        int length = vsnprintf(text, sizeof(text), fmt, args);
         va_end(args);
-        for (int new_size = Buf.size(); old_size < new_size; old_size++)
-            if (Buf[old_size] == '\n')
-                LineOffsets.push_back(old_size + 1);
+        if (length < 0) return;
+        if ((size_t)length < sizeof(text)) {
+            Lines.Push(std::string_view(text, (size_t)length));
+            return;
+        }
+        std::string long_text((size_t)length, '\0');
+        va_start(args, fmt);
+        vsnprintf(&long_text[0], long_text.size() + 1, fmt, args);
+        va_end(args);
+        Lines.Push(long_text);
+    }
+
+    void UpdateFilter() {
+        if (FilteredFor != Filter.InputBuf) {
+            FilteredFor = Filter.InputBuf;
+            FilteredLines.clear();
+            FilteredEnd = 0;
+        }
+        // Lines that fell out of the ring, then the ones not tested yet
+        while (!FilteredLines.empty() && FilteredLines.front() < Lines.GetFirstLine()) FilteredLines.pop_front();
+        for (uint64_t line = std::max(FilteredEnd, Lines.GetFirstLine()); line < Lines.GetEndLine(); line++) {
+            std::string_view text = Lines.GetLine(line);
+            if (Filter.PassFilter(text.data(), text.data() + text.size())) FilteredLines.push_back(line);
+        }
+        FilteredEnd = Lines.GetEndLine();
     }
 
     void Draw() {
+        Lines.Drain();
+
         // Options menu
         if (ImGui::BeginPopup("Options")) {
             ImGui::Checkbox("Auto-scroll", &AutoScroll);
@@ -67,27 +105,36 @@ struct AppLog {
         Filter.Draw("Filter", -100.0f);
 
         if (clear) Clear();
-        if (copy) ImGui::LogToClipboard();
+        bool filtered = Filter.IsActive();
+        if (filtered) UpdateFilter();
+        size_t count = filtered ? FilteredLines.size() : Lines.Size();
+        auto line_at = [&](size_t row) { return filtered ? FilteredLines[row] : Lines.GetFirstLine() + row; };
+
+        // The clipper only submits visible lines, so copying has to build the text itself
+        if (copy) {
+            std::string text;
+            for (size_t row = 0; row < count; row++) {
+                text += Lines.GetLine(line_at(row));
+                text += '\n';
+            }
+            ImGui::SetClipboardText(text.c_str());
+        }
 
         ImGui::Separator();
+        if (Lines.GetDroppedCount() > 0)
+            ImGui::TextDisabled("(%llu older lines dropped)", (unsigned long long)Lines.GetDroppedCount());
         ImGui::BeginChild("scrolling", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 
-        if (copy) ImGui::LogToClipboard();
-
         ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
-        const char* buf = Buf.begin();
-        const char* buf_end = Buf.end();
-        if (Filter.IsActive()) {
-            for (int line_no = 0; line_no < LineOffsets.Size; line_no++) {
-                const char* line_start = buf + LineOffsets[line_no];
-                const char* line_end = (line_no + 1 < LineOffsets.Size) ? (buf + LineOffsets[line_no + 1] - 1) : buf_end;
-                if (Filter.PassFilter(line_start, line_end))
-                    ImGui::TextUnformatted(line_start, line_end);
+        ImGuiListClipper clipper;
+        clipper.Begin((int)count);
+        while (clipper.Step()) {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                std::string_view text = Lines.GetLine(line_at((size_t)row));
+                ImGui::TextUnformatted(text.data(), text.data() + text.size());
             }
         }
-        else {
-            ImGui::TextUnformatted(buf, buf_end);
-        }
+        clipper.End();
         ImGui::PopStyleVar();
 
         if (AutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
@@ -97,6 +144,319 @@ struct AppLog {
     }
 };
 
+// Tree mode: folders are listed as they're expanded (see DirectoryTree). Returns a folder to
+// open in the list view when one was picked from a row's context menu.
+static std::string DrawTreeTable(DirectoryTree& tree) {
+    std::string open_in_list;
+    if (tree.GetRootState() == DirectoryTree::State::Listing) {
+        ImGui::TextDisabled("Listing %s...", tree.GetRoot().c_str());
+        return open_in_list;
+    }
+    if (!ImGui::BeginTable("TreeTable", 3, ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable))
+        return open_in_list;
+    PROFILE_SCOPE("GUI::TreeTable");
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_None);
+    ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, 100.0f);
+    ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, 100.0f);
+    ImGui::TableHeadersRow();
+
+    // Expanding or collapsing changes the rows, so the click is applied after the loop.
+    // Open state comes from the tree every frame; ImGui's own is ignored.
+    const std::vector<DirectoryTree::Row>& rows = tree.GetRows();
+    int toggled = -1;
+    float indent = ImGui::GetTreeNodeToLabelSpacing();
+    ImGuiListClipper clipper;
+    clipper.Begin((int)rows.size());
+    while (clipper.Step()) {
+        for (int r = clipper.DisplayStart; r < clipper.DisplayEnd; r++) {
+            const DirectoryTree::Row& row = rows[r];
+            bool is_dir = tree.IsDirectory(row);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (row.depth > 0) ImGui::Indent(indent * row.depth);
+            ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+            flags |= is_dir ? ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick : ImGuiTreeNodeFlags_Leaf;
+            if (is_dir) ImGui::SetNextItemOpen(tree.IsExpanded(row));
+            std::string_view name = tree.GetName(row);
+            ImGui::TreeNodeEx((void*)(intptr_t)r, flags, "%.*s", (int)name.size(), name.data());
+            if (is_dir && ImGui::IsItemToggledOpen()) toggled = r;
+            if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", tree.GetPath(row).c_str());
+            if (is_dir && ImGui::BeginPopupContextItem()) {
+                if (ImGui::MenuItem("Open in List View")) open_in_list = tree.GetPath(row);
+                ImGui::EndPopup();
+            }
+            if (row.depth > 0) ImGui::Unindent(indent * row.depth);
+
+            ImGui::TableNextColumn();
+            if (!is_dir) ImGui::Text("%llu B", (unsigned long long)tree.GetSize(row));
+            else if (tree.GetState(row) == DirectoryTree::State::Listed) ImGui::Text("%zu items", tree.GetChildCount(row));
+            else if (tree.IsExpanded(row)) ImGui::TextDisabled("listing...");
+
+            ImGui::TableNextColumn();
+            ImGui::Text(is_dir ? "Folder" : "File");
+        }
+    }
+    clipper.End();
+    ImGui::EndTable();
+
+    if (toggled >= 0) {
+        DirectoryTree::Row row = rows[toggled];
+        if (tree.IsExpanded(row)) tree.Collapse(row);
+        else tree.Expand(row);
+    }
+    return open_in_list;
+}
+
+// Timers, counters and frame times collected by Profiler
+struct PerfPanel {
+    std::vector<float> FrameMs;
+    std::vector<Profiler::ScopeStats> Scopes;
+    std::vector<Profiler::CounterStats> Counters;
+    std::unordered_map<std::string, uint64_t> LastValues; // counter values at the last rate sample
+    std::unordered_map<std::string, double> Rates;        // per second
+    double LastSample = 0.0;
+    bool DrawEveryFrame = false;                          // vsync rate even when idle, for measuring
+
+    void SampleRates() {
+        double now = ImGui::GetTime();
+        double elapsed = now - LastSample;
+        if (elapsed < 0.5) return;
+        for (const auto& counter : Counters) {
+            auto it = LastValues.find(counter.name);
+            uint64_t last = it != LastValues.end() ? it->second : counter.value;
+            Rates[counter.name] = counter.value >= last ? (counter.value - last) / elapsed : 0.0;
+            LastValues[counter.name] = counter.value;
+        }
+        LastSample = now;
+    }
+
+    void Draw(bool* open, AppLog& log) {
+        ImGui::SetNextWindowSize(ImVec2(620, 640), ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin("Performance", open)) {
+            ImGui::End();
+            return;
+        }
+        Profiler::GetFrameTimes(FrameMs);
+        Profiler::GetScopes(Scopes);
+        Profiler::GetCounters(Counters);
+        SampleRates();
+
+        // Frame times: CPU work per frame, the wait for vsync not included
+        float average = 0.0f, worst = 0.0f;
+        int slow = 0, very_slow = 0;
+        for (float ms : FrameMs) {
+            average += ms;
+            worst = (std::max)(worst, ms);
+            if (ms > 16.7f) slow++;
+            if (ms > 33.3f) very_slow++;
+        }
+        if (!FrameMs.empty()) average /= FrameMs.size();
+        ImGui::Text("%.1f FPS   frame %.2f ms avg, %.2f ms max   over 16.7 ms: %d, over 33.3 ms: %d (last %zu frames)",
+            ImGui::GetIO().Framerate, average, worst, slow, very_slow, FrameMs.size());
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f ms", FrameMs.empty() ? 0.0f : FrameMs.back());
+        ImGui::PlotHistogram("##frames", FrameMs.data(), (int)FrameMs.size(), 0, overlay, 0.0f, 33.3f, ImVec2(-1, 80));
+
+        if (ImGui::Button("Reset")) {
+            Profiler::Reset();
+            LastValues.clear();
+            Rates.clear();
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Draw every frame", &DrawEveryFrame);
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Off: frames are only drawn on input or when something changes.");
+        ImGui::SameLine();
+        if (!Profiler::IsTracing()) {
+            if (ImGui::Button("Start Trace")) {
+                Profiler::StartTrace();
+                log.AddLog("Trace started\n");
+            }
+        } else if (ImGui::Button("Stop Trace")) {
+            char stamp[32];
+            std::time_t now = std::time(nullptr);
+            std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+            std::error_code ec;
+            std::string file = (std::filesystem::temp_directory_path(ec) / ("fnm_trace_" + std::string(stamp) + ".json")).string();
+            size_t events = 0;
+            if (Profiler::StopTrace(file, events)) {
+                log.AddLog("Trace written: %s (%zu events, open in ui.perfetto.dev or chrome://tracing)\n", file.c_str(), events);
+            } else {
+                log.AddLog("[Error] Could not write trace: %s\n", file.c_str());
+            }
+        }
+        if (Profiler::IsTracing()) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Recording");
+        }
+
+        // Entry lists, sort orders and rows are PagedArrays; past the limit, growing ones move to temp files
+        ImGui::SeparatorText("Memory");
+        ImGui::Text("Entry lists: %.1f MB in memory, %.1f MB in temp files",
+            PagedBuffer::GetHeapBytes() / 1048576.0, PagedBuffer::GetSpilledBytes() / 1048576.0);
+        int limit_mb = (int)(std::min)(PagedBuffer::GetBudget() >> 20, (size_t)INT32_MAX);
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::InputInt("Memory limit (MB)", &limit_mb, 256, 1024, ImGuiInputTextFlags_EnterReturnsTrue)) {
+            PagedBuffer::SetBudget((size_t)(std::max)(limit_mb, 0) << 20);
+            if (limit_mb > 0) log.AddLog("Memory limit for entry lists: %d MB\n", limit_mb);
+            else log.AddLog("Memory limit for entry lists: none\n");
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Past this, entry lists move to memory-mapped temp files as they grow (Linux), e.g. on the next scan.\n"
+                              "0: no limit. Set FNM_MEMORY_LIMIT (in MB) to start with one.");
+
+        ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+        ImGui::SeparatorText("Timers");
+        if (ImGui::BeginTable("PerfScopes", 5, flags, ImVec2(0, 260))) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableSetupColumn("Total ms", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+            ImGui::TableSetupColumn("Avg ms", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableSetupColumn("Max ms", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableHeadersRow();
+            for (const auto& scope : Scopes) {
+                if (scope.calls == 0) continue;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(scope.name);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)scope.calls);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", scope.total_ns / 1e6);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", scope.total_ns / 1e6 / scope.calls);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", scope.max_ns / 1e6);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::SeparatorText("Counters");
+        if (ImGui::BeginTable("PerfCounters", 3, flags, ImVec2(0, 0))) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Counter", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Total", ImGuiTableColumnFlags_WidthFixed, 110.0f);
+            ImGui::TableSetupColumn("Per second", ImGuiTableColumnFlags_WidthFixed, 110.0f);
+            ImGui::TableHeadersRow();
+            for (const auto& counter : Counters) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(counter.name);
+                ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)counter.value);
+                ImGui::TableNextColumn(); ImGui::Text("%.0f", Rates[counter.name]);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+};
+
+// One tab: a scanner with its own folder, filter, view and selection. Every session is polled
+// each frame whether its tab is showing or not, so roots opened side by side scan at the same
+// time; their walks share the process-wide listing limit (see DirectoryWalker) and their
+// lists share one name pool (see SharedNames).
+struct ScanSession {
+    FileScanner Scanner;
+    DirectoryTree Tree;
+    int Id;                     // keeps the tab's ImGui id while its title changes
+    char FilterBuffer[256] = "";
+    bool FilterIgnoreCase = false;
+    bool Recursive = false;
+    bool Watch = false;
+    bool TreeMode = false;
+    int LastSelectedRow = -1;   // anchor for Shift+Click, as a position in the visible rows
+    FileScanner::DeleteStatus DeleteProgress;
+    FileScanner::DuplicateStatus DuplicateProgress;
+    FileScanner::ContentSearchStatus SearchProgress;
+    FileScanner::MetadataStatus MetadataProgress;
+
+    ScanSession(std::shared_ptr<SharedNames> names, int id) : Scanner(std::move(names)), Id(id) {}
+
+    const std::string& GetRoot() const { return TreeMode ? Tree.GetRoot() : Scanner.GetCurrentPath(); }
+
+    // Last component of the root, "New Tab" before a folder is picked
+    std::string GetTitle() const {
+        const std::string& root = GetRoot();
+        if (root.empty()) return "New Tab";
+        std::string name = std::filesystem::path(root).filename().string();
+        return name.empty() ? root : name;
+    }
+
+    bool IsBusy() const {
+        return Scanner.IsScanning() || Scanner.IsDeleting() || Scanner.IsFindingDuplicates() || Scanner.IsSearchingContents() ||
+               Scanner.IsFetchingMetadata() || Scanner.HasPendingUpdates();
+    }
+
+    // Selection the list view's batch actions work on; a tab showing the tree has none
+    uint32_t GetSelectedCount() const { return TreeMode ? 0 : Scanner.GetFiles().GetSelectedCount(); }
+};
+
+// Picks up whatever the session's background work finished since last frame. `tag` starts
+// every log line, to tell tabs apart.
+static void PollSession(ScanSession& session, AppLog& log, const char* tag) {
+    FileScanner& scanner = session.Scanner;
+    if (scanner.IsScanning()) {
+        bool was_refreshing = scanner.IsRefreshing();
+        scanner.PollScanResults();
+        if (was_refreshing && !scanner.IsRefreshing()) session.LastSelectedRow = -1; // refreshed list replaced the snapshot
+        if (!scanner.IsScanning()) {
+            log.AddLog("%sScan finished: %zu entries in %.2f s (%.0f entries/s, %.1f MB)\n", tag,
+                scanner.GetScannedCount(), scanner.GetScanSeconds(), scanner.GetScanRate(),
+                scanner.GetFiles().GetMemoryBytes() / (1024.0 * 1024.0));
+        }
+    }
+    // Batch delete runs on worker threads; report progress and errors as they come in
+    session.DeleteProgress = FileScanner::DeleteStatus();
+    if (scanner.IsDeleting()) {
+        FileScanner::DeleteStatus& status = session.DeleteProgress;
+        status = scanner.PollDelete();
+        for (const std::string& error : status.errors) log.AddLog("%s[Error] Delete failed: %s\n", tag, error.c_str());
+        if (status.finished) {
+            log.AddLog("%sDeleted %zu of %zu entries%s (%zu failed).\n", tag, status.completed - status.failed, status.total,
+                status.cancelled ? " before cancelling" : "", status.failed);
+            session.LastSelectedRow = -1;
+        }
+    }
+    // Duplicate search reads files on worker threads; the table switches to the groups when it's done
+    session.DuplicateProgress = FileScanner::DuplicateStatus();
+    if (scanner.IsFindingDuplicates()) {
+        FileScanner::DuplicateStatus& status = session.DuplicateProgress;
+        status = scanner.PollDuplicates();
+        for (const std::string& error : status.errors) log.AddLog("%s[Error] Can't read: %s\n", tag, error.c_str());
+        if (status.finished && !status.cancelled) {
+            size_t copies = 0;
+            uint64_t wasted = 0;
+            for (const DuplicateGroup& group : scanner.GetDuplicateGroups()) {
+                copies += group.entries.size() - 1;
+                wasted += group.GetWastedBytes();
+            }
+            if (copies == 0) log.AddLog("%sNo duplicates found (%.1f MB read).\n", tag, status.bytes_read / (1024.0 * 1024.0));
+            else log.AddLog("%sFound %zu groups of duplicates: %zu extra copies using %.1f MB (%.1f MB read).\n", tag, scanner.GetDuplicateGroups().size(),
+                copies, wasted / (1024.0 * 1024.0), status.bytes_read / (1024.0 * 1024.0));
+            session.LastSelectedRow = -1;
+        }
+    }
+    // Content search streams matching files into the table as they're found
+    session.SearchProgress = FileScanner::ContentSearchStatus();
+    if (scanner.IsSearchingContents()) {
+        FileScanner::ContentSearchStatus& status = session.SearchProgress;
+        status = scanner.PollContentSearch();
+        for (const std::string& error : status.errors) log.AddLog("%s[Error] Can't read: %s\n", tag, error.c_str());
+        if (status.finished) {
+            log.AddLog("%sContent search: %zu of %zu files match (%zu skipped as binary or too large, %.1f MB read).\n", tag,
+                status.hits, status.total, status.skipped, status.bytes_read / (1024.0 * 1024.0));
+            session.LastSelectedRow = -1;
+        }
+    }
+    // Details for the rows on screen, or for everything when sorting or filtering on them
+    session.MetadataProgress = scanner.PollMetadata();
+    if (session.MetadataProgress.finished) {
+        log.AddLog("%sRead details of %zu entries.\n", tag, session.MetadataProgress.total);
+        session.LastSelectedRow = -1;
+    }
+    session.Tree.Poll();
+    // Changes made by other programs while watching
+    if (size_t changes = scanner.PollWatchEvents()) {
+        log.AddLog("%s[Watch] %zu entries changed on disk\n", tag, changes);
+        session.LastSelectedRow = -1;
+    }
+}
+
 void SetupStyle() {
     ImGuiStyle& style = ImGui::GetStyle();
     ImVec4* colors = style.Colors;
@@ -164,6 +524,9 @@ void SetupStyle() {
 
 int main(int, char**)
 {
+    // Memory budget for entry lists in MB, also set from the Performance panel
+    if (const char* limit = std::getenv("FNM_MEMORY_LIMIT")) PagedBuffer::SetBudget((size_t)std::strtoull(limit, nullptr, 10) << 20);
+
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
@@ -198,20 +561,83 @@ int main(int, char**)
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
-    // App State
-    FileScanner scanner;
+    // App State: one session per tab, all interning into the same name pool
+    auto shared_names = std::make_shared<SharedNames>();
+    std::vector<std::unique_ptr<ScanSession>> sessions;
+    int next_session_id = 0;
+    sessions.push_back(std::make_unique<ScanSession>(shared_names, next_session_id++));
+    size_t active_session = 0;
     AppLog my_log;
     my_log.AddLog("Welcome to FileNamesManager!\n");
+    PerfPanel perf_panel;
+    bool show_perf_panel = false;
+    Profiler::SetThreadName("GUI");
     
     bool show_rename_popup = false;
-    char rename_suffix_buffer[256] = "";
-    char filter_buffer[256] = "";
-    bool is_recursive_mode = false;
-    int last_selected_index = -1;
+    char rename_template_buffer[256] = "{name}{ext}";
+    char rename_match_buffer[256] = "";
+    bool rename_match_ignore_case = false;
+    int rename_counter_start = 1;
+    int rename_counter_step = 1;
+    // Renames cover the selections of every tab, one plan per tab with the counter carrying on
+    // from one tab to the next
+    struct RenamePreview {
+        ScanSession* Session;
+        RenameOptions Options;
+        RenamePlan Plan;
+    };
+    std::vector<RenamePreview> rename_previews;
+    std::vector<std::pair<size_t, uint32_t>> rename_preview_rows; // (preview, plan item) shown; only the conflicts when there are any
+    bool rename_preview_dirty = true;
+    uint64_t rename_preview_size = 0;          // list sizes the preview was made for, summed
+
+    char content_text_buffer[256] = "";
+    char content_regex_buffer[256] = "";
+    bool content_ignore_case = false;
+    int content_max_mb = 64;
+    std::string content_search_error;
+
+    // Reopen the last folder; with a cached snapshot the table is filled before the first frame
+    {
+        std::string last_root;
+        ScanSession& first = *sessions[0];
+        if (ScanSnapshot::LoadLastSession(last_root, first.Recursive)) {
+            first.Scanner.StartScan(last_root, first.Recursive);
+            if (first.Scanner.IsRefreshing()) {
+                my_log.AddLog("Reopened %s from cache: %u entries, checking for changes...\n", last_root.c_str(), first.Scanner.GetFiles().Size());
+            } else {
+                my_log.AddLog("Scanning directory: %s\n", last_root.c_str());
+            }
+        }
+    }
+
+    // Frames are drawn on demand. While nothing is running the loop sleeps until there is
+    // input or a background thread calls RedrawSignal::Request(), then draws a few frames so
+    // hover states and popups settle. Scans, deletes, duplicate and content searches, pending
+    // watch updates and mouse drags run at the vsync rate. The timeout covers timers nobody signals (tooltip
+    // delay, caret blink, the delayed snapshot save).
+    constexpr int kWakeFrames = 3;
+    constexpr double kIdleWait = 2.0;
+    constexpr double kHoverWait = 0.25;
+    RedrawSignal::SetWakeHandler(glfwPostEmptyEvent);
+    int wake_frames = kWakeFrames;
 
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        bool busy = ImGui::IsAnyItemActive() || ImGui::IsAnyMouseDown() || perf_panel.DrawEveryFrame;
+        for (const auto& session : sessions) busy |= session->IsBusy();
+        if (busy || wake_frames > 0) {
+            glfwPollEvents();
+            wake_frames = busy ? kWakeFrames : wake_frames - 1;
+        } else {
+            double timeout = io.WantTextInput || ImGui::IsAnyItemHovered() ? kHoverWait : kIdleWait;
+            double wait_begin = glfwGetTime();
+            glfwWaitEventsTimeout(timeout);
+            // Returned early: input, or a redraw request
+            if (glfwGetTime() - wait_begin < timeout) wake_frames = kWakeFrames;
+        }
+        RedrawSignal::Consume(); // requests from here on wake the next wait
+        uint64_t frame_begin = Profiler::Now();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -229,10 +655,80 @@ int main(int, char**)
         ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(10.0f, 10.0f)); 
         ImGui::Begin("MainDockSpace", nullptr, window_flags);
         ImGui::PopStyleVar(3);
-        
-        // Count selected
+
+        // Every tab's background work, not just the one on screen
+        PROFILE_COUNT("gui.frames", 1);
+        for (const auto& session : sessions) {
+            std::string tag = sessions.size() > 1 ? "[" + session->GetTitle() + "] " : "";
+            PollSession(*session, my_log, tag.c_str());
+        }
+
+        // --- 0. Tabs ---
+        size_t close_session = sessions.size();
+        if (ImGui::BeginTabBar("Sessions", ImGuiTabBarFlags_Reorderable | ImGuiTabBarFlags_AutoSelectNewTabs | ImGuiTabBarFlags_FittingPolicyScroll)) {
+            for (size_t k = 0; k < sessions.size(); k++) {
+                const ScanSession& session = *sessions[k];
+                // The part after ### is the id, so the tab stays put while its title changes
+                std::string label = session.GetTitle();
+                if (session.Scanner.IsScanning()) label += " (scanning)";
+                label += "###session" + std::to_string(session.Id);
+                bool open = true;
+                if (ImGui::BeginTabItem(label.c_str(), sessions.size() > 1 ? &open : nullptr)) {
+                    active_session = k;
+                    ImGui::EndTabItem();
+                }
+                if (ImGui::IsItemHovered() && !session.GetRoot().empty()) ImGui::SetTooltip("%s", session.GetRoot().c_str());
+                if (!open) close_session = k;
+            }
+            if (ImGui::TabItemButton("+", ImGuiTabItemFlags_Trailing | ImGuiTabItemFlags_NoTooltip)) {
+                sessions.push_back(std::make_unique<ScanSession>(shared_names, next_session_id++));
+            }
+            if (ImGui::IsItemHovered()) ImGui::SetTooltip("Open another folder in a new tab; all tabs scan at the same time.");
+            ImGui::EndTabBar();
+        }
+        // Closing cancels whatever the tab's scanner was doing
+        if (close_session < sessions.size()) {
+            sessions.erase(sessions.begin() + close_session);
+            if (active_session > close_session || active_session == sessions.size()) active_session--;
+        }
+
+        // The rest of the window shows the active tab
+        ScanSession& session = *sessions[active_session];
+        FileScanner& scanner = session.Scanner;
+        DirectoryTree& tree = session.Tree;
+        char (&filter_buffer)[256] = session.FilterBuffer;
+        bool& filter_ignore_case = session.FilterIgnoreCase;
+        bool& is_recursive_mode = session.Recursive;
+        bool& watch_mode = session.Watch;
+        bool& tree_mode = session.TreeMode;
+        int& last_selected_row = session.LastSelectedRow;
+        const FileScanner::DeleteStatus& delete_status = session.DeleteProgress;
+        const FileScanner::DuplicateStatus& duplicate_status = session.DuplicateProgress;
+        const FileScanner::ContentSearchStatus& search_status = session.SearchProgress;
+        const FileScanner::MetadataStatus& metadata_status = session.MetadataProgress;
+        // Tables and popups get their own state per tab: column layout, sort, scroll position
+        ImGui::PushID(session.Id);
+
+        // Delete and rename take the selections of every tab
         int selected_count = 0;
-        for(const auto& f : scanner.GetFiles()) if(f.is_selected) selected_count++;
+        int selected_tabs = 0;
+        bool selection_scanning = false; // in a tab with a selection
+        bool selection_deleting = false;
+        for (const auto& other : sessions) {
+            uint32_t count = other->GetSelectedCount();
+            if (count == 0) continue;
+            selected_count += (int)count;
+            selected_tabs++;
+            selection_scanning |= other->Scanner.IsScanning();
+            selection_deleting |= other->Scanner.IsDeleting();
+        }
+        auto start_delete = [&] {
+            int started = 0;
+            for (const auto& other : sessions) {
+                if (other->GetSelectedCount() > 0 && other->Scanner.StartDelete()) started++;
+            }
+            return started;
+        };
 
         // --- 1. Top Toolbar ---
         // Blue "Select Folder" Button
@@ -240,64 +736,217 @@ int main(int, char**)
         ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.35f, 0.65f, 1.00f, 1.00f));
         if (ImGui::Button("Select Folder", ImVec2(120, 30))) {
             auto selection = pfd::select_folder("Select Directory", "").result();
-            if (!selection.empty()) {
-                scanner.ScanDirectory(selection, is_recursive_mode);
-                my_log.AddLog("Scanned directory: %s\n", selection.c_str());
-                last_selected_index = -1;
+            if (!selection.empty() && tree_mode) {
+                tree.Open(selection);
+                my_log.AddLog("Browsing directory: %s\n", selection.c_str());
+            } else if (!selection.empty()) {
+                scanner.StartScan(selection, is_recursive_mode);
+                ScanSnapshot::SaveLastSession(selection, is_recursive_mode);
+                my_log.AddLog("Scanning directory: %s\n", selection.c_str());
+                last_selected_row = -1;
             }
         }
         ImGui::PopStyleColor(2);
 
+        // Listings: the visible rows as CSV/NDJSON, or the whole list as a binary listing that can be imported again
+        ImGui::SameLine();
+        ImGui::BeginDisabled(tree_mode || scanner.IsScanning() || scanner.GetFiles().Empty());
+        if (ImGui::Button("Export...", ImVec2(0, 30))) {
+            std::string file = pfd::save_file("Export Listing", "", {"Binary listing (*.fnml)", "*.fnml", "CSV (*.csv)", "*.csv", "NDJSON (*.ndjson)", "*.ndjson"}).result();
+            if (!file.empty()) {
+                ScanExport::Format format = ScanExport::GuessFormat(file);
+                std::string error;
+                uint64_t begin = Profiler::Now();
+                if (scanner.ExportListing(file, format, error)) {
+                    my_log.AddLog("Exported %zu entries to %s in %.2f s\n", format == ScanExport::Format::Binary ? (size_t)scanner.GetFiles().Size() : scanner.GetVisibleRows().size(),
+                        file.c_str(), (Profiler::Now() - begin) / 1e9);
+                } else {
+                    my_log.AddLog("[Error] Export failed: %s\n", error.c_str());
+                }
+            }
+        }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Save the visible rows as .csv or .ndjson, or the whole list as a .fnml listing for Import.");
+        ImGui::SameLine();
+        ImGui::BeginDisabled(tree_mode || scanner.IsDeleting());
+        if (ImGui::Button("Import...", ImVec2(0, 30))) {
+            std::vector<std::string> files = pfd::open_file("Import Listing", "", {"Binary listing (*.fnml)", "*.fnml", "All files", "*"}).result();
+            std::string error;
+            if (!files.empty() && scanner.ImportListing(files[0], error)) {
+                // Shown as saved, maybe from another machine: no rescan, no watching
+                is_recursive_mode = scanner.IsRecursive();
+                watch_mode = false;
+                scanner.SetWatchEnabled(false);
+                my_log.AddLog("Imported %u entries of %s from %s\n", scanner.GetFiles().Size(), scanner.GetCurrentPath().c_str(), files[0].c_str());
+                last_selected_row = -1;
+            } else if (!files.empty()) {
+                my_log.AddLog("[Error] Import failed: %s\n", error.c_str());
+            }
+        }
+        ImGui::EndDisabled();
+
         ImGui::SameLine();
         ImGui::AlignTextToFramePadding();
         ImGui::Text("Path:");
         ImGui::SameLine();
-        ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 1.0f), "%s", scanner.GetCurrentPath().empty() ? "[No Folder Selected]" : scanner.GetCurrentPath().c_str());
+        const std::string& shown_path = tree_mode ? tree.GetRoot() : scanner.GetCurrentPath();
+        ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 1.0f), "%s", shown_path.empty() ? "[No Folder Selected]" : shown_path.c_str());
 
         // Right-aligned Selected Count
-        float count_width = 150.0f;
+        int selected_elsewhere = selected_count - (int)session.GetSelectedCount();
+        float count_width = selected_elsewhere > 0 ? 300.0f : 150.0f;
         ImGui::SameLine(ImGui::GetContentRegionAvail().x - count_width);
-        ImGui::Text("%d Selected Files", selected_count);
+        if (selected_elsewhere > 0) ImGui::Text("%d Selected Files (%d in other tabs)", selected_count, selected_elsewhere);
+        else ImGui::Text("%d Selected Files", selected_count);
 
         ImGui::Dummy(ImVec2(0, 5)); // Spacer
 
         // --- 2. Filter Bar ---
+        ImGui::BeginDisabled(tree_mode); // filter, scan options and selection act on the list view
         ImGui::AlignTextToFramePadding();
         ImGui::Text("Filter:");
         ImGui::SameLine();
         ImGui::SetNextItemWidth(400);
-        if (ImGui::InputText("##filter", filter_buffer, IM_ARRAYSIZE(filter_buffer))) {
-            scanner.ApplyFilter(filter_buffer);
+        bool filter_changed = ImGui::InputText("##filter", filter_buffer, IM_ARRAYSIZE(filter_buffer));
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Words match names, terms must all hold:\n"
+                              "  report  *.log  IMG_??  \"two words\"\n"
+                              "  ext:jpg,png  size>100M  size<=4K  type:file  type:dir\n"
+                              "  age>30d  modified<2024-01-31  owner:root  perm:644\n"
+                              "  re:^\\d+\\.txt$ (name regex)  path:src/.*\\.h (path regex)\n"
+                              "  !term negates");
+        ImGui::SameLine();
+        filter_changed |= ImGui::Checkbox("Ignore Case", &filter_ignore_case);
+        if (filter_changed) {
+            scanner.ApplyFilter(filter_buffer, !filter_ignore_case);
+            last_selected_row = -1; // row positions changed
+        }
+        if (!scanner.GetFilterError().empty()) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", scanner.GetFilterError().c_str());
         }
 
        ImGui::SameLine();
         if (ImGui::Checkbox("Recursive Scan", &is_recursive_mode)) {
             std::string current_path = scanner.GetCurrentPath();
             if (!current_path.empty()) {
-                scanner.ScanDirectory(current_path, is_recursive_mode);
-                scanner.ApplyFilter(filter_buffer);
-                
+                // Restarting cancels any scan still in flight; the filter is re-applied as entries stream in
+                scanner.StartScan(current_path, is_recursive_mode);
+                ScanSnapshot::SaveLastSession(current_path, is_recursive_mode);
+
                 my_log.AddLog("[System] Recursive scan toggled: %s\n", is_recursive_mode ? "ENABLED" : "DISABLED");
-                last_selected_index = -1;
+                last_selected_row = -1;
             }
         }
         if (ImGui::IsItemHovered()) 
             ImGui::SetTooltip("Apply filter to all subdirectories within the current path.");
 
+        ImGui::SameLine();
+        if (ImGui::Button("Full Rescan") && !scanner.GetCurrentPath().empty()) {
+            scanner.StartScan(scanner.GetCurrentPath(), is_recursive_mode, false);
+            my_log.AddLog("Rescanning directory: %s\n", scanner.GetCurrentPath().c_str());
+            last_selected_row = -1;
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Re-read every folder instead of only the ones that changed since the cached scan.");
+
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Watch", &watch_mode)) {
+            scanner.SetWatchEnabled(watch_mode);
+            my_log.AddLog("[System] Watching for changes: %s\n", watch_mode ? "ENABLED" : "DISABLED");
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(scanner.IsWatchPolling() ? "Keep the list in sync with changes on disk (polling folder times every few seconds)."
+                                                       : "Keep the list in sync with changes on disk.");
+
         ImGui::SameLine();
         if (ImGui::Button("Select All")) {
-            for (auto& f : scanner.GetFilesModifiable()) {
-                if (!f.is_filtered) f.is_selected = true;
-            }
+            scanner.SelectAll();
             my_log.AddLog("Selected all visible files.\n");
         }
         ImGui::SameLine();
         if (ImGui::Button("Deselect All")) {
-            for (auto& f : scanner.GetFilesModifiable()) {
-                f.is_selected = false;
-            }
+            scanner.GetFilesModifiable().ClearSelection();
             my_log.AddLog("Deselected all files.\n");
-            last_selected_index = -1;
+            last_selected_row = -1;
+        }
+        ImGui::EndDisabled();
+
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Tree View", &tree_mode)) {
+            if (tree_mode) {
+                // Browsing needs no flat list: only what gets expanded is read
+                scanner.CancelScan();
+                if (!scanner.GetCurrentPath().empty()) tree.Open(scanner.GetCurrentPath());
+            } else {
+                std::string root = tree.GetRoot();
+                tree.Close();
+                if (!root.empty()) {
+                    scanner.StartScan(root, is_recursive_mode);
+                    ScanSnapshot::SaveLastSession(root, is_recursive_mode);
+                }
+            }
+            my_log.AddLog("[System] Tree view: %s\n", tree_mode ? "ENABLED" : "DISABLED");
+            last_selected_row = -1;
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Browse folder by folder; each one is read when first expanded.");
+        if (tree_mode && tree.IsBusy()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("Listing... (%zu folders, %.1f MB)", tree.GetListedCount(), tree.GetMemoryBytes() / (1024.0 * 1024.0));
+        }
+
+        // Live scan status
+        if (scanner.IsScanning()) {
+            ImGui::SameLine();
+            ImGui::AlignTextToFramePadding();
+            ImGui::TextColored(ImVec4(0.26f, 0.59f, 0.98f, 1.0f), "%s %zu entries (%.0f/s)",
+                scanner.IsRefreshing() ? "Refreshing..." : "Scanning...", scanner.GetScannedCount(), scanner.GetScanRate());
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel Scan")) {
+                scanner.CancelScan();
+                my_log.AddLog("Scan cancelled after %zu entries.\n", scanner.GetScannedCount());
+            }
+        }
+        if (scanner.IsDeleting()) {
+            ImGui::SameLine();
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "Deleting %zu / %zu", delete_status.completed, delete_status.total);
+            ImGui::ProgressBar(delete_status.total ? (float)delete_status.completed / delete_status.total : 0.0f, ImVec2(200, 0), overlay);
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel Delete")) scanner.CancelDelete();
+        }
+        if (scanner.IsFindingDuplicates()) {
+            ImGui::SameLine();
+            char overlay[96];
+            snprintf(overlay, sizeof(overlay), "%s %zu / %zu (%.0f MB)", duplicate_status.stage == DuplicateJob::kEdges ? "Comparing" : "Reading",
+                duplicate_status.stage_done, duplicate_status.stage_total, duplicate_status.bytes_read / (1024.0 * 1024.0));
+            ImGui::ProgressBar(duplicate_status.stage_total ? (float)duplicate_status.stage_done / duplicate_status.stage_total : 0.0f, ImVec2(260, 0), overlay);
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel Search")) {
+                scanner.CancelFindDuplicates();
+                my_log.AddLog("Duplicate search cancelled.\n");
+            }
+        }
+        if (scanner.IsSearchingContents()) {
+            ImGui::SameLine();
+            char overlay[96];
+            snprintf(overlay, sizeof(overlay), "Searching %zu / %zu, %zu found (%.0f MB)", search_status.completed, search_status.total,
+                search_status.hits, search_status.bytes_read / (1024.0 * 1024.0));
+            ImGui::ProgressBar(search_status.total ? (float)search_status.completed / search_status.total : 0.0f, ImVec2(300, 0), overlay);
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel Search##contents")) {
+                scanner.CancelContentSearch();
+                my_log.AddLog("Content search cancelled; %zu matching files found so far.\n", scanner.GetContentHits().size());
+                last_selected_row = -1;
+            }
+        }
+        if (metadata_status.fetching) {
+            ImGui::SameLine();
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "Reading details %zu / %zu", metadata_status.completed, metadata_status.total);
+            ImGui::ProgressBar(metadata_status.total ? (float)metadata_status.completed / metadata_status.total : 0.0f, ImVec2(260, 0), overlay);
         }
 
         ImGui::Dummy(ImVec2(0, 5)); // Spacer
@@ -310,114 +959,186 @@ int main(int, char**)
         ImGui::BeginChild("FileArea", ImVec2(0, table_height), true);
         
         // Handle Shortcuts (Must be done before Table to catch events, or inside if focused, but Window focus is safe)
-        if (ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows)) {
+        if (!tree_mode && ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows)) {
             if (ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_A)) {
-                for (auto& f : scanner.GetFilesModifiable()) {
-                    if (!f.is_filtered) f.is_selected = true;
-                }
+                scanner.SelectAll();
                 my_log.AddLog("Selected all visible files (Ctrl+A).\n");
             }
             if (ImGui::IsKeyPressed(ImGuiKey_Delete) && selected_count > 0) {
-                 int deleted = scanner.ExecuteDelete();
-                 if (deleted > 0) my_log.AddLog("Deleted %d files (Del).\n", deleted);
-                 last_selected_index = -1;
+                if (int started = start_delete()) my_log.AddLog("Deleting selected files in %d tab(s) (Del)...\n", started);
             }
             if (ImGui::IsKeyPressed(ImGuiKey_F2) && selected_count > 0) {
                 show_rename_popup = true;
+                rename_preview_dirty = true;
                 ImGui::OpenPopup("Rename Files");
             }
         }
 
-        static ImGuiTableFlags table_flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
+        static ImGuiTableFlags table_flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable |
+                                              ImGuiTableFlags_Sortable | ImGuiTableFlags_SortTristate;
         
-        if (ImGui::BeginTable("FileTable", 4, table_flags)) {
+        if (tree_mode) {
+            std::string folder = DrawTreeTable(tree);
+            if (!folder.empty()) {
+                tree_mode = false;
+                tree.Close();
+                scanner.StartScan(folder, is_recursive_mode);
+                ScanSnapshot::SaveLastSession(folder, is_recursive_mode);
+                my_log.AddLog("Scanning directory: %s\n", folder.c_str());
+                last_selected_row = -1;
+            }
+        } else if (ImGui::BeginTable("FileTable", 7, table_flags)) {
+            PROFILE_SCOPE("GUI::FileTable");
             ImGui::TableSetupScrollFreeze(0, 1);
             // Select column is now just an indicator or redundant if whole row is selectable. 
             // Let's keep a small checkbox for visual clarity but allow row click.
-            ImGui::TableSetupColumn("Select", ImGuiTableColumnFlags_WidthFixed, 30.0f);
-            ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_None);
-            ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, 100.0f);
-            ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, 100.0f);
+            // Column user ids are the SortColumn each header sorts by; no sort means scan order
+            ImGui::TableSetupColumn("Select", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort, 30.0f, (ImGuiID)SortColumn::None);
+            ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_None, 0.0f, (ImGuiID)SortColumn::Name);
+            ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 100.0f, (ImGuiID)SortColumn::Size);
+            ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, 100.0f, (ImGuiID)SortColumn::Type);
+            // Details the scan doesn't read; shown from the header's context menu, fetched for the rows on screen
+            ImGui::TableSetupColumn("Modified", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultHide | ImGuiTableColumnFlags_PreferSortDescending, 130.0f, (ImGuiID)SortColumn::Modified);
+            ImGui::TableSetupColumn("Permissions", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultHide, 90.0f, (ImGuiID)SortColumn::Permissions);
+            ImGui::TableSetupColumn("Owner", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultHide, 80.0f, (ImGuiID)SortColumn::Owner);
             ImGui::TableHeadersRow();
+            bool show_details = false;
+            for (int column = 4; column < 7; column++) show_details |= (ImGui::TableGetColumnFlags(column) & ImGuiTableColumnFlags_IsEnabled) != 0;
 
-            auto& files = scanner.GetFilesModifiable();
-            for (int i = 0; i < (int)files.size(); i++) {
-                auto& file = files[i];
-                if (file.is_filtered) continue;
+            if (ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs()) {
+                if (sort_specs->SpecsDirty) {
+                    if (sort_specs->SpecsCount == 0) {
+                        scanner.SetSort(SortColumn::None, true);
+                    } else {
+                        const ImGuiTableColumnSortSpecs& spec = sort_specs->Specs[0];
+                        scanner.SetSort((SortColumn)spec.ColumnUserID, spec.SortDirection == ImGuiSortDirection_Ascending);
+                    }
+                    sort_specs->SpecsDirty = false;
+                    last_selected_row = -1; // the anchor row now holds a different entry
+                }
+            }
 
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
+            // Only the rows on screen are submitted; the clipper skips the rest in O(1)
+            EntryStore& files = scanner.GetFilesModifiable();
+            const PagedArray<uint32_t>& rows = scanner.GetVisibleRows();
+            ImGuiListClipper clipper;
+            clipper.Begin((int)rows.size());
+            int first_shown = (int)rows.size(), last_shown = 0;
+            while (clipper.Step()) {
+                first_shown = (std::min)(first_shown, clipper.DisplayStart);
+                last_shown = (std::max)(last_shown, clipper.DisplayEnd);
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                    uint32_t i = rows[row];
+                    FileEntry file = files[i];
+
+                    ImGui::TableNextRow();
+                    // Every other duplicate group gets a tint so the groups read as blocks
+                    uint32_t group = scanner.GetDuplicateGroup(i);
+                    if (scanner.IsShowingDuplicates() && (group & 1))
+                        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, ImGui::GetColorU32(ImVec4(0.26f, 0.59f, 0.98f, 0.12f)));
+                    ImGui::TableNextColumn();
                 
-                // Selectable Row Logic
-                // We want the whole row to be interactable. ImGui::Selectable spans width.
-                // But we are in a table column. To make the WHOLE row selectable, we usually use Selectable in the first column 
-                // with SpanAllColumns flag.
+                    // Selectable Row Logic
+                    // We want the whole row to be interactable. ImGui::Selectable spans width.
+                    // But we are in a table column. To make the WHOLE row selectable, we usually use Selectable in the first column 
+                    // with SpanAllColumns flag.
                 
-                bool is_selected = file.is_selected;
-                ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap;
+                    bool is_selected = file.IsSelected();
+                    ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap;
                 
-                // Checkbox purely for visual or individual toggle without affecting selection logic of row?
-                // Actually, if we use Selectable, we replace the checkbox interaction usually.
-                // Let's draw the checkbox manually or just use the Selectable state.
-                // We will use the Selectable for the interaction.
+                    // Checkbox purely for visual or individual toggle without affecting selection logic of row?
+                    // Actually, if we use Selectable, we replace the checkbox interaction usually.
+                    // Let's draw the checkbox manually or just use the Selectable state.
+                    // We will use the Selectable for the interaction.
                 
-                // Interaction
-                if (ImGui::Selectable(("##" + std::to_string(i)).c_str(), is_selected, selectable_flags)) {
-                    if (ImGui::GetIO().KeyShift) {
-                        // Shift+Click: Range Select
-                        if (last_selected_index != -1) {
-                             int start = (std::min)(last_selected_index, i);
-                             int end = (std::max)(last_selected_index, i);
-                             
-                             // Deselect all others if Ctrl not held? Explorer usually keeps previous state if just Shift
-                             // Standard Shift-Click logic: Select from Anchor to Current.
-                             // If Ctrl is NOT held, we explicitly set the range and clear others? 
-                             // Let's stick to simple "Add Range" or "Set Range".
+                    // Interaction. The entry index is the ID, pushed as an integer so no string is built per row.
+                    ImGui::PushID((int)i);
+                    bool clicked = ImGui::Selectable("##row", is_selected, selectable_flags);
+                    ImGui::PopID();
+                    if (clicked) {
+                        if (ImGui::GetIO().KeyShift) {
+                            // Shift+Click: Range Select
+                            if (last_selected_row != -1) {
+                                 // Deselect all others if Ctrl not held? Explorer usually keeps previous state if just Shift
+                                 // Standard Shift-Click logic: Select from Anchor to Current.
+                                 // If Ctrl is NOT held, we explicitly set the range and clear others? 
+                                 // Let's stick to simple "Add Range" or "Set Range".
                              
-                             if (!ImGui::GetIO().KeyCtrl) {
-                                 // Clear others if Ctrl is not held
-                                 for (auto& f : files) f.is_selected = false;
-                             }
-
-                             for (int k = start; k <= end; k++) {
-                                 if (!files[k].is_filtered) files[k].is_selected = true;
-                             }
-                        } else {
-                            // No anchor, just select this one
-                            file.is_selected = true;
-                            last_selected_index = i;
+                                 if (!ImGui::GetIO().KeyCtrl) {
+                                     // Clear others if Ctrl is not held
+                                     files.ClearSelection();
+                                 }
+                                 scanner.SelectRows((size_t)last_selected_row, (size_t)row);
+                            } else {
+                                // No anchor, just select this one
+                                files.SetSelected(i, true);
+                                last_selected_row = row;
+                            }
+                        } 
+                        else if (ImGui::GetIO().KeyCtrl) {
+                            // Ctrl+Click: Toggle
+                            files.SetSelected(i, !file.IsSelected());
+                            last_selected_row = row;
+                        } 
+                        else {
+                            // Regular Click: Select Single, Clear Others
+                            files.ClearSelection();
+                            files.SetSelected(i, true);
+                            last_selected_row = row;
                         }
-                    } 
-                    else if (ImGui::GetIO().KeyCtrl) {
-                        // Ctrl+Click: Toggle
-                        file.is_selected = !file.is_selected;
-                        last_selected_index = i;
-                    } 
-                    else {
-                        // Regular Click: Select Single, Clear Others
-                        for (auto& f : files) f.is_selected = false;
-                        file.is_selected = true;
-                        last_selected_index = i;
                     }
-                }
                 
-                // Visual Checkbox (Non-interactive mostly, reflects state)
-                ImGui::SameLine();
-                // Store cursor pos to draw over the Selectable? Or just draw simple text/icon
-                // Using standard checkbox but pass a dummy bool or the real one (careful with ID)
-                // Actually, Selectable handles the click. Just render a box state.
-                ImGui::Text(file.is_selected ? "[X]" : "[ ]"); 
-
-                ImGui::TableNextColumn();
-                ImGui::TextUnformatted(file.name.c_str());
-                if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", file.path.c_str());
+                    // Visual Checkbox (Non-interactive mostly, reflects state)
+                    ImGui::SameLine();
+                    // Store cursor pos to draw over the Selectable? Or just draw simple text/icon
+                    // Using standard checkbox but pass a dummy bool or the real one (careful with ID)
+                    // Actually, Selectable handles the click. Just render a box state.
+                    ImGui::Text(file.IsSelected() ? "[X]" : "[ ]"); 
+
+                    ImGui::TableNextColumn();
+                    std::string_view name = file.Name();
+                    ImGui::TextUnformatted(name.data(), name.data() + name.size());
+                    // Full path is only rebuilt for the hovered row
+                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", file.Path().c_str());
                 
-                ImGui::TableNextColumn();
-                if (file.is_directory) ImGui::Text("-");
-                else ImGui::Text("%zu B", file.size);
+                    ImGui::TableNextColumn();
+                    // Folders show everything below them once the scan has rolled the totals up
+                    if (file.IsDirectory() && !files.HasDirTotals(i)) ImGui::Text("-");
+                    else ImGui::Text("%llu B", (unsigned long long)files.GetTotalSize(i));
                 
-                ImGui::TableNextColumn();
-                ImGui::Text(file.is_directory ? "Folder" : "File");
+                    ImGui::TableNextColumn();
+                    // Hits say where the first match is; the line itself is in the tooltip
+                    const ContentHit* hit = scanner.IsShowingContentHits() ? scanner.GetContentHit(i) : nullptr;
+                    if (scanner.IsShowingDuplicates() && group != FileScanner::kNoGroup) ImGui::Text("Group %u", group + 1);
+                    else if (hit) {
+                        ImGui::Text("Line %llu", (unsigned long long)hit->line);
+                        if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", hit->excerpt.c_str());
+                    }
+                    else if (files.HasDirTotals(i)) ImGui::Text("Folder (%llu files)", (unsigned long long)files.GetDirFiles(files.GetDirId(i)));
+                    else ImGui::Text(file.IsDirectory() ? "Folder" : "File");
+
+                    // Unknown until fetched, "-" if the entry couldn't be read
+                    EntryStore::MetadataState state = files.GetMetadataState(i);
+                    const char* missing = state == EntryStore::kMetadataFailed ? "-" : "...";
+                    EntryMetadata meta = state == EntryStore::kMetadataKnown ? files.GetMetadata(i) : EntryMetadata();
+                    if (ImGui::TableNextColumn()) {
+                        if (state == EntryStore::kMetadataKnown) ImGui::TextUnformatted(MetadataFetcher::FormatTime(meta.mtime).c_str());
+                        else ImGui::TextDisabled("%s", missing);
+                    }
+                    if (ImGui::TableNextColumn()) {
+                        if (state == EntryStore::kMetadataKnown) ImGui::TextUnformatted(MetadataFetcher::FormatMode(meta.mode, file.IsDirectory()).c_str());
+                        else ImGui::TextDisabled("%s", missing);
+                    }
+                    if (ImGui::TableNextColumn()) {
+                        if (state == EntryStore::kMetadataKnown) ImGui::TextUnformatted(MetadataFetcher::GetOwnerName(meta.uid).c_str());
+                        else ImGui::TextDisabled("%s", missing);
+                    }
+                }
+            }
+            // The rows on screen plus a screenful either way, so scrolling finds them ready
+            if (show_details && first_shown < last_shown) {
+                int margin = last_shown - first_shown;
+                scanner.RequestMetadata((size_t)(std::max)(0, first_shown - margin), (size_t)(last_shown + margin));
             }
             ImGui::EndTable();
         }
@@ -427,35 +1148,188 @@ int main(int, char**)
         ImGui::Dummy(ImVec2(0, 5));
         ImGui::Text("Actions:");
         ImGui::SameLine();
+        ImGui::BeginDisabled(tree_mode);
         
-        ImGui::BeginDisabled(selected_count == 0);
+        ImGui::BeginDisabled(selected_count == 0 || selection_deleting);
+        ImGui::BeginDisabled(selection_scanning); // a scan may still replace the list
         if (ImGui::Button("Delete Selected", ImVec2(150, 30))) {
-             int deleted = scanner.ExecuteDelete();
-             if (deleted > 0) my_log.AddLog("Deleted %d files.\n", deleted);
-             last_selected_index = -1;
+            if (int started = start_delete()) my_log.AddLog("Deleting selected files in %d tab(s)...\n", started);
         }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled) && selected_tabs > 1)
+            ImGui::SetTooltip("Deletes what is selected in all %d tabs.", selected_tabs);
         
         ImGui::SameLine();
         if (ImGui::Button("Rename Selected", ImVec2(150, 30))) {
             show_rename_popup = true;
+            rename_preview_dirty = true;
             ImGui::OpenPopup("Rename Files");
         }
         ImGui::EndDisabled();
 
+        ImGui::SameLine();
+        bool reading_files = scanner.IsScanning() || scanner.IsDeleting() || scanner.IsFindingDuplicates() || scanner.IsSearchingContents();
+        ImGui::BeginDisabled(reading_files);
+        if (ImGui::Button("Find Duplicates", ImVec2(150, 30))) {
+            if (scanner.StartFindDuplicates()) my_log.AddLog("Looking for duplicates among %zu visible entries...\n", scanner.GetVisibleRows().size());
+        }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Compare the visible files by size, then by their first and last 4 KB, and read in full only the ones that still match.");
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(reading_files);
+        if (ImGui::Button("Search Contents", ImVec2(150, 30))) {
+            content_search_error.clear();
+            ImGui::OpenPopup("Search Contents");
+        }
+        ImGui::EndDisabled();
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Find the visible files that contain a string. Searching the results again narrows them down.");
+        if (scanner.IsShowingDuplicates()) {
+            ImGui::SameLine();
+            if (ImGui::Button("Select Extra Copies", ImVec2(150, 30))) {
+                size_t count = scanner.SelectDuplicateCopies();
+                my_log.AddLog("Selected %zu extra copies; the first file of each group is kept.\n", count);
+                last_selected_row = -1;
+            }
+        }
+        if (scanner.IsShowingDuplicates() || scanner.IsShowingContentHits()) {
+            ImGui::SameLine();
+            if (ImGui::Button("Show All", ImVec2(100, 30))) {
+                scanner.ShowAllEntries();
+                last_selected_row = -1;
+            }
+        }
+        ImGui::EndDisabled();
+
         // Rename Modal
         if (ImGui::BeginPopupModal("Rename Files", &show_rename_popup, ImGuiWindowFlags_AlwaysAutoResize)) {
-            ImGui::Text("Rename %d selected files.", selected_count);
-            ImGui::InputText("Suffix to append", rename_suffix_buffer, IM_ARRAYSIZE(rename_suffix_buffer));
-            
+            if (selected_tabs > 1) ImGui::Text("Rename %d selected files in %d tabs.", selected_count, selected_tabs);
+            else ImGui::Text("Rename %d selected files.", selected_count);
+            bool options_changed = ImGui::InputText("Template", rename_template_buffer, IM_ARRAYSIZE(rename_template_buffer));
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("{name} name without extension, {ext} extension with its dot, {full} whole name,\n"
+                                  "{n} counter ({n:3} pads to 3 digits), {1}..{9} groups of the match pattern.\n"
+                                  "Add :upper, :lower or :title to change case, e.g. {ext:lower}. {{ and }} for braces.");
+            options_changed |= ImGui::InputText("Match (regex)", rename_match_buffer, IM_ARRAYSIZE(rename_match_buffer));
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Only entries whose name matches are renamed. Leave empty to rename all of them.");
+            ImGui::SameLine();
+            options_changed |= ImGui::Checkbox("Ignore Case##rename", &rename_match_ignore_case);
+            ImGui::SetNextItemWidth(120);
+            options_changed |= ImGui::InputInt("Counter start", &rename_counter_start);
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120);
+            options_changed |= ImGui::InputInt("Step", &rename_counter_step);
+
+            RenameOptions rename_options;
+            rename_options.name_template = rename_template_buffer;
+            rename_options.match = rename_match_buffer;
+            rename_options.match_case_sensitive = !rename_match_ignore_case;
+            rename_options.counter_start = rename_counter_start;
+            rename_options.counter_step = rename_counter_step;
+
+            // Dry run: re-planned whenever the options or a list change, nothing touches the disk.
+            // Each tab's counter starts where the previous tab's left off.
+            uint64_t list_sizes = 0;
+            for (const auto& other : sessions) list_sizes += other->Scanner.GetFiles().Size();
+            if (options_changed || rename_preview_dirty || rename_preview_size != list_sizes) {
+                rename_previews.clear();
+                rename_preview_rows.clear();
+                int64_t counter = rename_counter_start;
+                size_t conflicts = 0;
+                for (const auto& other : sessions) {
+                    if (other->GetSelectedCount() == 0) continue;
+                    RenamePreview preview{other.get(), rename_options, RenamePlan()};
+                    preview.Options.counter_start = counter;
+                    preview.Plan = other->Scanner.PlanRename(preview.Options);
+                    // The counter steps once per target the regex matched
+                    counter += (int64_t)preview.Plan.matched * rename_counter_step;
+                    conflicts += preview.Plan.conflicts;
+                    rename_previews.push_back(std::move(preview));
+                }
+                for (size_t p = 0; p < rename_previews.size(); p++) {
+                    const RenamePlan& plan = rename_previews[p].Plan;
+                    for (uint32_t k = 0; k < plan.items.size(); k++) {
+                        if (conflicts == 0 || !plan.items[k].error.empty()) rename_preview_rows.push_back({p, k});
+                    }
+                }
+                rename_preview_dirty = false;
+                rename_preview_size = list_sizes;
+            }
+
+            // Every plan comes from the same template, so they share any template error
+            size_t rename_items = 0, rename_unchanged = 0, rename_cycles = 0, rename_conflicts = 0;
+            bool rename_deleting = false;
+            for (const RenamePreview& preview : rename_previews) {
+                rename_items += preview.Plan.items.size();
+                rename_unchanged += preview.Plan.unchanged;
+                rename_cycles += preview.Plan.cycles;
+                rename_conflicts += preview.Plan.conflicts;
+                rename_deleting |= preview.Session->Scanner.IsDeleting();
+            }
+            const std::string& template_error = rename_previews.empty() ? std::string() : rename_previews[0].Plan.template_error;
+            if (!template_error.empty()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", template_error.c_str());
+            } else {
+                ImGui::Text("%zu to rename, %zu unchanged, %zu swapped", rename_items - rename_conflicts, rename_unchanged, rename_cycles);
+                if (rename_conflicts > 0) {
+                    ImGui::SameLine();
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "- %zu conflicts (shown below)", rename_conflicts);
+                }
+            }
+
+            ImGuiTableFlags preview_flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+            if (ImGui::BeginTable("RenamePreview", 3, preview_flags, ImVec2(760, 300))) {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn("Current Name");
+                ImGui::TableSetupColumn("New Name");
+                ImGui::TableSetupColumn("Problem");
+                ImGui::TableHeadersRow();
+
+                ImGuiListClipper clipper;
+                clipper.Begin((int)rename_preview_rows.size());
+                while (clipper.Step()) {
+                    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                        const RenamePreview& preview = rename_previews[rename_preview_rows[row].first];
+                        const RenamePlan::Item& item = preview.Plan.items[rename_preview_rows[row].second];
+                        const EntryStore& files = preview.Session->Scanner.GetFiles();
+                        if (item.entry >= files.Size()) continue;
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        std::string_view name = files.GetName(item.entry);
+                        ImGui::TextUnformatted(name.data(), name.data() + name.size());
+                        if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", files.GetPath(item.entry).c_str());
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(item.new_name.c_str());
+                        ImGui::TableNextColumn();
+                        if (!item.error.empty()) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", item.error.c_str());
+                    }
+                }
+                ImGui::EndTable();
+            }
+
+            ImGui::BeginDisabled(!template_error.empty() || rename_conflicts > 0 || rename_items == 0 || rename_deleting);
             if (ImGui::Button("Execute Rename", ImVec2(120, 0))) {
-                int renamed = scanner.ExecuteRename(rename_suffix_buffer);
-                if (renamed > 0) my_log.AddLog("Renamed %d files.\n", renamed);
+                RenameResult total;
+                for (const RenamePreview& preview : rename_previews) {
+                    if (preview.Plan.items.empty()) continue;
+                    RenameResult result = preview.Session->Scanner.ExecuteRename(preview.Options);
+                    for (const std::string& error : result.errors) my_log.AddLog("[Error] Rename failed: %s\n", error.c_str());
+                    total.renamed += result.renamed;
+                    total.failed += result.failed;
+                    preview.Session->LastSelectedRow = -1;
+                }
+                if (total.renamed + total.failed > 0) my_log.AddLog("Renamed %zu files (%zu failed).\n", total.renamed, total.failed);
                 else my_log.AddLog("Rename failed.\n");
-                
+
                 ImGui::CloseCurrentPopup();
                 show_rename_popup = false;
-                last_selected_index = -1;
+                rename_previews.clear();
+                rename_preview_rows.clear();
             }
+            ImGui::EndDisabled();
             ImGui::SameLine();
             if (ImGui::Button("Cancel", ImVec2(120, 0))) { 
                 ImGui::CloseCurrentPopup(); 
@@ -464,12 +1338,51 @@ int main(int, char**)
             ImGui::EndPopup();
         }
 
+        // Content Search Modal
+        if (ImGui::BeginPopupModal("Search Contents", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+            ImGui::Text("Search the contents of the %zu visible entries.", scanner.GetVisibleRows().size());
+            bool submit = ImGui::InputText("Text", content_text_buffer, IM_ARRAYSIZE(content_text_buffer), ImGuiInputTextFlags_EnterReturnsTrue);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Files containing this string, e.g. a host name. Each file is read up to its first match.");
+            submit |= ImGui::InputText("Regex", content_regex_buffer, IM_ARRAYSIZE(content_regex_buffer), ImGuiInputTextFlags_EnterReturnsTrue);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Optional, matched line by line. Together with a text only the lines containing\n"
+                                  "the text are tried, which is much faster than the regex alone.");
+            ImGui::Checkbox("Ignore Case##contents", &content_ignore_case);
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120);
+            ImGui::InputInt("Max file size (MB)", &content_max_mb);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Larger files are skipped, and so are binaries (a NUL byte in the first 8 KB).");
+            if (!content_search_error.empty()) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", content_search_error.c_str());
+
+            if (ImGui::Button("Search", ImVec2(120, 0)) || submit) {
+                ContentQuery query;
+                query.text = content_text_buffer;
+                query.regex = content_regex_buffer;
+                query.case_sensitive = !content_ignore_case;
+                query.max_file_bytes = (uint64_t)(std::max)(content_max_mb, 1) << 20;
+                size_t visible = scanner.GetVisibleRows().size();
+                if (scanner.StartContentSearch(query, content_search_error)) {
+                    my_log.AddLog("Searching the contents of %zu visible entries...\n", visible);
+                    last_selected_row = -1;
+                    ImGui::CloseCurrentPopup();
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel", ImVec2(120, 0))) ImGui::CloseCurrentPopup();
+            ImGui::EndPopup();
+        }
+
+        ImGui::PopID();
         ImGui::Dummy(ImVec2(0, 5));
 
         // --- 5. Log Panel ---
         ImGui::Dummy(ImVec2(0, 5));
         ImGui::Separator();
         ImGui::Text("Log Output:");
+        ImGui::SameLine();
+        ImGui::Checkbox("Performance", &show_perf_panel);
         
         // Use remaining space for log
         ImGui::BeginChild("LogPanel", ImVec2(0, 0), true);
@@ -478,13 +1391,19 @@ int main(int, char**)
 
         ImGui::End();
 
-        ImGui::Render();
-        int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
-        glViewport(0, 0, display_w, display_h);
-        glClearColor(0.12f, 0.12f, 0.12f, 1.00f); // Match window bg
-        glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (show_perf_panel) perf_panel.Draw(&show_perf_panel, my_log);
+
+        {
+            PROFILE_SCOPE("GUI::Render");
+            ImGui::Render();
+            int display_w, display_h;
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+            glViewport(0, 0, display_w, display_h);
+            glClearColor(0.12f, 0.12f, 0.12f, 1.00f); // Match window bg
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        Profiler::RecordFrame(frame_begin, Profiler::Now());
 
         glfwSwapBuffers(window);
     }
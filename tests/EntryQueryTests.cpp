@@ -0,0 +1,36 @@
+#include "Test.h"
+#include "EntryQuery.h"
+
+namespace {
+
+// Names among `names` (files under the root, entry i = names[i]) that `query` matches
+std::vector<std::string> Matching(const std::vector<std::string>& names, const std::string& query, bool case_sensitive = true) {
+    test::StoreBuilder builder;
+    for (const std::string& name : names) builder.AddFile(0, name);
+    EntryStore store = builder.Build();
+    EntryQuery parsed;
+    std::string error;
+    std::vector<std::string> out;
+    if (!parsed.Parse(query, case_sensitive, error)) return {"error: " + error};
+    for (uint32_t i = 0; i < store.Size(); i++) {
+        if (parsed.Matches(store, i)) out.emplace_back(store.GetName(i));
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(ExtensionMatchesTheLastSuffix) {
+    std::vector<std::string> names = {"a.jpg", "b.PNG", "c.txt", "jpg", ".jpg", "d.jpg.txt"};
+    CHECK_EQ(Matching(names, "ext:jpg,png"), (std::vector<std::string>{"a.jpg"}));
+    CHECK_EQ(Matching(names, "ext:.jpg,png", false), (std::vector<std::string>{"a.jpg", "b.PNG"}));
+}
+
+// Used to compare only the text after the last dot, so a dotted extension matched nothing
+TEST(ExtensionMatchesDottedSuffixes) {
+    std::vector<std::string> names = {"a.tar.gz", "b.gz", "tar.gz", ".tar.gz", "c.TAR.GZ", "dtar.gz"};
+    CHECK_EQ(Matching(names, "ext:tar.gz"), (std::vector<std::string>{"a.tar.gz"}));
+    CHECK_EQ(Matching(names, "ext:tar.gz", false), (std::vector<std::string>{"a.tar.gz", "c.TAR.GZ"}));
+    CHECK_EQ(Matching(names, "ext:gz"), (std::vector<std::string>{"a.tar.gz", "b.gz", "tar.gz", ".tar.gz", "dtar.gz"}));
+    CHECK_EQ(Matching(names, "!ext:tar.gz"), (std::vector<std::string>{"b.gz", "tar.gz", ".tar.gz", "c.TAR.GZ", "dtar.gz"}));
+}
@@ -0,0 +1,73 @@
+#include "Test.h"
+#include <filesystem>
+
+namespace {
+
+std::string Join(const std::string& a, const std::string& b) {
+    return a + (char)std::filesystem::path::preferred_separator + b;
+}
+
+} // namespace
+
+TEST(GetPathJoinsTheParentChain) {
+    test::StoreBuilder builder("/data");
+    uint32_t a = builder.AddDir(0, "a");
+    uint32_t b = builder.AddDir(a, "b");
+    builder.AddFile(b, "file.txt");
+    builder.AddFile(0, "top.txt");
+    EntryStore store = builder.Build();
+    CHECK_EQ(store.GetPath(0), Join("/data", "a"));
+    CHECK_EQ(store.GetPath(2), Join(Join(Join("/data", "a"), "b"), "file.txt"));
+    CHECK_EQ(store.GetPath(3), Join("/data", "top.txt"));
+}
+
+// Used to stop at 256 components and return the root joined to the lowest ones only
+TEST(GetPathWorksAtAnyDepth) {
+    test::StoreBuilder builder("/deep");
+    std::vector<std::string> expected; // per folder entry
+    std::string path = "/deep";
+    uint32_t dir = 0;
+    for (int depth = 0; depth < 1000; depth++) {
+        std::string name = "d" + std::to_string(depth);
+        dir = builder.AddDir(dir, name);
+        path = Join(path, name);
+        expected.push_back(path);
+    }
+    builder.AddFile(dir, "leaf");
+    EntryStore store = builder.Build();
+    // Both sides of the stack buffer's size, and the bottom
+    for (uint32_t i : {62u, 63u, 64u, 65u, 255u, 256u, 999u}) CHECK_EQ(store.GetPath(i), expected[i]);
+    CHECK_EQ(store.GetPath(store.Size() - 1), Join(path, "leaf"));
+}
+
+TEST(CompactRemapsSurvivorsAndDropsContents) {
+    test::StoreBuilder builder("/r");
+    uint32_t keep = builder.AddDir(0, "keep");   // entry 0
+    uint32_t gone = builder.AddDir(0, "gone");   // entry 1
+    builder.AddFile(keep, "k1", 10);             // entry 2
+    builder.AddFile(gone, "g1", 20);             // entry 3, inside the removed folder
+    uint32_t sub = builder.AddDir(gone, "sub");  // entry 4, likewise
+    builder.AddFile(sub, "g2", 30);              // entry 5, two levels down
+    builder.AddFile(keep, "k2", 40);             // entry 6
+    builder.AddFile(0, "top", 50);               // entry 7, removed itself
+    EntryStore store = builder.Build();
+    store.SetSelected(6, true);
+
+    std::vector<bool> removed(store.Size(), false);
+    removed[1] = true;
+    removed[7] = true;
+    std::vector<uint32_t> remap;
+    store.Compact(removed, &remap);
+
+    CHECK_EQ(store.Size(), 3u);
+    CHECK_EQ(remap.size(), (size_t)8);
+    CHECK_EQ(remap[0], 0u);
+    CHECK_EQ(remap[2], 1u);
+    CHECK_EQ(remap[6], 2u);
+    for (uint32_t old : {1u, 3u, 4u, 5u, 7u}) CHECK_EQ(remap[old], EntryStore::kNoEntry);
+    CHECK_EQ(store.GetPath(remap[6]), Join(Join("/r", "keep"), "k2"));
+    // Flags travel with their entries, and the totals lose what went away
+    CHECK(store.IsSelected(remap[6]));
+    CHECK_EQ(store.GetSelectedCount(), 1u);
+    CHECK_EQ(store.GetTotalSize(remap[0]), (uint64_t)50);
+}
@@ -0,0 +1,65 @@
+#include "Test.h"
+#include "LiteralScan.h"
+#include "NameIndex.h"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+std::string Lower(std::string text) {
+    for (char& c : text) c = (char)LiteralScan::FoldAscii((unsigned char)c);
+    return text;
+}
+
+} // namespace
+
+// The SSE2 filter against std::string::find, with needles of every length around the 16-byte
+// block and matches at every alignment, including the unfiltered tail
+TEST(FindLiteralAgreesWithFind) {
+    std::mt19937 random(1234);
+    const char alphabet[] = "abAB.\x80\xC3";
+    bool agree = true;
+    for (int round = 0; round < 3000 && agree; round++) {
+        std::string text(random() % 80, ' ');
+        for (char& c : text) c = alphabet[random() % (sizeof(alphabet) - 1)];
+        size_t k = 1 + random() % 20;
+        std::string needle(k, ' ');
+        if (k <= text.size() && random() % 2) {
+            needle = text.substr(random() % (text.size() - k + 1), k);
+        } else {
+            for (char& c : needle) c = alphabet[random() % (sizeof(alphabet) - 1)];
+        }
+
+        size_t expected = text.find(needle);
+        agree &= LiteralScan::FindLiteral(text.data(), text.size(), needle, true) == (expected == std::string::npos ? text.size() : expected);
+        std::string folded = Lower(needle);
+        expected = Lower(text).find(folded);
+        agree &= LiteralScan::FindLiteral(text.data(), text.size(), folded, false) == (expected == std::string::npos ? text.size() : expected);
+    }
+    CHECK(agree);
+}
+
+TEST(NameIndexFindsEveryContainingName) {
+    NamePool pool;
+    std::vector<std::string> names;
+    for (int i = 0; i < 5000; i++) {
+        std::string name = (i % 7 ? "file_" : "Report_") + std::to_string(i * 37) + (i % 3 ? ".txt" : ".LOG");
+        names.push_back(name);
+        pool.Intern(name);
+    }
+    NameIndex index;
+    index.Update(pool);
+    for (const char* pattern : {"report", "Report_1", "_", "log", ".LOG", "9", "xyz"}) {
+        for (bool case_sensitive : {true, false}) {
+            std::vector<uint32_t> offsets;
+            index.FindNames(pool, pattern, case_sensitive, offsets);
+            size_t expected = 0;
+            for (const std::string& name : names) {
+                expected += case_sensitive ? name.find(pattern) != std::string::npos
+                                           : Lower(name).find(Lower(pattern)) != std::string::npos;
+            }
+            CHECK_EQ(offsets.size(), expected);
+        }
+    }
+}
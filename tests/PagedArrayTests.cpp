@@ -0,0 +1,51 @@
+#include "Test.h"
+#include "EntrySorter.h"
+#include "PagedArray.h"
+
+namespace {
+
+// Sets a budget for one test and lifts it again
+struct ScopedBudget {
+    explicit ScopedBudget(size_t bytes) { PagedBuffer::SetBudget(bytes); }
+    ~ScopedBudget() { PagedBuffer::SetBudget(0); }
+};
+
+} // namespace
+
+TEST(PagedArrayKeepsItsContentsWhenSpilled) {
+    ScopedBudget budget(1);
+    PagedArray<uint32_t> values;
+    // Several chunks, so appends page out what they filled along the way
+    size_t count = 3 * PagedBuffer::kChunkBytes / sizeof(uint32_t) + 123;
+    for (size_t i = 0; i < count; i++) values.push_back((uint32_t)(i * 7));
+#if defined(__linux__)
+    CHECK(values.IsSpilled());
+    CHECK(PagedBuffer::GetSpilledBytes() >= count * sizeof(uint32_t));
+#endif
+    values.PageOut();
+    bool intact = values.size() == count;
+    for (size_t i = 0; i < count && intact; i++) intact = values[i] == (uint32_t)(i * 7);
+    CHECK(intact);
+
+    values.Free();
+    CHECK_EQ(PagedBuffer::GetSpilledBytes(), (size_t)0);
+}
+
+TEST(SortOrdersSpillPastTheBudget) {
+    test::StoreBuilder builder;
+    for (int i = 0; i < 1000; i++) builder.AddFile(0, "f" + std::to_string(999 - i), (uint64_t)i);
+    EntryStore store = builder.Build();
+
+    ScopedBudget budget(1);
+    EntrySorter sorter;
+    const PagedArray<uint32_t>& order = sorter.GetOrder(store, SortColumn::Name);
+#if defined(__linux__)
+    CHECK(order.IsSpilled());
+#endif
+    sorter.PageOut();
+    CHECK_EQ(order.size(), (size_t)1000);
+    // "f0", "f1", ... in natural order, which is scan order backwards
+    bool sorted = true;
+    for (uint32_t row = 0; row < order.size() && sorted; row++) sorted = order[row] == 999 - row;
+    CHECK(sorted);
+}
@@ -0,0 +1,214 @@
+#include "Test.h"
+#include "FileScanner.h"
+#include "RenamePlanner.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+RenameOptions Counter(const std::string& name_template, int64_t start, int64_t step = 1) {
+    RenameOptions options;
+    options.name_template = name_template;
+    options.counter_start = start;
+    options.counter_step = step;
+    return options;
+}
+
+uint32_t FindEntry(const EntryStore& files, const std::string& name) {
+    for (uint32_t i = 0; i < files.Size(); i++) {
+        if (files.GetName(i) == name) return i;
+    }
+    return EntryStore::kNoEntry;
+}
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+// f1 -> f2, f2 -> f3, f3 -> f4 only works from the free end
+TEST(PlanRunsChainsFromTheFreeEnd) {
+    test::StoreBuilder builder;
+    builder.AddFile(0, "f1");
+    builder.AddFile(0, "f2");
+    builder.AddFile(0, "f3");
+    EntryStore store = builder.Build();
+    RenamePlan plan = RenamePlanner::Plan(store, {0, 1, 2}, Counter("f{n}", 2));
+    CHECK(plan.CanExecute());
+    CHECK_EQ(plan.cycles, (size_t)0);
+    CHECK_EQ(plan.steps.size(), (size_t)3);
+    CHECK_EQ(plan.tasks.size(), (size_t)1);
+    if (plan.steps.size() != 3) return;
+    CHECK_EQ(plan.items[plan.steps[0].item].new_name, std::string("f4"));
+    CHECK_EQ(plan.items[plan.steps[1].item].new_name, std::string("f3"));
+    CHECK_EQ(plan.items[plan.steps[2].item].new_name, std::string("f2"));
+    for (const RenamePlan::Step& step : plan.steps) CHECK(!step.from_temp && !step.to_temp);
+    // One sequence: a failure anywhere skips the rest
+    CHECK(!plan.steps[0].sequence_end && !plan.steps[1].sequence_end && plan.steps[2].sequence_end);
+}
+
+// x1 <-> x2 goes through a temporary name
+TEST(PlanParksOneMemberOfACycle) {
+    test::StoreBuilder builder;
+    builder.AddFile(0, "x1");
+    builder.AddFile(0, "x2");
+    EntryStore store = builder.Build();
+    RenamePlan plan = RenamePlanner::Plan(store, {0, 1}, Counter("x{n}", 2, -1));
+    CHECK(plan.CanExecute());
+    CHECK_EQ(plan.cycles, (size_t)1);
+    CHECK_EQ(plan.steps.size(), (size_t)3);
+    if (plan.steps.size() != 3) return;
+    const RenamePlan::Step& park = plan.steps[0];
+    const RenamePlan::Step& unpark = plan.steps[2];
+    CHECK(park.to_temp && !park.from_temp);
+    CHECK(!plan.steps[1].from_temp && !plan.steps[1].to_temp && plan.steps[1].item != park.item);
+    CHECK(unpark.from_temp && !unpark.to_temp && unpark.item == park.item);
+    CHECK(unpark.sequence_end);
+}
+
+TEST(PlanReportsConflictsAndWhatTheyBlock) {
+    test::StoreBuilder builder;
+    builder.AddFile(0, "1");
+    builder.AddFile(0, "2");
+    builder.AddFile(0, "3");
+    builder.AddFile(0, "a");
+    builder.AddFile(0, "b");
+    EntryStore store = builder.Build();
+
+    // "2" -> "3" is taken by an entry that stays, so "1" -> "2" can't go either
+    RenamePlan plan = RenamePlanner::Plan(store, {0, 1}, Counter("{n}", 2));
+    CHECK(!plan.CanExecute());
+    CHECK_EQ(plan.conflicts, (size_t)2);
+    if (plan.items.size() != 2) return;
+    CHECK_EQ(plan.items[1].error, std::string("'3' already exists"));
+    CHECK_EQ(plan.items[0].error, std::string("'2' is kept by a conflicting rename"));
+
+    // Two entries landing on one name
+    plan = RenamePlanner::Plan(store, {3, 4}, Counter("same", 1));
+    CHECK_EQ(plan.conflicts, (size_t)2);
+    CHECK(plan.steps.empty());
+
+    // Names that don't change aren't items at all
+    plan = RenamePlanner::Plan(store, {3}, Counter("{full}", 1));
+    CHECK_EQ(plan.unchanged, (size_t)1);
+    CHECK(plan.items.empty());
+}
+
+// Non-matching entries used to use up counter values: img_02, img_04, img_05
+TEST(PlanNumbersOnlyMatchingEntries) {
+    test::StoreBuilder builder;
+    for (const char* name : {"a1", "b1", "a2", "b2", "a3"}) builder.AddFile(0, name);
+    EntryStore store = builder.Build();
+    RenameOptions options = Counter("img_{n:2}", 1);
+    options.match = "^a";
+    RenamePlan plan = RenamePlanner::Plan(store, {0, 1, 2, 3, 4}, options);
+    CHECK(plan.CanExecute());
+    CHECK_EQ(plan.unchanged, (size_t)2);
+    CHECK_EQ(plan.matched, (size_t)3);
+    CHECK_EQ(plan.items.size(), (size_t)3);
+    if (plan.items.size() != 3) return;
+    CHECK_EQ(plan.items[0].entry, 0u);
+    CHECK_EQ(plan.items[0].new_name, std::string("img_01"));
+    CHECK_EQ(plan.items[1].entry, 2u);
+    CHECK_EQ(plan.items[1].new_name, std::string("img_02"));
+    CHECK_EQ(plan.items[2].entry, 4u);
+    CHECK_EQ(plan.items[2].new_name, std::string("img_03"));
+
+    // Captures still come through after the counting pass
+    options.name_template = "{n}_{1}";
+    options.match = "^a(\\d)";
+    options.counter_start = 10;
+    options.counter_step = 5;
+    plan = RenamePlanner::Plan(store, {1, 4, 3, 0}, options);
+    CHECK_EQ(plan.items.size(), (size_t)2);
+    if (plan.items.size() != 2) return;
+    CHECK_EQ(plan.items[0].new_name, std::string("10_3"));
+    CHECK_EQ(plan.items[1].new_name, std::string("15_1"));
+}
+
+// Large batches expand on several threads; the numbering mustn't depend on the split
+TEST(PlanNumbersMatchesAcrossThreads) {
+    test::StoreBuilder builder;
+    std::vector<uint32_t> entries;
+    for (uint32_t i = 0; i < 20000; i++) {
+        builder.AddFile(0, (i % 3 ? "keep" : "take") + std::to_string(i));
+        entries.push_back(i);
+    }
+    EntryStore store = builder.Build();
+    RenameOptions options = Counter("n{n}", 0);
+    options.match = "^take";
+    RenamePlan plan = RenamePlanner::Plan(store, entries, options);
+    CHECK_EQ(plan.matched, (size_t)6667);
+    CHECK_EQ(plan.items.size(), (size_t)6667);
+    bool numbered = true;
+    for (size_t k = 0; k < plan.items.size() && numbered; k++) {
+        numbered = plan.items[k].entry == k * 3 && plan.items[k].new_name == "n" + std::to_string(k);
+    }
+    CHECK(numbered);
+}
+
+TEST(PlanRenamesContentsBeforeTheirFolder) {
+    test::StoreBuilder builder;
+    uint32_t dir = builder.AddDir(0, "d"); // entry 0
+    builder.AddFile(dir, "inner");         // entry 1
+    EntryStore store = builder.Build();
+    RenamePlan plan = RenamePlanner::Plan(store, {0, 1}, Counter("{name}_x", 1));
+    CHECK(plan.CanExecute());
+    CHECK_EQ(plan.level_begin.size(), (size_t)2);
+    CHECK_EQ(plan.tasks.size(), (size_t)2);
+    if (plan.tasks.size() != 2) return;
+    CHECK_EQ(plan.tasks[0].dir, dir);
+    CHECK_EQ(plan.tasks[1].dir, EntryStore::kRootDir);
+}
+
+TEST(ExecuteSwapsAndShiftsNamesOnDisk) {
+    test::TempDir dir("rename_execute");
+    dir.WriteFile("x1", "one");
+    dir.WriteFile("x2", "two");
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(false);
+    scanner.SetWatchEnabled(false);
+    scanner.ScanDirectory(dir.Path());
+    const EntryStore& files = scanner.GetFiles();
+    RenamePlan plan = RenamePlanner::Plan(files, {FindEntry(files, "x1"), FindEntry(files, "x2")}, Counter("x{n}", 2, -1));
+    RenameResult result = scanner.ExecuteRename(plan);
+    CHECK_EQ(result.renamed, (size_t)2);
+    CHECK_EQ(result.failed, (size_t)0);
+    CHECK_EQ(ReadFile(dir.Path("x1")), std::string("two"));
+    CHECK_EQ(ReadFile(dir.Path("x2")), std::string("one"));
+    CHECK(files.GetName(FindEntry(files, "x1")) == "x1");
+}
+
+// Renaming a watched folder used to drop its watch for good
+TEST(RenamedFolderIsStillWatched) {
+    test::TempDir dir("rename_watch");
+    dir.MakeDir("sub/deeper");
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(false);
+    scanner.ScanDirectory(dir.Path(), true);
+    scanner.SetWatchEnabled(true);
+    const EntryStore& files = scanner.GetFiles();
+    // Let the watcher thread register the tree
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    RenameOptions options;
+    options.name_template = "moved";
+    RenameResult result = scanner.ExecuteRename(RenamePlanner::Plan(files, {FindEntry(files, "sub")}, options));
+    CHECK_EQ(result.renamed, (size_t)1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // Polling, where inotify isn't available, takes a few seconds to notice
+    dir.WriteFile("moved/new.txt", "x");
+    dir.WriteFile("moved/deeper/newer.txt", "x");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+    while (std::chrono::steady_clock::now() < deadline &&
+           (FindEntry(files, "new.txt") == EntryStore::kNoEntry || FindEntry(files, "newer.txt") == EntryStore::kNoEntry)) {
+        scanner.PollWatchEvents();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    CHECK(FindEntry(files, "new.txt") != EntryStore::kNoEntry);
+    CHECK(FindEntry(files, "newer.txt") != EntryStore::kNoEntry);
+}
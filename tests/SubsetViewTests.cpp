@@ -0,0 +1,120 @@
+#include "Test.h"
+#include "FileScanner.h"
+
+namespace {
+
+uint32_t FindEntry(const EntryStore& files, const std::string& name) {
+    for (uint32_t i = 0; i < files.Size(); i++) {
+        if (files.GetName(i) == name) return i;
+    }
+    return EntryStore::kNoEntry;
+}
+
+// Two copies of one file plus files that have no duplicate
+void ScanWithDuplicates(const test::TempDir& dir, FileScanner& scanner) {
+    dir.WriteFile("a1.txt", "same contents");
+    dir.WriteFile("a2.txt", "same contents");
+    dir.WriteFile("ab.log", "something else");
+    dir.WriteFile("c.txt", "and another thing");
+    scanner.SetSnapshotsEnabled(false);
+    scanner.SetWatchEnabled(false);
+    scanner.ScanDirectory(dir.Path());
+}
+
+} // namespace
+
+TEST(DuplicateViewSelectAllStaysInTheGroups) {
+    test::TempDir dir("dupes_select");
+    FileScanner scanner;
+    ScanWithDuplicates(dir, scanner);
+    const EntryStore& files = scanner.GetFiles();
+    uint32_t c = FindEntry(files, "c.txt");
+    scanner.GetFilesModifiable().SetSelected(c, true);
+
+    scanner.ExecuteFindDuplicates();
+    CHECK(scanner.IsShowingDuplicates());
+    // Entering the view drops a selection that would be hidden by it
+    CHECK_EQ(files.GetSelectedCount(), 0u);
+
+    scanner.SelectAll();
+    CHECK_EQ(files.GetSelectedCount(), 2u);
+    CHECK(files.IsSelected(FindEntry(files, "a1.txt")));
+    CHECK(files.IsSelected(FindEntry(files, "a2.txt")));
+    CHECK(!files.IsSelected(c));
+
+    // Leaving it does the same
+    scanner.ShowAllEntries();
+    CHECK_EQ(files.GetSelectedCount(), 0u);
+}
+
+TEST(DuplicateViewDeleteSkipsEntriesOutsideIt) {
+    test::TempDir dir("dupes_delete");
+    FileScanner scanner;
+    ScanWithDuplicates(dir, scanner);
+    scanner.ExecuteFindDuplicates();
+    CHECK(scanner.IsShowingDuplicates());
+
+    // A selection outside the groups, however it got there, isn't deleted from this view
+    EntryStore& files = scanner.GetFilesModifiable();
+    files.SetSelected(FindEntry(files, "c.txt"), true);
+    files.SetSelected(FindEntry(files, "a2.txt"), true);
+    FileScanner::DeleteStatus status = scanner.ExecuteDelete();
+    CHECK_EQ(status.total, (size_t)1);
+    CHECK_EQ(status.failed, (size_t)0);
+    CHECK(dir.Exists("a1.txt"));
+    CHECK(!dir.Exists("a2.txt"));
+    CHECK(dir.Exists("c.txt"));
+    CHECK(dir.Exists("ab.log"));
+}
+
+TEST(DuplicateViewFilterRedoesHiddenEntries) {
+    test::TempDir dir("dupes_filter");
+    FileScanner scanner;
+    ScanWithDuplicates(dir, scanner);
+    scanner.ExecuteFindDuplicates();
+    scanner.ApplyFilter("a", true);
+    // Narrowing "a" to "a1" has to filter out ab.log as well, though the view doesn't show it
+    scanner.ApplyFilter("a1", true);
+    const EntryStore& files = scanner.GetFiles();
+    CHECK(files.IsFiltered(FindEntry(files, "ab.log")));
+    CHECK_EQ(scanner.GetVisibleRows().size(), (size_t)1);
+
+    scanner.ShowAllEntries();
+    CHECK_EQ(scanner.GetVisibleRows().size(), (size_t)1);
+    CHECK_EQ(scanner.GetVisibleRows()[0], FindEntry(files, "a1.txt"));
+}
+
+TEST(ContentHitViewSelectAllAndDeleteStayInTheHits) {
+    test::TempDir dir("hits");
+    dir.WriteFile("match1.txt", "a needle here");
+    dir.WriteFile("match2.txt", "another needle");
+    dir.WriteFile("other.txt", "nothing to see");
+    FileScanner scanner;
+    scanner.SetSnapshotsEnabled(false);
+    scanner.SetWatchEnabled(false);
+    scanner.ScanDirectory(dir.Path());
+    EntryStore& files = scanner.GetFilesModifiable();
+    uint32_t other = FindEntry(files, "other.txt");
+    files.SetSelected(other, true);
+
+    ContentQuery query;
+    query.text = "needle";
+    std::string error;
+    scanner.ExecuteContentSearch(query, error);
+    CHECK(error.empty());
+    CHECK(scanner.IsShowingContentHits());
+    CHECK_EQ(files.GetSelectedCount(), 0u);
+
+    scanner.SelectAll();
+    CHECK_EQ(files.GetSelectedCount(), 2u);
+    CHECK(!files.IsSelected(other));
+
+    // Select all used to pick up the non-matching file too, and delete removed it
+    files.SetSelected(other, true);
+    files.SetSelected(FindEntry(files, "match1.txt"), false);
+    FileScanner::DeleteStatus status = scanner.ExecuteDelete();
+    CHECK_EQ(status.total, (size_t)1);
+    CHECK(dir.Exists("match1.txt"));
+    CHECK(!dir.Exists("match2.txt"));
+    CHECK(dir.Exists("other.txt"));
+}
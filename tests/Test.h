@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "EntryStore.h"
+
+// A minimal test registry. TEST(Name) { CHECK(...); } registers a test; fnm_tests runs every
+// one (or those whose name contains its argument) and exits non-zero if a check failed.
+// Kept dependency-free like the rest of the core.
+namespace test {
+
+struct Case {
+    const char* name;
+    void (*fn)();
+};
+
+inline std::vector<Case>& Registry() {
+    static std::vector<Case> cases;
+    return cases;
+}
+
+inline int& Failures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct Registrar {
+    Registrar(const char* name, void (*fn)()) { Registry().push_back({name, fn}); }
+};
+
+inline void Fail(const char* file, int line, const std::string& what) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what.c_str());
+    Failures()++;
+}
+
+// Builds a store the way the walker would fill it: folders before their contents, ids handed
+// out in creation order, root = directory 0
+class StoreBuilder {
+public:
+    explicit StoreBuilder(std::string root = "/root") : m_root(std::move(root)) {}
+
+    uint32_t AddDir(uint32_t parent, const std::string& name) {
+        uint32_t id = m_next_dir++;
+        Add(parent, id, name, 0, true);
+        return id;
+    }
+    void AddFile(uint32_t parent, const std::string& name, uint64_t size = 1) { Add(parent, EntryStore::kNoDir, name, size, false); }
+
+    EntryStore Build() const {
+        EntryStore store;
+        store.Clear(m_root);
+        store.AppendBatch(m_batch);
+        store.RollUpDirTotals();
+        return store;
+    }
+
+private:
+    void Add(uint32_t parent, uint32_t dir_id, const std::string& name, uint64_t size, bool is_directory) {
+        ScanRecord record{parent, dir_id, (uint32_t)m_batch.names.size(), (uint16_t)name.size(), size, is_directory, EntryStore::kNoEntry};
+        m_batch.names += name;
+        m_batch.names += '\0';
+        m_batch.records.push_back(record);
+    }
+
+    std::string m_root;
+    ScanBatch m_batch;
+    uint32_t m_next_dir = 1;
+};
+
+// A scratch folder under the system temp directory, removed with everything in it
+class TempDir {
+public:
+    explicit TempDir(const std::string& name) {
+        m_path = std::filesystem::temp_directory_path() / ("fnm_tests_" + name);
+        std::filesystem::remove_all(m_path);
+        std::filesystem::create_directories(m_path);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(m_path, ec);
+    }
+
+    std::string Path() const { return m_path.string(); }
+    std::string Path(const std::string& relative) const { return (m_path / relative).string(); }
+    bool Exists(const std::string& relative) const { return std::filesystem::exists(m_path / relative); }
+
+    void MakeDir(const std::string& relative) const { std::filesystem::create_directories(m_path / relative); }
+    void WriteFile(const std::string& relative, const std::string& contents) const {
+        std::ofstream(m_path / relative, std::ios::binary) << contents;
+    }
+
+private:
+    std::filesystem::path m_path;
+};
+
+} // namespace test
+
+#define FNM_TEST_CONCAT2(a, b) a##b
+#define FNM_TEST_CONCAT(a, b) FNM_TEST_CONCAT2(a, b)
+#define TEST(name)                                                                  \
+    static void name();                                                             \
+    static test::Registrar FNM_TEST_CONCAT(name, _registrar)(#name, &name);         \
+    static void name()
+
+#define CHECK(condition)                                                            \
+    do {                                                                            \
+        if (!(condition)) test::Fail(__FILE__, __LINE__, #condition);               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                              \
+    do {                                                                            \
+        auto&& check_a = (a);                                                       \
+        auto&& check_b = (b);                                                       \
+        if (!(check_a == check_b)) test::Fail(__FILE__, __LINE__, #a " == " #b);    \
+    } while (0)
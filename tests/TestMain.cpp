@@ -0,0 +1,16 @@
+#include "Test.h"
+#include <cstring>
+
+int main(int argc, char** argv) {
+    const char* only = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    for (const test::Case& c : test::Registry()) {
+        if (only && !std::strstr(c.name, only)) continue;
+        int before = test::Failures();
+        c.fn();
+        run++;
+        std::printf("%s %s\n", test::Failures() == before ? "ok  " : "FAIL", c.name);
+    }
+    std::printf("%d tests, %d failed checks\n", run, test::Failures());
+    return test::Failures() == 0 ? 0 : 1;
+}